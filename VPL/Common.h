@@ -0,0 +1,3022 @@
+﻿#pragma once
+
+// ----------------------------------------------------------------------------
+// Includes
+// ----------------------------------------------------------------------------
+
+// Windows (the D3D11 entry point, the GPU copy of the meshes and the memory mapped VPL bake)
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#include <Windowsx.h>
+#include <wrl/client.h> // for ComPtr
+namespace wrl = Microsoft::WRL;
+
+// D3D11
+#include <d3d11.h>
+#include <d3dcompiler.h>
+#include <dxgi1_3.h>
+#if defined(_DEBUG)
+#include <dxgidebug.h>
+#endif
+#else
+// POSIX (the memory mapped VPL bake)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Math Library
+#include "SimpleMath.h"
+using Matrix = DirectX::SimpleMath::Matrix;
+using Vector2 = DirectX::SimpleMath::Vector2;
+using Vector3 = DirectX::SimpleMath::Vector3;
+using Vector4 = DirectX::SimpleMath::Vector4;
+using Quaternion = DirectX::SimpleMath::Quaternion;
+
+// Constant buffers
+#define float2 Vector2
+#define float3 Vector3
+#define float4 Vector4
+#define matrix Matrix
+#define int int32_t
+#include "ConstantBuffers.hlsli"
+#undef float2
+#undef float3
+#undef float4
+#undef matrix
+#undef int
+
+// ----------------------------------------------------------------------------
+// Program constants
+// ----------------------------------------------------------------------------
+
+constexpr int WINDOW_START_W{ 1280 };
+constexpr int WINDOW_START_H{ 720 };
+constexpr int WINDOW_MIN_W{ 8 };
+constexpr int WINDOW_MIN_H{ 8 };
+constexpr float CAMERA_START_YAW_DEG{ -90.0f };
+constexpr float CAMERA_START_PITCH_DEG{ 0.0f };
+constexpr float CAMERA_MIN_PITCH_DEG{ -89.0f };
+constexpr float CAMERA_MAX_PITCH_DEG{ +89.0f };
+constexpr float CAMERA_FOV_DEG{ 45.0f };
+constexpr float CAMERA_NEAR_PLANE{ 0.01f };
+constexpr float CAMERA_FAR_PLANE{ 100.0f };
+constexpr float CAMERA_MOVE_SPEED{ 10.0f };
+constexpr float CAMERA_MOVE_SPEED_MULTIPLIER{ 2.0f };
+constexpr float MOUSE_SENSITIVITY{ 5.0f };
+constexpr float POINT_LIGHT_RADIUS{ 0.25f };
+constexpr float POINT_LIGHT_MIN_INTENSITY{ 1.0f };
+constexpr float POINT_LIGHT_MAX_INTENSITY{ 100.0f };
+constexpr float POINT_LIGHT_START_INTENSITY{ 5.0f };
+constexpr int POINT_LIGHTS_MIN{ 1 };
+constexpr int POINT_LIGHTS_MAX{ 64 };
+constexpr float EMISSIVE_INTENSITY_MIN{ 0.0f };
+constexpr float EMISSIVE_INTENSITY_MAX{ 100.0f };
+constexpr float EMISSION_RAY_OFFSET{ 0.0001f }; // rays leaving an emissive quad start this far from its surface
+constexpr Vector3 LINE_OK_COLOR{ 0.0f, 1.0f, 0.0f };
+constexpr Vector3 LINE_ERROR_COLOR{ 1.0f, 0.0f, 0.0f };
+constexpr Vector3 LINE_NORMAL_COLOR{ 1.0f, 0.0f, 1.0f };
+constexpr float LINE_NORMAL_T{ 0.5f };
+constexpr float LINE_ERROR_T{ 10.0f };
+constexpr int PARTICLES_COUNT_START{ 10 };
+constexpr int PARTICLES_COUNT_MIN{ 1 };
+constexpr int PARTICLES_COUNT_MAX{ 1000 };
+constexpr float MEAN_REFLECTIVITY_START{ 0.5f };
+constexpr float MEAN_REFLECTIVITY_MIN{ 0.1f };
+constexpr float MEAN_REFLECTIVITY_MAX{ 0.9f };
+constexpr int MIN_SELECTED_LIGHT_PATH_INDEX{ -1 };
+constexpr int MIN_SELECTED_LIGHT_INDEX{ -1 };
+constexpr int PRIMARY_LIGHT_BOUNCE{ -1 }; // bounce of the virtual lights standing for the point lights
+constexpr int CUBE_MAP_FACES{ 6 };
+constexpr Vector3 CUBE_MAP_FACE_DIRECTIONS[CUBE_MAP_FACES]{ { +1.0f, +0.0f, +0.0f }, { -1.0f, +0.0f, +0.0f }, { +0.0f, +1.0f, +0.0f }, { +0.0f, -1.0f, +0.0f }, { +0.0f, +0.0f, +1.0f }, { +0.0f, +0.0f, -1.0f } }; // +X, -X, +Y, -Y, +Z, -Z
+constexpr Vector3 CUBE_MAP_FACE_UPS[CUBE_MAP_FACES]{ { +0.0f, +1.0f, +0.0f }, { +0.0f, +1.0f, +0.0f }, { +0.0f, +0.0f, -1.0f }, { +0.0f, +0.0f, +1.0f }, { +0.0f, +1.0f, +0.0f }, { +0.0f, +1.0f, +0.0f } };
+constexpr int CUBE_SHADOW_MAP_SIZE{ 1024 };
+constexpr int CUBE_SHADOW_MAP_MIN_SIZE{ 128 };
+constexpr float CUBE_SHADOW_MAP_NEAR{ 0.1f };
+constexpr float CUBE_SHADOW_MAP_FAR{ 10.0f };
+constexpr float CUBE_SHADOW_MAP_STATIC_BIAS_START{ 0.01f };
+constexpr float CUBE_SHADOW_MAP_MAX_DYNAMIC_BIAS_START{ 0.1f };
+constexpr float CUBE_SHADOW_MAP_BIAS_MIN{ 0.0f };
+constexpr float CUBE_SHADOW_MAP_BIAS_MAX{ 1.0f };
+constexpr int CUBE_SHADOW_MAP_PCF_SAMPLES_START{ 4 };
+constexpr int CUBE_SHADOW_MAP_PCF_SAMPLES_MIN{ 1 };
+constexpr int CUBE_SHADOW_MAP_PCF_SAMPLES_MAX{ PCF_MAX_SAMPLES };
+constexpr float CUBE_SHADOW_MAP_PCF_OFFSET_SCALE_START{ 0.005f };
+constexpr float CUBE_SHADOW_MAP_PCF_OFFSET_SCALE_MIN{ 0.0f };
+constexpr float CUBE_SHADOW_MAP_PCF_OFFSET_SCALE_MAX{ 1.0f };
+constexpr Vector3 PCF_OFFSETS[PCF_MAX_SAMPLES] // same as PSShadowed.hlsl
+{
+    { +0.0f, +0.0f, +0.0f },
+    { +1.0f, +1.0f, +1.0f }, { +1.0f, -1.0f, +1.0f }, { -1.0f, -1.0f, +1.0f }, { -1.0f, +1.0f, +1.0f },
+    { +1.0f, +1.0f, -1.0f }, { +1.0f, -1.0f, -1.0f }, { -1.0f, -1.0f, -1.0f }, { -1.0f, +1.0f, -1.0f },
+    { +1.0f, +1.0f, +0.0f }, { +1.0f, -1.0f, +0.0f }, { -1.0f, -1.0f, +0.0f }, { -1.0f, +1.0f, +0.0f },
+    { +1.0f, +0.0f, +1.0f }, { -1.0f, +0.0f, +1.0f }, { +1.0f, +0.0f, -1.0f }, { -1.0f, +0.0f, -1.0f },
+    { +0.0f, +1.0f, +1.0f }, { +0.0f, -1.0f, +1.0f }, { +0.0f, -1.0f, -1.0f }, { +0.0f, +1.0f, -1.0f },
+};
+constexpr Vector3 FRAME_CLEAR_COLOR{ 0.2f, 0.3f, 0.3f };
+constexpr int VPL_BUDGET_MIN{ 1 };
+constexpr int VPL_BUDGET_MAX{ 1000000 };
+constexpr int VPL_BUDGET_START{ VPL_BUDGET_MAX };
+constexpr int VPL_BUDGET_SAMPLING_UNIFORM_STRIDE{ 0 };
+constexpr int VPL_BUDGET_SAMPLING_POWER{ 1 };
+constexpr float FRAME_BUDGET_TARGET_MSEC_START{ 1000.0f / 60.0f };
+constexpr float FRAME_BUDGET_TARGET_MSEC_MIN{ 1.0f };
+constexpr float FRAME_BUDGET_TARGET_MSEC_MAX{ 100.0f };
+constexpr float FRAME_BUDGET_HEADROOM{ 0.25f }; // fraction of the target frame time left to visualizations, ui and present
+constexpr float FRAME_BUDGET_HYSTERESIS{ 0.1f }; // width of the dead band (below the stage budget) in which the controller holds its output
+constexpr float FRAME_BUDGET_GAIN{ 0.25f }; // fraction of the gap between the current and the desired particles count closed each frame
+constexpr float FRAME_BUDGET_SMOOTHING{ 0.1f }; // weight of the newest measurement in the stage times moving averages
+constexpr float FRAME_BUDGET_MAX_GROWTH{ 1.1f }; // max per frame particles count growth factor
+constexpr float FRAME_BUDGET_MAX_SHRINK{ 0.5f }; // max per frame particles count shrink factor
+constexpr int FRAME_BUDGET_GPU_TIMER_FRAMES{ 3 }; // timestamp query sets in flight, read back 1-2 frames after the rendering they time
+constexpr int LIGHT_TREE_SAMPLES_START{ 8 };
+constexpr int LIGHT_TREE_SAMPLES_MIN{ 1 };
+constexpr int LIGHT_TREE_SAMPLES_MAX{ 64 };
+constexpr int LIGHT_TREE_PARTICLES_COUNT_MAX{ 500000 }; // sampling the light tree makes much larger particles counts affordable
+constexpr int LIGHT_TREE_BENCHMARK_VPL_COUNTS[]{ 1000, 4000, 16000, 64000, 256000, 1000000 };
+constexpr int LIGHT_TREE_BENCHMARK_REPETITIONS{ 5 };
+constexpr int VPL_ROTATION_SUBSETS_START{ 8 };
+constexpr int VPL_ROTATION_SUBSETS_MIN{ 1 };
+constexpr int VPL_ROTATION_SUBSETS_MAX{ 256 };
+constexpr float PROGRESSIVE_THRESHOLD_START{ 0.01f }; // relative RMS standard error of the average of the frames
+constexpr float PROGRESSIVE_THRESHOLD_MIN{ 0.0001f };
+constexpr float PROGRESSIVE_THRESHOLD_MAX{ 0.1f };
+constexpr int PROGRESSIVE_CHECK_FRAMES{ 16 }; // frames between convergence checks (each one reads both averages back), even
+constexpr int MORTON_CODE_BITS{ 30 };
+constexpr int MORTON_RADIX_BITS{ 8 }; // bits sorted by each radix sort pass
+constexpr int MORTON_RADIX_BUCKETS{ 1 << MORTON_RADIX_BITS };
+constexpr const char* VPL_BAKE_FILE_PATH{ "vpl_bake.bin" };
+constexpr std::uint32_t VPL_BAKE_MAGIC{ 0x424C5056 }; // "VPLB"
+constexpr std::uint32_t VPL_BAKE_VERSION{ 1 };
+constexpr int VPL_BAKE_LATTICE_SIZE_START{ 8 };
+constexpr int VPL_BAKE_LATTICE_SIZE_MIN{ 2 };
+constexpr int VPL_BAKE_LATTICE_SIZE_MAX{ 32 };
+constexpr int VPL_BAKE_LOOKUP_NEAREST{ 0 };
+constexpr int VPL_BAKE_LOOKUP_TRILINEAR{ 1 };
+constexpr int SCENE_CORNELL_BOX{ 0 };
+constexpr int SCENE_DOORWAY{ 1 };
+constexpr float SHADOW_RAY_OFFSET{ 0.001f };
+constexpr int MIR_EMISSION_DIMENSIONS{ 5 }; // emitter + up to 4 random numbers for the emitted ray
+constexpr int MIR_MAX_BOUNCES{ 64 };
+constexpr int MIR_PATH_DIMENSIONS{ MIR_EMISSION_DIMENSIONS + MIR_MAX_BOUNCES }; // + 1 russian roulette random number per bounce
+constexpr int MIR_BOOTSTRAP_PATHS{ 256 };
+constexpr int MIR_CHAINS_COUNT{ 16 };
+constexpr float MIR_LARGE_STEP_PROBABILITY{ 0.3f };
+constexpr float MIR_MUTATION_MIN_SIZE{ 1.0f / 1024.0f };
+constexpr float MIR_MUTATION_MAX_SIZE{ 1.0f / 64.0f };
+constexpr int MIR_CAMERA_SAMPLES_W{ 16 };
+constexpr int MIR_CAMERA_SAMPLES_H{ 16 };
+constexpr int MIR_BENCHMARK_CAMERA_SAMPLES_W{ 32 };
+constexpr int MIR_BENCHMARK_CAMERA_SAMPLES_H{ 18 };
+constexpr int MIR_BENCHMARK_REFERENCE_PARTICLES{ 16384 };
+constexpr int MIR_BENCHMARK_UNIFORM_PARTICLES_MIN{ 16 };
+constexpr int MIR_BENCHMARK_UNIFORM_PARTICLES_MAX{ 2048 };
+constexpr int MIR_BENCHMARK_PARTICLES[]{ 16, 64, 256 };
+constexpr int MIR_BENCHMARK_RUNS{ 4 };
+constexpr int RESTIR_CANDIDATES_START{ 32 };
+constexpr int RESTIR_CANDIDATES_MIN{ 1 };
+constexpr int RESTIR_CANDIDATES_MAX{ 256 };
+constexpr int RESTIR_SPATIAL_NEIGHBOURS_START{ 4 };
+constexpr int RESTIR_SPATIAL_NEIGHBOURS_MIN{ 0 };
+constexpr int RESTIR_SPATIAL_NEIGHBOURS_MAX{ 16 };
+constexpr float RESTIR_SPATIAL_RADIUS_START{ 16.0f }; // pixels
+constexpr float RESTIR_SPATIAL_RADIUS_MIN{ 1.0f };
+constexpr float RESTIR_SPATIAL_RADIUS_MAX{ 64.0f };
+constexpr float RESTIR_MAX_HISTORY{ 20.0f }; // max candidates carried over from the previous frame, relative to the candidates per pixel
+constexpr float RESTIR_NORMAL_THRESHOLD{ 0.9f }; // min cosine between the normals of pixels sharing reservoirs
+constexpr float RESTIR_DEPTH_THRESHOLD{ 0.1f }; // max distance between the surfaces of pixels sharing reservoirs, relative to the depth
+constexpr int RASTER_TILE_SIZE{ 64 }; // pixels, a multiple of RASTER_SIMD_WIDTH
+constexpr int RASTER_SIMD_WIDTH{ 4 }; // pixels whose edge functions are evaluated at once (SSE)
+constexpr const char* HEADLESS_FLAG{ "--headless" };
+constexpr const char* HEADLESS_OUTPUT_PATH_START{ "vpl.pfm" };
+constexpr int HEADLESS_MODE_FRAME{ 0 }; // VPL frame
+constexpr int HEADLESS_MODE_REFERENCE{ 1 }; // path traced reference
+constexpr int HEADLESS_MODE_EQUAL_TIME{ 2 }; // equal time RMSE of the VPL frame and the path tracer against a reference
+constexpr int HEADLESS_MODE_SHADING_CHECK{ 3 }; // VPL frame, compared with the one of the other shading path
+constexpr int HEADLESS_MODE_CULLING_BENCHMARK{ 4 }; // deferred VPL frame with and without light culling
+constexpr int HEADLESS_MODE_INTERLEAVE_BENCHMARK{ 5 }; // deferred VPL frame with and without interleaved sampling
+constexpr int HEADLESS_MODE_VISIBILITY_BENCHMARK{ 6 }; // deferred VPL frame without VPL visibility, with imperfect shadow maps and with rays
+constexpr int HEADLESS_MODE_IRRADIANCE_CACHE_BENCHMARK{ 7 }; // deferred VPL frame with and without the irradiance cache
+constexpr int HEADLESS_MODE_UPSAMPLE_BENCHMARK{ 8 }; // deferred VPL frame with the VPL light at full and reduced resolutions
+constexpr int HEADLESS_MODE_DENOISE_BENCHMARK{ 9 }; // deferred VPL frame with and without denoising, against one with more particles
+constexpr int HEADLESS_MODE_TEMPORAL_BENCHMARK{ 10 }; // deferred VPL frames of a moving camera with and without temporal reuse
+constexpr int HEADLESS_MODE_KERNEL_BENCHMARK{ 11 }; // generic and specialized shading kernels over the camera samples
+constexpr int HEADLESS_MODE_SIMD_CHECK{ 12 }; // multi-light kernels compared with the scalar reference
+constexpr int HEADLESS_MODE_RESAMPLE_CHECK{ 13 }; // VPL budget resampling of spawned VPLs followed by black ones
+constexpr int HEADLESS_MODE_PROGRESSIVE_CHECK{ 14 }; // standard error of averages of frames estimated from their halves, against a reference
+constexpr int HEADLESS_MODE_BAKE_CHECK{ 15 }; // memory mapped VPL bake round trip and blended lookups
+constexpr int PATH_TRACER_REFERENCE_SAMPLES_START{ 256 }; // samples per pixel of the references
+constexpr int PATH_TRACER_REFERENCE_SAMPLES_MIN{ 1 };
+constexpr int PATH_TRACER_REFERENCE_SAMPLES_MAX{ 1 << 20 };
+constexpr int PATH_TRACER_BENCHMARK_PARTICLES_MIN{ 4 };
+constexpr int PATH_TRACER_BENCHMARK_PARTICLES_MAX{ 1024 };
+constexpr int LIGHT_CULLING_NONE{ 0 };
+constexpr int LIGHT_CULLING_TILED{ 1 };
+constexpr int LIGHT_CULLING_CLUSTERED{ 2 };
+constexpr int LIGHT_CULLING_TILE_SIZE{ 16 }; // pixels
+constexpr int CLUSTER_TILE_SIZE{ 32 }; // pixels
+constexpr int CLUSTER_DEPTH_SLICES{ 24 };
+constexpr float VPL_ATTENUATION_EPSILON_START{ 0.0f }; // no distance attenuation, as the GPU passes
+constexpr float VPL_ATTENUATION_EPSILON_BENCHMARK{ 0.001f }; // used by the culling benchmark when no epsilon is given
+constexpr int LIGHT_CULLING_BENCHMARK_PARTICLES_MIN{ 16 };
+constexpr int LIGHT_CULLING_BENCHMARK_PARTICLES_MAX{ 1024 };
+constexpr int INTERLEAVE_START{ 1 }; // pixels per side of the interleaved sampling blocks, 1 for no interleaving
+constexpr int INTERLEAVE_MIN{ 1 };
+constexpr int INTERLEAVE_MAX{ 8 };
+constexpr int INTERLEAVE_BENCHMARK_PARTICLES_MIN{ 64 };
+constexpr int INTERLEAVE_BENCHMARK_PARTICLES_MAX{ 1024 };
+constexpr int INDIRECT_SCALE_START{ 1 }; // the VPL light is shaded at 1 / scale of the resolution, 1 for full resolution
+constexpr int INDIRECT_SCALE_MAX{ 4 }; // a power of 2, as the other scales
+constexpr float UPSAMPLE_DEPTH_SIGMA{ 0.02f }; // depth difference falloff of the joint bilateral upsampling, relative to the depth
+constexpr float UPSAMPLE_NORMAL_EXPONENT{ 16.0f }; // normals cosine falloff of the joint bilateral upsampling
+constexpr float UPSAMPLE_MIN_WEIGHT{ 0.001f }; // below it, the pixel takes the reduced pixel with the most similar surface
+constexpr int UPSAMPLE_BENCHMARK_PARTICLES[]{ 64, 256, 1024 };
+constexpr int DENOISE_ITERATIONS_START{ 0 }; // a-trous passes over the VPL light, 0 for no denoising
+constexpr int DENOISE_ITERATIONS_MAX{ 5 };
+constexpr int DENOISE_SIMD_WIDTH{ 16 }; // the rows are padded to the pixels filtered at once by the widest path (AVX-512)
+constexpr int DENOISE_TILE_WIDTH{ 256 }; // widest tile (plus its halo) filtered by a core, so that its rows stay in the L2 cache
+constexpr float DENOISE_NORMAL_SIGMA{ 0.1f }; // max 1 - cosine between the normals of a pixel and a tap, at most 0.5
+constexpr float DENOISE_PLANE_SIGMA{ 0.01f }; // max distance of a pixel to the tangent plane of a tap and back, relative to the depth
+constexpr float DENOISE_ALBEDO_SIGMA{ 0.1f }; // max albedo difference of a tap
+constexpr int DENOISE_BENCHMARK_REFERENCE_PARTICLES{ 1024 };
+constexpr int DENOISE_BENCHMARK_PARTICLES[]{ 16, 64, 256 };
+constexpr int TEMPORAL_SUBSETS_START{ 0 }; // the VPLs are split into subsets shaded a frame each, 0 for no temporal reuse
+constexpr int TEMPORAL_SUBSETS_MAX{ 16 };
+constexpr float TEMPORAL_MAX_HISTORY{ 2.0f }; // max frames accumulated per pixel, relative to the VPL subsets
+constexpr float TEMPORAL_MIN_HISTORY_WEIGHT{ 0.01f }; // below it, the reprojected pixel has no history
+constexpr int TEMPORAL_BENCHMARK_FRAMES{ 32 };
+constexpr int TEMPORAL_BENCHMARK_SUBSETS[]{ 1, 2, 4, 8 };
+constexpr int TEMPORAL_BENCHMARK_PARTICLES{ 256 };
+constexpr float TEMPORAL_BENCHMARK_FRAME_SEC{ 1.0f / 60.0f }; // the camera strafes at CAMERA_MOVE_SPEED, as with WASD
+constexpr int KERNEL_BENCHMARK_SAMPLES_W{ 256 };
+constexpr int KERNEL_BENCHMARK_SAMPLES_H{ 144 };
+constexpr int KERNEL_BENCHMARK_PARTICLES{ 256 };
+constexpr int KERNEL_BENCHMARK_POINT_LIGHT_RUNS{ 64 }; // the point lights are few, their passes are repeated
+constexpr int KERNEL_BENCHMARK_TRIALS{ 5 }; // each kernel is timed as the fastest of as many trials
+constexpr int SIMD_LANES_START{ 1 }; // the exact span kernels, the approximate multi-light kernels depend on the CPU and are opt-in
+constexpr int SIMD_MAX_LANES{ 16 }; // AVX-512, the VPLs of the multi-light kernels are padded to a multiple of it
+constexpr int SIMD_CHECK_SAMPLES_W{ 64 };
+constexpr int SIMD_CHECK_SAMPLES_H{ 36 };
+constexpr int SIMD_CHECK_PARTICLES{ 256 };
+constexpr int SIMD_CHECK_VPL_COUNTS[]{ 1, 7, 8, 9, 15, 16, 17, 33 }; // around the lane widths, the padding differs, all the VPLs are checked too
+constexpr float SIMD_TOLERANCE{ 1e-4f }; // max difference of the multi-light kernels with the scalar reference, relative to the brightest sample
+constexpr int RESAMPLE_CHECK_PARTICLES{ 256 };
+constexpr int RESAMPLE_CHECK_BLACK_VPLS[]{ 1, 2, 16, 1024 }; // appended after the spawned VPLs
+constexpr int RESAMPLE_CHECK_BUDGETS[]{ 1, 2, 7, 64, 255 };
+constexpr int RESAMPLE_CHECK_SEEDS{ 1024 }; // resamplings of each case
+constexpr float RESAMPLE_TOLERANCE{ 1e-4f }; // max relative difference of the total power of the kept VPLs with the spawned ones
+constexpr int PROGRESSIVE_CHECK_PARTICLES{ 16 };
+constexpr int PROGRESSIVE_CHECK_FRAME_COUNTS[]{ 8, 16, 32 }; // frames of the blocks whose standard error is estimated, multiples of 2
+constexpr int PROGRESSIVE_CHECK_REFERENCE_FRAMES{ 512 }; // split into blocks, and averaged into the reference the blocks are checked against
+constexpr float PROGRESSIVE_TOLERANCE{ 1.5f }; // max ratio of the RMS estimated and actual standard errors over the blocks, both ways
+constexpr const char* BAKE_CHECK_FILE_NAME{ "vpl_bake_check.bin" }; // in the temporary directory, removed after the check
+constexpr int BAKE_CHECK_LATTICE_SIZE{ 4 };
+constexpr int BAKE_CHECK_PARTICLES{ 64 };
+constexpr int BAKE_CHECK_BUDGETS[]{ 1, 16, 256, VPL_BUDGET_MAX };
+constexpr int BAKE_CHECK_LOOKUPS{ 256 }; // random point light positions of the blended lookups of each case
+constexpr float BAKE_TOLERANCE{ 1e-4f }; // max relative power difference, and 1 - cosine of the normals (octahedral encoding), of the baked VPLs
+constexpr int VPL_VISIBILITY_NONE{ 0 }; // unshadowed VPLs, as the GPU passes
+constexpr int VPL_VISIBILITY_ISM{ 1 }; // imperfect shadow maps
+constexpr int ISM_SIZE{ 32 }; // pixels per side of the paraboloid shadow map of each VPL, a power of 2
+constexpr int ISM_SCENE_POINTS{ 1 << 16 }; // points of the scene representation
+constexpr int ISM_POINTS_PER_VPL{ 4096 }; // points splatted into each shadow map
+constexpr float ISM_DEPTH_BIAS{ 0.1f }; // relative to the distance from the VPL
+constexpr int VPL_VISIBILITY_RAYS{ 2 }; // shadow rays through a BVH of the scene triangles (deferred only)
+constexpr int BVH_LEAF_TRIANGLES{ 4 }; // max triangles per leaf
+constexpr int VISIBILITY_CACHE_SIZE{ 1 << 12 }; // entries of the visibility cache of each chunk of tiles, a power of 2
+constexpr float VISIBILITY_CACHE_CELL{ 0.02f }; // side of the cells the shading points are quantized to
+constexpr int VISIBILITY_BENCHMARK_VPLS[]{ 256, 4096 };
+constexpr float IRRADIANCE_CACHE_ACCURACY_START{ 0.0f }; // Ward's a (max error of the interpolated records), 0 to shade every pixel against the VPLs
+constexpr float IRRADIANCE_CACHE_ACCURACY_MAX{ 1.0f };
+constexpr int IRRADIANCE_CACHE_HEMISPHERE_STRATA{ 8 }; // per side, the split sphere radius of a record comes from strata^2 rays
+constexpr float IRRADIANCE_CACHE_MIN_PIXELS{ 1.5f }; // bounds of the radius of validity of the records, in pixels of the view creating them
+constexpr float IRRADIANCE_CACHE_MAX_PIXELS{ 64.0f };
+constexpr int IRRADIANCE_CACHE_FIRST_STRIDE{ 32 }; // pixels between the first candidate records, halved down to 1
+constexpr float IRRADIANCE_CACHE_GRADIENT_STEP{ 0.25f }; // translation of the gradient finite differences, relative to the radius of validity
+constexpr float IRRADIANCE_CACHE_GRADIENT_TILT{ 0.1f }; // rotation of the normal of the gradient finite differences, radians
+constexpr float IRRADIANCE_CACHE_FRONT_TOLERANCE{ 0.01f }; // records further in front of the shading point are rejected, relative to their radius
+constexpr int IRRADIANCE_CACHE_OCTREE_MAX_DEPTH{ 16 };
+constexpr float IRRADIANCE_CACHE_BENCHMARK_ACCURACIES[]{ 0.05f, 0.1f, 0.2f, 0.4f };
+constexpr int IRRADIANCE_CACHE_BENCHMARK_PARTICLES{ 256 };
+constexpr float IRRADIANCE_CACHE_BENCHMARK_CAMERA_STEP{ 0.25f }; // sideways move of the camera for the frame reusing the records
+
+// ----------------------------------------------------------------------------
+// Custom Assertions
+// ----------------------------------------------------------------------------
+
+class Error : public std::runtime_error
+{
+public:
+    Error(const char* file, int line, const std::string& msg)
+        : std::runtime_error{ std::format("{}({}): {}\n{}", file, line, msg, std::stacktrace::current(1)) }
+    {}
+};
+
+#if defined(_DEBUG)
+#define Crash(msg) __debugbreak()
+#else
+#define Crash(msg) throw Error(__FILE__, __LINE__, msg)
+#endif
+
+#define Check(p) do { if (!(p)) Crash("check failed: " #p); } while (false)
+
+#define Unreachable() Crash("unreachable code path")
+
+// ----------------------------------------------------------------------------
+// Miscellaneous Utilities
+// ----------------------------------------------------------------------------
+
+inline int ParallelChunkCount(int count)
+{
+    // number of chunks count items are split into by parallel algorithms (a few per core, to balance the load)
+    return std::min(count, 4 * static_cast<int>(std::max(std::thread::hardware_concurrency(), 1u)));
+}
+
+template <typename F>
+inline void ParallelForChunks(int count, F&& f)
+{
+    // calls f(chunk, begin, end) for each of the ParallelChunkCount(count) contiguous chunks of [0;count), a chunk on a single thread
+    if (count <= 0) return;
+
+    int chunk_count{ ParallelChunkCount(count) };
+    std::vector<int> chunks(chunk_count);
+    std::iota(chunks.begin(), chunks.end(), 0);
+
+    std::for_each(std::execution::par, chunks.begin(), chunks.end(), [&](int chunk)
+    {
+        int begin{ static_cast<int>(static_cast<long long>(count) * chunk / chunk_count) };
+        int end{ static_cast<int>(static_cast<long long>(count) * (chunk + 1) / chunk_count) };
+        f(chunk, begin, end);
+    });
+}
+
+template <typename F>
+inline void ParallelFor(int count, F&& f)
+{
+    // calls f(i) for each i in [0;count), spreading contiguous chunks of indices over the available cores
+    ParallelForChunks(count, [&](int, int begin, int end)
+    {
+        for (int i{ begin }; i < end; i++)
+        {
+            f(i);
+        }
+    });
+}
+
+template <typename T>
+inline void HashCombine(std::size_t& hash, const T& value)
+{
+    // same mixing as boost::hash_combine
+    hash ^= std::hash<T>{}(value) + 0x9E3779B9 + (hash << 6) + (hash >> 2);
+}
+
+inline void HashCombine(std::size_t& hash, Vector3 value)
+{
+    HashCombine(hash, value.x);
+    HashCombine(hash, value.y);
+    HashCombine(hash, value.z);
+}
+
+inline std::uint32_t PCGHash(std::uint32_t v)
+{
+    // PCG hash (Jarzynski and Olano, "Hash Functions for GPU Rendering"), same as PSLightTree.hlsl
+    std::uint32_t state{ v * 747796405u + 2891336453u };
+    std::uint32_t word{ ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u };
+    return (word >> 22u) ^ word;
+}
+
+inline float RandomFloat(std::uint32_t& state)
+{
+    // uniform random number in [0;1)
+    state = PCGHash(state);
+    return static_cast<float>(state >> 8) / 16777216.0f;
+}
+
+inline std::string GetBytesStr(size_t bytes)
+{
+    const char* suffixes[]{ "B", "KB", "MB", "GB", "TB", "PB" };
+
+    size_t i{};
+    double val{ static_cast<double>(bytes) };
+    while (val >= 1024.0 && i < std::size(suffixes) - 1)
+    {
+        val /= 1024.0;
+        i++;
+    }
+
+    std::ostringstream out{};
+    out << std::fixed << std::setprecision(2) << val << " " << suffixes[i];
+
+    return out.str();
+}
+
+// ----------------------------------------------------------------------------
+// Timer
+// ----------------------------------------------------------------------------
+
+class Timer
+{
+public:
+    void Start();
+    void End();
+    float DeltaSec();
+private:
+    std::chrono::steady_clock::time_point m_t0{};
+    std::chrono::steady_clock::time_point m_t1{};
+};
+
+inline void Timer::Start()
+{
+    m_t0 = std::chrono::steady_clock::now();
+}
+inline void Timer::End()
+{
+    m_t1 = std::chrono::steady_clock::now();
+}
+inline float Timer::DeltaSec()
+{
+    return std::chrono::duration<float>(m_t1 - m_t0).count();
+}
+
+// ----------------------------------------------------------------------------
+// Vertex Definition
+// ----------------------------------------------------------------------------
+
+struct Vertex
+{
+    Vector3 position;
+    Vector3 normal;
+};
+
+// ----------------------------------------------------------------------------
+// Mesh
+// ----------------------------------------------------------------------------
+
+class Mesh
+{
+public:
+    static Mesh Quad();
+    static Mesh Cube();
+public:
+    Mesh(std::vector<Vertex> vertices, std::vector<std::uint32_t> indices);
+    ~Mesh() = default;
+    Mesh(const Mesh&) = delete;
+    Mesh(Mesh&&) noexcept = default;
+    Mesh& operator=(const Mesh&) = delete;
+    Mesh& operator=(Mesh&&) noexcept = default;
+public:
+    const std::vector<Vertex>& CPUVertices() const noexcept { return m_cpu_vertices; }
+    const std::vector<std::uint32_t>& CPUIndices() const noexcept { return m_cpu_indices; }
+#if defined(_WIN32)
+public:
+    void Upload(ID3D11Device* d3d_dev); // creates the GPU copy of the geometry (Main.cpp), headless meshes only have the CPU one
+    ID3D11Buffer* const* Vertices() const noexcept { return m_vertices.GetAddressOf(); }
+    ID3D11Buffer* Indices() const noexcept { return m_indices.Get(); }
+    UINT VertexCount() const noexcept { return static_cast<UINT>(m_cpu_vertices.size()); }
+    UINT IndexCount() const noexcept { return static_cast<UINT>(m_cpu_indices.size()); }
+    const UINT* Stride() const noexcept { return &m_stride; }
+    DXGI_FORMAT IndexFormat() const noexcept { return DXGI_FORMAT_R32_UINT; }
+    const UINT* Offset() const noexcept { return &m_offset; }
+private:
+    wrl::ComPtr<ID3D11Buffer> m_vertices;
+    wrl::ComPtr<ID3D11Buffer> m_indices;
+    UINT m_stride{ sizeof(Vertex) };
+    UINT m_offset{};
+#endif
+private:
+    std::vector<Vertex> m_cpu_vertices; // read by the software rasterizer and the ray casts, uploaded as they are
+    std::vector<std::uint32_t> m_cpu_indices;
+};
+
+inline Mesh Mesh::Quad()
+{
+    /*
+        Local space quad vertex positions (we are on z = 0)
+        We suppose the quad's normal is (0, 0, 1)
+
+        (-0.5, +0.5)            (+0.5, +0.5)
+                    +----------+
+                    |          |
+                    |          |
+                    |          |
+                    |          |
+                    +----------+
+        (-0.5, -0.5)            (+0.5, -0.5)
+
+    */
+
+    std::vector<Vertex> vertices
+    {
+        { { +0.5f, +0.5f, 0.0f }, { 0.0f, 0.0f, 1.0f } },
+        { { -0.5f, +0.5f, 0.0f }, { 0.0f, 0.0f, 1.0f } },
+        { { -0.5f, -0.5f, 0.0f }, { 0.0f, 0.0f, 1.0f } },
+        { { +0.5f, -0.5f, 0.0f }, { 0.0f, 0.0f, 1.0f } },
+    };
+
+    std::vector<std::uint32_t> indices
+    {
+        0, 1, 2,
+        2, 3, 0,
+    };
+
+    return { std::move(vertices), std::move(indices) };
+}
+
+inline Mesh Mesh::Cube()
+{
+    std::vector<Vertex> vertices
+    {
+        // front face (Z+)
+        { { -0.5f, -0.5f, +0.5f }, { 0.0f, 0.0f, 1.0f } },
+        { { +0.5f, -0.5f, +0.5f }, { 0.0f, 0.0f, 1.0f } },
+        { { +0.5f, +0.5f, +0.5f }, { 0.0f, 0.0f, 1.0f } },
+        { { -0.5f, +0.5f, +0.5f }, { 0.0f, 0.0f, 1.0f } },
+
+        // back face (Z-)
+        { { +0.5f, -0.5f, -0.5f }, { 0.0f, 0.0f, -1.0f } },
+        { { -0.5f, -0.5f, -0.5f }, { 0.0f, 0.0f, -1.0f } },
+        { { -0.5f, +0.5f, -0.5f }, { 0.0f, 0.0f, -1.0f } },
+        { { +0.5f, +0.5f, -0.5f }, { 0.0f, 0.0f, -1.0f } },
+
+        // left face (X-)
+        { { -0.5f, -0.5f, -0.5f }, { -1.0f, 0.0f, 0.0f } },
+        { { -0.5f, -0.5f, +0.5f }, { -1.0f, 0.0f, 0.0f } },
+        { { -0.5f, +0.5f, +0.5f }, { -1.0f, 0.0f, 0.0f } },
+        { { -0.5f, +0.5f, -0.5f }, { -1.0f, 0.0f, 0.0f } },
+
+        // right face (X+)
+        { { +0.5f, -0.5f, +0.5f }, { +1.0f, 0.0f, 0.0f } },
+        { { +0.5f, -0.5f, -0.5f }, { +1.0f, 0.0f, 0.0f } },
+        { { +0.5f, +0.5f, -0.5f }, { +1.0f, 0.0f, 0.0f } },
+        { { +0.5f, +0.5f, +0.5f }, { +1.0f, 0.0f, 0.0f } },
+
+        // top face (Y+)
+        { { -0.5f, +0.5f, +0.5f }, { 0.0f, +1.0f, 0.0f } },
+        { { +0.5f, +0.5f, +0.5f }, { 0.0f, +1.0f, 0.0f } },
+        { { +0.5f, +0.5f, -0.5f }, { 0.0f, +1.0f, 0.0f } },
+        { { -0.5f, +0.5f, -0.5f }, { 0.0f, +1.0f, 0.0f } },
+
+        // bottom face (Y-)
+        { { -0.5f, -0.5f, -0.5f }, { 0.0f, -1.0f, 0.0f } },
+        { { +0.5f, -0.5f, -0.5f }, { 0.0f, -1.0f, 0.0f } },
+        { { +0.5f, -0.5f, +0.5f }, { 0.0f, -1.0f, 0.0f } },
+        { { -0.5f, -0.5f, +0.5f }, { 0.0f, -1.0f, 0.0f } },
+    };
+
+    std::vector<std::uint32_t> indices
+    {
+        // front
+        0, 1, 2,
+        0, 2, 3,
+
+        // back
+        4, 5, 6,
+        4, 6, 7,
+
+        // left
+        8, 9,10,
+        8,10,11,
+
+        // right
+        12,13,14,
+        12,14,15,
+
+        // top 
+        16,17,18,
+        16,18,19,
+
+        // bottom
+        20,21,22,
+        20,22,23
+    };
+
+    return { std::move(vertices), std::move(indices) };
+}
+
+inline Mesh::Mesh(std::vector<Vertex> vertices, std::vector<std::uint32_t> indices)
+    : m_cpu_vertices{ std::move(vertices) }
+    , m_cpu_indices{ std::move(indices) }
+{
+    Check(!m_cpu_vertices.empty());
+    Check(!m_cpu_indices.empty());
+}
+
+// ----------------------------------------------------------------------------
+// Geometry
+// ----------------------------------------------------------------------------
+
+struct Ray
+{
+    Vector3 origin;
+    Vector3 direction;
+};
+
+struct RayHit
+{
+    bool valid;
+    Vector3 position;
+    Vector3 normal;
+};
+
+using RayIntersectFn = RayHit(Ray ray, const Matrix& model, const Matrix& normal);
+
+inline RayHit RayQuadIntersect(Ray ray, const Matrix& model, const Matrix& normal)
+{
+    /*
+        ray/quad intersection test in local space
+
+        ray: p(t) = o + td
+        plane p.n + s = 0
+
+        quad in local space lies on z=0 (we know it because we know how the quad mesh has been defined)
+        n: (0,0,1)
+        s: 0
+        plane: p.(0,0,1) = 0
+
+        we plug the ray equation into the plane equation
+
+        (o + td).(0,0,1) = 0
+        o.(0,0,1) + td.(0,0,1) = 0
+        o_z + t * d_z = 0
+        t * d_z = - o_z
+        t = - o_z / d_z
+
+        if d_z != 0 then t exists
+        since we have a ray t must also be >= 0
+
+        if both conditions are met, there is an intersection at point p(t)
+    */
+
+    RayHit hit{};
+
+    // inverse transform: world -> model
+    Matrix inverse_model{ model.Invert() };
+
+    // transform world space ray into model space ray
+    {
+        Vector4 origin{ ray.origin.x, ray.origin.y, ray.origin.z, 1.0f }; // influenced by translations
+        Vector4 direction{ ray.direction.x, ray.direction.y, ray.direction.z, 0.0f }; // NOT influenced by translations
+
+        origin = Vector4::Transform(origin, inverse_model); // local space ray origin
+        direction = Vector4::Transform(direction, inverse_model); // local space ray direction
+
+        ray.origin = { origin.x, origin.y, origin.z };
+        ray.direction = { direction.x, direction.y, direction.z };
+    }
+
+    // ray/plane intersection in local space
+    if (ray.direction.z != 0)
+    {
+        float t{ -(ray.origin.z) / (ray.direction.z) };
+        if (t > 0) // we ignore hits at the ray's origin
+        {
+            // find hit local space position 
+            Vector3 local_hit{ ray.origin + t * ray.direction };
+
+            // check whether local_hit is within the quad's bounds or not
+            if ((-0.5f <= local_hit.x && local_hit.x <= +0.5f) && (-0.5f <= local_hit.y && local_hit.y <= +0.5f))
+            {
+                hit.valid = true;
+
+                // compute world hit
+                Vector4 world_hit{ Vector4::Transform({local_hit.x, local_hit.y, local_hit.z, 1.0f}, model) };
+                hit.position = { world_hit.x, world_hit.y, world_hit.z };
+
+                // compute normal at hit point
+                Vector4 local_normal{ 0.0f, 0.0f, 1.0f, 0.0f }; // NOT influenced by translations
+                Vector4 world_normal{ Vector4::Transform(local_normal, normal) };
+                world_normal.Normalize();
+                hit.normal = { world_normal.x, world_normal.y, world_normal.z };
+            }
+        }
+    }
+
+    return hit;
+}
+
+inline RayHit RayBoxIntersect(Ray ray, const Matrix& model, const Matrix& normal)
+{
+    /*
+        ray/box intersection test in local space
+
+        ray: p(t) = o + td
+
+        in local space, the box is an AABB from (-0.5, -0.5, -0.5) to (+0.5, +0.5, +0.5)
+        we can consider the box as being made up of three slabs
+        - one slab with normal (0, 0, 1) and shifts -0.5, +0.5
+        - one slab with normal (0, 1, 0) and shifts -0.5, +0.5
+        - one slab with normal (1, 0, 0) and shifts -0.5, +0.5
+
+        we use the slab method for finding the ray/box intersection
+        - we intersect the ray with the first slab, finding an interval for t
+        - we intersect the ray with the second slab, finding an interval for t
+        - we intersect the ray with the third slab, finding an interval for t
+
+        if the intersection of the found intervals is not empty, we have an intersection
+    */
+
+    RayHit hit{};
+
+    // inverse transform: world -> model
+    Matrix inverse_model{ model.Invert() };
+
+    // transform world space ray into model space ray
+    {
+        Vector4 origin{ ray.origin.x, ray.origin.y, ray.origin.z, 1.0f }; // influenced by translations
+        Vector4 direction{ ray.direction.x, ray.direction.y, ray.direction.z, 0.0f }; // NOT influenced by translations
+
+        origin = Vector4::Transform(origin, inverse_model); // local space ray origin
+        direction = Vector4::Transform(direction, inverse_model); // local space ray direction
+
+        ray.origin = { origin.x, origin.y, origin.z };
+        ray.direction = { direction.x, direction.y, direction.z };
+    }
+
+    /*
+        ray/slab intersection (slab 1)
+
+        slab:
+        p.(0,0,1) - 0.5 = 0
+        p.(0,0,1) + 0.5 = 0
+
+        we plug the ray equation
+
+        (o + t_a * d).(0, 0, 1) - 0.5 = 0
+        o.(0,0,1) + (t_a * d).(0,0,1) - 0.5 = 0
+        o_z + t_a * d_z - 0.5 = 0
+        t_a * d_z = 0.5 - o_z
+        t_a = (0.5 - o_z) / d_z
+
+        analogously
+
+        t_b = (-0.5 - o_z) / d_z
+
+        it is easy to derive the formulas for the other slabs
+    */
+
+    float t_min{ 0.0f }; // intervals intersection lower bound
+    float t_max{ std::numeric_limits<float>::infinity() }; // intervals intersection upper bound
+    {
+        float ray_origin[3]{ ray.origin.x, ray.origin.y, ray.origin.z };
+        float ray_direction[3]{ ray.direction.x, ray.direction.y, ray.direction.z };
+
+        for (int i{}; i < 3; i++) // the hardcoded 3 stands for the three slabs
+        {
+            if (ray_direction[i] != 0) // there is an intersection
+            {
+                // find interval
+                float t_a{ (+0.5f - ray_origin[i]) / ray_direction[i] };
+                float t_b{ (-0.5f - ray_origin[i]) / ray_direction[i] };
+
+                // intersect found interval
+                t_min = std::max(t_min, std::min(t_a, t_b));
+                t_max = std::min(t_max, std::max(t_a, t_b));
+            }
+            else // there is no intersection
+            {
+                t_max = t_min; // collapse the intervals intersection into a single value
+            }
+        }
+    }
+
+    if (t_min < t_max) // the ray intersects the box (we ignore single value intervals)
+    {
+        if (t_min > 0) // we ignore hits at the ray's origin
+        {
+            hit.valid = true;
+
+            // find hit local space position 
+            Vector3 local_hit{ ray.origin + t_min * ray.direction };
+
+            // compute world hit
+            Vector4 world_hit{ Vector4::Transform({local_hit.x, local_hit.y, local_hit.z, 1.0f}, model) };
+            hit.position = { world_hit.x, world_hit.y, world_hit.z };
+
+            // find hit normal
+            {
+                float local_normal[3]{};
+                float hit_position[3]{ local_hit.x, local_hit.y, local_hit.z };
+
+                constexpr float EPSILON{ 0.0001f }; // TODO: hardcoded epsilon
+                for (int i{}; i < 3; i++)
+                {
+                    if (std::abs(std::abs(hit_position[i]) - 0.5f) < EPSILON)
+                    {
+                        local_normal[i] = hit_position[i] > 0.0f ? +1.0f : -1.0f;
+                        break;
+                    }
+                }
+
+                Vector4 world_normal{ Vector4::Transform({local_normal[0], local_normal[1], local_normal[2], 0.0f}, normal) };
+                world_normal.Normalize();
+                hit.normal = { world_normal.x, world_normal.y, world_normal.z };
+            }
+        }
+    }
+
+    return hit;
+}
+
+inline void BuildOrthonormalBasis(Vector3 n, Vector3& t, Vector3& b)
+{
+    // tangent and bitangent of unit vector n (Duff et al., "Building an Orthonormal Basis, Revisited", 2017)
+    float sign{ std::copysign(1.0f, n.z) };
+    float a{ -1.0f / (sign + n.z) };
+    float c{ n.x * n.y * a };
+    t = { 1.0f + sign * n.x * n.x * a, sign * c, -sign * n.x };
+    b = { c, sign + n.y * n.y * a, -n.y };
+}
+
+inline Vector3 SampleCosineHemisphere(Vector3 n, float u0, float u1)
+{
+    // cosine weighted direction around unit vector n (Malley's method: uniform disk point projected on the hemisphere)
+    float r{ std::sqrt(u0) };
+    float phi{ 2.0f * std::numbers::pi_v<float> * u1 };
+
+    Vector3 t{}, b{};
+    BuildOrthonormalBasis(n, t, b);
+
+    Vector3 direction{ t * (r * std::cos(phi)) + b * (r * std::sin(phi)) + n * std::sqrt(std::max(1.0f - u0, 0.0f)) };
+    direction.Normalize();
+    return direction;
+}
+
+// ----------------------------------------------------------------------------
+// Scene
+// ----------------------------------------------------------------------------
+
+struct Camera
+{
+    Vector3 eye;
+    float yaw_deg;
+    float pitch_deg;
+    float fov_deg;
+    float near_plane;
+    float far_plane;
+    Vector3 target;
+};
+
+struct Object
+{
+    std::string name{ "unknown" };
+    Vector3 position{};
+    Vector3 rotation{};
+    Vector3 scaling{ 1.0f, 1.0f, 1.0f };
+    Mesh* mesh{};
+    Vector3 albedo{ 1.0f, 1.0f, 1.0f };
+    Vector3 emissive_color{ 1.0f, 1.0f, 1.0f };
+    float emissive_intensity{}; // emitted radiance is emissive_intensity * emissive_color (only quads can emit)
+    RayIntersectFn* ray_intersect_fn{};
+    Matrix model{ Matrix::Identity };
+    Matrix normal{ Matrix::Identity };
+};
+
+struct PointLight
+{
+    Vector3 position;
+    Vector3 color;
+    float intenisty;
+};
+
+inline float Luminance(Vector3 color)
+{
+    return 0.2126f * color.x + 0.7152f * color.y + 0.0722f * color.z;
+}
+
+inline bool IsEmissiveQuad(const Object& obj)
+{
+    return obj.ray_intersect_fn == RayQuadIntersect && obj.emissive_intensity > 0.0f && Luminance(obj.emissive_color) > 0.0f;
+}
+
+inline float QuadArea(const Object& obj)
+{
+    // the local space quad is a unit square on z = 0
+    Vector3 x{ Vector3::TransformNormal({ 1.0f, 0.0f, 0.0f }, obj.model) };
+    Vector3 y{ Vector3::TransformNormal({ 0.0f, 1.0f, 0.0f }, obj.model) };
+    return x.Cross(y).Length();
+}
+
+inline void QuadCorners(const Object& obj, Vector3 (&corners)[4])
+{
+    // world space corners, counter clockwise as seen from the side the normal points to (same order as the quad mesh)
+    Vector3 local_corners[4]{ { +0.5f, +0.5f, 0.0f }, { -0.5f, +0.5f, 0.0f }, { -0.5f, -0.5f, 0.0f }, { +0.5f, -0.5f, 0.0f } };
+    for (int c{}; c < 4; c++)
+    {
+        corners[c] = Vector3::Transform(local_corners[c], obj.model);
+    }
+}
+
+inline Vector3 CameraForward(float yaw_deg, float pitch_deg)
+{
+    const float yaw_rad{ DirectX::XMConvertToRadians(yaw_deg) };
+    const float pitch_rad{ DirectX::XMConvertToRadians(pitch_deg) };
+
+    Vector3 forward{};
+    forward.x = std::cos(yaw_rad) * std::cos(pitch_rad);
+    forward.y = std::sin(pitch_rad);
+    forward.z = std::sin(yaw_rad) * std::cos(pitch_rad);
+    forward.Normalize();
+    return forward;
+}
+
+inline Matrix CameraViewProjection(const Camera& camera, float aspect)
+{
+    // same view and projection matrices as the ones of the frame constants
+    Matrix view{ Matrix::CreateLookAt(camera.eye, camera.target, { 0.0f, 1.0f, 0.0f }) };
+    Matrix projection{ Matrix::CreatePerspectiveFieldOfView(DirectX::XMConvertToRadians(camera.fov_deg), aspect, camera.near_plane, camera.far_plane) };
+    return view * projection;
+}
+
+inline void UpdateObjectMatrices(Object& obj)
+{
+    Vector3 rotation_rad{};
+    rotation_rad.x = DirectX::XMConvertToRadians(obj.rotation.x);
+    rotation_rad.y = DirectX::XMConvertToRadians(obj.rotation.y);
+    rotation_rad.z = DirectX::XMConvertToRadians(obj.rotation.z);
+
+    Matrix translate{ Matrix::CreateTranslation(obj.position) };
+    Matrix rotate{ Matrix::CreateFromYawPitchRoll(rotation_rad) };
+    Matrix scale{ Matrix::CreateScale(obj.scaling) };
+    Matrix model{ scale * rotate * translate };
+    Matrix normal{ scale * rotate };
+    normal.Invert();
+    normal.Transpose();
+
+    obj.model = model;
+    obj.normal = normal;
+}
+
+inline void BuildCornellBoxScene(std::vector<Object>& objects, std::vector<PointLight>& point_lights, Camera& camera, Mesh* quad_mesh, Mesh* cube_mesh)
+{
+    objects.clear();
+    point_lights.clear();
+
+    camera.eye = { 0.0f, 2.0f, 10.0f };
+    camera.yaw_deg = CAMERA_START_YAW_DEG;
+    camera.pitch_deg = CAMERA_START_PITCH_DEG;
+    camera.target = camera.eye + CameraForward(camera.yaw_deg, camera.pitch_deg);
+
+    {
+        PointLight& point_light{ point_lights.emplace_back() };
+        point_light.position = { 0.0f, 3.25f, 1.0f };
+        point_light.color = { 1.0f, 1.0f, 1.0f };
+        point_light.intenisty = POINT_LIGHT_START_INTENSITY;
+    }
+
+    {
+        Object& obj{ objects.emplace_back() };
+        obj.name = "Left Cube";
+        obj.position = { -0.40f, 1.35f, -0.75f };
+        obj.rotation = { 0.0f, 20.0f, 0.0f };
+        obj.scaling = { 1.5f, 2.75f, 1.0f };
+        obj.mesh = cube_mesh;
+        obj.albedo = { 1.0f, 1.0f, 1.0f };
+        obj.ray_intersect_fn = RayBoxIntersect;
+    }
+    {
+        Object& obj{ objects.emplace_back() };
+        obj.name = "Right Cube";
+        obj.position = { 1.0f, 0.61f, 1.15f };
+        obj.rotation = { 0.0f, -15.0f, 0.0f };
+        obj.scaling = { 1.25f, 1.25f, 1.25f };
+        obj.mesh = cube_mesh;
+        obj.albedo = { 1.0f, 1.0f, 1.0f };
+        obj.ray_intersect_fn = RayBoxIntersect;
+    }
+    {
+        Object& obj{ objects.emplace_back() };
+        obj.name = "Floor";
+        obj.position = {};
+        obj.rotation = { 270.0f, 0.0f, 0.0f };
+        obj.scaling = { 4.0f, 4.0f, 1.0f };
+        obj.mesh = quad_mesh;
+        obj.albedo = { 1.0f, 1.0f, 1.0f };
+        obj.ray_intersect_fn = RayQuadIntersect;
+    }
+    {
+        Object& obj{ objects.emplace_back() };
+        obj.name = "Cieling";
+        obj.position = { 0.0f, 4.0f, 0.0f };
+        obj.rotation = { 90.0f, 0.0f, 0.0f };
+        obj.scaling = { 4.0f, 4.0f, 1.0f };
+        obj.mesh = quad_mesh;
+        obj.albedo = { 1.0f, 1.0f, 1.0f };
+        obj.ray_intersect_fn = RayQuadIntersect;
+    }
+    {
+        Object& obj{ objects.emplace_back() };
+        obj.name = "Left Wall";
+        obj.position = { -2.0f, 2.0f, 0.0f };
+        obj.rotation = { 0.0f, 90.0f, 0.0f };
+        obj.scaling = { 4.0f, 4.0f, 1.0f };
+        obj.mesh = quad_mesh;
+        obj.albedo = { 1.0f, 0.0f, 0.0f };
+        obj.ray_intersect_fn = RayQuadIntersect;
+    }
+    {
+        Object& obj{ objects.emplace_back() };
+        obj.name = "Right Wall";
+        obj.position = { 2.0f, 2.0f, 0.0f };
+        obj.rotation = { 0.0f, 270.0f, 0.0f };
+        obj.scaling = { 4.0f, 4.0f, 1.0f };
+        obj.mesh = quad_mesh;
+        obj.albedo = { 0.0f, 1.0f, 0.0f };
+        obj.ray_intersect_fn = RayQuadIntersect;
+    }
+    {
+        Object& obj{ objects.emplace_back() };
+        obj.name = "Back Wall";
+        obj.position = { 0.0f, 2.0f, -2.0f };
+        obj.rotation = { 0.0f, 0.0f, 0.0f };
+        obj.scaling = { 4.0f, 4.0f, 1.0f };
+        obj.mesh = quad_mesh;
+        obj.albedo = { 1.0f, 1.0f, 1.0f };
+        obj.ray_intersect_fn = RayQuadIntersect;
+    }
+    {
+        Object& obj{ objects.emplace_back() };
+        obj.name = "Front Wall";
+        obj.position = { 0.0f, 2.0f, 2.0f };
+        obj.rotation = { 0.0f, 180.0f, 0.0f };
+        obj.scaling = { 4.0f, 4.0f, 1.0f };
+        obj.mesh = quad_mesh;
+        obj.albedo = { 1.0f, 1.0f, 1.0f };
+        obj.ray_intersect_fn = RayQuadIntersect;
+    }
+}
+
+inline void BuildDoorwayScene(std::vector<Object>& objects, std::vector<PointLight>& point_lights, Camera& camera, Mesh* quad_mesh, Mesh* cube_mesh)
+{
+    /*
+        Two 4x4x4 rooms side by side (along x), separated by a wall with a small doorway (0.5 wide, 1 high) at floor level.
+        The point light is in the right room, the camera looks at the dividing wall from the left room:
+        all the light the camera sees reaches the left room through the doorway.
+    */
+    objects.clear();
+    point_lights.clear();
+
+    camera.eye = { -3.5f, 2.0f, 0.0f };
+    camera.yaw_deg = 0.0f;
+    camera.pitch_deg = -15.0f;
+    camera.target = camera.eye + CameraForward(camera.yaw_deg, camera.pitch_deg);
+
+    {
+        PointLight& point_light{ point_lights.emplace_back() };
+        point_light.position = { 2.5f, 3.25f, 0.0f };
+        point_light.color = { 1.0f, 1.0f, 1.0f };
+        point_light.intenisty = POINT_LIGHT_START_INTENSITY;
+    }
+
+    {
+        Object& obj{ objects.emplace_back() };
+        obj.name = "Floor";
+        obj.position = {};
+        obj.rotation = { 270.0f, 0.0f, 0.0f };
+        obj.scaling = { 8.0f, 4.0f, 1.0f };
+        obj.mesh = quad_mesh;
+        obj.albedo = { 1.0f, 1.0f, 1.0f };
+        obj.ray_intersect_fn = RayQuadIntersect;
+    }
+    {
+        Object& obj{ objects.emplace_back() };
+        obj.name = "Cieling";
+        obj.position = { 0.0f, 4.0f, 0.0f };
+        obj.rotation = { 90.0f, 0.0f, 0.0f };
+        obj.scaling = { 8.0f, 4.0f, 1.0f };
+        obj.mesh = quad_mesh;
+        obj.albedo = { 1.0f, 1.0f, 1.0f };
+        obj.ray_intersect_fn = RayQuadIntersect;
+    }
+    {
+        Object& obj{ objects.emplace_back() };
+        obj.name = "Left Wall";
+        obj.position = { -4.0f, 2.0f, 0.0f };
+        obj.rotation = { 0.0f, 90.0f, 0.0f };
+        obj.scaling = { 4.0f, 4.0f, 1.0f };
+        obj.mesh = quad_mesh;
+        obj.albedo = { 1.0f, 0.0f, 0.0f };
+        obj.ray_intersect_fn = RayQuadIntersect;
+    }
+    {
+        Object& obj{ objects.emplace_back() };
+        obj.name = "Right Wall";
+        obj.position = { 4.0f, 2.0f, 0.0f };
+        obj.rotation = { 0.0f, 270.0f, 0.0f };
+        obj.scaling = { 4.0f, 4.0f, 1.0f };
+        obj.mesh = quad_mesh;
+        obj.albedo = { 0.0f, 1.0f, 0.0f };
+        obj.ray_intersect_fn = RayQuadIntersect;
+    }
+    {
+        Object& obj{ objects.emplace_back() };
+        obj.name = "Back Wall";
+        obj.position = { 0.0f, 2.0f, -2.0f };
+        obj.rotation = { 0.0f, 0.0f, 0.0f };
+        obj.scaling = { 8.0f, 4.0f, 1.0f };
+        obj.mesh = quad_mesh;
+        obj.albedo = { 1.0f, 1.0f, 1.0f };
+        obj.ray_intersect_fn = RayQuadIntersect;
+    }
+    {
+        Object& obj{ objects.emplace_back() };
+        obj.name = "Front Wall";
+        obj.position = { 0.0f, 2.0f, 2.0f };
+        obj.rotation = { 0.0f, 180.0f, 0.0f };
+        obj.scaling = { 8.0f, 4.0f, 1.0f };
+        obj.mesh = quad_mesh;
+        obj.albedo = { 1.0f, 1.0f, 1.0f };
+        obj.ray_intersect_fn = RayQuadIntersect;
+    }
+    {
+        Object& obj{ objects.emplace_back() };
+        obj.name = "Dividing Wall Back";
+        obj.position = { 0.0f, 2.0f, -1.125f };
+        obj.rotation = {};
+        obj.scaling = { 0.1f, 4.0f, 1.75f };
+        obj.mesh = cube_mesh;
+        obj.albedo = { 1.0f, 1.0f, 1.0f };
+        obj.ray_intersect_fn = RayBoxIntersect;
+    }
+    {
+        Object& obj{ objects.emplace_back() };
+        obj.name = "Dividing Wall Front";
+        obj.position = { 0.0f, 2.0f, 1.125f };
+        obj.rotation = {};
+        obj.scaling = { 0.1f, 4.0f, 1.75f };
+        obj.mesh = cube_mesh;
+        obj.albedo = { 1.0f, 1.0f, 1.0f };
+        obj.ray_intersect_fn = RayBoxIntersect;
+    }
+    {
+        Object& obj{ objects.emplace_back() };
+        obj.name = "Doorway Lintel";
+        obj.position = { 0.0f, 2.5f, 0.0f };
+        obj.rotation = {};
+        obj.scaling = { 0.1f, 3.0f, 0.5f };
+        obj.mesh = cube_mesh;
+        obj.albedo = { 1.0f, 1.0f, 1.0f };
+        obj.ray_intersect_fn = RayBoxIntersect;
+    }
+}
+
+inline void ValidateSceneObjects(const std::vector<Object>& objects)
+{
+    // no two objects can have the same name
+    {
+        std::unordered_set<std::string> object_names{};
+        for (const Object& obj : objects)
+        {
+            if (object_names.contains(obj.name))
+            {
+                Crash(std::format("two or more scene objects have the same name '{}'", obj.name));
+            }
+            else
+            {
+                object_names.emplace(obj.name);
+            }
+        }
+    }
+
+    // all objects must be able to intersect with a ray
+    for (const Object& obj : objects)
+    {
+        if (!obj.ray_intersect_fn)
+        {
+            Crash(std::format("object '{}' doesn't support ray intersection", obj.name));
+        }
+    }
+}
+
+inline int CubeShadowMapSize(int point_lights_count)
+{
+    // the point lights share the memory of a single CUBE_SHADOW_MAP_SIZE cube shadow map
+    int lights_per_side{ static_cast<int>(std::ceil(std::sqrt(static_cast<float>(point_lights_count)))) };
+    return std::max(CUBE_SHADOW_MAP_SIZE / std::max(lights_per_side, 1), CUBE_SHADOW_MAP_MIN_SIZE);
+}
+
+inline Matrix CubeShadowMapView(Vector3 light_position, int face)
+{
+    return DirectX::XMMatrixLookAtLH(light_position, light_position + CUBE_MAP_FACE_DIRECTIONS[face], CUBE_MAP_FACE_UPS[face]);
+}
+
+inline Matrix CubeShadowMapProjection()
+{
+    // 90 degrees field of view, so that the 6 faces cover every direction
+    return DirectX::XMMatrixPerspectiveFovLH(std::numbers::pi_v<float> / 2.0f, 1.0f, CUBE_SHADOW_MAP_NEAR, CUBE_SHADOW_MAP_FAR);
+}
+
+inline std::size_t HashScene(const Camera& camera, const std::vector<PointLight>& point_lights, const std::vector<Object>& objects)
+{
+    // hash of everything in the scene that affects the rendered frame (used to detect when accumulated frames become stale)
+    std::size_t hash{};
+
+    HashCombine(hash, camera.eye);
+    HashCombine(hash, camera.target);
+    HashCombine(hash, camera.fov_deg);
+    HashCombine(hash, camera.near_plane);
+    HashCombine(hash, camera.far_plane);
+
+    for (const PointLight& point_light : point_lights)
+    {
+        HashCombine(hash, point_light.position);
+        HashCombine(hash, point_light.color);
+        HashCombine(hash, point_light.intenisty);
+    }
+
+    for (const Object& obj : objects)
+    {
+        HashCombine(hash, obj.position);
+        HashCombine(hash, obj.rotation);
+        HashCombine(hash, obj.scaling);
+        HashCombine(hash, obj.albedo);
+        HashCombine(hash, obj.emissive_color);
+        HashCombine(hash, obj.emissive_intensity);
+    }
+
+    return hash;
+}
+
+inline void ComputeSceneBounds(const std::vector<Object>& objects, Vector3& bounds_min, Vector3& bounds_max)
+{
+    // aabb of the objects (the local space meshes fit in the unit cube centered at the origin)
+    bounds_min = Vector3{ std::numeric_limits<float>::max() };
+    bounds_max = Vector3{ std::numeric_limits<float>::lowest() };
+    for (const Object& obj : objects)
+    {
+        for (int corner{}; corner < 8; corner++)
+        {
+            Vector3 local{ (corner & 1) ? 0.5f : -0.5f, (corner & 2) ? 0.5f : -0.5f, (corner & 4) ? 0.5f : -0.5f };
+            Vector3 world{ Vector3::Transform(local, obj.model) };
+            bounds_min = Vector3::Min(bounds_min, world);
+            bounds_max = Vector3::Max(bounds_max, world);
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------
+// Alias Table
+// ----------------------------------------------------------------------------
+
+/*
+    Walker's alias method (with Vose's construction): O(n) build, O(1) sampling of a discrete distribution.
+    Each of the n columns holds the probability of keeping the column index and the index of its alias.
+    Sampling picks a column uniformly, then either keeps it or jumps to its alias.
+*/
+class AliasTable
+{
+public:
+    AliasTable();
+    ~AliasTable() = default;
+    AliasTable(const AliasTable&) = delete;
+    AliasTable(AliasTable&&) noexcept = default;
+    AliasTable& operator=(const AliasTable&) = delete;
+    AliasTable& operator=(AliasTable&&) noexcept = default;
+public:
+    void Build(const std::vector<float>& weights); // non negative weights, when all of them are zero the distribution is uniform
+    int Sample(float u) const; // u is uniformly distributed in [0;1)
+    float Probability(int i) const noexcept { return m_probabilities[i]; }
+    int Size() const noexcept { return static_cast<int>(m_probabilities.size()); }
+private:
+    std::vector<float> m_probabilities;
+    std::vector<float> m_thresholds;
+    std::vector<int> m_aliases;
+};
+
+inline AliasTable::AliasTable()
+    : m_probabilities{}
+    , m_thresholds{}
+    , m_aliases{}
+{
+}
+
+inline void AliasTable::Build(const std::vector<float>& weights)
+{
+    const int n{ static_cast<int>(weights.size()) };
+    Check(n > 0);
+
+    // normalize weights
+    float weights_sum{ std::accumulate(weights.begin(), weights.end(), 0.0f) };
+    m_probabilities.resize(n);
+    for (int i{}; i < n; i++)
+    {
+        Check(weights[i] >= 0.0f);
+        m_probabilities[i] = weights_sum > 0.0f ? weights[i] / weights_sum : 1.0f / static_cast<float>(n);
+    }
+
+    // split columns in under full and over full ones (with respect to the average column height 1/n)
+    std::vector<float> heights(n);
+    std::vector<int> small{};
+    std::vector<int> large{};
+    for (int i{}; i < n; i++)
+    {
+        heights[i] = m_probabilities[i] * static_cast<float>(n);
+        if (heights[i] < 1.0f)
+        {
+            small.emplace_back(i);
+        }
+        else
+        {
+            large.emplace_back(i);
+        }
+    }
+
+    // fill each under full column with the excess of an over full one
+    m_thresholds.assign(n, 1.0f);
+    m_aliases.resize(n);
+    std::iota(m_aliases.begin(), m_aliases.end(), 0);
+    while (!small.empty() && !large.empty())
+    {
+        int s{ small.back() };
+        small.pop_back();
+        int l{ large.back() };
+
+        m_thresholds[s] = heights[s];
+        m_aliases[s] = l;
+
+        heights[l] -= 1.0f - heights[s];
+        if (heights[l] < 1.0f)
+        {
+            large.pop_back();
+            small.emplace_back(l);
+        }
+    }
+
+    // whatever is left is full (up to rounding errors)
+    for (int i : small) m_thresholds[i] = 1.0f;
+    for (int i : large) m_thresholds[i] = 1.0f;
+}
+
+inline int AliasTable::Sample(float u) const
+{
+    // the integer part of u * n picks the column, the fractional part decides between the column and its alias
+    const int n{ Size() };
+    float scaled{ u * static_cast<float>(n) };
+    int column{ std::min(static_cast<int>(scaled), n - 1) };
+    float fraction{ scaled - static_cast<float>(column) };
+    return fraction < m_thresholds[column] ? column : m_aliases[column];
+}
+
+// ----------------------------------------------------------------------------
+// VPL
+// ----------------------------------------------------------------------------
+
+struct LightPathNode
+{
+    Ray ray;
+    RayHit hit;
+    Vector3 ray_color;
+    Vector3 hit_color;
+    int emitter; // index of the emitter the particle was emitted from (see Emitters)
+};
+
+/*
+    Either a point light or a VPL
+*/
+struct VirtualLight
+{
+    Vector3 position;
+    Vector3 normal;
+    Vector3 color;
+    float intensity;
+    int bounce; // PRIMARY_LIGHT_BOUNCE for point lights
+    int emitter; // index of the emitter the light stands for (point lights) or the particle was emitted from (VPLs)
+};
+
+inline Vector3 CompensateVPLColor(int particles_count, float mean_reflectivity, int bounce, Vector3 color)
+{
+    /*
+        Keller corrects each VPL color multiplying it by N / floor(w), where
+        - N is the number of particles/rays we shot from the light source
+        - w = mean_reflectivity^bounce * N
+        here bounce is the number of bounces the ray had to do before hitting the point in which the VPL was spawned
+        Keller spaws N VPLs on the surface of the light source and considers them to be at bounce 0.
+        Then, mean_reflectivity * N rays are cast.
+        Their hit points are at bounce 1, and so on ...
+        In our implementation, we did not spawn N VPLs on the light source.
+        Instead, we simply shot N rays from it.
+        These N rays will hit something.
+        These hits are considered to be at bounce zero.
+    */
+    float num{ static_cast<float>(particles_count) };
+    float den{ static_cast<float>(std::floor(std::pow(mean_reflectivity, bounce) * particles_count)) };
+    Check(den != 0.0f);
+    float compensation{ num / den };
+    Vector3 compensated_color = compensation * color;
+    return compensated_color;
+}
+
+inline RayHit IntersectScene(const std::vector<Object>& objects, Ray ray, const Object** hit_obj)
+{
+    RayHit closest{}; // closest ray hit
+    const Object* closest_obj{}; // closest object hit
+
+    for (const Object& obj : objects) // test each object for ray intersection
+    {
+        RayHit hit{ obj.ray_intersect_fn(ray, obj.model, obj.normal) };
+        if (hit.valid) // there is an intersection point
+        {
+            // check if the current hit is closer than the closest hit recorded up until now
+            if (!closest.valid) // cloeset hit up until now is not valid
+            {
+                // current hit is closer
+                closest = hit;
+                closest_obj = &obj;
+            }
+            else // cloeset hit up until now is valid
+            {
+                // we need to compare the distance between both hits and the ray origin
+                Vector3 o_closest{ closest.position - ray.origin }; // from ray origin to closest hit position
+                Vector3 o_hit{ hit.position - ray.origin }; // from ray origin to current hit position
+                float d_o_closest{ o_closest.Dot(o_closest) }; // squared adistance between ray origin and closest hit 
+                float d_o_hit{ o_hit.Dot(o_hit) }; // squared adistance between ray origin and current hit 
+                if (d_o_hit < d_o_closest)
+                {
+                    // current hit is closer than closest hit
+                    closest = hit;
+                    closest_obj = &obj;
+                }
+            }
+        }
+    }
+
+    if (hit_obj) *hit_obj = closest_obj;
+    return closest;
+}
+
+/*
+    Light sources particles are emitted from: the point lights first (same indices as in the point lights vector), then the emissive quads.
+    Each emissive quad is described by the intensity of the point light with its same power:
+    a point light emits 4 PI * intensity, while a lambertian quad of area A and radiance L emits PI * A * L.
+*/
+struct Emitters
+{
+    std::vector<const Object*> quads; // emissive quads
+    std::vector<Vector3> colors; // per emitter color
+    std::vector<float> intensities; // per emitter intensity
+    AliasTable table; // emitters sampling distribution (proportional to their power)
+};
+
+inline void BuildEmitters(Emitters& emitters, const std::vector<PointLight>& point_lights, const std::vector<Object>& objects)
+{
+    emitters.quads.clear();
+    emitters.colors.clear();
+    emitters.intensities.clear();
+
+    for (const PointLight& point_light : point_lights)
+    {
+        emitters.colors.emplace_back(point_light.color);
+        emitters.intensities.emplace_back(point_light.intenisty);
+    }
+
+    for (const Object& obj : objects)
+    {
+        if (!IsEmissiveQuad(obj)) continue;
+
+        emitters.quads.emplace_back(&obj);
+        emitters.colors.emplace_back(obj.emissive_color);
+        emitters.intensities.emplace_back(QuadArea(obj) * obj.emissive_intensity / 4.0f);
+    }
+
+    // particles are distributed across the emitters proportionally to their power (area x radiance, for emissive quads)
+    std::vector<float> powers(emitters.colors.size());
+    for (std::size_t i{}; i < powers.size(); i++)
+    {
+        powers[i] = 4.0f * std::numbers::pi_v<float> * emitters.intensities[i] * Luminance(emitters.colors[i]);
+    }
+    emitters.table.Build(powers);
+}
+
+inline int EmissionDimensions(const std::vector<PointLight>& point_lights, int emitter)
+{
+    // number of uniform random numbers EmitParticle needs for the emitter
+    return emitter < static_cast<int>(point_lights.size()) ? 2 : 4;
+}
+
+inline Ray EmitParticle(const std::vector<PointLight>& point_lights, const Emitters& emitters, int emitter, const float* u)
+{
+    Ray ray{};
+    if (emitter < static_cast<int>(point_lights.size())) // point light: uniform direction
+    {
+        const PointLight& point_light{ point_lights[emitter] };
+
+        float theta{ 2.0f * static_cast<float>(std::numbers::pi) * u[0] }; // azimuthal angle (0 to 2π)
+        float z{ 2.0f * u[1] - 1.0f }; // z-coordinate (-1 to 1)
+        float r{ std::sqrt(1.0f - z * z) }; // radius at that z
+
+        float x{ r * std::cos(theta) };
+        float y{ r * std::sin(theta) };
+
+        ray.origin = point_light.position;
+        ray.direction = { x, y, z };
+    }
+    else // emissive quad: uniform position on its surface, cosine weighted direction around its normal
+    {
+        const Object& quad{ *emitters.quads[emitter - point_lights.size()] };
+
+        Vector3 local_position{ u[0] - 0.5f, u[1] - 0.5f, 0.0f };
+        Vector3 normal{ Vector3::TransformNormal({ 0.0f, 0.0f, 1.0f }, quad.normal) };
+        normal.Normalize();
+
+        ray.origin = Vector3::Transform(local_position, quad.model) + normal * EMISSION_RAY_OFFSET; // don't let the ray hit the quad itself
+        ray.direction = SampleCosineHemisphere(normal, u[2], u[3]);
+    }
+    return ray;
+}
+
+inline void ShootLightPaths(std::vector<std::vector<LightPathNode>>& light_paths, const std::vector<PointLight>& point_lights, const Emitters& emitters, int particles_count, int seed)
+{
+    light_paths.clear(); // forget the previous frame's light paths
+
+    // uniform distribution between [0, 1)
+    std::uniform_real_distribution<float> dis{ 0.0f, 1.0f };
+
+    // generate random ray direction from random positions on a unit sphere
+    std::mt19937 generator{ static_cast<unsigned>(seed) };
+
+    for (int i{}; i < particles_count; i++)
+    {
+        // pick the emitter of the particle (in constant time, regardless of the number of emitters)
+        int emitter{ emitters.table.Sample(dis(generator)) };
+
+        float u[4]{};
+        for (int k{}; k < EmissionDimensions(point_lights, emitter); k++)
+        {
+            u[k] = dis(generator);
+        }
+        Ray ray{ EmitParticle(point_lights, emitters, emitter, u) };
+
+        // generate new light path with randomly generated starting ray
+        std::vector<LightPathNode>& light_path{ light_paths.emplace_back() };
+        LightPathNode start{};
+        start.ray = ray;
+        start.ray_color = emitters.colors[emitter];
+        start.emitter = emitter;
+        light_path.emplace_back(start);
+    }
+}
+
+inline bool ExtendLightPath(std::vector<LightPathNode>& light_path, const std::vector<Object>& objects)
+{
+    // intersect the last ray of the light path with the scene and, when it hits something, append the reflected ray
+    Ray ray{ light_path.back().ray }; // starting ray
+    const Object* closest_obj{}; // closest object hit
+    RayHit closest{ IntersectScene(objects, ray, &closest_obj) }; // closest ray hit
+
+    if (closest.valid) // the ray hit something
+    {
+        // compute ray reflection
+        Vector3 reflection{ Vector3::Reflect(ray.direction, closest.normal) };
+        Ray reflected_ray{ closest.position, reflection };
+
+        // compute hit albedo attenuating the ray's color by the object's albedo divided by PI
+        Vector3 hit_color{ light_path.back().ray_color * (closest_obj->albedo / std::numbers::pi_v<float>) };
+
+        // record current ray hit into the light path
+        light_path.back().hit = closest;
+        light_path.back().hit_color = hit_color;
+
+        // append the next light path node given by the reflected direction vector
+        {
+            LightPathNode next{};
+            next.ray = reflected_ray;
+            next.ray_color = hit_color;
+            next.emitter = light_path.back().emitter;
+            light_path.emplace_back(next);
+        }
+    }
+
+    return closest.valid;
+}
+
+inline void TraceLightPaths(std::vector<std::vector<LightPathNode>>& light_paths, const std::vector<Object>& objects, int particles_count, float mean_reflectivity)
+{
+    for (int i{}; i < static_cast<int>(light_paths.size()); i++)
+    {
+        std::vector<LightPathNode>& light_path{ light_paths[i] }; // light path we are building
+
+        int bounce{}; // counter for the number of ray bounces
+        bool last_ray_hit_something{ true };
+
+        /*
+            This while loop deals with ray bounce logic.
+            Keller tells us that:
+            - the first mean_reflectivity^1 * N rays bounce at least once.
+            - the first mean_reflectivity^2 * N rays bounce at least twice.
+            - the first mean_reflectivity^3 * N rays bounce at least trice.
+            - ...
+            - the first mean_reflectivity^j * N rays bounce at least j times.
+            - and so on ...
+        */
+        while (i < static_cast<int>(std::pow(mean_reflectivity, bounce) * particles_count) && last_ray_hit_something)
+        {
+            last_ray_hit_something = ExtendLightPath(light_path, objects);
+
+            bounce++; // go to the next bounce
+        }
+    }
+}
+
+inline void SpawnVirtualLights(
+    std::vector<VirtualLight>& virtual_lights, const std::vector<std::vector<LightPathNode>>& light_paths,
+    const std::vector<PointLight>& point_lights, const Emitters& emitters, int particles_count, float mean_reflectivity,
+    const std::vector<float>& path_weights // empty for Keller's light paths, one weight per light path for Metropolis light paths
+)
+{
+    virtual_lights.clear(); // forget about previous frame virtual lights
+
+    // point lights are treated as virtual lights (and take the first point_lights.size() indices)
+    for (int i{}; i < static_cast<int>(point_lights.size()); i++)
+    {
+        VirtualLight light{};
+        light.position = point_lights[i].position;
+        light.color = point_lights[i].color;
+        light.intensity = point_lights[i].intenisty;
+        light.bounce = PRIMARY_LIGHT_BOUNCE;
+        light.emitter = i;
+        virtual_lights.emplace_back(light);
+    }
+
+    // spawn VPLs at light paths hits
+    for (int i{}; i < static_cast<int>(light_paths.size()); i++)
+    {
+        const std::vector<LightPathNode>& light_path{ light_paths[i] };
+        for (int j{}; j < static_cast<int>(light_path.size()); j++)
+        {
+            const LightPathNode& node{ light_path[j] };
+
+            // if we hit something, we spawn a VPL
+            if (node.hit.valid)
+            {
+                VirtualLight vpl{};
+                vpl.position = node.hit.position;
+                vpl.normal = node.hit.normal;
+                if (path_weights.empty())
+                {
+                    vpl.color = CompensateVPLColor(particles_count, mean_reflectivity, j, node.hit_color);
+                }
+                else // Metropolis light paths bounce with probability mean_reflectivity (russian roulette) and carry their own weight
+                {
+                    vpl.color = node.hit_color * (path_weights[i] / std::pow(mean_reflectivity, static_cast<float>(j)));
+                }
+                vpl.intensity = emitters.intensities[node.emitter] / emitters.table.Probability(node.emitter); // the emitter was picked with that probability
+                vpl.bounce = j;
+                vpl.emitter = node.emitter;
+                virtual_lights.emplace_back(vpl);
+            }
+        }
+    }
+}
+
+inline void ApplyVPLBudget(std::vector<VirtualLight>& virtual_lights, int point_lights_count, int vpl_budget)
+{
+    /*
+        Keep at most vpl_budget VPLs, picking them with a uniform stride over the spawned ones.
+        Each kept VPL stands for stride spawned VPLs, so its color is scaled by the stride to preserve the total VPL energy.
+        The point lights are always kept (and keep their indices).
+    */
+    int vpl_count{ static_cast<int>(virtual_lights.size()) - point_lights_count };
+    if (vpl_count <= vpl_budget) return;
+
+    Check(vpl_budget > 0);
+    float stride{ static_cast<float>(vpl_count) / static_cast<float>(vpl_budget) };
+
+    std::vector<VirtualLight> kept{};
+    kept.reserve(point_lights_count + vpl_budget);
+    kept.insert(kept.end(), virtual_lights.begin(), virtual_lights.begin() + point_lights_count);
+    for (int i{}; i < vpl_budget; i++)
+    {
+        int spawned_idx{ point_lights_count + static_cast<int>(static_cast<float>(i) * stride) };
+        VirtualLight vpl{ virtual_lights[spawned_idx] };
+        vpl.color *= stride;
+        kept.emplace_back(vpl);
+    }
+
+    virtual_lights = std::move(kept);
+}
+
+inline void ResampleVPLs(std::vector<VirtualLight>& virtual_lights, int point_lights_count, int vpl_budget, double offset)
+{
+    /*
+        Draw vpl_budget VPLs from the spawned ones, with probability proportional to their power (systematic resampling).
+        The cumulative power is split into vpl_budget equal strata and a single offset (in [0;1) stratum) picks one VPL in each of them,
+        so a VPL of power w is picked on average vpl_budget * w / W times (W is the total power).
+        Each pick stands for W / (vpl_budget * w) of the VPL, which keeps the estimate unbiased and gives all the kept VPLs the same power.
+        A VPL picked more than once is kept once, with its weight multiplied by the number of picks: at most vpl_budget VPLs are kept.
+        Black VPLs are never picked, not even the ones after the last lit VPL a pick rounded past the total power would land on.
+        The point lights are always kept (and keep their indices).
+    */
+    int vpl_count{ static_cast<int>(virtual_lights.size()) - point_lights_count };
+    if (vpl_count <= vpl_budget) return;
+
+    Check(vpl_budget > 0);
+
+    // cumulative power of the VPLs (in double, to stay accurate over millions of VPLs)
+    std::vector<double> cumulative_power(vpl_count);
+    double total_power{};
+    int last_lit_idx{};
+    for (int i{}; i < vpl_count; i++)
+    {
+        const VirtualLight& vpl{ virtual_lights[point_lights_count + i] };
+        double power{ static_cast<double>(vpl.intensity * Luminance(vpl.color)) };
+        total_power += power;
+        cumulative_power[i] = total_power;
+        if (power > 0.0) last_lit_idx = i;
+    }
+
+    std::vector<VirtualLight> kept{};
+    kept.reserve(point_lights_count + vpl_budget);
+    kept.insert(kept.end(), virtual_lights.begin(), virtual_lights.begin() + point_lights_count);
+
+    if (total_power > 0.0)
+    {
+        double stratum_power{ total_power / static_cast<double>(vpl_budget) };
+
+        std::vector<int> picks{};
+        picks.reserve(vpl_budget);
+        int last_picked_idx{ -1 };
+        int idx{};
+        for (int i{}; i < vpl_budget; i++)
+        {
+            double target{ (offset + static_cast<double>(i)) * stratum_power };
+            while (idx < last_lit_idx && cumulative_power[idx] <= target)
+            {
+                idx++;
+            }
+
+            if (idx == last_picked_idx)
+            {
+                picks.back()++;
+            }
+            else
+            {
+                kept.emplace_back(virtual_lights[point_lights_count + idx]);
+                picks.emplace_back(1);
+                last_picked_idx = idx;
+            }
+        }
+
+        for (int i{}; i < static_cast<int>(picks.size()); i++)
+        {
+            VirtualLight& vpl{ kept[point_lights_count + i] };
+            double power{ static_cast<double>(vpl.intensity * Luminance(vpl.color)) };
+            vpl.color *= static_cast<float>(static_cast<double>(picks[i]) * stratum_power / power);
+        }
+    }
+    // else all the VPLs are black and none of them is worth rendering
+
+    virtual_lights = std::move(kept);
+}
+
+inline void ResampleVPLs(std::vector<VirtualLight>& virtual_lights, int point_lights_count, int vpl_budget, int seed)
+{
+    // systematic resampling with a random offset
+    std::uniform_real_distribution<double> dis{ 0.0, 1.0 };
+    std::mt19937 generator{ static_cast<unsigned>(seed) };
+    ResampleVPLs(virtual_lights, point_lights_count, vpl_budget, dis(generator));
+}
+
+// ----------------------------------------------------------------------------
+// Memory Mapped File
+// ----------------------------------------------------------------------------
+
+class MappedFile
+{
+public:
+    static MappedFile Create(const std::string& path, std::size_t size); // creates (or overwrites) a file of the given size, mapped for writing
+    static MappedFile Open(const std::string& path); // maps an existing file for reading, returns an empty MappedFile if there is none
+public:
+    MappedFile() = default;
+    ~MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile(MappedFile&&) noexcept = default;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile& operator=(MappedFile&&) noexcept = default;
+public:
+    std::byte* Data() const noexcept { return static_cast<std::byte*>(m_view.get()); }
+    std::size_t Size() const noexcept { return m_size; }
+private:
+#if defined(_WIN32)
+    MappedFile(HANDLE file, DWORD protection, DWORD access, std::size_t size);
+#else
+    MappedFile(int file, int protection, std::size_t size);
+#endif
+private:
+#if defined(_WIN32)
+    struct HandleCloser { void operator()(HANDLE handle) const noexcept { CloseHandle(handle); } };
+    struct ViewUnmapper { void operator()(void* view) const noexcept { UnmapViewOfFile(view); } };
+    std::unique_ptr<void, HandleCloser> m_file; // members are destroyed in reverse order: the view is unmapped first
+    std::unique_ptr<void, HandleCloser> m_mapping;
+#else
+    struct ViewUnmapper { std::size_t size; void operator()(void* view) const noexcept { munmap(view, size); } };
+#endif
+    std::unique_ptr<void, ViewUnmapper> m_view;
+    std::size_t m_size{};
+};
+
+#if defined(_WIN32)
+
+inline MappedFile MappedFile::Create(const std::string& path, std::size_t size)
+{
+    Check(size > 0);
+    HANDLE file{ CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr) };
+    Check(file != INVALID_HANDLE_VALUE);
+    return { file, PAGE_READWRITE, FILE_MAP_WRITE, size };
+}
+
+inline MappedFile MappedFile::Open(const std::string& path)
+{
+    HANDLE file{ CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr) };
+    if (file == INVALID_HANDLE_VALUE) return {};
+
+    LARGE_INTEGER size{};
+    if (!GetFileSizeEx(file, &size) || size.QuadPart <= 0) // empty files can't be mapped
+    {
+        CloseHandle(file);
+        return {};
+    }
+
+    return { file, PAGE_READONLY, FILE_MAP_READ, static_cast<std::size_t>(size.QuadPart) };
+}
+
+inline MappedFile::MappedFile(HANDLE file, DWORD protection, DWORD access, std::size_t size)
+    : m_file{ file }
+    , m_mapping{}
+    , m_view{}
+    , m_size{ size }
+{
+    LARGE_INTEGER max_size{};
+    max_size.QuadPart = static_cast<LONGLONG>(size);
+
+    HANDLE mapping{ CreateFileMappingA(file, nullptr, protection, static_cast<DWORD>(max_size.HighPart), max_size.LowPart, nullptr) };
+    Check(mapping);
+    m_mapping.reset(mapping);
+
+    void* view{ MapViewOfFile(mapping, access, 0, 0, size) };
+    Check(view);
+    m_view.reset(view);
+}
+
+#else
+
+inline MappedFile MappedFile::Create(const std::string& path, std::size_t size)
+{
+    Check(size > 0);
+    int file{ open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644) };
+    Check(file >= 0);
+    if (ftruncate(file, static_cast<off_t>(size)) != 0) // the mapping can't grow the file
+    {
+        close(file);
+        Crash(std::format("can't resize '{}' to {} bytes", path, size));
+    }
+    return { file, PROT_READ | PROT_WRITE, size };
+}
+
+inline MappedFile MappedFile::Open(const std::string& path)
+{
+    int file{ open(path.c_str(), O_RDONLY) };
+    if (file < 0) return {};
+
+    struct stat status{};
+    if (fstat(file, &status) != 0 || status.st_size <= 0) // empty files can't be mapped
+    {
+        close(file);
+        return {};
+    }
+
+    return { file, PROT_READ, static_cast<std::size_t>(status.st_size) };
+}
+
+inline MappedFile::MappedFile(int file, int protection, std::size_t size)
+    : m_view{ nullptr, ViewUnmapper{ size } }
+    , m_size{ size }
+{
+    // the mapping keeps a reference to the file, the descriptor can be closed right away
+    void* view{ mmap(nullptr, size, protection, MAP_SHARED, file, 0) };
+    close(file);
+    Check(view != MAP_FAILED);
+    m_view.reset(view);
+}
+
+#endif
+
+// ----------------------------------------------------------------------------
+// VPL Bake
+// ----------------------------------------------------------------------------
+
+/*
+    Offline bake of the VPLs spawned by one point light, for each position of a 3D lattice spanning the scene bounds.
+    At runtime the VPL set is taken from the lattice point nearest to the point light (or blended from the 8 surrounding ones)
+    without simulating any particle.
+    The file is memory mapped (MappedFile), with the Win32 file mappings or mmap.
+
+    File layout (memory mapped):
+    - VPLBakeHeader
+    - lattice_size^3 + 1 std::uint32_t offsets: index of the first record of each lattice point (the last one is the record count)
+    - the BakedVPL records of each lattice point, one after the other
+    Lattice points are laid out x first, then y, then z.
+*/
+
+struct VPLBakeHeader
+{
+    std::uint32_t magic;
+    std::uint32_t version;
+    std::uint64_t inputs_hash; // see HashVPLInputs
+    std::int32_t lattice_size; // lattice points per axis
+    std::int32_t point_light; // index of the baked point light
+    float bounds_min[3];
+    float bounds_max[3];
+    std::int32_t particles_count;
+    std::int32_t _pad;
+};
+static_assert(sizeof(VPLBakeHeader) == 56);
+
+struct BakedVPL
+{
+    float position[3];
+    std::int16_t normal[2]; // octahedral encoding
+    float color[3]; // color * intensity
+    std::int16_t bounce;
+    std::int16_t emitter;
+};
+static_assert(sizeof(BakedVPL) == 32);
+
+inline void EncodeOctahedralNormal(Vector3 n, std::int16_t encoded[2])
+{
+    // project on the octahedron |x| + |y| + |z| = 1, then fold the lower hemisphere over the upper one
+    n /= std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+    float x{ n.x };
+    float y{ n.y };
+    if (n.z < 0.0f)
+    {
+        x = (1.0f - std::abs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f);
+        y = (1.0f - std::abs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f);
+    }
+    encoded[0] = static_cast<std::int16_t>(std::round(std::clamp(x, -1.0f, 1.0f) * 32767.0f));
+    encoded[1] = static_cast<std::int16_t>(std::round(std::clamp(y, -1.0f, 1.0f) * 32767.0f));
+}
+
+inline Vector3 DecodeOctahedralNormal(const std::int16_t encoded[2])
+{
+    float x{ static_cast<float>(encoded[0]) / 32767.0f };
+    float y{ static_cast<float>(encoded[1]) / 32767.0f };
+    Vector3 n{ x, y, 1.0f - std::abs(x) - std::abs(y) };
+    if (n.z < 0.0f)
+    {
+        n.x = (1.0f - std::abs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+        n.y = (1.0f - std::abs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+    }
+    n.Normalize();
+    return n;
+}
+
+inline std::size_t HashVPLInputs(
+    const std::vector<PointLight>& point_lights, int excluded_point_light, const std::vector<Object>& objects,
+    int particles_count, float mean_reflectivity, int seed
+)
+{
+    // hash of everything the VPLs depend on, except the position of excluded_point_light (the baked one, -1 for none)
+    std::size_t hash{};
+
+    for (int i{}; i < static_cast<int>(point_lights.size()); i++)
+    {
+        if (i != excluded_point_light)
+        {
+            HashCombine(hash, point_lights[i].position);
+        }
+        HashCombine(hash, point_lights[i].color);
+        HashCombine(hash, point_lights[i].intenisty);
+    }
+
+    for (const Object& obj : objects)
+    {
+        HashCombine(hash, obj.position);
+        HashCombine(hash, obj.rotation);
+        HashCombine(hash, obj.scaling);
+        HashCombine(hash, obj.albedo);
+        HashCombine(hash, obj.emissive_color);
+        HashCombine(hash, obj.emissive_intensity);
+    }
+
+    HashCombine(hash, excluded_point_light);
+    HashCombine(hash, particles_count);
+    HashCombine(hash, mean_reflectivity);
+    HashCombine(hash, seed);
+
+    return hash;
+}
+
+inline Vector3 VPLBakeLatticePosition(const VPLBakeHeader& header, int x, int y, int z)
+{
+    // lattice points are at the centers of the cells of a lattice_size^3 grid over the scene bounds
+    Vector3 bounds_min{ header.bounds_min[0], header.bounds_min[1], header.bounds_min[2] };
+    Vector3 bounds_max{ header.bounds_max[0], header.bounds_max[1], header.bounds_max[2] };
+    Vector3 t{ static_cast<float>(x) + 0.5f, static_cast<float>(y) + 0.5f, static_cast<float>(z) + 0.5f };
+    return bounds_min + (bounds_max - bounds_min) * t / static_cast<float>(header.lattice_size);
+}
+
+inline void BakeVPLs(
+    const std::string& path, const std::vector<PointLight>& point_lights, int baked_point_light, const std::vector<Object>& objects,
+    int lattice_size, int particles_count, float mean_reflectivity, int seed
+)
+{
+    /*
+        Each lattice point runs the regular particle simulation (in parallel) with the baked point light moved there.
+        All lattice points share the same seed, so the VPL sets of neighbouring lattice points stay coherent.
+    */
+    VPLBakeHeader header{};
+    header.magic = VPL_BAKE_MAGIC;
+    header.version = VPL_BAKE_VERSION;
+    header.inputs_hash = HashVPLInputs(point_lights, baked_point_light, objects, particles_count, mean_reflectivity, seed);
+    header.lattice_size = lattice_size;
+    header.point_light = baked_point_light;
+    header.particles_count = particles_count;
+    {
+        Vector3 bounds_min{};
+        Vector3 bounds_max{};
+        ComputeSceneBounds(objects, bounds_min, bounds_max);
+        header.bounds_min[0] = bounds_min.x; header.bounds_min[1] = bounds_min.y; header.bounds_min[2] = bounds_min.z;
+        header.bounds_max[0] = bounds_max.x; header.bounds_max[1] = bounds_max.y; header.bounds_max[2] = bounds_max.z;
+    }
+
+    const int point_lights_count{ static_cast<int>(point_lights.size()) };
+    const int lattice_count{ lattice_size * lattice_size * lattice_size };
+
+    // simulate
+    std::vector<std::vector<VirtualLight>> vpl_sets(lattice_count);
+    ParallelFor(lattice_count, [&](int i)
+    {
+        std::vector<PointLight> lattice_point_lights{ point_lights };
+        lattice_point_lights[baked_point_light].position = VPLBakeLatticePosition(header, i % lattice_size, (i / lattice_size) % lattice_size, i / (lattice_size * lattice_size));
+
+        Emitters emitters{};
+        BuildEmitters(emitters, lattice_point_lights, objects);
+
+        std::vector<std::vector<LightPathNode>> light_paths{};
+        ShootLightPaths(light_paths, lattice_point_lights, emitters, particles_count, seed);
+        TraceLightPaths(light_paths, objects, particles_count, mean_reflectivity);
+        SpawnVirtualLights(vpl_sets[i], light_paths, lattice_point_lights, emitters, particles_count, mean_reflectivity, {});
+        vpl_sets[i].erase(vpl_sets[i].begin(), vpl_sets[i].begin() + point_lights_count); // point lights are not baked
+    });
+
+    std::vector<std::uint32_t> offsets(lattice_count + 1);
+    for (int i{}; i < lattice_count; i++)
+    {
+        offsets[i + 1] = offsets[i] + static_cast<std::uint32_t>(vpl_sets[i].size());
+    }
+
+    // write
+    std::size_t offsets_size{ offsets.size() * sizeof(std::uint32_t) };
+    std::size_t records_size{ static_cast<std::size_t>(offsets.back()) * sizeof(BakedVPL) };
+    MappedFile file{ MappedFile::Create(path, sizeof(VPLBakeHeader) + offsets_size + records_size) };
+
+    std::memcpy(file.Data(), &header, sizeof(VPLBakeHeader));
+    std::memcpy(file.Data() + sizeof(VPLBakeHeader), offsets.data(), offsets_size);
+
+    auto records{ reinterpret_cast<BakedVPL*>(file.Data() + sizeof(VPLBakeHeader) + offsets_size) };
+    ParallelFor(lattice_count, [&](int i)
+    {
+        for (std::size_t j{}; j < vpl_sets[i].size(); j++)
+        {
+            const VirtualLight& vpl{ vpl_sets[i][j] };
+            Vector3 color{ vpl.color * vpl.intensity };
+
+            BakedVPL& record{ records[offsets[i] + j] };
+            record.position[0] = vpl.position.x; record.position[1] = vpl.position.y; record.position[2] = vpl.position.z;
+            EncodeOctahedralNormal(vpl.normal, record.normal);
+            record.color[0] = color.x; record.color[1] = color.y; record.color[2] = color.z;
+            record.bounce = static_cast<std::int16_t>(vpl.bounce);
+            record.emitter = static_cast<std::int16_t>(vpl.emitter);
+        }
+    });
+
+    std::println("baked {} VPLs over a {}^3 lattice ({})", offsets.back(), lattice_size, GetBytesStr(file.Size()));
+}
+
+class VPLBake
+{
+public:
+    VPLBake() = default;
+    ~VPLBake() = default;
+    VPLBake(const VPLBake&) = delete;
+    VPLBake(VPLBake&&) noexcept = default;
+    VPLBake& operator=(const VPLBake&) = delete;
+    VPLBake& operator=(VPLBake&&) noexcept = default;
+public:
+    bool Load(const std::string& path); // false when the file is missing or not a valid bake
+    void Unload();
+    bool IsLoaded() const noexcept { return m_header != nullptr; }
+    const VPLBakeHeader& Header() const noexcept { return *m_header; }
+    int VPLCount() const noexcept { return static_cast<int>(m_offsets[LatticeCount()]); }
+    // appends the VPLs for the point light position, a blended lookup appends at most vpl_budget of them (drawn with budget_sampling)
+    void Lookup(std::vector<VirtualLight>& virtual_lights, Vector3 position, int lookup, int vpl_budget, int budget_sampling, int seed) const;
+private:
+    int LatticeCount() const noexcept { return m_header->lattice_size * m_header->lattice_size * m_header->lattice_size; }
+    int LatticePointVPLCount(int x, int y, int z) const noexcept;
+    void AppendLatticePoint(std::vector<VirtualLight>& virtual_lights, int x, int y, int z, float weight) const;
+private:
+    MappedFile m_file;
+    const VPLBakeHeader* m_header{};
+    const std::uint32_t* m_offsets{};
+    const BakedVPL* m_records{};
+};
+
+inline bool VPLBake::Load(const std::string& path)
+{
+    Unload();
+
+    MappedFile file{ MappedFile::Open(path) };
+    if (file.Size() < sizeof(VPLBakeHeader)) return false;
+
+    auto header{ reinterpret_cast<const VPLBakeHeader*>(file.Data()) };
+    if (header->magic != VPL_BAKE_MAGIC || header->version != VPL_BAKE_VERSION || header->lattice_size <= 0) return false;
+
+    std::size_t lattice_count{ static_cast<std::size_t>(header->lattice_size) * header->lattice_size * header->lattice_size };
+    std::size_t offsets_size{ (lattice_count + 1) * sizeof(std::uint32_t) };
+    if (file.Size() < sizeof(VPLBakeHeader) + offsets_size) return false;
+
+    auto offsets{ reinterpret_cast<const std::uint32_t*>(file.Data() + sizeof(VPLBakeHeader)) };
+    if (file.Size() != sizeof(VPLBakeHeader) + offsets_size + static_cast<std::size_t>(offsets[lattice_count]) * sizeof(BakedVPL)) return false;
+
+    m_header = header;
+    m_offsets = offsets;
+    m_records = reinterpret_cast<const BakedVPL*>(file.Data() + sizeof(VPLBakeHeader) + offsets_size);
+    m_file = std::move(file);
+    return true;
+}
+
+inline void VPLBake::Unload()
+{
+    m_header = nullptr;
+    m_offsets = nullptr;
+    m_records = nullptr;
+    m_file = {};
+}
+
+inline void VPLBake::Lookup(std::vector<VirtualLight>& virtual_lights, Vector3 position, int lookup, int vpl_budget, int budget_sampling, int seed) const
+{
+    // continuous lattice coordinates of the position (lattice points sit at integer coordinates)
+    const int n{ m_header->lattice_size };
+    const float p[3]{ position.x, position.y, position.z };
+    float g[3]{};
+    for (int axis{}; axis < 3; axis++)
+    {
+        float extent{ m_header->bounds_max[axis] - m_header->bounds_min[axis] };
+        float t{ extent > 0.0f ? (p[axis] - m_header->bounds_min[axis]) / extent : 0.5f };
+        g[axis] = std::clamp(t * static_cast<float>(n) - 0.5f, 0.0f, static_cast<float>(n - 1));
+    }
+
+    if (lookup == VPL_BAKE_LOOKUP_NEAREST || n == 1)
+    {
+        AppendLatticePoint(virtual_lights, static_cast<int>(std::round(g[0])), static_cast<int>(std::round(g[1])), static_cast<int>(std::round(g[2])), 1.0f);
+        return;
+    }
+
+    /*
+        Blend the VPL sets of the 8 surrounding lattice points, each one weighted by its trilinear weight.
+        Appending the 8 sets whole would render up to 8 times the VPLs of a nearest lookup, so the blend is capped to the trilinear
+        average of the set sizes (and to vpl_budget): each corner gets a share of the cap proportional to its weight and its set is
+        reduced to that share with the budget sampling, each kept VPL standing for the dropped ones. The corners whose share rounds
+        to zero are left out and the weights of the others renormalized.
+    */
+    int i0[3]{};
+    float t[3]{};
+    for (int axis{}; axis < 3; axis++)
+    {
+        i0[axis] = std::min(static_cast<int>(g[axis]), n - 2);
+        t[axis] = g[axis] - static_cast<float>(i0[axis]);
+    }
+
+    float weights[8]{};
+    float blended_count{};
+    for (int corner{}; corner < 8; corner++)
+    {
+        int dx{ corner & 1 };
+        int dy{ (corner >> 1) & 1 };
+        int dz{ (corner >> 2) & 1 };
+        weights[corner] = (dx ? t[0] : 1.0f - t[0]) * (dy ? t[1] : 1.0f - t[1]) * (dz ? t[2] : 1.0f - t[2]);
+        blended_count += weights[corner] * static_cast<float>(LatticePointVPLCount(i0[0] + dx, i0[1] + dy, i0[2] + dz));
+    }
+    const int cap{ std::min(vpl_budget, static_cast<int>(std::lround(blended_count))) };
+
+    // shares of the cap from the cumulative weights, so that they sum to the cap
+    int shares[8]{};
+    float kept_weight{};
+    float cumulative_weight{};
+    int assigned{};
+    for (int corner{}; corner < 8; corner++)
+    {
+        cumulative_weight += weights[corner];
+        int cumulative_share{ corner == 7 ? cap : std::min(static_cast<int>(cumulative_weight * static_cast<float>(cap)), cap) };
+        shares[corner] = weights[corner] > 0.0f ? cumulative_share - assigned : 0;
+        assigned += shares[corner];
+        if (shares[corner] > 0) kept_weight += weights[corner];
+    }
+
+    std::vector<VirtualLight> corner_lights{};
+    for (int corner{}; corner < 8; corner++)
+    {
+        if (shares[corner] <= 0) continue;
+        int dx{ corner & 1 };
+        int dy{ (corner >> 1) & 1 };
+        int dz{ (corner >> 2) & 1 };
+        corner_lights.clear();
+        AppendLatticePoint(corner_lights, i0[0] + dx, i0[1] + dy, i0[2] + dz, weights[corner] / kept_weight);
+        if (budget_sampling == VPL_BUDGET_SAMPLING_POWER)
+        {
+            ResampleVPLs(corner_lights, 0, shares[corner], seed + corner);
+        }
+        else
+        {
+            ApplyVPLBudget(corner_lights, 0, shares[corner]);
+        }
+        virtual_lights.insert(virtual_lights.end(), corner_lights.begin(), corner_lights.end());
+    }
+}
+
+inline int VPLBake::LatticePointVPLCount(int x, int y, int z) const noexcept
+{
+    const int n{ m_header->lattice_size };
+    const int i{ x + n * (y + n * z) };
+    return static_cast<int>(m_offsets[i + 1] - m_offsets[i]);
+}
+
+inline void VPLBake::AppendLatticePoint(std::vector<VirtualLight>& virtual_lights, int x, int y, int z, float weight) const
+{
+    const int n{ m_header->lattice_size };
+    const int i{ x + n * (y + n * z) };
+    for (std::uint32_t j{ m_offsets[i] }; j < m_offsets[i + 1]; j++)
+    {
+        const BakedVPL& record{ m_records[j] };
+
+        VirtualLight vpl{};
+        vpl.position = { record.position[0], record.position[1], record.position[2] };
+        vpl.normal = DecodeOctahedralNormal(record.normal);
+        vpl.color = Vector3{ record.color[0], record.color[1], record.color[2] } * weight;
+        vpl.intensity = 1.0f; // baked in the color
+        vpl.bounce = record.bounce;
+        vpl.emitter = record.emitter;
+        virtual_lights.emplace_back(vpl);
+    }
+}
+
+// ----------------------------------------------------------------------------
+// Metropolis Instant Radiosity
+// ----------------------------------------------------------------------------
+
+/*
+    Metropolis instant radiosity (Segovia et al., "Metropolis Instant Radiosity", 2007).
+    Light paths are generated by Markov chains in primary sample space (Kelemen et al., "A Simple and Robust Mutation Strategy
+    for the Metropolis Light Transport Algorithm", 2002), with a stationary distribution proportional to the importance of each
+    light path: the contribution of its VPLs to a grid of points seen by the camera, shadow rays included.
+    When light reaches the visible region through a narrow opening, the chains stay on the few light paths that make it
+    through, instead of wasting particles on VPLs the camera can't see.
+    Each light path of the chains is weighted by b / f, where f is its importance and b is the mean importance
+    (estimated with independent light paths), which keeps the estimate unbiased.
+*/
+
+using PathSample = std::array<float, MIR_PATH_DIMENSIONS>; // point in primary sample space, each coordinate in [0;1)
+
+struct CameraSample
+{
+    Vector3 position;
+    Vector3 normal;
+    Vector3 albedo;
+};
+
+struct MetropolisStats
+{
+    float normalization; // mean importance of the light paths (b)
+    float acceptance_rate;
+};
+
+inline Ray CameraRay(const Matrix& inverse_view_projection, Vector3 eye, float ndc_x, float ndc_y)
+{
+    // ray from the eye through the point of the far plane at the given NDC coordinates
+    Vector3 far_position{ Vector3::Transform({ ndc_x, ndc_y, 1.0f }, inverse_view_projection) };
+
+    Vector3 direction{ far_position - eye };
+    direction.Normalize();
+
+    return { eye, direction };
+}
+
+inline void BuildCameraSamples(std::vector<CameraSample>& samples, const Camera& camera, float aspect, const std::vector<Object>& objects, int samples_w, int samples_h)
+{
+    // cast a ray through the center of each cell of a samples_w x samples_h grid over the view, keeping the points it hits
+    samples.clear();
+
+    Matrix inverse_view_projection{ CameraViewProjection(camera, aspect).Invert() };
+
+    for (int y{}; y < samples_h; y++)
+    {
+        for (int x{}; x < samples_w; x++)
+        {
+            float ndc_x{ 2.0f * (static_cast<float>(x) + 0.5f) / static_cast<float>(samples_w) - 1.0f };
+            float ndc_y{ 1.0f - 2.0f * (static_cast<float>(y) + 0.5f) / static_cast<float>(samples_h) };
+
+            const Object* hit_obj{};
+            RayHit hit{ IntersectScene(objects, CameraRay(inverse_view_projection, camera.eye, ndc_x, ndc_y), &hit_obj) };
+            if (!hit.valid) continue;
+
+            samples.emplace_back(CameraSample{ hit.position, hit.normal, hit_obj->albedo });
+        }
+    }
+}
+
+template <int LightType>
+inline Vector3 ShadeDiffuseKernel(Vector3 position, Vector3 normal, Vector3 albedo, const VirtualLight& light)
+{
+    // same shading math as PSLit.hlsl (without the 1 / particles_count weight), the light type is resolved at compile time
+    Vector3 to_light{ light.position - position };
+    float distance{ to_light.Length() };
+    if (distance <= 2.0f * SHADOW_RAY_OFFSET) return {};
+
+    Vector3 L{ to_light / distance };
+    float n_dot_l{ std::max(normal.Dot(L), 0.0f) };
+
+    float light_weight{ 1.0f };
+    if constexpr (LightType == LIGHT_TYPE_COS_WEIGHTED)
+    {
+        light_weight = std::max(light.normal.Dot(-L), 0.0f);
+    }
+    else if constexpr (LightType == LIGHT_TYPE_SIGN_COS_WEIGHTED)
+    {
+        light_weight = light.normal.Dot(-L) > 0.0f ? 1.0f : 0.0f;
+    }
+
+    return albedo / std::numbers::pi_v<float> * light.color * light.intensity * light_weight * n_dot_l;
+}
+
+inline Vector3 ShadeDiffuse(Vector3 position, Vector3 normal, Vector3 albedo, const VirtualLight& light, int light_type)
+{
+    // generic kernel, branching on the light type at every call
+    switch (light_type)
+    {
+    case LIGHT_TYPE_COS_WEIGHTED:
+        return ShadeDiffuseKernel<LIGHT_TYPE_COS_WEIGHTED>(position, normal, albedo, light);
+    case LIGHT_TYPE_SIGN_COS_WEIGHTED:
+        return ShadeDiffuseKernel<LIGHT_TYPE_SIGN_COS_WEIGHTED>(position, normal, albedo, light);
+    default:
+        return ShadeDiffuseKernel<LIGHT_TYPE_POINT>(position, normal, albedo, light);
+    }
+}
+
+inline bool Visible(const std::vector<Object>& objects, Vector3 position, Vector3 normal, Vector3 light_position)
+{
+    // the light is occluded when the shadow ray hits something before reaching it
+    Vector3 to_light{ light_position - position };
+    float distance{ to_light.Length() };
+
+    Ray ray{ position + normal * SHADOW_RAY_OFFSET, to_light / distance };
+    RayHit hit{ IntersectScene(objects, ray, nullptr) };
+    if (!hit.valid) return true;
+
+    float reach{ distance - 2.0f * SHADOW_RAY_OFFSET };
+    return (hit.position - ray.origin).LengthSquared() >= reach * reach;
+}
+
+inline Vector3 ShadeCameraSample(const CameraSample& sample, const VirtualLight& light, int light_type, const std::vector<Object>& objects)
+{
+    // PSLit.hlsl shading, plus a shadow ray
+    Vector3 color{ ShadeDiffuse(sample.position, sample.normal, sample.albedo, light, light_type) };
+    if (Luminance(color) <= 0.0f) return {};
+
+    return Visible(objects, sample.position, sample.normal, light.position) ? color : Vector3{};
+}
+
+inline void TraceMetropolisLightPath(
+    std::vector<LightPathNode>& light_path, const PathSample& sample,
+    const std::vector<PointLight>& point_lights, const Emitters& emitters, const std::vector<Object>& objects, float mean_reflectivity
+)
+{
+    // the light path is a deterministic function of the primary sample space point
+    light_path.clear();
+
+    int emitter{ emitters.table.Sample(sample[0]) };
+
+    LightPathNode start{};
+    start.ray = EmitParticle(point_lights, emitters, emitter, &sample[1]);
+    start.ray_color = emitters.colors[emitter];
+    start.emitter = emitter;
+    light_path.emplace_back(start);
+
+    for (int bounce{}; bounce < MIR_MAX_BOUNCES; bounce++)
+    {
+        if (!ExtendLightPath(light_path, objects)) break;
+
+        // russian roulette: bounce again with probability mean_reflectivity (the same expected bounces as Keller's light paths)
+        if (sample[MIR_EMISSION_DIMENSIONS + bounce] >= mean_reflectivity) break;
+    }
+}
+
+inline VirtualLight LightPathVPL(const LightPathNode& node, int bounce, const Emitters& emitters, float mean_reflectivity)
+{
+    // VPL spawned at the hit of a light path node, for light paths that bounce with probability mean_reflectivity (russian roulette)
+    VirtualLight vpl{};
+    vpl.position = node.hit.position;
+    vpl.normal = node.hit.normal;
+    vpl.color = node.hit_color / std::pow(mean_reflectivity, static_cast<float>(bounce));
+    vpl.intensity = emitters.intensities[node.emitter] / emitters.table.Probability(node.emitter);
+    vpl.bounce = bounce;
+    vpl.emitter = node.emitter;
+    return vpl;
+}
+
+inline float LightPathImportance(
+    const std::vector<LightPathNode>& light_path, const Emitters& emitters, float mean_reflectivity, int vpl_type,
+    const std::vector<CameraSample>& camera_samples, const std::vector<Object>& objects
+)
+{
+    // luminance of the contribution of the VPLs of the light path to the camera samples
+    float importance{};
+    for (int j{}; j < static_cast<int>(light_path.size()); j++)
+    {
+        const LightPathNode& node{ light_path[j] };
+        if (!node.hit.valid) continue;
+
+        VirtualLight vpl{ LightPathVPL(node, j, emitters, mean_reflectivity) };
+        for (const CameraSample& camera_sample : camera_samples)
+        {
+            importance += Luminance(ShadeCameraSample(camera_sample, vpl, vpl_type, objects));
+        }
+    }
+
+    return importance / static_cast<float>(std::max(camera_samples.size(), std::size_t{ 1 }));
+}
+
+inline void MutatePathSample(PathSample& sample, std::mt19937& generator)
+{
+    // small step: move each coordinate by an exponentially distributed offset in [MIN_SIZE;MAX_SIZE], wrapping around [0;1)
+    std::uniform_real_distribution<float> dis{ 0.0f, 1.0f };
+    for (float& u : sample)
+    {
+        float offset{ MIR_MUTATION_MAX_SIZE * std::exp(-std::log(MIR_MUTATION_MAX_SIZE / MIR_MUTATION_MIN_SIZE) * dis(generator)) };
+        u += dis(generator) < 0.5f ? offset : -offset;
+        u -= std::floor(u);
+        if (u >= 1.0f) u = 0.0f; // rounding
+    }
+}
+
+inline MetropolisStats MetropolisLightPaths(
+    std::vector<std::vector<LightPathNode>>& light_paths, std::vector<float>& path_weights,
+    const std::vector<PointLight>& point_lights, const Emitters& emitters, const std::vector<Object>& objects,
+    const std::vector<CameraSample>& camera_samples, int particles_count, float mean_reflectivity, int vpl_type, int seed
+)
+{
+    /*
+        Generates particles_count light paths (and their weights) with MIR_CHAINS_COUNT Markov chains running in parallel.
+        Each chain step proposes either a brand new light path (large step) or a small mutation of the current one,
+        and accepts it with probability min(1, f(proposal) / f(current)): both proposals are symmetric.
+        The chains start from independent light paths picked proportionally to their importance, so no burn-in is needed.
+    */
+    light_paths.assign(particles_count, {});
+    path_weights.assign(particles_count, 0.0f);
+
+    MetropolisStats stats{};
+
+    // independent light paths: estimate the normalization and seed the chains
+    std::vector<PathSample> bootstrap_samples(MIR_BOOTSTRAP_PATHS);
+    std::vector<float> bootstrap_importances(MIR_BOOTSTRAP_PATHS);
+    {
+        std::uniform_real_distribution<float> dis{ 0.0f, 1.0f };
+        std::mt19937 generator{ static_cast<unsigned>(seed) };
+        for (PathSample& sample : bootstrap_samples)
+        {
+            for (float& u : sample)
+            {
+                u = dis(generator);
+            }
+        }
+    }
+    ParallelFor(MIR_BOOTSTRAP_PATHS, [&](int i)
+    {
+        std::vector<LightPathNode> light_path{};
+        TraceMetropolisLightPath(light_path, bootstrap_samples[i], point_lights, emitters, objects, mean_reflectivity);
+        bootstrap_importances[i] = LightPathImportance(light_path, emitters, mean_reflectivity, vpl_type, camera_samples, objects);
+    });
+
+    double importance_sum{ std::accumulate(bootstrap_importances.begin(), bootstrap_importances.end(), 0.0) };
+    stats.normalization = static_cast<float>(importance_sum / MIR_BOOTSTRAP_PATHS);
+    if (stats.normalization <= 0.0f)
+    {
+        // no light path reaches the camera view
+        light_paths.clear();
+        path_weights.clear();
+        return stats;
+    }
+
+    AliasTable bootstrap_table{};
+    bootstrap_table.Build(bootstrap_importances);
+
+    int chains_count{ std::min(MIR_CHAINS_COUNT, particles_count) };
+    std::vector<int> accepted(chains_count);
+    ParallelFor(chains_count, [&](int chain)
+    {
+        std::uniform_real_distribution<float> dis{ 0.0f, 1.0f };
+        std::mt19937 generator{ static_cast<unsigned>(seed) + static_cast<unsigned>(chain + 1) * 0x9E3779B9u };
+
+        int start{ bootstrap_table.Sample(dis(generator)) };
+        PathSample current{ bootstrap_samples[start] };
+        float current_importance{ bootstrap_importances[start] };
+        std::vector<LightPathNode> current_path{};
+        TraceMetropolisLightPath(current_path, current, point_lights, emitters, objects, mean_reflectivity);
+
+        PathSample proposal{};
+        std::vector<LightPathNode> proposal_path{};
+
+        int begin{ particles_count * chain / chains_count };
+        int end{ particles_count * (chain + 1) / chains_count };
+        for (int i{ begin }; i < end; i++)
+        {
+            proposal = current;
+            if (dis(generator) < MIR_LARGE_STEP_PROBABILITY)
+            {
+                for (float& u : proposal)
+                {
+                    u = dis(generator);
+                }
+            }
+            else
+            {
+                MutatePathSample(proposal, generator);
+            }
+
+            TraceMetropolisLightPath(proposal_path, proposal, point_lights, emitters, objects, mean_reflectivity);
+            float proposal_importance{ LightPathImportance(proposal_path, emitters, mean_reflectivity, vpl_type, camera_samples, objects) };
+
+            if (dis(generator) * current_importance < proposal_importance)
+            {
+                std::swap(current, proposal);
+                std::swap(current_path, proposal_path);
+                current_importance = proposal_importance;
+                accepted[chain]++;
+            }
+
+            light_paths[i] = current_path;
+            path_weights[i] = stats.normalization / current_importance;
+        }
+    });
+
+    stats.acceptance_rate = static_cast<float>(std::accumulate(accepted.begin(), accepted.end(), 0)) / static_cast<float>(particles_count);
+    return stats;
+}
+
+inline void EvaluateVPLs(
+    std::vector<Vector3>& radiance, const std::vector<CameraSample>& camera_samples, const std::vector<VirtualLight>& virtual_lights,
+    int point_lights_count, int particles_count, int vpl_type, const std::vector<Object>& objects
+)
+{
+    // radiance the VPLs reflect from each camera sample (with the same 1 / particles_count weight as the shaders)
+    radiance.assign(camera_samples.size(), {});
+    ParallelFor(static_cast<int>(camera_samples.size()), [&](int i)
+    {
+        Vector3 sum{};
+        for (int j{ point_lights_count }; j < static_cast<int>(virtual_lights.size()); j++)
+        {
+            sum += ShadeCameraSample(camera_samples[i], virtual_lights[j], vpl_type, objects);
+        }
+        radiance[i] = sum / static_cast<float>(particles_count);
+    });
+}
+
+inline float RootMeanSquaredError(const std::vector<Vector3>& radiance, const std::vector<Vector3>& reference)
+{
+    double sum{};
+    for (std::size_t i{}; i < radiance.size(); i++)
+    {
+        Vector3 d{ radiance[i] - reference[i] };
+        sum += static_cast<double>(d.LengthSquared()) / 3.0;
+    }
+    return static_cast<float>(std::sqrt(sum / static_cast<double>(std::max(radiance.size(), std::size_t{ 1 }))));
+}
+
+template <typename Color>
+inline float ProgressiveRelativeError(const std::vector<Color>& average, const std::vector<Color>& odd_average)
+{
+    /*
+        Relative RMS standard error of the average of n frames (n even), estimated from the average of its n / 2 odd frames.
+        The even frames average to 2 average - odd_average, and the difference of the two independent averages of n / 2 frames
+        has 4 times the variance of the average of all n: the standard error of each pixel is about |average - odd_average|.
+    */
+    double error_sum{};
+    double average_sum{};
+    for (std::size_t i{}; i < average.size(); i++)
+    {
+        Vector3 a{ average[i].x, average[i].y, average[i].z };
+        Vector3 o{ odd_average[i].x, odd_average[i].y, odd_average[i].z };
+        error_sum += static_cast<double>((a - o).LengthSquared());
+        average_sum += static_cast<double>(a.LengthSquared());
+    }
+    return average_sum > 0.0 ? static_cast<float>(std::sqrt(error_sum / average_sum)) : 0.0f;
+}
+
+inline void RunMetropolisBenchmark(Mesh* quad_mesh, Mesh* cube_mesh, float aspect, float mean_reflectivity, int vpl_type)
+{
+    /*
+        Equal error comparison between Keller's uniform emission and Metropolis instant radiosity, on the doorway scene.
+        The error is the RMSE of the radiance the VPLs reflect from a grid of camera samples, against a uniform emission reference
+        with MIR_BENCHMARK_REFERENCE_PARTICLES particles, averaged over MIR_BENCHMARK_RUNS seeds.
+        For each Metropolis particles count, the number of VPLs uniform emission needs for the same error is interpolated
+        (in log-log space) between the measured uniform emission particles counts.
+    */
+    std::vector<Object> objects{};
+    std::vector<PointLight> point_lights{};
+    Camera camera{};
+    camera.fov_deg = CAMERA_FOV_DEG;
+    camera.near_plane = CAMERA_NEAR_PLANE;
+    camera.far_plane = CAMERA_FAR_PLANE;
+    BuildDoorwayScene(objects, point_lights, camera, quad_mesh, cube_mesh);
+    for (Object& obj : objects)
+    {
+        UpdateObjectMatrices(obj);
+    }
+
+    int point_lights_count{ static_cast<int>(point_lights.size()) };
+    Emitters emitters{};
+    BuildEmitters(emitters, point_lights, objects);
+
+    std::vector<CameraSample> camera_samples{};
+    BuildCameraSamples(camera_samples, camera, aspect, objects, MIR_BENCHMARK_CAMERA_SAMPLES_W, MIR_BENCHMARK_CAMERA_SAMPLES_H);
+
+    std::vector<std::vector<LightPathNode>> light_paths{};
+    std::vector<float> path_weights{};
+    std::vector<VirtualLight> virtual_lights{};
+    std::vector<Vector3> radiance{};
+
+    // reference
+    std::vector<Vector3> reference{};
+    ShootLightPaths(light_paths, point_lights, emitters, MIR_BENCHMARK_REFERENCE_PARTICLES, MIR_BENCHMARK_RUNS); // seed not used by the runs
+    TraceLightPaths(light_paths, objects, MIR_BENCHMARK_REFERENCE_PARTICLES, mean_reflectivity);
+    SpawnVirtualLights(virtual_lights, light_paths, point_lights, emitters, MIR_BENCHMARK_REFERENCE_PARTICLES, mean_reflectivity, {});
+    EvaluateVPLs(reference, camera_samples, virtual_lights, point_lights_count, MIR_BENCHMARK_REFERENCE_PARTICLES, vpl_type, objects);
+
+    std::println(
+        "metropolis instant radiosity benchmark (doorway scene, {} camera samples, {} reference VPLs, {} runs)",
+        camera_samples.size(), virtual_lights.size() - point_lights_count, MIR_BENCHMARK_RUNS
+    );
+
+    // uniform emission
+    std::vector<float> uniform_vpls{};
+    std::vector<float> uniform_errors{};
+    std::println("{:>10} {:>10} {:>12}", "particles", "VPLs", "RMSE");
+    for (int particles_count{ MIR_BENCHMARK_UNIFORM_PARTICLES_MIN }; particles_count <= MIR_BENCHMARK_UNIFORM_PARTICLES_MAX; particles_count *= 2)
+    {
+        float vpls{};
+        float error{};
+        for (int run{}; run < MIR_BENCHMARK_RUNS; run++)
+        {
+            ShootLightPaths(light_paths, point_lights, emitters, particles_count, run);
+            TraceLightPaths(light_paths, objects, particles_count, mean_reflectivity);
+            SpawnVirtualLights(virtual_lights, light_paths, point_lights, emitters, particles_count, mean_reflectivity, {});
+            EvaluateVPLs(radiance, camera_samples, virtual_lights, point_lights_count, particles_count, vpl_type, objects);
+            vpls += static_cast<float>(virtual_lights.size() - point_lights_count) / MIR_BENCHMARK_RUNS;
+            error += RootMeanSquaredError(radiance, reference) / MIR_BENCHMARK_RUNS;
+        }
+        uniform_vpls.emplace_back(vpls);
+        uniform_errors.emplace_back(error);
+        std::println("{:>10} {:>10.0f} {:>12.6f}", particles_count, vpls, error);
+    }
+
+    // metropolis instant radiosity
+    std::println("{:>10} {:>10} {:>12} {:>16} {:>8}", "particles", "MIR VPLs", "MIR RMSE", "uniform VPLs", "ratio");
+    for (int particles_count : MIR_BENCHMARK_PARTICLES)
+    {
+        float vpls{};
+        float error{};
+        for (int run{}; run < MIR_BENCHMARK_RUNS; run++)
+        {
+            std::vector<CameraSample> importance_samples{};
+            BuildCameraSamples(importance_samples, camera, aspect, objects, MIR_CAMERA_SAMPLES_W, MIR_CAMERA_SAMPLES_H);
+            MetropolisLightPaths(light_paths, path_weights, point_lights, emitters, objects, importance_samples, particles_count, mean_reflectivity, vpl_type, run);
+            SpawnVirtualLights(virtual_lights, light_paths, point_lights, emitters, particles_count, mean_reflectivity, path_weights);
+            EvaluateVPLs(radiance, camera_samples, virtual_lights, point_lights_count, particles_count, vpl_type, objects);
+            vpls += static_cast<float>(virtual_lights.size() - point_lights_count) / MIR_BENCHMARK_RUNS;
+            error += RootMeanSquaredError(radiance, reference) / MIR_BENCHMARK_RUNS;
+        }
+
+        // VPLs uniform emission needs for the same error
+        std::string equal_error_vpls{};
+        std::string ratio{ "-" };
+        auto reached{ std::find_if(uniform_errors.begin(), uniform_errors.end(), [&](float e) { return e <= error; }) };
+        if (reached == uniform_errors.end())
+        {
+            equal_error_vpls = std::format("> {:.0f}", uniform_vpls.back());
+        }
+        else if (reached == uniform_errors.begin())
+        {
+            equal_error_vpls = std::format("<= {:.0f}", uniform_vpls.front());
+        }
+        else
+        {
+            std::size_t k{ static_cast<std::size_t>(reached - uniform_errors.begin()) };
+            float t{ std::log(uniform_errors[k - 1] / error) / std::log(uniform_errors[k - 1] / uniform_errors[k]) };
+            float equal_vpls{ std::exp(std::lerp(std::log(uniform_vpls[k - 1]), std::log(uniform_vpls[k]), t)) };
+            equal_error_vpls = std::format("{:.0f}", equal_vpls);
+            ratio = std::format("{:.1f}x", equal_vpls / vpls);
+        }
+
+        std::println("{:>10} {:>10.0f} {:>12.6f} {:>16} {:>8}", particles_count, vpls, error, equal_error_vpls, ratio);
+    }
+}
+
+// ----------------------------------------------------------------------------
+// ReSTIR
+// ----------------------------------------------------------------------------
+
+/*
+    Per pixel reservoir resampling of the VPLs (Bitterli et al., "Spatiotemporal Reservoir Resampling for Real-Time Ray Tracing
+    with Dynamic Direct Lighting", 2020), rendered on the CPU.
+    Each pixel draws a few candidate VPLs (proportionally to their power) and keeps one of them in a weighted reservoir, by
+    resampled importance sampling with the unshadowed contribution of the VPL to the pixel as target function. The reservoir is
+    then merged with the one of the same surface in the previous frame and with the ones of a few neighbouring pixels, so that
+    each pixel sees many more candidates than it draws. Only the VPL left in the reservoir is shaded (with a shadow ray), so the
+    cost per pixel doesn't grow with the number of VPLs.
+    Reservoirs are combined with the biased 1 / M weights, and are never shared across depth or normal discontinuities.
+*/
+
+struct GBufferTexel
+{
+    Vector3 position;
+    Vector3 normal;
+    Vector3 albedo;
+    float depth; // distance from the eye, 0 when the camera ray hits nothing
+};
+
+struct Reservoir
+{
+    VirtualLight light; // selected sample (by value, so that reservoirs outlive the VPLs they were drawn from)
+    float weight_sum; // sum of the resampling weights of the candidates
+    float m; // number of candidates
+    float contribution_weight; // W = weight_sum / (m * target(light)), stands for 1 / pdf(light)
+};
+
+struct ReSTIRSettings
+{
+    int candidates; // VPLs drawn by each pixel
+    int spatial_neighbours;
+    float spatial_radius; // pixels
+    bool temporal_reuse;
+};
+
+inline float ReSTIRTarget(const GBufferTexel& texel, const VirtualLight& light, int vpl_type)
+{
+    // target function of the resampling: unshadowed luminance of the contribution of the light to the pixel
+    return Luminance(ShadeDiffuse(texel.position, texel.normal, texel.albedo, light, vpl_type));
+}
+
+inline void UpdateReservoir(Reservoir& reservoir, const VirtualLight& light, float weight, float m, float u)
+{
+    // weighted reservoir sampling: the light replaces the selected one with probability weight / weight_sum
+    reservoir.weight_sum += weight;
+    reservoir.m += m;
+    if (weight > 0.0f && u * reservoir.weight_sum < weight)
+    {
+        reservoir.light = light;
+    }
+}
+
+inline void MergeReservoir(Reservoir& reservoir, const Reservoir& other, const GBufferTexel& texel, int vpl_type, float u)
+{
+    // the sample of the other reservoir is resampled with the target function of texel
+    float weight{ ReSTIRTarget(texel, other.light, vpl_type) * other.contribution_weight * other.m };
+    UpdateReservoir(reservoir, other.light, weight, other.m, u);
+}
+
+inline void FinalizeReservoir(Reservoir& reservoir, const GBufferTexel& texel, int vpl_type)
+{
+    float target{ ReSTIRTarget(texel, reservoir.light, vpl_type) };
+    reservoir.contribution_weight = (target > 0.0f && reservoir.m > 0.0f) ? reservoir.weight_sum / (reservoir.m * target) : 0.0f;
+}
+
+inline bool SimilarTexels(const GBufferTexel& a, const GBufferTexel& b)
+{
+    // pixels share reservoirs (or interleaved samples) only when they see (nearly) the same surface
+    if (a.depth <= 0.0f || b.depth <= 0.0f) return false;
+    if (a.normal.Dot(b.normal) < RESTIR_NORMAL_THRESHOLD) return false;
+    return (a.position - b.position).Length() <= RESTIR_DEPTH_THRESHOLD * a.depth;
+}
+
+class ReSTIRRenderer
+{
+public:
+    ReSTIRRenderer();
+    ~ReSTIRRenderer() = default;
+    ReSTIRRenderer(const ReSTIRRenderer&) = delete;
+    ReSTIRRenderer(ReSTIRRenderer&&) noexcept = default;
+    ReSTIRRenderer& operator=(const ReSTIRRenderer&) = delete;
+    ReSTIRRenderer& operator=(ReSTIRRenderer&&) noexcept = default;
+public:
+    // renders the contribution of the VPLs (the point lights at the start of virtual_lights are skipped) to a width x height image
+    void Render(
+        const Camera& camera, int width, int height, const std::vector<Object>& objects,
+        const std::vector<VirtualLight>& virtual_lights, int point_lights_count, int particles_count, int vpl_type,
+        const ReSTIRSettings& settings, std::uint32_t frame
+    );
+    void ResetHistory() noexcept { m_history_valid = false; } // the reservoirs of the previous frame hold VPLs that no longer exist
+    const std::vector<Vector4>& Image() const noexcept { return m_image; }
+private:
+    void BuildGBuffer(const Camera& camera, const std::vector<Object>& objects);
+private:
+    int m_width;
+    int m_height;
+    std::size_t m_gbuffer_hash;
+    Matrix m_view_projection;
+    Matrix m_previous_view_projection;
+    std::vector<GBufferTexel> m_gbuffer;
+    std::vector<GBufferTexel> m_previous_gbuffer;
+    std::vector<Reservoir> m_reservoirs; // output of the temporal pass
+    std::vector<Reservoir> m_previous_reservoirs; // output of the spatial pass, reused by the next frame
+    std::vector<Vector4> m_image;
+    AliasTable m_vpl_table;
+    bool m_history_valid;
+};
+
+inline ReSTIRRenderer::ReSTIRRenderer()
+    : m_width{}
+    , m_height{}
+    , m_gbuffer_hash{}
+    , m_view_projection{ Matrix::Identity }
+    , m_previous_view_projection{ Matrix::Identity }
+    , m_gbuffer{}
+    , m_previous_gbuffer{}
+    , m_reservoirs{}
+    , m_previous_reservoirs{}
+    , m_image{}
+    , m_vpl_table{}
+    , m_history_valid{}
+{
+}
+
+inline void ReSTIRRenderer::Render(
+    const Camera& camera, int width, int height, const std::vector<Object>& objects,
+    const std::vector<VirtualLight>& virtual_lights, int point_lights_count, int particles_count, int vpl_type,
+    const ReSTIRSettings& settings, std::uint32_t frame
+)
+{
+    // a new size invalidates every per pixel buffer
+    bool resized{ width != m_width || height != m_height };
+    if (resized)
+    {
+        std::size_t pixel_count{ static_cast<std::size_t>(width) * static_cast<std::size_t>(height) };
+        m_width = width;
+        m_height = height;
+        m_gbuffer.assign(pixel_count, {});
+        m_previous_gbuffer.assign(pixel_count, {});
+        m_reservoirs.assign(pixel_count, {});
+        m_previous_reservoirs.assign(pixel_count, {});
+        m_image.assign(pixel_count, {});
+        m_history_valid = false;
+    }
+
+    // the G-buffer is only rebuilt when the camera or the objects change, keeping the previous one for reprojection
+    std::size_t gbuffer_hash{ HashScene(camera, {}, objects) };
+    bool gbuffer_changed{ resized || gbuffer_hash != m_gbuffer_hash };
+    if (gbuffer_changed)
+    {
+        std::swap(m_gbuffer, m_previous_gbuffer);
+        m_previous_view_projection = m_view_projection;
+        BuildGBuffer(camera, objects);
+        m_gbuffer_hash = gbuffer_hash;
+    }
+    const std::vector<GBufferTexel>& previous_gbuffer{ gbuffer_changed ? m_previous_gbuffer : m_gbuffer };
+    const Matrix& previous_view_projection{ gbuffer_changed ? m_previous_view_projection : m_view_projection };
+
+    const int vpls_count{ static_cast<int>(virtual_lights.size()) - point_lights_count };
+    if (vpls_count <= 0)
+    {
+        std::fill(m_image.begin(), m_image.end(), Vector4{});
+        m_history_valid = false;
+        return;
+    }
+
+    // candidates are drawn proportionally to the power of the VPLs
+    {
+        std::vector<float> powers(vpls_count);
+        for (int i{}; i < vpls_count; i++)
+        {
+            const VirtualLight& vpl{ virtual_lights[point_lights_count + i] };
+            powers[i] = vpl.intensity * Luminance(vpl.color);
+        }
+        m_vpl_table.Build(powers);
+    }
+
+    const bool temporal_reuse{ settings.temporal_reuse && m_history_valid };
+    const float max_history{ RESTIR_MAX_HISTORY * static_cast<float>(settings.candidates) };
+
+    // initial candidates, merged with the reservoir of the same surface in the previous frame
+    ParallelFor(m_height, [&](int y)
+    {
+        for (int x{}; x < m_width; x++)
+        {
+            int i{ y * m_width + x };
+            const GBufferTexel& texel{ m_gbuffer[i] };
+
+            Reservoir reservoir{};
+            if (texel.depth > 0.0f)
+            {
+                std::uint32_t rng{ PCGHash(static_cast<std::uint32_t>(i) + PCGHash(2u * frame)) };
+
+                for (int c{}; c < settings.candidates; c++)
+                {
+                    int k{ m_vpl_table.Sample(RandomFloat(rng)) };
+                    const VirtualLight& light{ virtual_lights[point_lights_count + k] };
+                    UpdateReservoir(reservoir, light, ReSTIRTarget(texel, light, vpl_type) / m_vpl_table.Probability(k), 1.0f, RandomFloat(rng));
+                }
+
+                if (temporal_reuse)
+                {
+                    Vector4 clip{ Vector4::Transform(texel.position, previous_view_projection) };
+                    if (clip.w > 0.0f)
+                    {
+                        int px{ static_cast<int>(std::floor((0.5f + 0.5f * clip.x / clip.w) * static_cast<float>(m_width))) };
+                        int py{ static_cast<int>(std::floor((0.5f - 0.5f * clip.y / clip.w) * static_cast<float>(m_height))) };
+                        if (px >= 0 && px < m_width && py >= 0 && py < m_height && SimilarTexels(texel, previous_gbuffer[py * m_width + px]))
+                        {
+                            // the history is capped, so that the reservoir keeps adapting to lighting changes
+                            Reservoir previous{ m_previous_reservoirs[py * m_width + px] };
+                            previous.m = std::min(previous.m, max_history);
+                            MergeReservoir(reservoir, previous, texel, vpl_type, RandomFloat(rng));
+                        }
+                    }
+                }
+
+                FinalizeReservoir(reservoir, texel, vpl_type);
+            }
+            m_reservoirs[i] = reservoir;
+        }
+    });
+
+    // spatial reuse, then shade the selected VPL only
+    ParallelFor(m_height, [&](int y)
+    {
+        for (int x{}; x < m_width; x++)
+        {
+            int i{ y * m_width + x };
+            const GBufferTexel& texel{ m_gbuffer[i] };
+
+            Reservoir reservoir{};
+            Vector3 color{};
+            if (texel.depth > 0.0f)
+            {
+                std::uint32_t rng{ PCGHash(static_cast<std::uint32_t>(i) + PCGHash(2u * frame + 1u)) }; // decorrelated from the temporal pass
+
+                MergeReservoir(reservoir, m_reservoirs[i], texel, vpl_type, RandomFloat(rng));
+                for (int n{}; n < settings.spatial_neighbours; n++)
+                {
+                    float r{ settings.spatial_radius * std::sqrt(RandomFloat(rng)) };
+                    float phi{ 2.0f * std::numbers::pi_v<float> * RandomFloat(rng) };
+                    int nx{ x + static_cast<int>(std::round(r * std::cos(phi))) };
+                    int ny{ y + static_cast<int>(std::round(r * std::sin(phi))) };
+                    if (nx < 0 || nx >= m_width || ny < 0 || ny >= m_height || (nx == x && ny == y)) continue;
+
+                    int j{ ny * m_width + nx };
+                    if (!SimilarTexels(texel, m_gbuffer[j])) continue;
+
+                    MergeReservoir(reservoir, m_reservoirs[j], texel, vpl_type, RandomFloat(rng));
+                }
+                FinalizeReservoir(reservoir, texel, vpl_type);
+
+                Vector3 contribution{ ShadeDiffuse(texel.position, texel.normal, texel.albedo, reservoir.light, vpl_type) };
+                if (Luminance(contribution) > 0.0f && Visible(objects, texel.position, texel.normal, reservoir.light.position))
+                {
+                    color = contribution * reservoir.contribution_weight / static_cast<float>(particles_count); // abiding by Keller, as PSLit.hlsl
+                }
+            }
+            m_previous_reservoirs[i] = reservoir;
+            m_image[i] = { color.x, color.y, color.z, 1.0f };
+        }
+    });
+
+    m_history_valid = true;
+}
+
+inline void ReSTIRRenderer::BuildGBuffer(const Camera& camera, const std::vector<Object>& objects)
+{
+    // cast a ray through the center of each pixel, keeping the closest surface it hits
+    m_view_projection = CameraViewProjection(camera, static_cast<float>(m_width) / static_cast<float>(m_height));
+    Matrix inverse_view_projection{ m_view_projection.Invert() };
+
+    ParallelFor(m_height, [&](int y)
+    {
+        for (int x{}; x < m_width; x++)
+        {
+            float ndc_x{ 2.0f * (static_cast<float>(x) + 0.5f) / static_cast<float>(m_width) - 1.0f };
+            float ndc_y{ 1.0f - 2.0f * (static_cast<float>(y) + 0.5f) / static_cast<float>(m_height) };
+
+            const Object* hit_obj{};
+            RayHit hit{ IntersectScene(objects, CameraRay(inverse_view_projection, camera.eye, ndc_x, ndc_y), &hit_obj) };
+
+            GBufferTexel& texel{ m_gbuffer[y * m_width + x] };
+            texel = hit.valid ? GBufferTexel{ hit.position, hit.normal, hit_obj->albedo, (hit.position - camera.eye).Length() } : GBufferTexel{};
+        }
+    });
+}
+
+// ----------------------------------------------------------------------------
+// Headless Entry Point
+// ----------------------------------------------------------------------------
+
+void HeadlessEntry(const std::vector<std::string_view>& args); // Headless.cpp, renders without a window nor a D3D11 device
@@ -38,7 +38,25 @@ cbuffer CBShadow : register(b3)
     ShadowConstants cb_shadow;
 };
 
+cbuffer CBLightTree : register(b4)
+{
+    LightTreeConstants cb_light_tree;
+};
+
+cbuffer CBAccumulation : register(b5)
+{
+    AccumulationConstants cb_accumulation;
+};
+
+cbuffer CBAreaLight : register(b6)
+{
+    AreaLightConstants cb_area_light;
+};
+
 TextureCube cube_shadow_map : register(t0);
+StructuredBuffer<LightTreeNode> light_tree_nodes : register(t1);
+StructuredBuffer<LightConstants> light_tree_lights : register(t2);
+Texture2D<float4> accumulation_buffer : register(t3);
 
 SamplerState shadow_sampler : register(s0);
 SamplerState skybox_sampler : register(s1);
@@ -5,6 +5,7 @@
 #define LIGHT_TYPE_SIGN_COS_WEIGHTED 1
 #define LIGHT_TYPE_COS_WEIGHTED 2
 #define PCF_MAX_SAMPLES 21
+#define LIGHT_TREE_NULL_INDEX -1
 
 struct SceneConstants
 {
@@ -42,4 +43,38 @@ struct ShadowConstants
     float _pad[3];
 };
 
+struct LightTreeConstants
+{
+    int root; // index of the root node (LIGHT_TREE_NULL_INDEX when the tree is empty)
+    int samples; // number of lights sampled by each shading point
+    int seed;
+    int vpl_type; // LIGHT_TYPE_* shared by all the lights in the tree
+};
+
+struct LightTreeNode
+{
+    float3 aabb_min;
+    float power; // sum of the power of the lights below this node
+    float3 aabb_max;
+    int light_index; // leaves only: index into the lights buffer (LIGHT_TREE_NULL_INDEX for internal nodes)
+    float3 cone_axis; // axis of the cone bounding the normals of the lights below this node
+    float cone_cos; // cosine of the cone half aperture
+    int left; // internal nodes only: index of the left child (LIGHT_TREE_NULL_INDEX for leaves)
+    int right; // internal nodes only: index of the right child (LIGHT_TREE_NULL_INDEX for leaves)
+    float2 _pad;
+};
+
+struct AreaLightConstants
+{
+    float4 corners[4]; // world space quad corners, counter clockwise as seen from the emitting side (w is unused)
+    float3 color;
+    float intensity;
+};
+
+struct AccumulationConstants
+{
+    float scale; // the accumulated color is multiplied by this factor when added to the frame
+    float _pad[3];
+};
+
 #endif
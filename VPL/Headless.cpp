@@ -0,0 +1,5335 @@
+﻿// ----------------------------------------------------------------------------
+// Includes
+// ----------------------------------------------------------------------------
+
+// Precompiled header
+#include "PCH.h"
+
+// math library, constant buffers, scene and VPLs shared with the D3D11 entry point
+#include "Common.h"
+
+// ----------------------------------------------------------------------------
+// Software Rasterizer
+// ----------------------------------------------------------------------------
+
+/*
+    Tile binned, multithreaded CPU rasterizer mirroring the D3D11 pipeline of the final render, for headless rendering.
+    Triangles are transformed as in VS.hlsl, clipped against the near plane and binned into RASTER_TILE_SIZE x RASTER_TILE_SIZE
+    screen tiles, then the tiles are rasterized in parallel. Each tile walks its triangles in submission order, so depth ties
+    resolve as they do on the GPU, and edge functions are evaluated RASTER_SIMD_WIDTH pixels at a time with SSE.
+    Pixels are sampled at their centers, depth is the NDC depth (linear in screen space) and the other attributes are
+    interpolated perspective correctly. Pixel centers on an edge shared by two triangles belong to exactly one of them.
+*/
+
+struct RasterVertex
+{
+    Vector4 clip_position;
+    Vector3 world_normal;
+    Vector3 world_position;
+};
+
+struct RasterTriangle
+{
+    float edge_a[3]; // edge function i is a * x + b * y + c, it is positive inside the triangle and zero on the edge opposite to vertex i
+    float edge_b[3];
+    float edge_c[3];
+    bool edge_owned[3]; // pixel centers exactly on the edge belong to this triangle
+    float inverse_area;
+    float z[3]; // NDC depth
+    float inverse_w[3];
+    Vector3 world_normal[3];
+    Vector3 world_position[3];
+    const Object* object;
+    int min_x; // pixel bounds (inclusive)
+    int min_y;
+    int max_x;
+    int max_y;
+};
+
+struct RasterFragment
+{
+    int x;
+    int y;
+    Vector3 world_normal; // interpolated, not normalized (as VSOutput)
+    Vector3 world_position;
+    const Object* object;
+};
+
+enum class RasterDepthTest
+{
+    Less,
+    Equal,
+};
+
+struct RasterState
+{
+    RasterDepthTest depth_test;
+    bool depth_write;
+    bool additive_blend; // the fragment color is added to the color buffer (bs_sum), instead of replacing it
+    bool distance_depth; // the fragment depth is its distance from distance_origin times distance_scale (as PSCubeShadowMap.hlsl)
+    Vector3 distance_origin;
+    float distance_scale;
+};
+
+class SoftwareRasterizer
+{
+public:
+    SoftwareRasterizer(int width, int height, bool depth_only);
+    SoftwareRasterizer();
+    ~SoftwareRasterizer() = default;
+    SoftwareRasterizer(const SoftwareRasterizer&) = delete;
+    SoftwareRasterizer(SoftwareRasterizer&&) noexcept = default;
+    SoftwareRasterizer& operator=(const SoftwareRasterizer&) = delete;
+    SoftwareRasterizer& operator=(SoftwareRasterizer&&) noexcept = default;
+public:
+    void Clear(Vector3 color, float depth);
+    void SetGeometry(const std::vector<Object>& objects, const Matrix& view_projection, bool cull_back_faces); // runs VS.hlsl and bins the triangles
+    template <typename PixelShader>
+    void Draw(const RasterState& state, PixelShader&& pixel_shader); // pixel_shader(const RasterFragment&) returns the fragment color
+    int Width() const noexcept { return m_width; }
+    int Height() const noexcept { return m_height; }
+    std::vector<Vector3>& Color() noexcept { return m_color; }
+    const std::vector<Vector3>& Color() const noexcept { return m_color; }
+    const std::vector<float>& Depth() const noexcept { return m_depth; }
+private:
+    void AddTriangle(const RasterVertex& v0, const RasterVertex& v1, const RasterVertex& v2, const Object* object, bool cull_back_faces);
+private:
+    int m_width;
+    int m_height;
+    int m_tiles_x;
+    int m_tiles_y;
+    std::vector<Vector3> m_color; // empty for depth only rasterizers
+    std::vector<float> m_depth;
+    std::vector<RasterTriangle> m_triangles;
+    std::vector<std::vector<int>> m_bins; // per tile indices of the triangles overlapping it, in submission order
+};
+
+SoftwareRasterizer::SoftwareRasterizer(int width, int height, bool depth_only)
+    : m_width{ width }
+    , m_height{ height }
+    , m_tiles_x{ (width + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE }
+    , m_tiles_y{ (height + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE }
+    , m_color{}
+    , m_depth{}
+    , m_triangles{}
+    , m_bins{}
+{
+    Check(width > 0 && height > 0);
+
+    std::size_t pixel_count{ static_cast<std::size_t>(width) * static_cast<std::size_t>(height) };
+    if (!depth_only)
+    {
+        m_color.resize(pixel_count);
+    }
+    m_depth.resize(pixel_count);
+    m_bins.resize(static_cast<std::size_t>(m_tiles_x) * static_cast<std::size_t>(m_tiles_y));
+}
+
+SoftwareRasterizer::SoftwareRasterizer()
+    : m_width{}
+    , m_height{}
+    , m_tiles_x{}
+    , m_tiles_y{}
+    , m_color{}
+    , m_depth{}
+    , m_triangles{}
+    , m_bins{}
+{
+}
+
+void SoftwareRasterizer::Clear(Vector3 color, float depth)
+{
+    std::fill(m_color.begin(), m_color.end(), color);
+    std::fill(m_depth.begin(), m_depth.end(), depth);
+}
+
+void SoftwareRasterizer::SetGeometry(const std::vector<Object>& objects, const Matrix& view_projection, bool cull_back_faces)
+{
+    m_triangles.clear();
+    for (std::vector<int>& bin : m_bins)
+    {
+        bin.clear();
+    }
+
+    for (const Object& obj : objects)
+    {
+        const std::vector<Vertex>& vertices{ obj.mesh->CPUVertices() };
+        const std::vector<std::uint32_t>& indices{ obj.mesh->CPUIndices() };
+
+        // same math as VS.hlsl
+        std::vector<RasterVertex> transformed(vertices.size());
+        for (std::size_t i{}; i < vertices.size(); i++)
+        {
+            transformed[i].world_position = Vector3::Transform(vertices[i].position, obj.model);
+            transformed[i].clip_position = Vector4::Transform(transformed[i].world_position, view_projection);
+            transformed[i].world_normal = Vector3::TransformNormal(vertices[i].normal, obj.normal);
+        }
+
+        for (std::size_t i{}; i + 2 < indices.size(); i += 3)
+        {
+            // clip against the near plane (z >= 0), which leaves 0, 3 or 4 vertices
+            const RasterVertex* triangle[3]{ &transformed[indices[i]], &transformed[indices[i + 1]], &transformed[indices[i + 2]] };
+            RasterVertex clipped[4]{};
+            int clipped_count{};
+            for (int v{}; v < 3; v++)
+            {
+                const RasterVertex& a{ *triangle[v] };
+                const RasterVertex& b{ *triangle[(v + 1) % 3] };
+                bool a_inside{ a.clip_position.z >= 0.0f };
+                bool b_inside{ b.clip_position.z >= 0.0f };
+
+                if (a_inside)
+                {
+                    clipped[clipped_count++] = a;
+                }
+                if (a_inside != b_inside)
+                {
+                    float t{ a.clip_position.z / (a.clip_position.z - b.clip_position.z) };
+                    clipped[clipped_count++] = {
+                        Vector4::Lerp(a.clip_position, b.clip_position, t),
+                        Vector3::Lerp(a.world_normal, b.world_normal, t),
+                        Vector3::Lerp(a.world_position, b.world_position, t),
+                    };
+                }
+            }
+
+            for (int v{ 2 }; v < clipped_count; v++)
+            {
+                AddTriangle(clipped[0], clipped[v - 1], clipped[v], &obj, cull_back_faces);
+            }
+        }
+    }
+}
+
+void SoftwareRasterizer::AddTriangle(const RasterVertex& v0, const RasterVertex& v1, const RasterVertex& v2, const Object* object, bool cull_back_faces)
+{
+    const RasterVertex* vertices[3]{ &v0, &v1, &v2 };
+
+    // viewport transform
+    float x[3]{};
+    float y[3]{};
+    for (int v{}; v < 3; v++)
+    {
+        const Vector4& clip{ vertices[v]->clip_position };
+        x[v] = (0.5f + 0.5f * clip.x / clip.w) * static_cast<float>(m_width);
+        y[v] = (0.5f - 0.5f * clip.y / clip.w) * static_cast<float>(m_height);
+    }
+
+    // front faces are counter clockwise on screen (FrontCounterClockwise), which is a negative area with y pointing down
+    float area{ (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]) };
+    if (area == 0.0f || (cull_back_faces && area > 0.0f)) return;
+    if (area < 0.0f)
+    {
+        std::swap(vertices[1], vertices[2]);
+        std::swap(x[1], x[2]);
+        std::swap(y[1], y[2]);
+        area = -area;
+    }
+
+    RasterTriangle triangle{};
+    triangle.min_x = std::max(static_cast<int>(std::floor(std::min({ x[0], x[1], x[2] }))), 0);
+    triangle.min_y = std::max(static_cast<int>(std::floor(std::min({ y[0], y[1], y[2] }))), 0);
+    triangle.max_x = std::min(static_cast<int>(std::ceil(std::max({ x[0], x[1], x[2] }))), m_width - 1);
+    triangle.max_y = std::min(static_cast<int>(std::ceil(std::max({ y[0], y[1], y[2] }))), m_height - 1);
+    if (triangle.min_x > triangle.max_x || triangle.min_y > triangle.max_y) return;
+
+    for (int v{}; v < 3; v++)
+    {
+        // the edge opposite to vertex v, set up from its lexicographically smaller end so that a shared edge gets exactly
+        // opposite functions in the two triangles (and a pixel center on it is inside exactly one of them)
+        int a{ (v + 1) % 3 };
+        int b{ (v + 2) % 3 };
+        bool swapped{ std::tie(x[a], y[a]) > std::tie(x[b], y[b]) };
+        if (swapped) std::swap(a, b);
+
+        float dx{ x[b] - x[a] };
+        float dy{ y[b] - y[a] };
+        float sign{ swapped ? -1.0f : 1.0f };
+        triangle.edge_a[v] = sign * -dy;
+        triangle.edge_b[v] = sign * dx;
+        triangle.edge_c[v] = sign * (dy * x[a] - dx * y[a]);
+        triangle.edge_owned[v] = swapped ? (dy < 0.0f || (dy == 0.0f && dx > 0.0f)) : (dy > 0.0f || (dy == 0.0f && dx < 0.0f));
+    }
+
+    triangle.inverse_area = 1.0f / area;
+    for (int v{}; v < 3; v++)
+    {
+        triangle.z[v] = vertices[v]->clip_position.z / vertices[v]->clip_position.w;
+        triangle.inverse_w[v] = 1.0f / vertices[v]->clip_position.w;
+        triangle.world_normal[v] = vertices[v]->world_normal;
+        triangle.world_position[v] = vertices[v]->world_position;
+    }
+    triangle.object = object;
+
+    // bin the triangle into the tiles its bounds overlap
+    int index{ static_cast<int>(m_triangles.size()) };
+    m_triangles.emplace_back(triangle);
+    for (int tile_y{ triangle.min_y / RASTER_TILE_SIZE }; tile_y <= triangle.max_y / RASTER_TILE_SIZE; tile_y++)
+    {
+        for (int tile_x{ triangle.min_x / RASTER_TILE_SIZE }; tile_x <= triangle.max_x / RASTER_TILE_SIZE; tile_x++)
+        {
+            m_bins[tile_y * m_tiles_x + tile_x].emplace_back(index);
+        }
+    }
+}
+
+template <typename PixelShader>
+void SoftwareRasterizer::Draw(const RasterState& state, PixelShader&& pixel_shader)
+{
+    ParallelFor(m_tiles_x * m_tiles_y, [&](int tile)
+    {
+        const int tile_min_x{ (tile % m_tiles_x) * RASTER_TILE_SIZE };
+        const int tile_min_y{ (tile / m_tiles_x) * RASTER_TILE_SIZE };
+        const int tile_max_x{ std::min(tile_min_x + RASTER_TILE_SIZE, m_width) - 1 };
+        const int tile_max_y{ std::min(tile_min_y + RASTER_TILE_SIZE, m_height) - 1 };
+#if defined(__x86_64__) || defined(_M_X64)
+        const __m128 lane_offsets{ _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f) }; // pixel centers
+        const __m128 zero{ _mm_setzero_ps() };
+#endif
+
+        for (int triangle_index : m_bins[tile])
+        {
+            const RasterTriangle& triangle{ m_triangles[triangle_index] };
+#if defined(__x86_64__) || defined(_M_X64)
+            const __m128 edge_a[3]{ _mm_set1_ps(triangle.edge_a[0]), _mm_set1_ps(triangle.edge_a[1]), _mm_set1_ps(triangle.edge_a[2]) };
+            const __m128 edge_b[3]{ _mm_set1_ps(triangle.edge_b[0]), _mm_set1_ps(triangle.edge_b[1]), _mm_set1_ps(triangle.edge_b[2]) };
+            const __m128 edge_c[3]{ _mm_set1_ps(triangle.edge_c[0]), _mm_set1_ps(triangle.edge_c[1]), _mm_set1_ps(triangle.edge_c[2]) };
+#endif
+
+            // spans start on a RASTER_SIMD_WIDTH aligned column, out of bounds lanes are masked out
+            const int min_x{ std::max(triangle.min_x, tile_min_x) / RASTER_SIMD_WIDTH * RASTER_SIMD_WIDTH };
+            const int max_x{ std::min(triangle.max_x, tile_max_x) };
+            const int min_y{ std::max(triangle.min_y, tile_min_y) };
+            const int max_y{ std::min(triangle.max_y, tile_max_y) };
+
+            for (int y{ min_y }; y <= max_y; y++)
+            {
+                const float center_y{ static_cast<float>(y) + 0.5f };
+                for (int x{ min_x }; x <= max_x; x += RASTER_SIMD_WIDTH)
+                {
+                    int mask{ (1 << std::min(max_x - x + 1, RASTER_SIMD_WIDTH)) - 1 };
+                    alignas(16) float edges[3][RASTER_SIMD_WIDTH];
+#if defined(__x86_64__) || defined(_M_X64)
+                    const __m128 px{ _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), lane_offsets) };
+                    const __m128 py{ _mm_set1_ps(center_y) };
+                    for (int e{}; e < 3; e++)
+                    {
+                        __m128 edge{ _mm_add_ps(_mm_add_ps(_mm_mul_ps(edge_a[e], px), _mm_mul_ps(edge_b[e], py)), edge_c[e]) };
+                        mask &= _mm_movemask_ps(triangle.edge_owned[e] ? _mm_cmpge_ps(edge, zero) : _mm_cmpgt_ps(edge, zero));
+                        _mm_store_ps(edges[e], edge);
+                    }
+#else
+                    for (int e{}; e < 3; e++)
+                    {
+                        for (int lane{}; lane < RASTER_SIMD_WIDTH; lane++)
+                        {
+                            const float center_x{ static_cast<float>(x) + (static_cast<float>(lane) + 0.5f) };
+                            const float edge{ triangle.edge_a[e] * center_x + triangle.edge_b[e] * center_y + triangle.edge_c[e] };
+                            if (triangle.edge_owned[e] ? edge < 0.0f : edge <= 0.0f) mask &= ~(1 << lane);
+                            edges[e][lane] = edge;
+                        }
+                    }
+#endif
+
+                    for (; mask != 0; mask &= mask - 1)
+                    {
+                        const int lane{ std::countr_zero(static_cast<unsigned>(mask)) };
+                        const int i{ y * m_width + x + lane };
+
+                        // screen space barycentrics
+                        float l0{ edges[0][lane] * triangle.inverse_area };
+                        float l1{ edges[1][lane] * triangle.inverse_area };
+                        float l2{ edges[2][lane] * triangle.inverse_area };
+
+                        float z{ l0 * triangle.z[0] + l1 * triangle.z[1] + l2 * triangle.z[2] };
+                        if (z < 0.0f || z > 1.0f) continue; // depth clipping
+
+                        // perspective correct barycentrics
+                        float p0{ l0 * triangle.inverse_w[0] };
+                        float p1{ l1 * triangle.inverse_w[1] };
+                        float p2{ l2 * triangle.inverse_w[2] };
+                        float inverse_sum{ 1.0f / (p0 + p1 + p2) };
+                        p0 *= inverse_sum;
+                        p1 *= inverse_sum;
+                        p2 *= inverse_sum;
+
+                        RasterFragment fragment{};
+                        fragment.x = x + lane;
+                        fragment.y = y;
+                        fragment.world_position = triangle.world_position[0] * p0 + triangle.world_position[1] * p1 + triangle.world_position[2] * p2;
+                        fragment.object = triangle.object;
+
+                        float depth{ z };
+                        if (state.distance_depth)
+                        {
+                            depth = std::clamp((fragment.world_position - state.distance_origin).Length() * state.distance_scale, 0.0f, 1.0f);
+                        }
+
+                        bool passed{ (state.depth_test == RasterDepthTest::Less) ? (depth < m_depth[i]) : (depth == m_depth[i]) };
+                        if (!passed) continue;
+
+                        if (state.depth_write)
+                        {
+                            m_depth[i] = depth;
+                        }
+
+                        if (!m_color.empty())
+                        {
+                            fragment.world_normal = triangle.world_normal[0] * p0 + triangle.world_normal[1] * p1 + triangle.world_normal[2] * p2;
+                            Vector3 color{ pixel_shader(fragment) };
+                            m_color[i] = state.additive_blend ? m_color[i] + color : color;
+                        }
+                    }
+                }
+            }
+        }
+    });
+}
+
+class SoftwareCubeShadowMap
+{
+public:
+    SoftwareCubeShadowMap();
+    ~SoftwareCubeShadowMap() = default;
+    SoftwareCubeShadowMap(const SoftwareCubeShadowMap&) = delete;
+    SoftwareCubeShadowMap(SoftwareCubeShadowMap&&) noexcept = default;
+    SoftwareCubeShadowMap& operator=(const SoftwareCubeShadowMap&) = delete;
+    SoftwareCubeShadowMap& operator=(SoftwareCubeShadowMap&&) noexcept = default;
+public:
+    void Render(const std::vector<Object>& objects, Vector3 light_position, int size); // same as the cube shadow map pass of the final render
+    float Sample(Vector3 v) const; // distance (over CUBE_SHADOW_MAP_FAR) of the closest surface along v, with point filtering
+private:
+    std::array<SoftwareRasterizer, CUBE_MAP_FACES> m_faces;
+    std::array<Matrix, CUBE_MAP_FACES> m_views;
+};
+
+SoftwareCubeShadowMap::SoftwareCubeShadowMap()
+    : m_faces{}
+    , m_views{}
+{
+}
+
+void SoftwareCubeShadowMap::Render(const std::vector<Object>& objects, Vector3 light_position, int size)
+{
+    RasterState state{};
+    state.depth_test = RasterDepthTest::Less;
+    state.depth_write = true;
+    state.distance_depth = true;
+    state.distance_origin = light_position;
+    state.distance_scale = 1.0f / CUBE_SHADOW_MAP_FAR;
+
+    for (int face{}; face < CUBE_MAP_FACES; face++)
+    {
+        if (m_faces[face].Width() != size)
+        {
+            m_faces[face] = { size, size, true };
+        }
+
+        m_views[face] = CubeShadowMapView(light_position, face);
+        m_faces[face].Clear({}, 1.0f);
+        m_faces[face].SetGeometry(objects, m_views[face] * CubeShadowMapProjection(), false); // rs_cube_shadow_map doesn't cull
+        m_faces[face].Draw(state, [](const RasterFragment&) { return Vector3{}; });
+    }
+}
+
+float SoftwareCubeShadowMap::Sample(Vector3 v) const
+{
+    // the face is the one of the major axis of v
+    float ax{ std::abs(v.x) };
+    float ay{ std::abs(v.y) };
+    float az{ std::abs(v.z) };
+    int face{};
+    if (ax >= ay && ax >= az)
+    {
+        face = v.x >= 0.0f ? 0 : 1;
+    }
+    else if (ay >= az)
+    {
+        face = v.y >= 0.0f ? 2 : 3;
+    }
+    else
+    {
+        face = v.z >= 0.0f ? 4 : 5;
+    }
+
+    // project v as the face was rendered (90 degrees field of view, so NDC coordinates are the view space x / z and y / z)
+    Vector3 view{ Vector3::TransformNormal(v, m_views[face]) };
+    if (view.z <= 0.0f) return 1.0f;
+
+    const SoftwareRasterizer& rasterizer{ m_faces[face] };
+    int size{ rasterizer.Width() };
+    int x{ std::clamp(static_cast<int>((0.5f + 0.5f * view.x / view.z) * static_cast<float>(size)), 0, size - 1) };
+    int y{ std::clamp(static_cast<int>((0.5f - 0.5f * view.y / view.z) * static_cast<float>(size)), 0, size - 1) };
+    return rasterizer.Depth()[y * size + x];
+}
+
+template <int PcfSamples>
+static Vector3 ShadeShadowedKernel(Vector3 position, Vector3 normal, Vector3 albedo, const VirtualLight& light, const SoftwareCubeShadowMap& shadow_map, const ShadowConstants& shadow)
+{
+    // same shading math as PSShadowed.hlsl (without the 1 / particles_count weight), PcfSamples of 0 for shadow.pcf_samples at run time
+    const int pcf_samples{ PcfSamples > 0 ? PcfSamples : shadow.pcf_samples };
+
+    Vector3 L{ light.position - position };
+    L.Normalize();
+    float n_dot_l{ std::max(normal.Dot(L), 0.0f) };
+
+    Vector3 v{ position - light.position };
+    float distance{ v.Length() };
+    float bias{ shadow.static_bias + shadow.max_dynamic_bias * (1.0f - n_dot_l) };
+
+    float shadowed{};
+    for (int i{}; i < pcf_samples; i++)
+    {
+        float sampled_distance{ shadow_map.Sample(v + PCF_OFFSETS[i] * shadow.offset_scale) * shadow.far_plane };
+        if (distance - bias > sampled_distance)
+        {
+            shadowed += 1.0f;
+        }
+    }
+    shadowed /= static_cast<float>(pcf_samples);
+
+    return ShadeDiffuseKernel<LIGHT_TYPE_POINT>(position, normal, albedo, light) * (1.0f - shadowed);
+}
+
+static Vector3 ShadeShadowed(Vector3 position, Vector3 normal, Vector3 albedo, const VirtualLight& light, const SoftwareCubeShadowMap& shadow_map, const ShadowConstants& shadow)
+{
+    // generic kernel, looping over the PCF samples count of the constants
+    return ShadeShadowedKernel<0>(position, normal, albedo, light, shadow_map, shadow);
+}
+
+/*
+    Span kernels: a light against a span of G-buffer texels, each color accumulating the weighted contribution of the light, with the
+    same arithmetic as the generic kernels. The dispatch tables hold a kernel per light type and per PCF samples count, instantiated
+    from the templates, so that a pass picks its kernel once and its loop over the pixels has no branch on either.
+*/
+using VPLSpanKernel = void (*)(const VirtualLight& light, const GBufferTexel* texels, std::size_t count, float weight, Vector3* colors);
+using PointLightSpanKernel = void (*)(
+    const VirtualLight& light, const SoftwareCubeShadowMap& shadow_map, const ShadowConstants& shadow,
+    const GBufferTexel* texels, std::size_t count, float weight, Vector3* colors
+);
+
+template <int LightType>
+static void ShadeVPLSpan(const VirtualLight& light, const GBufferTexel* texels, std::size_t count, float weight, Vector3* colors)
+{
+    for (std::size_t k{}; k < count; k++)
+    {
+        colors[k] = colors[k] + ShadeDiffuseKernel<LightType>(texels[k].position, texels[k].normal, texels[k].albedo, light) * weight;
+    }
+}
+
+template <int PcfSamples>
+static void ShadePointLightSpan(
+    const VirtualLight& light, const SoftwareCubeShadowMap& shadow_map, const ShadowConstants& shadow,
+    const GBufferTexel* texels, std::size_t count, float weight, Vector3* colors
+)
+{
+    for (std::size_t k{}; k < count; k++)
+    {
+        colors[k] = colors[k] + ShadeShadowedKernel<PcfSamples>(texels[k].position, texels[k].normal, texels[k].albedo, light, shadow_map, shadow) * weight;
+    }
+}
+
+template <std::size_t... Indices>
+static constexpr std::array<PointLightSpanKernel, sizeof...(Indices)> PointLightSpanKernels(std::index_sequence<Indices...>)
+{
+    return { ShadePointLightSpan<static_cast<int>(Indices) + 1>... };
+}
+
+constexpr VPLSpanKernel VPL_SPAN_KERNELS[]{ ShadeVPLSpan<LIGHT_TYPE_POINT>, ShadeVPLSpan<LIGHT_TYPE_SIGN_COS_WEIGHTED>, ShadeVPLSpan<LIGHT_TYPE_COS_WEIGHTED> }; // by light type
+constexpr std::array<PointLightSpanKernel, PCF_MAX_SAMPLES> POINT_LIGHT_SPAN_KERNELS{ PointLightSpanKernels(std::make_index_sequence<PCF_MAX_SAMPLES>{}) }; // by PCF samples - 1
+
+static VPLSpanKernel SelectVPLSpanKernel(int light_type)
+{
+    static_assert(LIGHT_TYPE_POINT == 0 && LIGHT_TYPE_SIGN_COS_WEIGHTED == 1 && LIGHT_TYPE_COS_WEIGHTED == 2);
+    Check(light_type >= 0 && light_type < static_cast<int>(std::size(VPL_SPAN_KERNELS)));
+    return VPL_SPAN_KERNELS[light_type];
+}
+
+static PointLightSpanKernel SelectPointLightSpanKernel(int pcf_samples)
+{
+    Check(pcf_samples >= 1 && pcf_samples <= PCF_MAX_SAMPLES);
+    return POINT_LIGHT_SPAN_KERNELS[pcf_samples - 1];
+}
+
+/*
+    Multi-light kernels: a shading point against all the VPLs of a structure of arrays, 8 (AVX2) or 16 (AVX-512) of them per
+    iteration. The VPLs share their type, resolved at compile time, their intensities are premultiplied by their colors and the weight
+    when packed, and the arrays are padded with black lights to a multiple of SIMD_MAX_LANES. The reciprocal of the distance is the
+    approximation of rsqrt refined by a Newton-Raphson step, and the lights are summed in another order, so the colors match the
+    scalar reference within SIMD_TOLERANCE rather than exactly. Being approximate, they are opt-in (--simd, SIMD_LANES_START is the
+    exact span kernels) and simd-check, a CTest test, fails when they drift past the tolerance. The vector kernels are picked at run
+    time from the CPU features, the executable doesn't require AVX2. Outside of x86-64 only the scalar kernels exist.
+*/
+struct VPLLanes
+{
+    int count; // padded
+    std::vector<float> x, y, z; // position
+    std::vector<float> nx, ny, nz; // normal
+    std::vector<float> r, g, b; // intensity * color * weight
+};
+
+using VPLLanesKernel = Vector3 (*)(const VPLLanes& lanes, Vector3 position, Vector3 normal, Vector3 albedo);
+
+static void PackVPLLanes(const std::vector<VirtualLight>& virtual_lights, const std::vector<int>& indices, float weight, VPLLanes& lanes)
+{
+    const int count{ static_cast<int>(indices.size()) };
+    lanes.count = (count + SIMD_MAX_LANES - 1) / SIMD_MAX_LANES * SIMD_MAX_LANES;
+    for (std::vector<float>* array : { &lanes.x, &lanes.y, &lanes.z, &lanes.nx, &lanes.ny, &lanes.nz, &lanes.r, &lanes.g, &lanes.b })
+    {
+        array->assign(lanes.count, 0.0f);
+    }
+    for (int l{}; l < count; l++)
+    {
+        const VirtualLight& light{ virtual_lights[indices[l]] };
+        Vector3 color{ light.color * light.intensity * weight };
+        lanes.x[l] = light.position.x;
+        lanes.y[l] = light.position.y;
+        lanes.z[l] = light.position.z;
+        lanes.nx[l] = light.normal.x;
+        lanes.ny[l] = light.normal.y;
+        lanes.nz[l] = light.normal.z;
+        lanes.r[l] = color.x;
+        lanes.g[l] = color.y;
+        lanes.b[l] = color.z;
+    }
+}
+
+template <int LightType>
+static Vector3 ShadeVPLLanesScalar(const VPLLanes& lanes, Vector3 position, Vector3 normal, Vector3 albedo)
+{
+    // reference, a light at a time with the exact square root of ShadeDiffuseKernel
+    Vector3 sum{};
+    for (int l{}; l < lanes.count; l++)
+    {
+        Vector3 to_light{ Vector3{ lanes.x[l], lanes.y[l], lanes.z[l] } - position };
+        float distance{ to_light.Length() };
+        if (distance <= 2.0f * SHADOW_RAY_OFFSET) continue;
+
+        Vector3 L{ to_light / distance };
+        float n_dot_l{ std::max(normal.Dot(L), 0.0f) };
+
+        float light_weight{ 1.0f };
+        Vector3 light_normal{ lanes.nx[l], lanes.ny[l], lanes.nz[l] };
+        if constexpr (LightType == LIGHT_TYPE_COS_WEIGHTED)
+        {
+            light_weight = std::max(light_normal.Dot(-L), 0.0f);
+        }
+        else if constexpr (LightType == LIGHT_TYPE_SIGN_COS_WEIGHTED)
+        {
+            light_weight = light_normal.Dot(-L) > 0.0f ? 1.0f : 0.0f;
+        }
+
+        sum = sum + Vector3{ lanes.r[l], lanes.g[l], lanes.b[l] } * (light_weight * n_dot_l);
+    }
+    return albedo / std::numbers::pi_v<float> * sum;
+}
+
+constexpr VPLLanesKernel VPL_LANES_KERNELS_SCALAR[]{ ShadeVPLLanesScalar<LIGHT_TYPE_POINT>, ShadeVPLLanesScalar<LIGHT_TYPE_SIGN_COS_WEIGHTED>, ShadeVPLLanesScalar<LIGHT_TYPE_COS_WEIGHTED> };
+
+#if defined(__x86_64__) || defined(_M_X64)
+// MSVC compiles the intrinsics of any instruction set, GCC and Clang only inside functions targeting it
+#if defined(__GNUC__) || defined(__clang__)
+#define TARGET_XSAVE __attribute__((target("xsave")))
+#define TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define TARGET_AVX512 __attribute__((target("avx512f")))
+#else
+#define TARGET_XSAVE
+#define TARGET_AVX2
+#define TARGET_AVX512
+#endif
+
+template <int LightType>
+TARGET_AVX2 static Vector3 ShadeVPLLanesAVX2(const VPLLanes& lanes, Vector3 position, Vector3 normal, Vector3 albedo)
+{
+    const __m256 p[3]{ _mm256_set1_ps(position.x), _mm256_set1_ps(position.y), _mm256_set1_ps(position.z) };
+    const __m256 n[3]{ _mm256_set1_ps(normal.x), _mm256_set1_ps(normal.y), _mm256_set1_ps(normal.z) };
+    const __m256 zero{ _mm256_setzero_ps() };
+    const __m256 half{ _mm256_set1_ps(0.5f) };
+    const __m256 three{ _mm256_set1_ps(3.0f) };
+    const __m256 min_distance2{ _mm256_set1_ps(4.0f * SHADOW_RAY_OFFSET * SHADOW_RAY_OFFSET) };
+
+    __m256 sum[3]{ zero, zero, zero };
+    for (int l{}; l < lanes.count; l += 8)
+    {
+        const __m256 d[3]{
+            _mm256_sub_ps(_mm256_loadu_ps(lanes.x.data() + l), p[0]),
+            _mm256_sub_ps(_mm256_loadu_ps(lanes.y.data() + l), p[1]),
+            _mm256_sub_ps(_mm256_loadu_ps(lanes.z.data() + l), p[2])
+        };
+        const __m256 distance2{ _mm256_fmadd_ps(d[0], d[0], _mm256_fmadd_ps(d[1], d[1], _mm256_mul_ps(d[2], d[2]))) };
+
+        // 1 / distance: y (3 - x y^2) / 2 doubles the 12 bits of the approximation
+        __m256 inv_distance{ _mm256_rsqrt_ps(distance2) };
+        inv_distance = _mm256_mul_ps(_mm256_mul_ps(half, inv_distance), _mm256_fnmadd_ps(_mm256_mul_ps(distance2, inv_distance), inv_distance, three));
+
+        // N.L, times the light weight, the lights too close are masked out (with the infinities of a zero distance)
+        const __m256 n_dot_d{ _mm256_fmadd_ps(n[0], d[0], _mm256_fmadd_ps(n[1], d[1], _mm256_mul_ps(n[2], d[2]))) };
+        __m256 factor{ _mm256_mul_ps(_mm256_max_ps(n_dot_d, zero), inv_distance) };
+        if constexpr (LightType != LIGHT_TYPE_POINT)
+        {
+            const __m256 light_n_dot_d{ _mm256_fmadd_ps(
+                _mm256_loadu_ps(lanes.nx.data() + l), d[0],
+                _mm256_fmadd_ps(_mm256_loadu_ps(lanes.ny.data() + l), d[1], _mm256_mul_ps(_mm256_loadu_ps(lanes.nz.data() + l), d[2]))
+            ) }; // light normal.L times the distance, negative when the VPL faces the point
+            if constexpr (LightType == LIGHT_TYPE_COS_WEIGHTED)
+            {
+                factor = _mm256_mul_ps(factor, _mm256_mul_ps(_mm256_max_ps(_mm256_sub_ps(zero, light_n_dot_d), zero), inv_distance));
+            }
+            else
+            {
+                factor = _mm256_and_ps(factor, _mm256_cmp_ps(light_n_dot_d, zero, _CMP_LT_OQ));
+            }
+        }
+        factor = _mm256_and_ps(factor, _mm256_cmp_ps(distance2, min_distance2, _CMP_GT_OQ));
+
+        sum[0] = _mm256_fmadd_ps(factor, _mm256_loadu_ps(lanes.r.data() + l), sum[0]);
+        sum[1] = _mm256_fmadd_ps(factor, _mm256_loadu_ps(lanes.g.data() + l), sum[1]);
+        sum[2] = _mm256_fmadd_ps(factor, _mm256_loadu_ps(lanes.b.data() + l), sum[2]);
+    }
+
+    float color[3]{};
+    for (int c{}; c < 3; c++)
+    {
+        __m128 s{ _mm_add_ps(_mm256_castps256_ps128(sum[c]), _mm256_extractf128_ps(sum[c], 1)) };
+        s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+        color[c] = _mm_cvtss_f32(_mm_add_ss(s, _mm_movehdup_ps(s)));
+    }
+    return albedo / std::numbers::pi_v<float> * Vector3{ color[0], color[1], color[2] };
+}
+
+// the AVX-512 headers of GCC 12 initialize _mm512_undefined_ps with itself, which warns once inlined
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+template <int LightType>
+TARGET_AVX512 static Vector3 ShadeVPLLanesAVX512(const VPLLanes& lanes, Vector3 position, Vector3 normal, Vector3 albedo)
+{
+    // same as the AVX2 kernel, with masks instead of the and of comparisons, and the 14 bits approximation of rsqrt
+    const __m512 p[3]{ _mm512_set1_ps(position.x), _mm512_set1_ps(position.y), _mm512_set1_ps(position.z) };
+    const __m512 n[3]{ _mm512_set1_ps(normal.x), _mm512_set1_ps(normal.y), _mm512_set1_ps(normal.z) };
+    const __m512 zero{ _mm512_setzero_ps() };
+    const __m512 half{ _mm512_set1_ps(0.5f) };
+    const __m512 three{ _mm512_set1_ps(3.0f) };
+    const __m512 min_distance2{ _mm512_set1_ps(4.0f * SHADOW_RAY_OFFSET * SHADOW_RAY_OFFSET) };
+
+    __m512 sum[3]{ zero, zero, zero };
+    for (int l{}; l < lanes.count; l += 16)
+    {
+        const __m512 d[3]{
+            _mm512_sub_ps(_mm512_loadu_ps(lanes.x.data() + l), p[0]),
+            _mm512_sub_ps(_mm512_loadu_ps(lanes.y.data() + l), p[1]),
+            _mm512_sub_ps(_mm512_loadu_ps(lanes.z.data() + l), p[2])
+        };
+        const __m512 distance2{ _mm512_fmadd_ps(d[0], d[0], _mm512_fmadd_ps(d[1], d[1], _mm512_mul_ps(d[2], d[2]))) };
+
+        __m512 inv_distance{ _mm512_rsqrt14_ps(distance2) };
+        inv_distance = _mm512_mul_ps(_mm512_mul_ps(half, inv_distance), _mm512_fnmadd_ps(_mm512_mul_ps(distance2, inv_distance), inv_distance, three));
+
+        const __m512 n_dot_d{ _mm512_fmadd_ps(n[0], d[0], _mm512_fmadd_ps(n[1], d[1], _mm512_mul_ps(n[2], d[2]))) };
+        __m512 factor{ _mm512_mul_ps(_mm512_max_ps(n_dot_d, zero), inv_distance) };
+        __mmask16 mask{ _mm512_cmp_ps_mask(distance2, min_distance2, _CMP_GT_OQ) };
+        if constexpr (LightType != LIGHT_TYPE_POINT)
+        {
+            const __m512 light_n_dot_d{ _mm512_fmadd_ps(
+                _mm512_loadu_ps(lanes.nx.data() + l), d[0],
+                _mm512_fmadd_ps(_mm512_loadu_ps(lanes.ny.data() + l), d[1], _mm512_mul_ps(_mm512_loadu_ps(lanes.nz.data() + l), d[2]))
+            ) };
+            if constexpr (LightType == LIGHT_TYPE_COS_WEIGHTED)
+            {
+                factor = _mm512_mul_ps(factor, _mm512_mul_ps(_mm512_max_ps(_mm512_sub_ps(zero, light_n_dot_d), zero), inv_distance));
+            }
+            else
+            {
+                mask &= _mm512_cmp_ps_mask(light_n_dot_d, zero, _CMP_LT_OQ);
+            }
+        }
+        factor = _mm512_maskz_mov_ps(mask, factor);
+
+        sum[0] = _mm512_fmadd_ps(factor, _mm512_loadu_ps(lanes.r.data() + l), sum[0]);
+        sum[1] = _mm512_fmadd_ps(factor, _mm512_loadu_ps(lanes.g.data() + l), sum[1]);
+        sum[2] = _mm512_fmadd_ps(factor, _mm512_loadu_ps(lanes.b.data() + l), sum[2]);
+    }
+
+    Vector3 color{ _mm512_reduce_add_ps(sum[0]), _mm512_reduce_add_ps(sum[1]), _mm512_reduce_add_ps(sum[2]) };
+    return albedo / std::numbers::pi_v<float> * color;
+}
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+constexpr VPLLanesKernel VPL_LANES_KERNELS_AVX2[]{ ShadeVPLLanesAVX2<LIGHT_TYPE_POINT>, ShadeVPLLanesAVX2<LIGHT_TYPE_SIGN_COS_WEIGHTED>, ShadeVPLLanesAVX2<LIGHT_TYPE_COS_WEIGHTED> };
+constexpr VPLLanesKernel VPL_LANES_KERNELS_AVX512[]{ ShadeVPLLanesAVX512<LIGHT_TYPE_POINT>, ShadeVPLLanesAVX512<LIGHT_TYPE_SIGN_COS_WEIGHTED>, ShadeVPLLanesAVX512<LIGHT_TYPE_COS_WEIGHTED> };
+
+static void CPUID(int leaf, int (&info)[4])
+{
+    // eax, ebx, ecx and edx of the leaf at subleaf 0, zeros past the highest leaf on GCC and Clang
+#if defined(__GNUC__) || defined(__clang__)
+    unsigned int registers[4]{};
+    __get_cpuid_count(static_cast<unsigned int>(leaf), 0, &registers[0], &registers[1], &registers[2], &registers[3]);
+    for (int i{}; i < 4; i++) info[i] = static_cast<int>(registers[i]);
+#else
+    __cpuidex(info, leaf, 0);
+#endif
+}
+
+TARGET_XSAVE static unsigned long long ExtendedControlRegister0()
+{
+    // the register states the OS saves, only readable once CPUID reports OSXSAVE
+    return static_cast<unsigned long long>(_xgetbv(0));
+}
+
+static int SupportedSIMDLanes()
+{
+    // widest vector of the CPU whose registers the OS saves: 16 with AVX-512F, 8 with AVX2 and FMA, else 1
+    int info[4]{};
+    CPUID(0, info);
+    if (info[0] < 7) return 1;
+    CPUID(1, info);
+    const bool fma{ (info[2] & (1 << 12)) != 0 };
+    const bool osxsave{ (info[2] & (1 << 27)) != 0 };
+    if (!osxsave) return 1;
+    const unsigned long long xcr0{ ExtendedControlRegister0() };
+    CPUID(7, info);
+    const bool avx2{ (info[1] & (1 << 5)) != 0 };
+    const bool avx512f{ (info[1] & (1 << 16)) != 0 };
+    if (avx512f && fma && (xcr0 & 0xE6) == 0xE6) return 16; // SSE, AVX, opmask and ZMM states
+    if (avx2 && fma && (xcr0 & 0x6) == 0x6) return 8; // SSE and AVX states
+    return 1;
+}
+#else
+static int SupportedSIMDLanes()
+{
+    // the vector kernels are x86-64 only
+    return 1;
+}
+#endif
+
+static VPLLanesKernel SelectVPLLanesKernel(int light_type, int simd_lanes)
+{
+    Check(light_type >= 0 && light_type < static_cast<int>(std::size(VPL_LANES_KERNELS_SCALAR)));
+    Check(simd_lanes <= SupportedSIMDLanes());
+    switch (simd_lanes)
+    {
+#if defined(__x86_64__) || defined(_M_X64)
+    case 16:
+        return VPL_LANES_KERNELS_AVX512[light_type];
+    case 8:
+        return VPL_LANES_KERNELS_AVX2[light_type];
+#endif
+    default:
+        return VPL_LANES_KERNELS_SCALAR[light_type];
+    }
+}
+
+static void GatherSceneTriangles(const std::vector<Object>& objects, std::vector<std::array<Vector3, 3>>& triangles)
+{
+    // world space triangles of the CPU copies of the meshes
+    triangles.clear();
+    for (const Object& obj : objects)
+    {
+        const std::vector<Vertex>& vertices{ obj.mesh->CPUVertices() };
+        const std::vector<std::uint32_t>& indices{ obj.mesh->CPUIndices() };
+        for (std::size_t i{}; i + 2 < indices.size(); i += 3)
+        {
+            std::array<Vector3, 3>& triangle{ triangles.emplace_back() };
+            for (int v{}; v < 3; v++)
+            {
+                triangle[v] = Vector3::Transform(vertices[indices[i + v]].position, obj.model);
+            }
+        }
+    }
+}
+
+class ImperfectShadowMaps
+{
+public:
+    ImperfectShadowMaps();
+    ~ImperfectShadowMaps() = default;
+    ImperfectShadowMaps(const ImperfectShadowMaps&) = delete;
+    ImperfectShadowMaps(ImperfectShadowMaps&&) noexcept = default;
+    ImperfectShadowMaps& operator=(const ImperfectShadowMaps&) = delete;
+    ImperfectShadowMaps& operator=(ImperfectShadowMaps&&) noexcept = default;
+public:
+    // maps of the lights from first_light on, dual-paraboloid when the lights emit behind their surface too
+    void Render(const std::vector<Object>& objects, const std::vector<VirtualLight>& virtual_lights, int first_light, bool omnidirectional);
+    float Sample(int light, Vector3 v) const; // distance of the closest point along v from the light, 0 behind its surface if not omnidirectional
+private:
+    void SamplePoints(const std::vector<Object>& objects);
+    void PullPush(float* map) const;
+    int Texel(int k, Vector3 v) const; // of the direction v (normalized) in the compact maps of light k, -1 behind a single paraboloid
+private:
+    std::vector<Vector3> m_points; // in random order, so that any range is a random subset
+    std::vector<float> m_atlas; // ISM_SIZE x ISM_SIZE maps, m_maps_per_row per row, m_paraboloids consecutive maps per light
+    std::vector<Vector3> m_bases; // tangent, bitangent and normal of each light
+    int m_first_light;
+    int m_paraboloids; // 1 for the hemisphere around the normal, 2 for the whole sphere
+    int m_maps_per_row;
+};
+
+ImperfectShadowMaps::ImperfectShadowMaps()
+    : m_points{}
+    , m_atlas{}
+    , m_bases{}
+    , m_first_light{}
+    , m_paraboloids{ 1 }
+    , m_maps_per_row{}
+{
+}
+
+void ImperfectShadowMaps::Render(
+    const std::vector<Object>& objects, const std::vector<VirtualLight>& virtual_lights, int first_light, bool omnidirectional
+)
+{
+    /*
+        Imperfect shadow maps (Ritschel et al.): the scene is replaced by ISM_SCENE_POINTS points uniformly spread over its surface,
+        and each VPL splats a different subset of ISM_POINTS_PER_VPL of them into a low resolution paraboloid depth map of the
+        hemisphere around its normal (the other one is behind the surface the VPL lies on). VPLs shaded as point lights emit behind
+        their surface too, so they get a second paraboloid around the opposite of the normal (dual-paraboloid maps). The maps are
+        packed into one atlas and splatted in parallel, one light per task, then the holes left between the points are filled with a
+        pull-push pass.
+    */
+    SamplePoints(objects);
+
+    int lights_count{ std::max(static_cast<int>(virtual_lights.size()) - first_light, 0) };
+    m_first_light = first_light;
+    m_paraboloids = omnidirectional ? 2 : 1;
+    int maps_count{ lights_count * m_paraboloids };
+    m_maps_per_row = std::max(static_cast<int>(std::ceil(std::sqrt(static_cast<float>(maps_count)))), 1);
+    int maps_per_column{ (maps_count + m_maps_per_row - 1) / m_maps_per_row };
+    std::size_t atlas_width{ static_cast<std::size_t>(m_maps_per_row) * ISM_SIZE };
+    m_atlas.assign(atlas_width * ISM_SIZE * maps_per_column, std::numeric_limits<float>::infinity());
+    m_bases.resize(static_cast<std::size_t>(lights_count) * 3);
+
+    ParallelFor(lights_count, [&](int k)
+    {
+        const VirtualLight& light{ virtual_lights[first_light + k] };
+        Vector3& t{ m_bases[k * 3] };
+        Vector3& b{ m_bases[k * 3 + 1] };
+        Vector3& n{ m_bases[k * 3 + 2] };
+        n = light.normal;
+        n.Normalize();
+        BuildOrthonormalBasis(n, t, b);
+
+        // splat into a compact copy of the maps, the atlas rows of a map aren't contiguous
+        std::array<float, 2 * ISM_SIZE * ISM_SIZE> maps{};
+        maps.fill(std::numeric_limits<float>::infinity());
+        std::size_t first_point{ static_cast<std::size_t>(k) * ISM_POINTS_PER_VPL };
+        for (int j{}; j < ISM_POINTS_PER_VPL; j++)
+        {
+            Vector3 v{ m_points[(first_point + j) % m_points.size()] - light.position };
+            float distance{ v.Length() };
+            if (distance <= 0.0f) continue;
+
+            int texel{ Texel(k, v / distance) };
+            if (texel < 0) continue;
+            float& depth{ maps[texel] };
+            depth = std::min(depth, distance);
+        }
+
+        for (int paraboloid{}; paraboloid < m_paraboloids; paraboloid++)
+        {
+            float* map{ maps.data() + paraboloid * ISM_SIZE * ISM_SIZE };
+            PullPush(map);
+
+            int slot{ k * m_paraboloids + paraboloid };
+            std::size_t origin{ static_cast<std::size_t>(slot / m_maps_per_row) * ISM_SIZE * atlas_width + static_cast<std::size_t>(slot % m_maps_per_row) * ISM_SIZE };
+            for (int y{}; y < ISM_SIZE; y++)
+            {
+                std::copy_n(map + y * ISM_SIZE, ISM_SIZE, m_atlas.begin() + origin + y * atlas_width);
+            }
+        }
+    });
+}
+
+float ImperfectShadowMaps::Sample(int light, Vector3 v) const
+{
+    int k{ light - m_first_light };
+    float distance{ v.Length() };
+    if (distance <= 0.0f) return std::numeric_limits<float>::infinity();
+
+    int texel{ Texel(k, v / distance) };
+    if (texel < 0) return 0.0f;
+    int slot{ k * m_paraboloids + texel / (ISM_SIZE * ISM_SIZE) };
+    int x{ texel % ISM_SIZE };
+    int y{ texel / ISM_SIZE % ISM_SIZE };
+
+    std::size_t atlas_width{ static_cast<std::size_t>(m_maps_per_row) * ISM_SIZE };
+    std::size_t row{ static_cast<std::size_t>(slot / m_maps_per_row) * ISM_SIZE + y };
+    return m_atlas[row * atlas_width + static_cast<std::size_t>(slot % m_maps_per_row) * ISM_SIZE + x];
+}
+
+int ImperfectShadowMaps::Texel(int k, Vector3 v) const
+{
+    // paraboloid projection around the normal, or around its opposite (second map) for the directions behind it
+    const Vector3& t{ m_bases[k * 3] };
+    const Vector3& b{ m_bases[k * 3 + 1] };
+    const Vector3& n{ m_bases[k * 3 + 2] };
+    float z{ v.Dot(n) };
+    int paraboloid{ z > 0.0f ? 0 : 1 };
+    if (paraboloid >= m_paraboloids) return -1;
+
+    z = std::abs(z);
+    int x{ std::clamp(static_cast<int>((0.5f + 0.5f * v.Dot(t) / (1.0f + z)) * ISM_SIZE), 0, ISM_SIZE - 1) };
+    int y{ std::clamp(static_cast<int>((0.5f + 0.5f * v.Dot(b) / (1.0f + z)) * ISM_SIZE), 0, ISM_SIZE - 1) };
+    return (paraboloid * ISM_SIZE + y) * ISM_SIZE + x;
+}
+
+void ImperfectShadowMaps::SamplePoints(const std::vector<Object>& objects)
+{
+    // area weighted triangles, then a uniform point on the chosen one
+    std::vector<std::array<Vector3, 3>> triangles{};
+    GatherSceneTriangles(objects, triangles);
+    std::vector<float> areas_cdf(triangles.size());
+    float area_sum{};
+    for (std::size_t i{}; i < triangles.size(); i++)
+    {
+        area_sum += 0.5f * (triangles[i][1] - triangles[i][0]).Cross(triangles[i][2] - triangles[i][0]).Length();
+        areas_cdf[i] = area_sum;
+    }
+
+    m_points.resize(area_sum > 0.0f ? ISM_SCENE_POINTS : 0);
+    ParallelFor(static_cast<int>(m_points.size()), [&](int i)
+    {
+        std::uint32_t rng{ PCGHash(static_cast<std::uint32_t>(i)) };
+        float u{ RandomFloat(rng) * area_sum };
+        std::size_t index{ static_cast<std::size_t>(std::upper_bound(areas_cdf.begin(), areas_cdf.end(), u) - areas_cdf.begin()) };
+        const std::array<Vector3, 3>& triangle{ triangles[std::min(index, triangles.size() - 1)] };
+
+        float r{ std::sqrt(RandomFloat(rng)) };
+        float s{ RandomFloat(rng) };
+        m_points[i] = triangle[0] * (1.0f - r) + triangle[1] * (r * (1.0f - s)) + triangle[2] * (r * s);
+    });
+}
+
+void ImperfectShadowMaps::PullPush(float* map) const
+{
+    // pull: each coarser level averages the covered texels below it, push: the holes take the value of the texel above them
+    constexpr int levels_count{ std::bit_width(static_cast<unsigned>(ISM_SIZE)) };
+    std::array<std::vector<float>, levels_count> levels{};
+    levels[0].assign(map, map + ISM_SIZE * ISM_SIZE);
+    for (int level{ 1 }; level < levels_count; level++)
+    {
+        int size{ ISM_SIZE >> level };
+        levels[level].resize(static_cast<std::size_t>(size) * size);
+        for (int y{}; y < size; y++)
+        {
+            for (int x{}; x < size; x++)
+            {
+                float sum{};
+                int count{};
+                for (int j{}; j < 4; j++)
+                {
+                    float depth{ levels[level - 1][(2 * y + j / 2) * 2 * size + 2 * x + j % 2] };
+                    if (std::isinf(depth)) continue;
+                    sum += depth;
+                    count++;
+                }
+                levels[level][y * size + x] = count > 0 ? sum / static_cast<float>(count) : std::numeric_limits<float>::infinity();
+            }
+        }
+    }
+
+    for (int level{ levels_count - 2 }; level >= 0; level--)
+    {
+        int size{ ISM_SIZE >> level };
+        for (int y{}; y < size; y++)
+        {
+            for (int x{}; x < size; x++)
+            {
+                float& depth{ levels[level][y * size + x] };
+                if (std::isinf(depth)) depth = levels[level + 1][(y / 2) * (size / 2) + x / 2];
+            }
+        }
+    }
+    std::copy(levels[0].begin(), levels[0].end(), map);
+}
+
+class TriangleBVH
+{
+public:
+    TriangleBVH();
+    ~TriangleBVH() = default;
+    TriangleBVH(const TriangleBVH&) = delete;
+    TriangleBVH(TriangleBVH&&) noexcept = default;
+    TriangleBVH& operator=(const TriangleBVH&) = delete;
+    TriangleBVH& operator=(TriangleBVH&&) noexcept = default;
+public:
+    void Build(const std::vector<Object>& objects);
+    void OccludedBatch(Vector3 origin, const Vector3* targets, int count, std::uint8_t* occluded) const; // any hit between origin and each target
+private:
+    struct Node
+    {
+        Vector3 aabb_min;
+        Vector3 aabb_max;
+        int first; // first triangle (leaves) or right child (inner nodes, the left one follows the node)
+        int count; // triangles, 0 for inner nodes
+    };
+    struct Triangle
+    {
+        Vector3 v0;
+        Vector3 e1;
+        Vector3 e2;
+    };
+private:
+    int BuildNode(std::vector<std::array<Vector3, 3>>& triangles, int begin, int end);
+private:
+    std::vector<Node> m_nodes; // depth first
+    std::vector<Triangle> m_triangles; // in leaf order
+};
+
+TriangleBVH::TriangleBVH()
+    : m_nodes{}
+    , m_triangles{}
+{
+}
+
+void TriangleBVH::Build(const std::vector<Object>& objects)
+{
+    std::vector<std::array<Vector3, 3>> triangles{};
+    GatherSceneTriangles(objects, triangles);
+
+    m_nodes.clear();
+    m_triangles.clear();
+    if (triangles.empty()) return;
+
+    BuildNode(triangles, 0, static_cast<int>(triangles.size()));
+    m_triangles.resize(triangles.size());
+    for (std::size_t i{}; i < triangles.size(); i++)
+    {
+        m_triangles[i] = { triangles[i][0], triangles[i][1] - triangles[i][0], triangles[i][2] - triangles[i][0] };
+    }
+}
+
+int TriangleBVH::BuildNode(std::vector<std::array<Vector3, 3>>& triangles, int begin, int end)
+{
+    // median split along the longest axis of the centroids bounds
+    int index{ static_cast<int>(m_nodes.size()) };
+    Node node{ Vector3{ std::numeric_limits<float>::infinity() }, Vector3{ -std::numeric_limits<float>::infinity() }, begin, end - begin };
+    Vector3 centroids_min{ std::numeric_limits<float>::infinity() };
+    Vector3 centroids_max{ -std::numeric_limits<float>::infinity() };
+    for (int i{ begin }; i < end; i++)
+    {
+        for (const Vector3& v : triangles[i])
+        {
+            node.aabb_min = Vector3::Min(node.aabb_min, v);
+            node.aabb_max = Vector3::Max(node.aabb_max, v);
+        }
+        Vector3 centroid{ (triangles[i][0] + triangles[i][1] + triangles[i][2]) / 3.0f };
+        centroids_min = Vector3::Min(centroids_min, centroid);
+        centroids_max = Vector3::Max(centroids_max, centroid);
+    }
+    m_nodes.push_back(node);
+    if (end - begin <= BVH_LEAF_TRIANGLES) return index;
+
+    Vector3 extent{ centroids_max - centroids_min };
+    int axis{ extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2) };
+    auto centroid_coordinate{ [axis](const std::array<Vector3, 3>& triangle)
+    {
+        Vector3 sum{ triangle[0] + triangle[1] + triangle[2] };
+        return axis == 0 ? sum.x : (axis == 1 ? sum.y : sum.z);
+    } };
+
+    int middle{ begin + (end - begin) / 2 };
+    std::nth_element(triangles.begin() + begin, triangles.begin() + middle, triangles.begin() + end, [&](const auto& a, const auto& b)
+    {
+        return centroid_coordinate(a) < centroid_coordinate(b);
+    });
+
+    BuildNode(triangles, begin, middle);
+    int right{ BuildNode(triangles, middle, end) };
+    m_nodes[index].first = right;
+    m_nodes[index].count = 0;
+    return index;
+}
+
+void TriangleBVH::OccludedBatch(Vector3 origin, const Vector3* targets, int count, std::uint8_t* occluded) const
+{
+    /*
+        The rays share their origin, so the whole batch goes down the tree at once: each node tests the rays that reached its
+        parent and passes on those crossing its box, as a range of the rays stack. Rays stop at their first hit (any hit).
+    */
+    std::fill_n(occluded, count, std::uint8_t{});
+    if (m_nodes.empty() || count <= 0) return;
+
+    std::vector<Vector3> directions(count);
+    std::vector<Vector3> inverse_directions(count);
+    std::vector<float> reaches(count);
+    for (int r{}; r < count; r++)
+    {
+        Vector3 d{ targets[r] - origin };
+        float distance{ d.Length() };
+        directions[r] = distance > 0.0f ? d / distance : Vector3{};
+        inverse_directions[r] = { 1.0f / directions[r].x, 1.0f / directions[r].y, 1.0f / directions[r].z };
+        reaches[r] = distance - SHADOW_RAY_OFFSET;
+    }
+
+    struct Entry
+    {
+        int node;
+        std::size_t begin;
+        std::size_t end;
+    };
+    std::vector<int> rays(count);
+    std::iota(rays.begin(), rays.end(), 0);
+    std::vector<Entry> stack{ { 0, 0, rays.size() } };
+    while (!stack.empty())
+    {
+        Entry entry{ stack.back() };
+        stack.pop_back();
+        const Node& node{ m_nodes[entry.node] };
+
+        // slab test against the node box, ranges of the entries still on the stack are before begin
+        std::size_t begin{ rays.size() };
+        for (std::size_t k{ entry.begin }; k < entry.end; k++)
+        {
+            int r{ rays[k] };
+            if (occluded[r]) continue;
+            Vector3 t0{ (node.aabb_min - origin) * inverse_directions[r] };
+            Vector3 t1{ (node.aabb_max - origin) * inverse_directions[r] };
+            float t_min{ std::max({ std::min(t0.x, t1.x), std::min(t0.y, t1.y), std::min(t0.z, t1.z), SHADOW_RAY_OFFSET }) };
+            float t_max{ std::min({ std::max(t0.x, t1.x), std::max(t0.y, t1.y), std::max(t0.z, t1.z), reaches[r] }) };
+            if (t_min <= t_max) rays.push_back(r);
+        }
+        std::size_t end{ rays.size() };
+        if (begin == end) continue;
+
+        if (node.count > 0)
+        {
+            for (std::size_t k{ begin }; k < end; k++)
+            {
+                int r{ rays[k] };
+                for (int i{ node.first }; i < node.first + node.count; i++)
+                {
+                    // Moller-Trumbore
+                    const Triangle& triangle{ m_triangles[i] };
+                    Vector3 p{ directions[r].Cross(triangle.e2) };
+                    float determinant{ triangle.e1.Dot(p) };
+                    if (std::abs(determinant) < 1e-12f) continue;
+                    float inverse_determinant{ 1.0f / determinant };
+                    Vector3 s{ origin - triangle.v0 };
+                    float u{ s.Dot(p) * inverse_determinant };
+                    if (u < 0.0f || u > 1.0f) continue;
+                    Vector3 q{ s.Cross(triangle.e1) };
+                    float v{ directions[r].Dot(q) * inverse_determinant };
+                    if (v < 0.0f || u + v > 1.0f) continue;
+                    float t{ triangle.e2.Dot(q) * inverse_determinant };
+                    if (t > SHADOW_RAY_OFFSET && t < reaches[r])
+                    {
+                        occluded[r] = 1;
+                        break;
+                    }
+                }
+            }
+            rays.resize(begin);
+        }
+        else
+        {
+            stack.push_back({ node.first, begin, end });
+            stack.push_back({ entry.node + 1, begin, end });
+        }
+    }
+}
+
+class VisibilityCache
+{
+public:
+    explicit VisibilityCache(int size); // entries, a power of 2 (2 at least)
+    ~VisibilityCache() = default;
+    VisibilityCache(const VisibilityCache&) = delete;
+    VisibilityCache(VisibilityCache&&) noexcept = default;
+    VisibilityCache& operator=(const VisibilityCache&) = delete;
+    VisibilityCache& operator=(VisibilityCache&&) noexcept = default;
+public:
+    void Reset(float cell, std::size_t scene_hash); // drops all the entries
+    int Find(Vector3 position, int light) const; // 1 visible, 0 occluded, -1 not cached
+    void Insert(Vector3 position, int light, bool visible);
+    float Cell() const noexcept { return m_cell; }
+    std::size_t SceneHash() const noexcept { return m_scene_hash; }
+private:
+    std::uint64_t Key(Vector3 position, int light) const;
+    std::size_t Slot(std::uint64_t key) const;
+private:
+    std::vector<std::uint64_t> m_keys; // direct mapped, 0 for empty slots
+    std::vector<std::uint8_t> m_visible;
+    int m_slot_shift;
+    float m_cell; // side of the cells the positions are quantized to, 0 until reset
+    std::size_t m_scene_hash; // of the VPLs and the geometry the entries hold the visibility of
+};
+
+VisibilityCache::VisibilityCache(int size)
+    : m_keys{}
+    , m_visible{}
+    , m_slot_shift{}
+    , m_cell{}
+    , m_scene_hash{}
+{
+    // the slot is the top log2(size) bits of the hash, a shift by 64 bits would be undefined
+    Check(size >= 2 && std::has_single_bit(static_cast<unsigned>(size)));
+    m_keys.resize(size);
+    m_visible.resize(size);
+    m_slot_shift = 64 - std::countr_zero(static_cast<unsigned>(size));
+}
+
+void VisibilityCache::Reset(float cell, std::size_t scene_hash)
+{
+    std::fill(m_keys.begin(), m_keys.end(), 0);
+    m_cell = cell;
+    m_scene_hash = scene_hash;
+}
+
+int VisibilityCache::Find(Vector3 position, int light) const
+{
+    std::uint64_t key{ Key(position, light) };
+    std::size_t slot{ Slot(key) };
+    return m_keys[slot] == key ? m_visible[slot] : -1;
+}
+
+void VisibilityCache::Insert(Vector3 position, int light, bool visible)
+{
+    std::uint64_t key{ Key(position, light) };
+    std::size_t slot{ Slot(key) };
+    m_keys[slot] = key;
+    m_visible[slot] = visible ? 1 : 0;
+}
+
+std::uint64_t VisibilityCache::Key(Vector3 position, int light) const
+{
+    // 14 bits per cell coordinate (wrapping), 21 bits for the light, the top bit tells the key from an empty slot
+    auto cell{ [this](float coordinate)
+    {
+        return static_cast<std::uint64_t>(static_cast<std::int64_t>(std::floor(coordinate / m_cell))) & 0x3FFFu;
+    } };
+    return (1ull << 63) | (static_cast<std::uint64_t>(light & 0x1FFFFF) << 42) | (cell(position.z) << 28) | (cell(position.y) << 14) | cell(position.x);
+}
+
+std::size_t VisibilityCache::Slot(std::uint64_t key) const
+{
+    // Fibonacci hashing
+    return static_cast<std::size_t>((key * 0x9E3779B97F4A7C15ull) >> m_slot_shift);
+}
+
+class IrradianceCache
+{
+public:
+    struct Record
+    {
+        Vector3 position;
+        Vector3 normal;
+        Vector3 tangent; // the gradients are along the tangent and the bitangent
+        Vector3 bitangent;
+        Vector3 irradiance; // VPL light reflected by a white surface
+        float radius; // harmonic mean distance of the surfaces seen from the record (split sphere), clamped
+        Vector3 translation_gradient[2]; // derivatives of the irradiance moving along the tangent and the bitangent
+        Vector3 rotation_gradient[2]; // derivatives of the irradiance tilting the normal toward the tangent and the bitangent
+    };
+public:
+    IrradianceCache();
+    ~IrradianceCache() = default;
+    IrradianceCache(const IrradianceCache&) = delete;
+    IrradianceCache(IrradianceCache&&) noexcept = default;
+    IrradianceCache& operator=(const IrradianceCache&) = delete;
+    IrradianceCache& operator=(IrradianceCache&&) noexcept = default;
+public:
+    void Reset(Vector3 bounds_min, Vector3 bounds_max, float accuracy, std::size_t lighting_hash); // drops all the records
+    void Insert(const Record& record);
+    bool Interpolate(Vector3 position, Vector3 normal, Vector3& irradiance) const; // false when no record is valid at position
+    std::size_t LightingHash() const noexcept { return m_lighting_hash; }
+    int RecordsCount() const noexcept { return static_cast<int>(m_records.size()); }
+private:
+    struct Node
+    {
+        Vector3 center;
+        float half_size;
+        int children[8]; // -1 for none
+        std::vector<int> records; // overlapping the node, with a diameter between the size of the node and the one of its children
+    };
+private:
+    void InsertNode(int node, int record, Vector3 record_min, Vector3 record_max, float record_size, int depth);
+private:
+    std::vector<Record> m_records;
+    std::vector<Node> m_nodes; // m_nodes[0] is the root
+    float m_accuracy;
+    std::size_t m_lighting_hash;
+};
+
+IrradianceCache::IrradianceCache()
+    : m_records{}
+    , m_nodes{}
+    , m_accuracy{}
+    , m_lighting_hash{}
+{
+}
+
+void IrradianceCache::Reset(Vector3 bounds_min, Vector3 bounds_max, float accuracy, std::size_t lighting_hash)
+{
+    Vector3 extent{ bounds_max - bounds_min };
+    float half_size{ 0.5f * std::max({ extent.x, extent.y, extent.z }) + SHADOW_RAY_OFFSET };
+
+    m_records.clear();
+    m_nodes.clear();
+    m_nodes.push_back({ 0.5f * (bounds_min + bounds_max), half_size, { -1, -1, -1, -1, -1, -1, -1, -1 }, {} });
+    m_accuracy = accuracy;
+    m_lighting_hash = lighting_hash;
+}
+
+void IrradianceCache::Insert(const Record& record)
+{
+    // the record goes into every node its sphere of validity overlaps, at the depth matching its size (as pbrt)
+    int index{ static_cast<int>(m_records.size()) };
+    m_records.push_back(record);
+
+    float radius{ m_accuracy * record.radius };
+    InsertNode(0, index, record.position - Vector3{ radius }, record.position + Vector3{ radius }, 2.0f * radius, 0);
+}
+
+void IrradianceCache::InsertNode(int node, int record, Vector3 record_min, Vector3 record_max, float record_size, int depth)
+{
+    float child_half_size{ 0.5f * m_nodes[node].half_size };
+    if (depth >= IRRADIANCE_CACHE_OCTREE_MAX_DEPTH || 2.0f * child_half_size < record_size)
+    {
+        m_nodes[node].records.push_back(record);
+        return;
+    }
+
+    for (int c{}; c < 8; c++)
+    {
+        Vector3 offset{ (c & 1) ? child_half_size : -child_half_size, (c & 2) ? child_half_size : -child_half_size, (c & 4) ? child_half_size : -child_half_size };
+        Vector3 child_center{ m_nodes[node].center + offset };
+        Vector3 child_min{ child_center - Vector3{ child_half_size } };
+        Vector3 child_max{ child_center + Vector3{ child_half_size } };
+        if (record_max.x < child_min.x || record_min.x > child_max.x) continue;
+        if (record_max.y < child_min.y || record_min.y > child_max.y) continue;
+        if (record_max.z < child_min.z || record_min.z > child_max.z) continue;
+
+        if (m_nodes[node].children[c] < 0)
+        {
+            m_nodes[node].children[c] = static_cast<int>(m_nodes.size());
+            m_nodes.push_back({ child_center, child_half_size, { -1, -1, -1, -1, -1, -1, -1, -1 }, {} }); // invalidates references to nodes
+        }
+        InsertNode(m_nodes[node].children[c], record, record_min, record_max, record_size, depth + 1);
+    }
+}
+
+bool IrradianceCache::Interpolate(Vector3 position, Vector3 normal, Vector3& irradiance) const
+{
+    /*
+        Ward et al., "A Ray Tracing Solution for Diffuse Interreflection": the records whose error estimate at the point is below the
+        accuracy are averaged with the inverse of the error as weight, each one extrapolated with its gradients (Ward and Heckbert).
+        The records overlapping the point are the ones of the nodes on its path down the octree.
+    */
+    Vector3 irradiance_sum{};
+    float weight_sum{};
+    int node{ m_nodes.empty() ? -1 : 0 };
+    while (node >= 0)
+    {
+        for (int index : m_nodes[node].records)
+        {
+            const Record& record{ m_records[index] };
+            Vector3 d{ position - record.position };
+            float error{ d.Length() / record.radius + std::sqrt(std::max(1.0f - normal.Dot(record.normal), 0.0f)) };
+            if (error >= m_accuracy) continue;
+
+            // a record in front of the point sees surfaces the point doesn't
+            if (0.5f * d.Dot(normal + record.normal) < -IRRADIANCE_CACHE_FRONT_TOLERANCE * record.radius) continue;
+
+            Vector3 estimate{
+                record.irradiance
+                + record.translation_gradient[0] * d.Dot(record.tangent) + record.translation_gradient[1] * d.Dot(record.bitangent)
+                + record.rotation_gradient[0] * normal.Dot(record.tangent) + record.rotation_gradient[1] * normal.Dot(record.bitangent)
+            };
+            float weight{ 1.0f / std::max(error, 1e-4f) };
+            irradiance_sum += Vector3::Max(estimate, Vector3{}) * weight;
+            weight_sum += weight;
+        }
+
+        const Node& current{ m_nodes[node] };
+        int c{ (position.x > current.center.x ? 1 : 0) | (position.y > current.center.y ? 2 : 0) | (position.z > current.center.z ? 4 : 0) };
+        node = current.children[c];
+    }
+
+    if (weight_sum <= 0.0f) return false;
+    irradiance = irradiance_sum / weight_sum;
+    return true;
+}
+
+static float QuadProjectedSolidAngle(const Vector3 (&corners)[4], Vector3 position, Vector3 normal)
+{
+    // same as PSAreaLight.hlsl (Lambert's polygon formula, no horizon clipping)
+    Vector3 v[4]{};
+    for (int i{}; i < 4; i++)
+    {
+        v[i] = corners[i] - position;
+        v[i].Normalize();
+    }
+
+    float sum{};
+    for (int j{}; j < 4; j++)
+    {
+        const Vector3& a{ v[j] };
+        const Vector3& b{ v[(j + 1) % 4] };
+        float theta{ std::acos(std::clamp(a.Dot(b), -1.0f, 1.0f)) };
+        Vector3 edge_normal{ b.Cross(a) };
+        float length{ edge_normal.Length() };
+        if (length > 0.0f)
+        {
+            sum += theta * edge_normal.Dot(normal) / length;
+        }
+    }
+
+    return std::max(0.5f * sum, 0.0f);
+}
+
+struct SoftwareShading
+{
+    // defaults to the configuration the interactive mode starts with
+    bool deferred{ true }; // rasterize a G-buffer once and shade all the lights in a single pass, instead of a pass per light
+    int light_culling{ LIGHT_CULLING_NONE }; // LIGHT_CULLING_NONE, LIGHT_CULLING_TILED or LIGHT_CULLING_CLUSTERED (deferred only)
+    float attenuation_epsilon{ VPL_ATTENUATION_EPSILON_START }; // contribution below which the bounded attenuation of the VPLs cuts off, 0 for no attenuation (as the GPU)
+    int interleave{ INTERLEAVE_START }; // each pixel of an interleave x interleave block shades a different subset of the VPLs, 1 for all of them (deferred only)
+    int vpl_visibility{ VPL_VISIBILITY_NONE }; // VPL_VISIBILITY_NONE, VPL_VISIBILITY_ISM or VPL_VISIBILITY_RAYS
+    float irradiance_accuracy{ IRRADIANCE_CACHE_ACCURACY_START }; // of the irradiance cache interpolating the VPL light, 0 to shade every pixel against the VPLs (deferred only, no interleaving)
+    int indirect_scale{ INDIRECT_SCALE_START }; // the VPL light is shaded at 1 / indirect_scale of the resolution and upsampled (deferred only, no interleaving nor irradiance cache)
+    int denoise_iterations{ DENOISE_ITERATIONS_START }; // a-trous passes over the VPL light, 0 for no denoising (deferred only)
+    int temporal_subsets{ TEMPORAL_SUBSETS_START }; // the VPLs are shaded a subset per frame and accumulated over frames, 0 for no temporal reuse (deferred only, no interleaving nor irradiance cache)
+    int simd_lanes{ SIMD_LANES_START }; // of the multi-light kernel shading the VPLs without visibility nor attenuation, 1 for the exact span kernels (deferred only)
+};
+
+struct SoftwareFrameStats
+{
+    float average_list_lights; // lights per tile or cluster covering some geometry, 0 without light culling
+    float average_pixel_lights; // lights shaded per pixel covering some geometry (deferred only)
+    float vpl_visibility_sec; // building the VPL visibility (imperfect shadow maps or BVH), part of the frame
+    std::size_t shadow_rays; // traced for the VPL visibility
+    std::size_t visibility_cache_lookups;
+    std::size_t visibility_cache_hits;
+    float irradiance_cache_sec; // creating the irradiance cache records of the frame, part of the frame
+    int irradiance_records_created;
+    int irradiance_records; // in the cache, after the frame
+    float denoise_sec; // part of the frame
+    float temporal_sec; // reprojecting and accumulating the VPL light, part of the frame
+    float reprojected_ratio; // of the pixels covering some geometry, the ones with a valid history
+};
+
+struct TemporalHistory
+{
+    int width;
+    int height;
+    int frame; // rotates the subset of the VPLs shaded
+    Matrix view_projection; // of the frame the history comes from
+    std::vector<GBufferTexel> gbuffer;
+    std::vector<Vector3> irradiance; // accumulated VPL light, demodulated by the albedo
+    std::vector<float> length; // frames accumulated per pixel, 0 for no history
+};
+
+static float VPLInfluenceRadius(const VirtualLight& light, float epsilon, float weight)
+{
+    // distance at which the bounded attenuation drops the largest possible contribution (albedo and cosines of 1) to epsilon
+    if (epsilon <= 0.0f) return std::numeric_limits<float>::infinity();
+
+    float peak{ light.intensity * std::max({ light.color.x, light.color.y, light.color.z }) / std::numbers::pi_v<float> * weight };
+    return std::sqrt(std::max(peak / epsilon - 1.0f, 0.0f));
+}
+
+static float BoundedAttenuation(float distance, float radius)
+{
+    // inverse square falloff (offset not to blow up close to the light), windowed to reach zero at the influence radius
+    if (radius <= 0.0f) return 0.0f;
+
+    float x{ distance / radius };
+    float window{ std::clamp(1.0f - x * x * x * x, 0.0f, 1.0f) };
+    return window * window / (1.0f + distance * distance);
+}
+
+static float JointBilateralWeight(const GBufferTexel& texel, const GBufferTexel& sample)
+{
+    // how close the surface seen by a reduced resolution sample is to the one of a full resolution pixel
+    if (texel.depth <= 0.0f || sample.depth <= 0.0f) return 0.0f;
+
+    float depth_difference{ (sample.depth - texel.depth) / (UPSAMPLE_DEPTH_SIGMA * texel.depth) };
+    float normal_weight{ std::pow(std::max(texel.normal.Dot(sample.normal), 0.0f), UPSAMPLE_NORMAL_EXPONENT) };
+    return std::exp(-depth_difference * depth_difference) * normal_weight;
+}
+
+struct DenoiseGuides
+{
+    // a row of the SoA guide ring of an ATrousDenoiser tile, from its first pixel
+    const float* n[3]; // normals over sqrt(2 DENOISE_NORMAL_SIGMA), zero for invalid pixels
+    const float* p[3]; // positions
+    const float* a[3]; // albedos over DENOISE_ALBEDO_SIGMA
+    const float* inv_plane_sigma; // sqrt(DENOISE_NORMAL_SIGMA) / the max distance to the tangent plane, zero for invalid pixels
+};
+
+struct DenoiseGuidesRow
+{
+    // a row of the guide ring of an ATrousDenoiser tile as copied from the texels, and its VPL light, scaled in place
+    float* n[3];
+    float* p[3];
+    float* a[3];
+    float* inv_plane_sigma; // the depth until scaled
+    float* light[3]; // demodulated by the albedo once scaled
+    int width; // a multiple of DENOISE_SIMD_WIDTH
+};
+
+enum DenoisePair { DENOISE_RIGHT, DENOISE_DOWN_LEFT, DENOISE_DOWN, DENOISE_DOWN_RIGHT, DENOISE_PAIRS_COUNT };
+
+struct DenoiseRow
+{
+    // a row of an ATrousDenoiser tile: the weights of its pairs with the taps below and on its right, then the filtered light
+    DenoiseGuides guides;
+    DenoiseGuides below_guides; // a step below, null pointers below the image
+    float* weights[DENOISE_PAIRS_COUNT]; // of the pairs of the pixels of the row, times the kernel
+    const float* above_weights[DENOISE_PAIRS_COUNT]; // of the row a step above, null pointers above the image
+    const float* in[3]; // VPL light of the previous iteration, demodulated by the albedo
+    const float* above_in[3];
+    const float* below_in[3];
+    float* out[3];
+    int step;
+    int weights_x0, weights_x1; // multiples of DENOISE_SIMD_WIDTH, from x0 - step to x1 + step at least
+    int x0, x1; // pixels filtered, multiples of DENOISE_SIMD_WIDTH, x1 == x0 for the rows only the next one needs the weights of
+};
+
+using DenoiseGuidesKernel = void (*)(const DenoiseGuidesRow& row);
+using DenoiseRowKernel = void (*)(const DenoiseRow& row);
+
+constexpr float DENOISE_CENTER_KERNEL{ 1.0f / 4.0f }; // 3x3 binomial kernel
+constexpr float DENOISE_AXIS_KERNEL{ 1.0f / 8.0f };
+constexpr float DENOISE_DIAGONAL_KERNEL{ 1.0f / 16.0f };
+
+#if defined(__x86_64__) || defined(_M_X64)
+// the filter kernels spell out the 3 channels of their vectors: GCC at -O2 doesn't unroll loops over them, and keeps such arrays in memory
+
+static void DenoiseGuidesSSE(const DenoiseGuidesRow& row)
+{
+    // invalid pixels (no depth) get zero guides and light, the light of black pixels is 0 too
+    const __m128 zero{ _mm_setzero_ps() };
+    const __m128 normal_scale{ _mm_set1_ps(1.0f / std::sqrt(2.0f * DENOISE_NORMAL_SIGMA)) };
+    const __m128 plane_scale{ _mm_set1_ps(std::sqrt(DENOISE_NORMAL_SIGMA) / DENOISE_PLANE_SIGMA) };
+    const __m128 albedo_scale{ _mm_set1_ps(1.0f / DENOISE_ALBEDO_SIGMA) };
+    for (int x{}; x < row.width; x += 4)
+    {
+        const __m128 depth{ _mm_loadu_ps(row.inv_plane_sigma + x) };
+        const __m128 valid{ _mm_cmpgt_ps(depth, zero) };
+        _mm_storeu_ps(row.inv_plane_sigma + x, _mm_and_ps(valid, _mm_div_ps(plane_scale, depth)));
+        for (int c{}; c < 3; c++)
+        {
+            const __m128 albedo{ _mm_loadu_ps(row.a[c] + x) };
+            const __m128 lit{ _mm_and_ps(valid, _mm_cmpgt_ps(albedo, zero)) };
+            _mm_storeu_ps(row.light[c] + x, _mm_and_ps(lit, _mm_div_ps(_mm_loadu_ps(row.light[c] + x), albedo)));
+            _mm_storeu_ps(row.n[c] + x, _mm_and_ps(valid, _mm_mul_ps(_mm_loadu_ps(row.n[c] + x), normal_scale)));
+            _mm_storeu_ps(row.p[c] + x, _mm_and_ps(valid, _mm_loadu_ps(row.p[c] + x)));
+            _mm_storeu_ps(row.a[c] + x, _mm_and_ps(valid, _mm_mul_ps(albedo, albedo_scale)));
+        }
+    }
+}
+
+static inline __m128 DenoisePairWeightSSE(
+    const DenoiseGuides& q, std::ptrdiff_t i, const __m128 n[3], const __m128 p[3], const __m128 a[3], __m128 inv_plane_sigma, float kernel
+)
+{
+    // squared differences of the normals and of the albedos, plus the squared distances of each pixel to the plane of the other
+    const __m128 qn[3]{ _mm_loadu_ps(q.n[0] + i), _mm_loadu_ps(q.n[1] + i), _mm_loadu_ps(q.n[2] + i) };
+    const __m128 dn[3]{ _mm_sub_ps(qn[0], n[0]), _mm_sub_ps(qn[1], n[1]), _mm_sub_ps(qn[2], n[2]) };
+    const __m128 da[3]{ _mm_sub_ps(_mm_loadu_ps(q.a[0] + i), a[0]), _mm_sub_ps(_mm_loadu_ps(q.a[1] + i), a[1]), _mm_sub_ps(_mm_loadu_ps(q.a[2] + i), a[2]) };
+    const __m128 dp[3]{ _mm_sub_ps(_mm_loadu_ps(q.p[0] + i), p[0]), _mm_sub_ps(_mm_loadu_ps(q.p[1] + i), p[1]), _mm_sub_ps(_mm_loadu_ps(q.p[2] + i), p[2]) };
+    const __m128 plane{ _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(n[0], dp[0]), _mm_mul_ps(n[1], dp[1])), _mm_mul_ps(n[2], dp[2])), inv_plane_sigma) };
+    const __m128 q_plane{ _mm_mul_ps(
+        _mm_add_ps(_mm_add_ps(_mm_mul_ps(qn[0], dp[0]), _mm_mul_ps(qn[1], dp[1])), _mm_mul_ps(qn[2], dp[2])), _mm_loadu_ps(q.inv_plane_sigma + i)
+    ) };
+    const __m128 normal_distance2{ _mm_add_ps(_mm_add_ps(_mm_mul_ps(dn[0], dn[0]), _mm_mul_ps(dn[1], dn[1])), _mm_mul_ps(dn[2], dn[2])) };
+    const __m128 albedo_distance2{ _mm_add_ps(_mm_add_ps(_mm_mul_ps(da[0], da[0]), _mm_mul_ps(da[1], da[1])), _mm_mul_ps(da[2], da[2])) };
+    const __m128 plane_distance2{ _mm_add_ps(_mm_mul_ps(plane, plane), _mm_mul_ps(q_plane, q_plane)) };
+
+    // (1 - x^2)^2 of the whole distance
+    __m128 weight{ _mm_max_ps(_mm_sub_ps(_mm_set1_ps(1.0f), _mm_add_ps(_mm_add_ps(normal_distance2, albedo_distance2), plane_distance2)), _mm_setzero_ps()) };
+    return _mm_mul_ps(_mm_mul_ps(weight, weight), _mm_set1_ps(kernel));
+}
+
+static void DenoiseRowSSE(const DenoiseRow& row)
+{
+    const std::ptrdiff_t step{ row.step };
+    const bool below{ row.below_guides.n[0] != nullptr };
+    const bool above{ row.above_weights[0] != nullptr };
+    for (int x{ row.weights_x0 }; x < row.weights_x1; x += 4)
+    {
+        const __m128 n[3]{ _mm_loadu_ps(row.guides.n[0] + x), _mm_loadu_ps(row.guides.n[1] + x), _mm_loadu_ps(row.guides.n[2] + x) };
+        const __m128 p[3]{ _mm_loadu_ps(row.guides.p[0] + x), _mm_loadu_ps(row.guides.p[1] + x), _mm_loadu_ps(row.guides.p[2] + x) };
+        const __m128 a[3]{ _mm_loadu_ps(row.guides.a[0] + x), _mm_loadu_ps(row.guides.a[1] + x), _mm_loadu_ps(row.guides.a[2] + x) };
+        const __m128 inv_plane_sigma{ _mm_loadu_ps(row.guides.inv_plane_sigma + x) };
+        _mm_storeu_ps(row.weights[DENOISE_RIGHT] + x, DenoisePairWeightSSE(row.guides, x + step, n, p, a, inv_plane_sigma, DENOISE_AXIS_KERNEL));
+        _mm_storeu_ps(row.weights[DENOISE_DOWN_LEFT] + x,
+            below ? DenoisePairWeightSSE(row.below_guides, x - step, n, p, a, inv_plane_sigma, DENOISE_DIAGONAL_KERNEL) : _mm_setzero_ps());
+        _mm_storeu_ps(row.weights[DENOISE_DOWN] + x,
+            below ? DenoisePairWeightSSE(row.below_guides, x, n, p, a, inv_plane_sigma, DENOISE_AXIS_KERNEL) : _mm_setzero_ps());
+        _mm_storeu_ps(row.weights[DENOISE_DOWN_RIGHT] + x,
+            below ? DenoisePairWeightSSE(row.below_guides, x + step, n, p, a, inv_plane_sigma, DENOISE_DIAGONAL_KERNEL) : _mm_setzero_ps());
+    }
+
+    const __m128 center_kernel{ _mm_set1_ps(DENOISE_CENTER_KERNEL) };
+    const __m128 min_weight_sum{ _mm_set1_ps(std::numeric_limits<float>::min()) };
+    for (int x{ row.x0 }; x < row.x1; x += 4)
+    {
+        // the pixel itself has the center weight, invalid pixels have no weight at all and stay at 0
+        __m128 weight_sum{ _mm_and_ps(_mm_cmpgt_ps(_mm_loadu_ps(row.guides.inv_plane_sigma + x), _mm_setzero_ps()), center_kernel) };
+        __m128 r{ _mm_mul_ps(weight_sum, _mm_loadu_ps(row.in[0] + x)) };
+        __m128 g{ _mm_mul_ps(weight_sum, _mm_loadu_ps(row.in[1] + x)) };
+        __m128 b{ _mm_mul_ps(weight_sum, _mm_loadu_ps(row.in[2] + x)) };
+        auto add_tap{ [&](const float* weights, const float* const in[3], std::ptrdiff_t i)
+        {
+            const __m128 weight{ _mm_loadu_ps(weights) };
+            r = _mm_add_ps(r, _mm_mul_ps(weight, _mm_loadu_ps(in[0] + i)));
+            g = _mm_add_ps(g, _mm_mul_ps(weight, _mm_loadu_ps(in[1] + i)));
+            b = _mm_add_ps(b, _mm_mul_ps(weight, _mm_loadu_ps(in[2] + i)));
+            weight_sum = _mm_add_ps(weight_sum, weight);
+        } };
+
+        // the pairs with the right and left taps, then with the ones below and above (the weights of the row a step above)
+        add_tap(row.weights[DENOISE_RIGHT] + x, row.in, x + step);
+        add_tap(row.weights[DENOISE_RIGHT] + x - step, row.in, x - step);
+        if (below)
+        {
+            add_tap(row.weights[DENOISE_DOWN_LEFT] + x, row.below_in, x - step);
+            add_tap(row.weights[DENOISE_DOWN] + x, row.below_in, x);
+            add_tap(row.weights[DENOISE_DOWN_RIGHT] + x, row.below_in, x + step);
+        }
+        if (above)
+        {
+            add_tap(row.above_weights[DENOISE_DOWN_RIGHT] + x - step, row.above_in, x - step);
+            add_tap(row.above_weights[DENOISE_DOWN] + x, row.above_in, x);
+            add_tap(row.above_weights[DENOISE_DOWN_LEFT] + x + step, row.above_in, x + step);
+        }
+
+        const __m128 inv_weight_sum{ _mm_div_ps(_mm_set1_ps(1.0f), _mm_max_ps(weight_sum, min_weight_sum)) };
+        _mm_storeu_ps(row.out[0] + x, _mm_mul_ps(r, inv_weight_sum));
+        _mm_storeu_ps(row.out[1] + x, _mm_mul_ps(g, inv_weight_sum));
+        _mm_storeu_ps(row.out[2] + x, _mm_mul_ps(b, inv_weight_sum));
+    }
+}
+
+TARGET_AVX2 static void DenoiseGuidesAVX2(const DenoiseGuidesRow& row)
+{
+    // DenoiseGuidesSSE 8 pixels at a time
+    const __m256 zero{ _mm256_setzero_ps() };
+    const __m256 normal_scale{ _mm256_set1_ps(1.0f / std::sqrt(2.0f * DENOISE_NORMAL_SIGMA)) };
+    const __m256 plane_scale{ _mm256_set1_ps(std::sqrt(DENOISE_NORMAL_SIGMA) / DENOISE_PLANE_SIGMA) };
+    const __m256 albedo_scale{ _mm256_set1_ps(1.0f / DENOISE_ALBEDO_SIGMA) };
+    for (int x{}; x < row.width; x += 8)
+    {
+        const __m256 depth{ _mm256_loadu_ps(row.inv_plane_sigma + x) };
+        const __m256 valid{ _mm256_cmp_ps(depth, zero, _CMP_GT_OQ) };
+        _mm256_storeu_ps(row.inv_plane_sigma + x, _mm256_and_ps(valid, _mm256_div_ps(plane_scale, depth)));
+        for (int c{}; c < 3; c++)
+        {
+            const __m256 albedo{ _mm256_loadu_ps(row.a[c] + x) };
+            const __m256 lit{ _mm256_and_ps(valid, _mm256_cmp_ps(albedo, zero, _CMP_GT_OQ)) };
+            _mm256_storeu_ps(row.light[c] + x, _mm256_and_ps(lit, _mm256_div_ps(_mm256_loadu_ps(row.light[c] + x), albedo)));
+            _mm256_storeu_ps(row.n[c] + x, _mm256_and_ps(valid, _mm256_mul_ps(_mm256_loadu_ps(row.n[c] + x), normal_scale)));
+            _mm256_storeu_ps(row.p[c] + x, _mm256_and_ps(valid, _mm256_loadu_ps(row.p[c] + x)));
+            _mm256_storeu_ps(row.a[c] + x, _mm256_and_ps(valid, _mm256_mul_ps(albedo, albedo_scale)));
+        }
+    }
+}
+
+TARGET_AVX2 static inline __m256 DenoisePairWeightAVX2(
+    const DenoiseGuides& q, std::ptrdiff_t i, const __m256 n[3], const __m256 p[3], const __m256 a[3], __m256 inv_plane_sigma, float kernel
+)
+{
+    // DenoisePairWeightSSE 8 pixels at a time, with fused multiply-adds
+    const __m256 qn[3]{ _mm256_loadu_ps(q.n[0] + i), _mm256_loadu_ps(q.n[1] + i), _mm256_loadu_ps(q.n[2] + i) };
+    const __m256 dn[3]{ _mm256_sub_ps(qn[0], n[0]), _mm256_sub_ps(qn[1], n[1]), _mm256_sub_ps(qn[2], n[2]) };
+    const __m256 da[3]{ _mm256_sub_ps(_mm256_loadu_ps(q.a[0] + i), a[0]), _mm256_sub_ps(_mm256_loadu_ps(q.a[1] + i), a[1]), _mm256_sub_ps(_mm256_loadu_ps(q.a[2] + i), a[2]) };
+    const __m256 dp[3]{ _mm256_sub_ps(_mm256_loadu_ps(q.p[0] + i), p[0]), _mm256_sub_ps(_mm256_loadu_ps(q.p[1] + i), p[1]), _mm256_sub_ps(_mm256_loadu_ps(q.p[2] + i), p[2]) };
+    const __m256 plane{ _mm256_mul_ps(_mm256_fmadd_ps(n[0], dp[0], _mm256_fmadd_ps(n[1], dp[1], _mm256_mul_ps(n[2], dp[2]))), inv_plane_sigma) };
+    const __m256 q_plane{ _mm256_mul_ps(
+        _mm256_fmadd_ps(qn[0], dp[0], _mm256_fmadd_ps(qn[1], dp[1], _mm256_mul_ps(qn[2], dp[2]))), _mm256_loadu_ps(q.inv_plane_sigma + i)
+    ) };
+    __m256 distance2{ _mm256_fmadd_ps(plane, plane, _mm256_mul_ps(q_plane, q_plane)) };
+    distance2 = _mm256_fmadd_ps(dn[0], dn[0], _mm256_fmadd_ps(dn[1], dn[1], _mm256_fmadd_ps(dn[2], dn[2], distance2)));
+    distance2 = _mm256_fmadd_ps(da[0], da[0], _mm256_fmadd_ps(da[1], da[1], _mm256_fmadd_ps(da[2], da[2], distance2)));
+
+    __m256 weight{ _mm256_max_ps(_mm256_sub_ps(_mm256_set1_ps(1.0f), distance2), _mm256_setzero_ps()) };
+    return _mm256_mul_ps(_mm256_mul_ps(weight, weight), _mm256_set1_ps(kernel));
+}
+
+TARGET_AVX2 static void DenoiseRowAVX2(const DenoiseRow& row)
+{
+    // DenoiseRowSSE 8 pixels at a time, with fused multiply-adds
+    const std::ptrdiff_t step{ row.step };
+    const bool below{ row.below_guides.n[0] != nullptr };
+    const bool above{ row.above_weights[0] != nullptr };
+    for (int x{ row.weights_x0 }; x < row.weights_x1; x += 8)
+    {
+        const __m256 n[3]{ _mm256_loadu_ps(row.guides.n[0] + x), _mm256_loadu_ps(row.guides.n[1] + x), _mm256_loadu_ps(row.guides.n[2] + x) };
+        const __m256 p[3]{ _mm256_loadu_ps(row.guides.p[0] + x), _mm256_loadu_ps(row.guides.p[1] + x), _mm256_loadu_ps(row.guides.p[2] + x) };
+        const __m256 a[3]{ _mm256_loadu_ps(row.guides.a[0] + x), _mm256_loadu_ps(row.guides.a[1] + x), _mm256_loadu_ps(row.guides.a[2] + x) };
+        const __m256 inv_plane_sigma{ _mm256_loadu_ps(row.guides.inv_plane_sigma + x) };
+        _mm256_storeu_ps(row.weights[DENOISE_RIGHT] + x, DenoisePairWeightAVX2(row.guides, x + step, n, p, a, inv_plane_sigma, DENOISE_AXIS_KERNEL));
+        _mm256_storeu_ps(row.weights[DENOISE_DOWN_LEFT] + x,
+            below ? DenoisePairWeightAVX2(row.below_guides, x - step, n, p, a, inv_plane_sigma, DENOISE_DIAGONAL_KERNEL) : _mm256_setzero_ps());
+        _mm256_storeu_ps(row.weights[DENOISE_DOWN] + x,
+            below ? DenoisePairWeightAVX2(row.below_guides, x, n, p, a, inv_plane_sigma, DENOISE_AXIS_KERNEL) : _mm256_setzero_ps());
+        _mm256_storeu_ps(row.weights[DENOISE_DOWN_RIGHT] + x,
+            below ? DenoisePairWeightAVX2(row.below_guides, x + step, n, p, a, inv_plane_sigma, DENOISE_DIAGONAL_KERNEL) : _mm256_setzero_ps());
+    }
+
+    const __m256 center_kernel{ _mm256_set1_ps(DENOISE_CENTER_KERNEL) };
+    const __m256 min_weight_sum{ _mm256_set1_ps(std::numeric_limits<float>::min()) };
+    for (int x{ row.x0 }; x < row.x1; x += 8)
+    {
+        __m256 weight_sum{ _mm256_and_ps(_mm256_cmp_ps(_mm256_loadu_ps(row.guides.inv_plane_sigma + x), _mm256_setzero_ps(), _CMP_GT_OQ), center_kernel) };
+        __m256 r{ _mm256_mul_ps(weight_sum, _mm256_loadu_ps(row.in[0] + x)) };
+        __m256 g{ _mm256_mul_ps(weight_sum, _mm256_loadu_ps(row.in[1] + x)) };
+        __m256 b{ _mm256_mul_ps(weight_sum, _mm256_loadu_ps(row.in[2] + x)) };
+        auto add_tap{ [&](const float* weights, const float* const in[3], std::ptrdiff_t i) TARGET_AVX2
+        {
+            const __m256 weight{ _mm256_loadu_ps(weights) };
+            r = _mm256_fmadd_ps(weight, _mm256_loadu_ps(in[0] + i), r);
+            g = _mm256_fmadd_ps(weight, _mm256_loadu_ps(in[1] + i), g);
+            b = _mm256_fmadd_ps(weight, _mm256_loadu_ps(in[2] + i), b);
+            weight_sum = _mm256_add_ps(weight_sum, weight);
+        } };
+
+        add_tap(row.weights[DENOISE_RIGHT] + x, row.in, x + step);
+        add_tap(row.weights[DENOISE_RIGHT] + x - step, row.in, x - step);
+        if (below)
+        {
+            add_tap(row.weights[DENOISE_DOWN_LEFT] + x, row.below_in, x - step);
+            add_tap(row.weights[DENOISE_DOWN] + x, row.below_in, x);
+            add_tap(row.weights[DENOISE_DOWN_RIGHT] + x, row.below_in, x + step);
+        }
+        if (above)
+        {
+            add_tap(row.above_weights[DENOISE_DOWN_RIGHT] + x - step, row.above_in, x - step);
+            add_tap(row.above_weights[DENOISE_DOWN] + x, row.above_in, x);
+            add_tap(row.above_weights[DENOISE_DOWN_LEFT] + x + step, row.above_in, x + step);
+        }
+
+        const __m256 inv_weight_sum{ _mm256_div_ps(_mm256_set1_ps(1.0f), _mm256_max_ps(weight_sum, min_weight_sum)) };
+        _mm256_storeu_ps(row.out[0] + x, _mm256_mul_ps(r, inv_weight_sum));
+        _mm256_storeu_ps(row.out[1] + x, _mm256_mul_ps(g, inv_weight_sum));
+        _mm256_storeu_ps(row.out[2] + x, _mm256_mul_ps(b, inv_weight_sum));
+    }
+}
+
+// as for ShadeVPLLanesAVX512
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+TARGET_AVX512 static void DenoiseGuidesAVX512(const DenoiseGuidesRow& row)
+{
+    // DenoiseGuidesAVX2 16 pixels at a time
+    const __m512 zero{ _mm512_setzero_ps() };
+    const __m512 normal_scale{ _mm512_set1_ps(1.0f / std::sqrt(2.0f * DENOISE_NORMAL_SIGMA)) };
+    const __m512 plane_scale{ _mm512_set1_ps(std::sqrt(DENOISE_NORMAL_SIGMA) / DENOISE_PLANE_SIGMA) };
+    const __m512 albedo_scale{ _mm512_set1_ps(1.0f / DENOISE_ALBEDO_SIGMA) };
+    for (int x{}; x < row.width; x += 16)
+    {
+        const __m512 depth{ _mm512_loadu_ps(row.inv_plane_sigma + x) };
+        const __mmask16 valid{ _mm512_cmp_ps_mask(depth, zero, _CMP_GT_OQ) };
+        _mm512_storeu_ps(row.inv_plane_sigma + x, _mm512_maskz_div_ps(valid, plane_scale, depth));
+        for (int c{}; c < 3; c++)
+        {
+            const __m512 albedo{ _mm512_loadu_ps(row.a[c] + x) };
+            const __mmask16 lit{ _mm512_mask_cmp_ps_mask(valid, albedo, zero, _CMP_GT_OQ) };
+            _mm512_storeu_ps(row.light[c] + x, _mm512_maskz_div_ps(lit, _mm512_loadu_ps(row.light[c] + x), albedo));
+            _mm512_storeu_ps(row.n[c] + x, _mm512_maskz_mul_ps(valid, _mm512_loadu_ps(row.n[c] + x), normal_scale));
+            _mm512_storeu_ps(row.p[c] + x, _mm512_maskz_mov_ps(valid, _mm512_loadu_ps(row.p[c] + x)));
+            _mm512_storeu_ps(row.a[c] + x, _mm512_maskz_mul_ps(valid, albedo, albedo_scale));
+        }
+    }
+}
+
+TARGET_AVX512 static inline __m512 DenoisePairWeightAVX512(
+    const DenoiseGuides& q, std::ptrdiff_t i, const __m512 n[3], const __m512 p[3], const __m512 a[3], __m512 inv_plane_sigma, float kernel
+)
+{
+    // DenoisePairWeightAVX2 16 pixels at a time
+    const __m512 qn[3]{ _mm512_loadu_ps(q.n[0] + i), _mm512_loadu_ps(q.n[1] + i), _mm512_loadu_ps(q.n[2] + i) };
+    const __m512 dn[3]{ _mm512_sub_ps(qn[0], n[0]), _mm512_sub_ps(qn[1], n[1]), _mm512_sub_ps(qn[2], n[2]) };
+    const __m512 da[3]{ _mm512_sub_ps(_mm512_loadu_ps(q.a[0] + i), a[0]), _mm512_sub_ps(_mm512_loadu_ps(q.a[1] + i), a[1]), _mm512_sub_ps(_mm512_loadu_ps(q.a[2] + i), a[2]) };
+    const __m512 dp[3]{ _mm512_sub_ps(_mm512_loadu_ps(q.p[0] + i), p[0]), _mm512_sub_ps(_mm512_loadu_ps(q.p[1] + i), p[1]), _mm512_sub_ps(_mm512_loadu_ps(q.p[2] + i), p[2]) };
+    const __m512 plane{ _mm512_mul_ps(_mm512_fmadd_ps(n[0], dp[0], _mm512_fmadd_ps(n[1], dp[1], _mm512_mul_ps(n[2], dp[2]))), inv_plane_sigma) };
+    const __m512 q_plane{ _mm512_mul_ps(
+        _mm512_fmadd_ps(qn[0], dp[0], _mm512_fmadd_ps(qn[1], dp[1], _mm512_mul_ps(qn[2], dp[2]))), _mm512_loadu_ps(q.inv_plane_sigma + i)
+    ) };
+    __m512 distance2{ _mm512_fmadd_ps(plane, plane, _mm512_mul_ps(q_plane, q_plane)) };
+    distance2 = _mm512_fmadd_ps(dn[0], dn[0], _mm512_fmadd_ps(dn[1], dn[1], _mm512_fmadd_ps(dn[2], dn[2], distance2)));
+    distance2 = _mm512_fmadd_ps(da[0], da[0], _mm512_fmadd_ps(da[1], da[1], _mm512_fmadd_ps(da[2], da[2], distance2)));
+
+    __m512 weight{ _mm512_max_ps(_mm512_sub_ps(_mm512_set1_ps(1.0f), distance2), _mm512_setzero_ps()) };
+    return _mm512_mul_ps(_mm512_mul_ps(weight, weight), _mm512_set1_ps(kernel));
+}
+
+TARGET_AVX512 static void DenoiseRowAVX512(const DenoiseRow& row)
+{
+    // DenoiseRowAVX2 16 pixels at a time
+    const std::ptrdiff_t step{ row.step };
+    const bool below{ row.below_guides.n[0] != nullptr };
+    const bool above{ row.above_weights[0] != nullptr };
+    for (int x{ row.weights_x0 }; x < row.weights_x1; x += 16)
+    {
+        const __m512 n[3]{ _mm512_loadu_ps(row.guides.n[0] + x), _mm512_loadu_ps(row.guides.n[1] + x), _mm512_loadu_ps(row.guides.n[2] + x) };
+        const __m512 p[3]{ _mm512_loadu_ps(row.guides.p[0] + x), _mm512_loadu_ps(row.guides.p[1] + x), _mm512_loadu_ps(row.guides.p[2] + x) };
+        const __m512 a[3]{ _mm512_loadu_ps(row.guides.a[0] + x), _mm512_loadu_ps(row.guides.a[1] + x), _mm512_loadu_ps(row.guides.a[2] + x) };
+        const __m512 inv_plane_sigma{ _mm512_loadu_ps(row.guides.inv_plane_sigma + x) };
+        _mm512_storeu_ps(row.weights[DENOISE_RIGHT] + x, DenoisePairWeightAVX512(row.guides, x + step, n, p, a, inv_plane_sigma, DENOISE_AXIS_KERNEL));
+        _mm512_storeu_ps(row.weights[DENOISE_DOWN_LEFT] + x,
+            below ? DenoisePairWeightAVX512(row.below_guides, x - step, n, p, a, inv_plane_sigma, DENOISE_DIAGONAL_KERNEL) : _mm512_setzero_ps());
+        _mm512_storeu_ps(row.weights[DENOISE_DOWN] + x,
+            below ? DenoisePairWeightAVX512(row.below_guides, x, n, p, a, inv_plane_sigma, DENOISE_AXIS_KERNEL) : _mm512_setzero_ps());
+        _mm512_storeu_ps(row.weights[DENOISE_DOWN_RIGHT] + x,
+            below ? DenoisePairWeightAVX512(row.below_guides, x + step, n, p, a, inv_plane_sigma, DENOISE_DIAGONAL_KERNEL) : _mm512_setzero_ps());
+    }
+
+    const __m512 center_kernel{ _mm512_set1_ps(DENOISE_CENTER_KERNEL) };
+    const __m512 min_weight_sum{ _mm512_set1_ps(std::numeric_limits<float>::min()) };
+    for (int x{ row.x0 }; x < row.x1; x += 16)
+    {
+        __m512 weight_sum{ _mm512_maskz_mov_ps(_mm512_cmp_ps_mask(_mm512_loadu_ps(row.guides.inv_plane_sigma + x), _mm512_setzero_ps(), _CMP_GT_OQ), center_kernel) };
+        __m512 r{ _mm512_mul_ps(weight_sum, _mm512_loadu_ps(row.in[0] + x)) };
+        __m512 g{ _mm512_mul_ps(weight_sum, _mm512_loadu_ps(row.in[1] + x)) };
+        __m512 b{ _mm512_mul_ps(weight_sum, _mm512_loadu_ps(row.in[2] + x)) };
+        auto add_tap{ [&](const float* weights, const float* const in[3], std::ptrdiff_t i) TARGET_AVX512
+        {
+            const __m512 weight{ _mm512_loadu_ps(weights) };
+            r = _mm512_fmadd_ps(weight, _mm512_loadu_ps(in[0] + i), r);
+            g = _mm512_fmadd_ps(weight, _mm512_loadu_ps(in[1] + i), g);
+            b = _mm512_fmadd_ps(weight, _mm512_loadu_ps(in[2] + i), b);
+            weight_sum = _mm512_add_ps(weight_sum, weight);
+        } };
+
+        add_tap(row.weights[DENOISE_RIGHT] + x, row.in, x + step);
+        add_tap(row.weights[DENOISE_RIGHT] + x - step, row.in, x - step);
+        if (below)
+        {
+            add_tap(row.weights[DENOISE_DOWN_LEFT] + x, row.below_in, x - step);
+            add_tap(row.weights[DENOISE_DOWN] + x, row.below_in, x);
+            add_tap(row.weights[DENOISE_DOWN_RIGHT] + x, row.below_in, x + step);
+        }
+        if (above)
+        {
+            add_tap(row.above_weights[DENOISE_DOWN_RIGHT] + x - step, row.above_in, x - step);
+            add_tap(row.above_weights[DENOISE_DOWN] + x, row.above_in, x);
+            add_tap(row.above_weights[DENOISE_DOWN_LEFT] + x + step, row.above_in, x + step);
+        }
+
+        const __m512 inv_weight_sum{ _mm512_div_ps(_mm512_set1_ps(1.0f), _mm512_max_ps(weight_sum, min_weight_sum)) };
+        _mm512_storeu_ps(row.out[0] + x, _mm512_mul_ps(r, inv_weight_sum));
+        _mm512_storeu_ps(row.out[1] + x, _mm512_mul_ps(g, inv_weight_sum));
+        _mm512_storeu_ps(row.out[2] + x, _mm512_mul_ps(b, inv_weight_sum));
+    }
+}
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+#else
+static void DenoiseGuidesScalar(const DenoiseGuidesRow& row)
+{
+    // invalid pixels (no depth) get zero guides and light, the light of black pixels is 0 too
+    const float normal_scale{ 1.0f / std::sqrt(2.0f * DENOISE_NORMAL_SIGMA) };
+    const float plane_scale{ std::sqrt(DENOISE_NORMAL_SIGMA) / DENOISE_PLANE_SIGMA };
+    for (int x{}; x < row.width; x++)
+    {
+        const float depth{ row.inv_plane_sigma[x] };
+        const bool valid{ depth > 0.0f };
+        row.inv_plane_sigma[x] = valid ? plane_scale / depth : 0.0f;
+        for (int c{}; c < 3; c++)
+        {
+            const float albedo{ row.a[c][x] };
+            row.light[c][x] = valid && albedo > 0.0f ? row.light[c][x] / albedo : 0.0f;
+            row.n[c][x] = valid ? row.n[c][x] * normal_scale : 0.0f;
+            row.p[c][x] = valid ? row.p[c][x] : 0.0f;
+            row.a[c][x] = valid ? albedo / DENOISE_ALBEDO_SIGMA : 0.0f;
+        }
+    }
+}
+
+static float DenoisePairWeightScalar(const DenoiseGuides& guides, std::ptrdiff_t x, const DenoiseGuides& q, std::ptrdiff_t i, float kernel)
+{
+    // squared differences of the normals and of the albedos, plus the squared distances of each pixel to the plane of the other
+    float distance2{};
+    float plane{};
+    float q_plane{};
+    for (int c{}; c < 3; c++)
+    {
+        const float dn{ q.n[c][i] - guides.n[c][x] };
+        const float da{ q.a[c][i] - guides.a[c][x] };
+        const float dp{ q.p[c][i] - guides.p[c][x] };
+        distance2 += dn * dn + da * da;
+        plane += guides.n[c][x] * dp;
+        q_plane += q.n[c][i] * dp;
+    }
+    plane *= guides.inv_plane_sigma[x];
+    q_plane *= q.inv_plane_sigma[i];
+    distance2 += plane * plane + q_plane * q_plane;
+
+    // (1 - x^2)^2 of the whole distance
+    const float weight{ std::max(1.0f - distance2, 0.0f) };
+    return weight * weight * kernel;
+}
+
+static void DenoiseRowScalar(const DenoiseRow& row)
+{
+    // DenoiseRowSSE a pixel at a time
+    const std::ptrdiff_t step{ row.step };
+    const bool below{ row.below_guides.n[0] != nullptr };
+    const bool above{ row.above_weights[0] != nullptr };
+    for (std::ptrdiff_t x{ row.weights_x0 }; x < row.weights_x1; x++)
+    {
+        row.weights[DENOISE_RIGHT][x] = DenoisePairWeightScalar(row.guides, x, row.guides, x + step, DENOISE_AXIS_KERNEL);
+        row.weights[DENOISE_DOWN_LEFT][x] = below ? DenoisePairWeightScalar(row.guides, x, row.below_guides, x - step, DENOISE_DIAGONAL_KERNEL) : 0.0f;
+        row.weights[DENOISE_DOWN][x] = below ? DenoisePairWeightScalar(row.guides, x, row.below_guides, x, DENOISE_AXIS_KERNEL) : 0.0f;
+        row.weights[DENOISE_DOWN_RIGHT][x] = below ? DenoisePairWeightScalar(row.guides, x, row.below_guides, x + step, DENOISE_DIAGONAL_KERNEL) : 0.0f;
+    }
+
+    for (std::ptrdiff_t x{ row.x0 }; x < row.x1; x++)
+    {
+        // the pixel itself has the center weight, invalid pixels have no weight at all and stay at 0
+        float weight_sum{ row.guides.inv_plane_sigma[x] > 0.0f ? DENOISE_CENTER_KERNEL : 0.0f };
+        float sum[3]{ weight_sum * row.in[0][x], weight_sum * row.in[1][x], weight_sum * row.in[2][x] };
+        auto add_tap{ [&](float weight, const float* const in[3], std::ptrdiff_t i)
+        {
+            for (int c{}; c < 3; c++) sum[c] += weight * in[c][i];
+            weight_sum += weight;
+        } };
+
+        // the pairs with the right and left taps, then with the ones below and above (the weights of the row a step above)
+        add_tap(row.weights[DENOISE_RIGHT][x], row.in, x + step);
+        add_tap(row.weights[DENOISE_RIGHT][x - step], row.in, x - step);
+        if (below)
+        {
+            add_tap(row.weights[DENOISE_DOWN_LEFT][x], row.below_in, x - step);
+            add_tap(row.weights[DENOISE_DOWN][x], row.below_in, x);
+            add_tap(row.weights[DENOISE_DOWN_RIGHT][x], row.below_in, x + step);
+        }
+        if (above)
+        {
+            add_tap(row.above_weights[DENOISE_DOWN_RIGHT][x - step], row.above_in, x - step);
+            add_tap(row.above_weights[DENOISE_DOWN][x], row.above_in, x);
+            add_tap(row.above_weights[DENOISE_DOWN_LEFT][x + step], row.above_in, x + step);
+        }
+
+        const float inv_weight_sum{ 1.0f / std::max(weight_sum, std::numeric_limits<float>::min()) };
+        for (int c{}; c < 3; c++) row.out[c][x] = sum[c] * inv_weight_sum;
+    }
+}
+#endif
+
+class ATrousDenoiser
+{
+public:
+    ATrousDenoiser();
+    ~ATrousDenoiser() = default;
+    ATrousDenoiser(const ATrousDenoiser&) = delete;
+    ATrousDenoiser(ATrousDenoiser&&) noexcept = default;
+    ATrousDenoiser& operator=(const ATrousDenoiser&) = delete;
+    ATrousDenoiser& operator=(ATrousDenoiser&&) noexcept = default;
+public:
+    void Denoise(std::vector<Vector3>& light, const std::vector<GBufferTexel>& gbuffer, int width, int height, int iterations);
+private:
+    enum Guide { NX, NY, NZ, PX, PY, PZ, AR, AG, AB, INV_PLANE_SIGMA, GUIDES_COUNT };
+
+    struct Tile
+    {
+        int x0, x1, y0, y1; // pixels written, the halo around them is filtered too but thrown away
+        int first_column; // image column of the first pixel of the rows
+        int pad; // invalid pixels on both sides of the rows, for the taps of the pairs of the largest step
+        int row_width; // a multiple of DENOISE_SIMD_WIDTH
+        std::vector<float> guides; // ring of guide rows, GUIDES_COUNT planes
+        std::vector<float> light; // a ring of rows per iteration, 3 planes each, the VPL light the iteration filters
+        std::vector<float> weights; // a ring of rows per iteration, DENOISE_PAIRS_COUNT planes each
+        std::vector<float> output; // one row of the last iteration, 3 planes
+    };
+private:
+    void DenoiseTile(
+        Tile& tile, const std::vector<Vector3>& light, const std::vector<GBufferTexel>& gbuffer, DenoiseGuidesKernel denoise_guides,
+        DenoiseRowKernel denoise_row
+    );
+private:
+    int m_width; // layout of the tiles
+    int m_height;
+    int m_iterations;
+    std::vector<Tile> m_tiles;
+    std::vector<Vector3> m_output; // swapped with the light of the caller
+};
+
+ATrousDenoiser::ATrousDenoiser()
+    : m_width{}
+    , m_height{}
+    , m_iterations{}
+    , m_tiles{}
+    , m_output{}
+{
+}
+
+void ATrousDenoiser::Denoise(std::vector<Vector3>& light, const std::vector<GBufferTexel>& gbuffer, int width, int height, int iterations)
+{
+    /*
+        Dammertz et al., "Edge-Avoiding A-Trous Wavelet Transform for fast Global Illumination Filtering": each iteration convolves
+        with a kernel with holes doubling the step between its taps, and weighs each tap down by the differences of its normal, of its
+        distance to the tangent plane of the pixel (so depth discontinuities, not slopes) and of its albedo. The kernel is the 3x3
+        binomial one rather than the 5x5 B3 spline of the paper: 9 taps instead of 25 per iteration, for a footprint of 63 pixels
+        instead of 125 after 5 iterations, which the scenes of the repo don't need.
+        The light is demodulated by the albedo, so that the texture isn't blurred, and modulated back at the end.
+
+        Unlike the paper, the weight of a tap is the same for both pixels: the differences of the normals and of the albedos, and the
+        distances of each pixel to the tangent plane of the other, all over their max, are summed into a single (1 - x^2)^2 window.
+        So the weights of the pairs with the 4 taps below and on the right of a pixel are computed once, and the 4 other taps reuse
+        the ones of the pixels they belong to: a pixel costs 4 weights per iteration instead of 8 (and 3 windows each).
+
+        The image is split in tiles, filtered independently on the available cores. A tile runs all the iterations in a single sweep
+        over its rows: once a row of an iteration is filtered, the next iteration can filter the row its lowest tap just reached.
+        So only the last rows of each iteration are kept (rings), small enough to stay in the L2 cache, and the frame is read and
+        written once instead of once per iteration. The price is the halo of the tile (the footprint of the remaining iterations),
+        filtered by the neighbouring tiles too. The result doesn't depend on the tiles.
+
+        The rows are SoA, padded with invalid pixels wide enough for the largest step, so that they are filtered 4, 8 or 16 pixels
+        at once (SSE, AVX2 or AVX-512, the widest the CPU supports) with unaligned loads and no bounds checks along the row.
+        Invalid pixels (background and padding) have zero normals, hence a normal difference that zeroes the weight of their pairs
+        with the valid ones.
+    */
+    static_assert(DENOISE_NORMAL_SIGMA <= 0.5f, "the normals of invalid pixels must be too different from the valid ones");
+    if (iterations <= 0) return;
+
+    // a tile per core (as wide as DENOISE_TILE_WIDTH at most, to keep the rings in the cache), the halo is filtered twice
+    if (width != m_width || height != m_height || iterations != m_iterations)
+    {
+        m_width = width;
+        m_height = height;
+        m_iterations = iterations;
+
+        const int halo{ (1 << iterations) - 1 };
+        const int columns{ (width + DENOISE_TILE_WIDTH - 1) / DENOISE_TILE_WIDTH };
+        const int cores{ static_cast<int>(std::max(std::thread::hardware_concurrency(), 1u)) };
+        const int rows{ std::clamp((cores + columns - 1) / columns, 1, height) };
+        m_tiles.clear();
+        for (int ty{}; ty < rows; ty++)
+        {
+            for (int tx{}; tx < columns; tx++)
+            {
+                Tile tile{};
+                tile.x0 = width * tx / columns;
+                tile.x1 = width * (tx + 1) / columns;
+                tile.y0 = height * ty / rows;
+                tile.y1 = height * (ty + 1) / rows;
+                tile.first_column = std::max(tile.x0 - halo, 0);
+                tile.pad = 2 * (((1 << (iterations - 1)) + DENOISE_SIMD_WIDTH - 1) / DENOISE_SIMD_WIDTH * DENOISE_SIMD_WIDTH);
+                tile.row_width = (std::min(tile.x1 + halo, width) - tile.first_column + DENOISE_SIMD_WIDTH - 1) / DENOISE_SIMD_WIDTH * DENOISE_SIMD_WIDTH;
+
+                // the weights of an iteration are read a step above, its light a step above and below, the guides up to the last step
+                const std::size_t stride{ static_cast<std::size_t>(tile.pad + tile.row_width + tile.pad) };
+                std::size_t light_rows{};
+                std::size_t weights_rows{};
+                for (int iteration{}; iteration < iterations; iteration++)
+                {
+                    light_rows += 2 * (std::size_t{ 1 } << iteration) + 1;
+                    weights_rows += (std::size_t{ 1 } << iteration) + 1;
+                }
+                tile.guides.assign(stride * (std::size_t{ 1 } << iterations) * GUIDES_COUNT, 0.0f);
+                tile.light.assign(stride * light_rows * 3, 0.0f);
+                tile.weights.assign(stride * weights_rows * DENOISE_PAIRS_COUNT, 0.0f);
+                tile.output.assign(stride * 3, 0.0f);
+                m_tiles.push_back(std::move(tile));
+            }
+        }
+    }
+    m_output.resize(light.size());
+
+#if defined(__x86_64__) || defined(_M_X64)
+    const int lanes{ SupportedSIMDLanes() };
+    const DenoiseGuidesKernel denoise_guides{ lanes >= 16 ? DenoiseGuidesAVX512 : lanes >= 8 ? DenoiseGuidesAVX2 : DenoiseGuidesSSE };
+    const DenoiseRowKernel denoise_row{ lanes >= 16 ? DenoiseRowAVX512 : lanes >= 8 ? DenoiseRowAVX2 : DenoiseRowSSE };
+#else
+    const DenoiseGuidesKernel denoise_guides{ DenoiseGuidesScalar };
+    const DenoiseRowKernel denoise_row{ DenoiseRowScalar };
+#endif
+    std::for_each(std::execution::par, m_tiles.begin(), m_tiles.end(), [&](Tile& tile)
+    {
+        DenoiseTile(tile, light, gbuffer, denoise_guides, denoise_row);
+    });
+    light.swap(m_output);
+}
+
+void ATrousDenoiser::DenoiseTile(
+    Tile& tile, const std::vector<Vector3>& light, const std::vector<GBufferTexel>& gbuffer, DenoiseGuidesKernel denoise_guides,
+    DenoiseRowKernel denoise_row
+)
+{
+    const int width{ m_width };
+    const int height{ m_height };
+    const int iterations{ m_iterations };
+    const int halo{ (1 << iterations) - 1 };
+    const std::size_t stride{ static_cast<std::size_t>(tile.pad + tile.row_width + tile.pad) };
+    const int guide_rows{ 1 << iterations };
+
+    // rings of an iteration: the rows of the light it filters, 2 * step + 1 of them, and the rows of its weights, step + 1
+    int light_rows[DENOISE_ITERATIONS_MAX]{};
+    int weights_rows[DENOISE_ITERATIONS_MAX]{};
+    std::size_t light_offsets[DENOISE_ITERATIONS_MAX]{};
+    std::size_t weights_offsets[DENOISE_ITERATIONS_MAX]{};
+    for (int iteration{}, light_total{}, weights_total{}; iteration < iterations; iteration++)
+    {
+        light_rows[iteration] = 2 * (1 << iteration) + 1;
+        weights_rows[iteration] = (1 << iteration) + 1;
+        light_offsets[iteration] = stride * light_total * 3;
+        weights_offsets[iteration] = stride * weights_total * DENOISE_PAIRS_COUNT;
+        light_total += light_rows[iteration];
+        weights_total += weights_rows[iteration];
+    }
+    auto guide_row{ [&](int g, int y) { return tile.guides.data() + stride * (static_cast<std::size_t>(guide_rows) * g + y % guide_rows) + tile.pad; } };
+    auto light_row{ [&](int iteration, int c, int y)
+    {
+        return tile.light.data() + light_offsets[iteration] + stride * (static_cast<std::size_t>(light_rows[iteration]) * c + y % light_rows[iteration]) + tile.pad;
+    } };
+    auto weights_row{ [&](int iteration, int pair, int y)
+    {
+        return tile.weights.data() + weights_offsets[iteration] + stride * (static_cast<std::size_t>(weights_rows[iteration]) * pair + y % weights_rows[iteration]) + tile.pad;
+    } };
+    auto row_guides{ [&](int y)
+    {
+        DenoiseGuides guides{};
+        for (int c{}; c < 3; c++)
+        {
+            guides.n[c] = guide_row(NX + c, y);
+            guides.p[c] = guide_row(PX + c, y);
+            guides.a[c] = guide_row(AR + c, y);
+        }
+        guides.inv_plane_sigma = guide_row(INV_PLANE_SIGMA, y);
+        return guides;
+    } };
+
+    const int guides_y0{ std::max(tile.y0 - halo, 0) };
+    const int guides_y1{ std::min(tile.y1 + halo, height) };
+    for (int t{ guides_y0 }; t < tile.y1 + halo; t++)
+    {
+        // guides and demodulated light of row t: the texels are copied to the planes, then scaled in place a vector at a time
+        if (t < guides_y1)
+        {
+            DenoiseGuidesRow row{};
+            for (int c{}; c < 3; c++)
+            {
+                row.n[c] = guide_row(NX + c, t);
+                row.p[c] = guide_row(PX + c, t);
+                row.a[c] = guide_row(AR + c, t);
+                row.light[c] = light_row(0, c, t);
+            }
+            row.inv_plane_sigma = guide_row(INV_PLANE_SIGMA, t);
+            row.width = tile.row_width;
+
+            const GBufferTexel* texels{ gbuffer.data() + static_cast<std::size_t>(t) * width + tile.first_column };
+            const Vector3* colors{ light.data() + static_cast<std::size_t>(t) * width + tile.first_column };
+            const int valid_width{ std::min(tile.x1 + halo, width) - tile.first_column };
+            for (int x{}; x < row.width; x++)
+            {
+                const GBufferTexel texel{ x < valid_width ? texels[x] : GBufferTexel{} };
+                const Vector3 color{ x < valid_width ? colors[x] : Vector3{} };
+                row.n[0][x] = texel.normal.x;
+                row.n[1][x] = texel.normal.y;
+                row.n[2][x] = texel.normal.z;
+                row.p[0][x] = texel.position.x;
+                row.p[1][x] = texel.position.y;
+                row.p[2][x] = texel.position.z;
+                row.a[0][x] = texel.albedo.x;
+                row.a[1][x] = texel.albedo.y;
+                row.a[2][x] = texel.albedo.z;
+                row.inv_plane_sigma[x] = texel.depth;
+                row.light[0][x] = color.x;
+                row.light[1][x] = color.y;
+                row.light[2][x] = color.z;
+            }
+            denoise_guides(row);
+        }
+
+        // each iteration filters the row whose lowest tap the previous one just filtered, down to the footprint of the next ones,
+        // after the weights of its pairs, which the row a step below needs too
+        for (int iteration{}; iteration < iterations; iteration++)
+        {
+            const int step{ 1 << iteration };
+            const int y{ t - ((2 << iteration) - 1) };
+            const int remaining_halo{ halo - ((2 << iteration) - 1) };
+            const int filtered_y0{ std::max(tile.y0 - remaining_halo, 0) };
+            const int filtered_y1{ std::min(tile.y1 + remaining_halo, height) };
+            if (y < std::max(filtered_y0 - step, 0) || y >= filtered_y1) continue;
+
+            const int x0{ (std::max(tile.x0 - remaining_halo, 0) - tile.first_column) / DENOISE_SIMD_WIDTH * DENOISE_SIMD_WIDTH };
+            const int x1{ std::min((std::min(tile.x1 + remaining_halo, width) - tile.first_column + DENOISE_SIMD_WIDTH - 1) / DENOISE_SIMD_WIDTH * DENOISE_SIMD_WIDTH, tile.row_width) };
+            const int step_pad{ (step + DENOISE_SIMD_WIDTH - 1) / DENOISE_SIMD_WIDTH * DENOISE_SIMD_WIDTH };
+            const bool filtered{ y >= filtered_y0 };
+            const bool last{ iteration == iterations - 1 };
+            DenoiseRow row{};
+            row.guides = row_guides(y);
+            if (y + step < height)
+            {
+                row.below_guides = row_guides(y + step);
+            }
+            for (int pair{}; pair < DENOISE_PAIRS_COUNT; pair++)
+            {
+                row.weights[pair] = weights_row(iteration, pair, y);
+                row.above_weights[pair] = y - step >= 0 ? weights_row(iteration, pair, y - step) : nullptr;
+            }
+            for (int c{}; c < 3; c++)
+            {
+                row.in[c] = light_row(iteration, c, y);
+                row.above_in[c] = light_row(iteration, c, std::max(y - step, 0));
+                row.below_in[c] = light_row(iteration, c, y + step);
+                row.out[c] = last ? tile.output.data() + stride * c + tile.pad : light_row(iteration + 1, c, y);
+            }
+            row.step = step;
+            row.weights_x0 = x0 - step_pad;
+            row.weights_x1 = x1 + step_pad;
+            row.x0 = x0;
+            row.x1 = filtered ? x1 : x0;
+            denoise_row(row);
+
+            // the last iteration modulates the light back, the background keeps its own
+            if (last && filtered)
+            {
+                const float* inv_plane_sigma{ guide_row(INV_PLANE_SIGMA, y) };
+                const float* albedo[3]{ guide_row(AR, y), guide_row(AG, y), guide_row(AB, y) };
+                for (int x{ tile.x0 }; x < tile.x1; x++)
+                {
+                    const std::size_t i{ static_cast<std::size_t>(y) * width + x };
+                    const int o{ x - tile.first_column };
+                    m_output[i] = inv_plane_sigma[o] > 0.0f ? Vector3{
+                        tile.output[tile.pad + o] * albedo[0][o], tile.output[stride + tile.pad + o] * albedo[1][o], tile.output[2 * stride + tile.pad + o] * albedo[2][o]
+                    } * DENOISE_ALBEDO_SIGMA : light[i];
+                }
+            }
+        }
+    }
+}
+
+static void BuildTileLightLists(
+    std::vector<std::vector<int>>& tile_lights, const std::vector<GBufferTexel>& gbuffer, int width, int height, const Camera& camera,
+    const std::vector<VirtualLight>& virtual_lights, const std::vector<float>& influence_radii, int point_lights_count, int vpl_type
+)
+{
+    /*
+        Each LIGHT_CULLING_TILE_SIZE x LIGHT_CULLING_TILE_SIZE tile bounds its pixels with the part of its frustum between their min
+        and max view depth, then keeps the lights whose influence sphere overlaps it (tested against the 6 planes, conservatively)
+        and, for the cosine weighted VPL types, whose lit half space contains some of it. Point lights are never culled.
+        Lists keep the lights in ascending order, so that they are summed in the same order as by the all lights loop.
+    */
+    const int tiles_x{ (width + LIGHT_CULLING_TILE_SIZE - 1) / LIGHT_CULLING_TILE_SIZE };
+    const int tiles_y{ (height + LIGHT_CULLING_TILE_SIZE - 1) / LIGHT_CULLING_TILE_SIZE };
+    tile_lights.resize(static_cast<std::size_t>(tiles_x) * static_cast<std::size_t>(tiles_y));
+
+    Matrix inverse_view_projection{ CameraViewProjection(camera, static_cast<float>(width) / static_cast<float>(height)).Invert() };
+    Vector3 forward{ camera.target - camera.eye };
+    forward.Normalize();
+
+    ParallelFor(static_cast<int>(tile_lights.size()), [&](int tile)
+    {
+        std::vector<int>& lights{ tile_lights[tile] };
+        lights.clear();
+
+        const int min_x{ (tile % tiles_x) * LIGHT_CULLING_TILE_SIZE };
+        const int min_y{ (tile / tiles_x) * LIGHT_CULLING_TILE_SIZE };
+        const int max_x{ std::min(min_x + LIGHT_CULLING_TILE_SIZE, width) }; // exclusive
+        const int max_y{ std::min(min_y + LIGHT_CULLING_TILE_SIZE, height) };
+
+        // view depth range
+        float min_depth{ std::numeric_limits<float>::max() };
+        float max_depth{ std::numeric_limits<float>::lowest() };
+        for (int y{ min_y }; y < max_y; y++)
+        {
+            for (int x{ min_x }; x < max_x; x++)
+            {
+                const GBufferTexel& texel{ gbuffer[static_cast<std::size_t>(y) * width + x] };
+                if (texel.depth <= 0.0f) continue;
+
+                float depth{ (texel.position - camera.eye).Dot(forward) };
+                min_depth = std::min(min_depth, depth);
+                max_depth = std::max(max_depth, depth);
+            }
+        }
+        if (min_depth > max_depth) return; // background only
+
+        // rays through the tile corners (counter clockwise on screen), and the corners of the frustum part between the depths
+        Vector3 directions[4]{};
+        const int corner_x[4]{ min_x, max_x, max_x, min_x };
+        const int corner_y[4]{ max_y, max_y, min_y, min_y };
+        for (int c{}; c < 4; c++)
+        {
+            float ndc_x{ 2.0f * static_cast<float>(corner_x[c]) / static_cast<float>(width) - 1.0f };
+            float ndc_y{ 1.0f - 2.0f * static_cast<float>(corner_y[c]) / static_cast<float>(height) };
+            directions[c] = CameraRay(inverse_view_projection, camera.eye, ndc_x, ndc_y).direction;
+        }
+
+        Vector3 corners[8]{};
+        for (int c{}; c < 4; c++)
+        {
+            float cos_forward{ directions[c].Dot(forward) };
+            corners[c] = camera.eye + directions[c] * (min_depth / cos_forward);
+            corners[c + 4] = camera.eye + directions[c] * (max_depth / cos_forward);
+        }
+
+        // inward side planes through the eye
+        Vector3 center_direction{ directions[0] + directions[1] + directions[2] + directions[3] };
+        Vector3 side_normals[4]{};
+        for (int c{}; c < 4; c++)
+        {
+            side_normals[c] = directions[c].Cross(directions[(c + 1) % 4]);
+            side_normals[c].Normalize();
+            if (side_normals[c].Dot(center_direction) < 0.0f) side_normals[c] = -side_normals[c];
+        }
+
+        for (int i{}; i < static_cast<int>(virtual_lights.size()); i++)
+        {
+            if (i < point_lights_count)
+            {
+                lights.emplace_back(i);
+                continue;
+            }
+
+            const VirtualLight& light{ virtual_lights[i] };
+            const float radius{ influence_radii[i] };
+
+            // influence sphere
+            Vector3 to_light{ light.position - camera.eye };
+            float light_depth{ to_light.Dot(forward) };
+            if (light_depth < min_depth - radius || light_depth > max_depth + radius) continue;
+            bool outside{};
+            for (const Vector3& side_normal : side_normals)
+            {
+                outside = outside || to_light.Dot(side_normal) < -radius;
+            }
+            if (outside) continue;
+
+            // lit half space
+            if (vpl_type != LIGHT_TYPE_POINT)
+            {
+                bool lit{};
+                for (const Vector3& corner : corners)
+                {
+                    lit = lit || (corner - light.position).Dot(light.normal) > 0.0f;
+                }
+                if (!lit) continue;
+            }
+
+            lights.emplace_back(i);
+        }
+    });
+}
+
+/*
+    Clustered light assignment (Olsson et al., "Clustered Deferred and Forward Shading", 2012): the view frustum is split into
+    CLUSTER_TILE_SIZE x CLUSTER_TILE_SIZE pixel tiles and CLUSTER_DEPTH_SLICES depth slices, exponentially spaced between the
+    min and max view depth of the G-buffer, so that froxels stay about as deep as they are wide.
+    Unlike 2D tiles, a froxel in front of a depth discontinuity doesn't get the lights of the surfaces behind it.
+*/
+struct LightClusters
+{
+    int tiles_x;
+    int tiles_y;
+    float min_depth; // view depth of the near side of the first slice
+    float depth_scale; // slice of view depth z is floor(log(z / min_depth) * depth_scale)
+    std::vector<int> offsets; // per cluster start of its lights, then the end of the last cluster
+    std::vector<int> lights; // per cluster VPL indices, in ascending order (point lights are never culled, and not listed)
+    std::vector<int> pixel_clusters; // per pixel cluster, -1 for the background
+};
+
+static int ClusterSlice(const LightClusters& clusters, float depth)
+{
+    int slice{ static_cast<int>(std::floor(std::log(depth / clusters.min_depth) * clusters.depth_scale)) };
+    return std::clamp(slice, 0, CLUSTER_DEPTH_SLICES - 1);
+}
+
+static float ClusterSliceDepth(const LightClusters& clusters, int slice)
+{
+    // view depth of the near side of the slice
+    return clusters.min_depth * std::exp(static_cast<float>(slice) / clusters.depth_scale);
+}
+
+static void BuildLightClusters(
+    LightClusters& clusters, const std::vector<GBufferTexel>& gbuffer, int width, int height, const Camera& camera,
+    const std::vector<VirtualLight>& virtual_lights, const std::vector<float>& influence_radii, int point_lights_count, int vpl_type
+)
+{
+    /*
+        Each VPL is binned in parallel: its influence sphere gives a range of slices and a conservative screen space range of
+        tiles, and it is kept by the froxels of that range whose view space bounding box it overlaps and, for the cosine weighted
+        VPL types, whose bounding box reaches its lit half space.
+        The per cluster lists are then compacted as in RadixSortMortonKeys: every chunk of VPLs counts its lights per cluster, an
+        exclusive scan over (cluster, chunk) gives the offsets, and each chunk scatters its lights in order.
+    */
+    clusters.tiles_x = (width + CLUSTER_TILE_SIZE - 1) / CLUSTER_TILE_SIZE;
+    clusters.tiles_y = (height + CLUSTER_TILE_SIZE - 1) / CLUSTER_TILE_SIZE;
+    const int cluster_count{ clusters.tiles_x * clusters.tiles_y * CLUSTER_DEPTH_SLICES };
+
+    // view space basis (same as Matrix::CreateLookAt, with the depth along forward)
+    Vector3 forward{ camera.target - camera.eye };
+    forward.Normalize();
+    Vector3 right{ forward.Cross({ 0.0f, 1.0f, 0.0f }) };
+    right.Normalize();
+    Vector3 up{ right.Cross(forward) };
+    auto to_view{ [&](Vector3 v) { return Vector3{ v.Dot(right), v.Dot(up), v.Dot(forward) }; } };
+
+    const float tan_y{ std::tan(0.5f * DirectX::XMConvertToRadians(camera.fov_deg)) };
+    const float tan_x{ tan_y * static_cast<float>(width) / static_cast<float>(height) };
+
+    // depth range of the G-buffer
+    std::vector<float> row_min_depths(height, std::numeric_limits<float>::max());
+    std::vector<float> row_max_depths(height, std::numeric_limits<float>::lowest());
+    ParallelFor(height, [&](int y)
+    {
+        for (int x{}; x < width; x++)
+        {
+            const GBufferTexel& texel{ gbuffer[static_cast<std::size_t>(y) * width + x] };
+            if (texel.depth <= 0.0f) continue;
+
+            float depth{ (texel.position - camera.eye).Dot(forward) };
+            row_min_depths[y] = std::min(row_min_depths[y], depth);
+            row_max_depths[y] = std::max(row_max_depths[y], depth);
+        }
+    });
+    float min_depth{ *std::min_element(row_min_depths.begin(), row_min_depths.end()) };
+    float max_depth{ *std::max_element(row_max_depths.begin(), row_max_depths.end()) };
+
+    clusters.offsets.assign(static_cast<std::size_t>(cluster_count) + 1, 0);
+    clusters.lights.clear();
+    clusters.pixel_clusters.assign(gbuffer.size(), -1);
+    if (min_depth > max_depth) return; // background only
+
+    max_depth = std::max(max_depth, min_depth * 1.001f); // a single depth still needs a non empty range
+    clusters.min_depth = min_depth;
+    clusters.depth_scale = static_cast<float>(CLUSTER_DEPTH_SLICES) / std::log(max_depth / min_depth);
+
+    ParallelFor(height, [&](int y)
+    {
+        for (int x{}; x < width; x++)
+        {
+            std::size_t i{ static_cast<std::size_t>(y) * width + x };
+            if (gbuffer[i].depth <= 0.0f) continue;
+
+            int slice{ ClusterSlice(clusters, (gbuffer[i].position - camera.eye).Dot(forward)) };
+            clusters.pixel_clusters[i] = (slice * clusters.tiles_y + y / CLUSTER_TILE_SIZE) * clusters.tiles_x + x / CLUSTER_TILE_SIZE;
+        }
+    });
+
+    // binning
+    const int vpls_count{ static_cast<int>(virtual_lights.size()) - point_lights_count };
+    if (vpls_count <= 0) return;
+
+    const int chunk_count{ ParallelChunkCount(vpls_count) };
+    auto chunk_begin{ [&](int chunk) { return point_lights_count + static_cast<int>(static_cast<long long>(vpls_count) * chunk / chunk_count); } };
+    std::vector<std::vector<int>> chunk_clusters(chunk_count); // (cluster, light) pairs found by each chunk, in light order
+    std::vector<std::vector<int>> chunk_lights(chunk_count);
+
+    ParallelFor(chunk_count, [&](int chunk)
+    {
+        std::vector<int>& found_clusters{ chunk_clusters[chunk] };
+        std::vector<int>& found_lights{ chunk_lights[chunk] };
+        found_clusters.clear();
+        found_lights.clear();
+
+        for (int i{ chunk_begin(chunk) }; i < chunk_begin(chunk + 1); i++)
+        {
+            const VirtualLight& light{ virtual_lights[i] };
+            const float radius{ influence_radii[i] };
+            const Vector3 center{ to_view(light.position - camera.eye) };
+            const Vector3 normal{ to_view(light.normal) };
+
+            // slices
+            float near_depth{ center.z - radius };
+            float far_depth{ center.z + radius };
+            if (far_depth < min_depth || near_depth > max_depth) continue;
+            int min_slice{ near_depth <= min_depth ? 0 : ClusterSlice(clusters, near_depth) };
+            int max_slice{ far_depth >= max_depth ? CLUSTER_DEPTH_SLICES - 1 : ClusterSlice(clusters, far_depth) };
+
+            // tiles (every tile when the sphere reaches the plane of the eye)
+            int min_tile_x{}, max_tile_x{ clusters.tiles_x - 1 };
+            int min_tile_y{}, max_tile_y{ clusters.tiles_y - 1 };
+            if (near_depth > 0.0f)
+            {
+                float z0{ std::max(near_depth, min_depth) };
+                float z1{ std::min(far_depth, max_depth) };
+                float min_ndc_x{ std::min((center.x - radius) / z0, (center.x - radius) / z1) / tan_x };
+                float max_ndc_x{ std::max((center.x + radius) / z0, (center.x + radius) / z1) / tan_x };
+                float min_ndc_y{ std::min((center.y - radius) / z0, (center.y - radius) / z1) / tan_y };
+                float max_ndc_y{ std::max((center.y + radius) / z0, (center.y + radius) / z1) / tan_y };
+
+                auto tile_x{ [&](float ndc) { return std::clamp(static_cast<int>(std::floor((0.5f + 0.5f * ndc) * static_cast<float>(width))) / CLUSTER_TILE_SIZE, 0, clusters.tiles_x - 1); } };
+                auto tile_y{ [&](float ndc) { return std::clamp(static_cast<int>(std::floor((0.5f - 0.5f * ndc) * static_cast<float>(height))) / CLUSTER_TILE_SIZE, 0, clusters.tiles_y - 1); } };
+                min_tile_x = tile_x(std::max(min_ndc_x, -1.0f));
+                max_tile_x = tile_x(std::min(max_ndc_x, +1.0f));
+                min_tile_y = tile_y(std::min(max_ndc_y, +1.0f));
+                max_tile_y = tile_y(std::max(min_ndc_y, -1.0f));
+            }
+
+            for (int slice{ min_slice }; slice <= max_slice; slice++)
+            {
+                const float z0{ ClusterSliceDepth(clusters, slice) };
+                const float z1{ ClusterSliceDepth(clusters, slice + 1) };
+                for (int ty{ min_tile_y }; ty <= max_tile_y; ty++)
+                {
+                    const float ndc_y0{ 1.0f - 2.0f * static_cast<float>(std::min((ty + 1) * CLUSTER_TILE_SIZE, height)) / static_cast<float>(height) };
+                    const float ndc_y1{ 1.0f - 2.0f * static_cast<float>(ty * CLUSTER_TILE_SIZE) / static_cast<float>(height) };
+                    for (int tx{ min_tile_x }; tx <= max_tile_x; tx++)
+                    {
+                        const float ndc_x0{ 2.0f * static_cast<float>(tx * CLUSTER_TILE_SIZE) / static_cast<float>(width) - 1.0f };
+                        const float ndc_x1{ 2.0f * static_cast<float>(std::min((tx + 1) * CLUSTER_TILE_SIZE, width)) / static_cast<float>(width) - 1.0f };
+
+                        // view space bounding box of the froxel
+                        Vector3 box_min{ std::min(ndc_x0 * z0, ndc_x0 * z1) * tan_x, std::min(ndc_y0 * z0, ndc_y0 * z1) * tan_y, z0 };
+                        Vector3 box_max{ std::max(ndc_x1 * z0, ndc_x1 * z1) * tan_x, std::max(ndc_y1 * z0, ndc_y1 * z1) * tan_y, z1 };
+
+                        Vector3 closest{ std::clamp(center.x, box_min.x, box_max.x), std::clamp(center.y, box_min.y, box_max.y), std::clamp(center.z, box_min.z, box_max.z) };
+                        if ((closest - center).LengthSquared() > radius * radius) continue;
+
+                        if (vpl_type != LIGHT_TYPE_POINT)
+                        {
+                            // the box corner farthest along the normal
+                            Vector3 farthest{ normal.x > 0.0f ? box_max.x : box_min.x, normal.y > 0.0f ? box_max.y : box_min.y, normal.z > 0.0f ? box_max.z : box_min.z };
+                            if ((farthest - center).Dot(normal) <= 0.0f) continue;
+                        }
+
+                        found_clusters.emplace_back((slice * clusters.tiles_y + ty) * clusters.tiles_x + tx);
+                        found_lights.emplace_back(i);
+                    }
+                }
+            }
+        }
+    });
+
+    // compaction
+    std::vector<int> offsets(static_cast<std::size_t>(chunk_count) * cluster_count); // per chunk light counts, then output offsets
+    ParallelFor(chunk_count, [&](int chunk)
+    {
+        int* counts{ &offsets[static_cast<std::size_t>(chunk) * cluster_count] };
+        std::fill(counts, counts + cluster_count, 0);
+        for (int cluster : chunk_clusters[chunk])
+        {
+            counts[cluster]++;
+        }
+    });
+
+    int sum{};
+    for (int cluster{}; cluster < cluster_count; cluster++)
+    {
+        clusters.offsets[cluster] = sum;
+        for (int chunk{}; chunk < chunk_count; chunk++)
+        {
+            int& offset{ offsets[static_cast<std::size_t>(chunk) * cluster_count + cluster] };
+            int count{ offset };
+            offset = sum;
+            sum += count;
+        }
+    }
+    clusters.offsets[cluster_count] = sum;
+
+    clusters.lights.resize(sum);
+    ParallelFor(chunk_count, [&](int chunk)
+    {
+        int* offset{ &offsets[static_cast<std::size_t>(chunk) * cluster_count] };
+        for (std::size_t k{}; k < chunk_clusters[chunk].size(); k++)
+        {
+            clusters.lights[offset[chunk_clusters[chunk][k]]++] = chunk_lights[chunk][k];
+        }
+    });
+}
+
+struct SoftwareScene
+{
+    const std::vector<Object>& objects;
+    const Emitters& emitters;
+    const ShadowConstants& shadow; // of the cube shadow maps of the point lights
+};
+
+struct SoftwareLights
+{
+    const std::vector<VirtualLight>& virtual_lights; // the point lights first, then the VPLs
+    int point_lights_count;
+    int particles_count; // abiding by Keller, the frame is weighted by the number of particles
+    int vpl_type;
+};
+
+class SoftwareRenderer
+{
+public:
+    SoftwareRenderer(int width, int height);
+    ~SoftwareRenderer() = default;
+    SoftwareRenderer(const SoftwareRenderer&) = delete;
+    SoftwareRenderer(SoftwareRenderer&&) noexcept = default;
+    SoftwareRenderer& operator=(const SoftwareRenderer&) = delete;
+    SoftwareRenderer& operator=(SoftwareRenderer&&) noexcept = default;
+public:
+    SoftwareFrameStats Render(const Camera& camera, const SoftwareScene& scene, const SoftwareLights& lights, const SoftwareShading& shading);
+    const std::vector<Vector3>& Color() const noexcept { return m_rasterizer.Color(); }
+private:
+    SoftwareRasterizer m_rasterizer;
+    std::vector<SoftwareCubeShadowMap> m_cube_shadow_maps; // of the point lights, rendered every frame
+    IrradianceCache m_irradiance_cache; // records persist across frames until the VPLs, the geometry or the VPL shading settings change
+    std::vector<VisibilityCache> m_visibility_caches; // of shadow rays, one per chunk of tiles, persist until the VPLs, the geometry or the cell change
+    TemporalHistory m_temporal_history; // VPL light accumulated by the previous frames
+    ATrousDenoiser m_denoiser;
+};
+
+SoftwareRenderer::SoftwareRenderer(int width, int height)
+    : m_rasterizer{ width, height, false }
+    , m_cube_shadow_maps{}
+    , m_irradiance_cache{}
+    , m_visibility_caches{}
+    , m_temporal_history{}
+    , m_denoiser{}
+{
+}
+
+SoftwareFrameStats SoftwareRenderer::Render(const Camera& camera, const SoftwareScene& scene, const SoftwareLights& lights, const SoftwareShading& shading)
+{
+    /*
+        Multipass: same passes as the final render, a pass over all the objects for each virtual light, summed over the first pass
+        (bs_sum and ds_equal), then a pass for each emissive quad (no point light markers and skybox, the background is the clear color).
+        Deferred: the objects are rasterized once into a G-buffer (position, normal, albedo), then all the lights are evaluated per
+        pixel in a single loop, in the same order and with the same arithmetic as the passes, so both produce the same image.
+        The only exception are coplanar triangles reaching a pixel with the exact same depth, which ds_equal lets through more than once.
+        With tiled or clustered light culling, each pixel only loops over the lights of its tile or cluster, which can only miss
+        contributions of (about) zero.
+        Interleaved sampling (Keller and Heidrich) splits the VPLs into interleave^2 subsets, VPL i going to the subset
+        (i - point_lights_count) % interleave^2 as the GPU rotation, and each pixel of an interleave x interleave block shades the
+        point lights, the emissive quads and a single subset, scaled by interleave^2. A discontinuity buffer then averages the VPL
+        light over the interleave x interleave window around each pixel, so all the subsets, but only over the pixels seeing the
+        same surface (SimilarTexels); across edges fewer subsets are averaged, trading noise for blur.
+        The VPLs are unshadowed as the GPU passes, or shadowed by imperfect shadow maps, or (deferred only) by shadow rays through a
+        BVH of the scene triangles, traced in batches from each VPL to the pixels of a tile and cached by quantized position
+        across frames, until the VPLs or the geometry move.
+        At reduced resolution (deferred only), a single pixel of each indirect_scale x indirect_scale block (the covered one closest
+        to its center) shades the VPLs, and a joint bilateral filter guided by the depths and normals of the G-buffer upsamples its
+        light; the point lights and the emissive quads are still shaded at every pixel.
+        Denoising (deferred only) runs an edge-avoiding a-trous filter over the VPL light of the frame, which is then added last.
+        With the irradiance cache (deferred only), the VPL light is only evaluated at sparse records and interpolated elsewhere.
+        Records are created coarse to fine, at the candidate pixels of halving strides no record is valid for yet, and persist
+        across frames (whatever the camera) until the VPLs, the geometry or the VPL shading settings change.
+        With temporal reuse (deferred only), each frame shades a single subset of the VPLs, in turn, as the interleaving subsets,
+        and blends its VPL light with the one accumulated by the previous frames, reprojected at the same surface.
+    */
+    const std::vector<Object>& objects{ scene.objects };
+    const Emitters& emitters{ scene.emitters };
+    const ShadowConstants& shadow{ scene.shadow };
+    const std::vector<VirtualLight>& virtual_lights{ lights.virtual_lights };
+    const int point_lights_count{ lights.point_lights_count };
+    const int particles_count{ lights.particles_count };
+    const int vpl_type{ lights.vpl_type };
+    SoftwareFrameStats stats{};
+
+    const float weight{ 1.0f / static_cast<float>(particles_count) }; // abiding by Keller, each frame is weighted by the number of particles
+
+    // cube shadow maps
+    m_cube_shadow_maps.resize(point_lights_count);
+    for (int i{}; i < point_lights_count; i++)
+    {
+        m_cube_shadow_maps[i].Render(objects, virtual_lights[i].position, CubeShadowMapSize(point_lights_count));
+    }
+
+    ImperfectShadowMaps imperfect_shadow_maps{};
+    TriangleBVH bvh{};
+    const bool ray_visibility{ shading.deferred && shading.vpl_visibility == VPL_VISIBILITY_RAYS };
+    if (shading.vpl_visibility == VPL_VISIBILITY_ISM || ray_visibility)
+    {
+        Timer timer{};
+        timer.Start();
+        if (ray_visibility)
+        {
+            bvh.Build(objects);
+        }
+        else
+        {
+            imperfect_shadow_maps.Render(objects, virtual_lights, point_lights_count, vpl_type == LIGHT_TYPE_POINT);
+        }
+        timer.End();
+        stats.vpl_visibility_sec = timer.DeltaSec();
+    }
+
+    std::vector<float> influence_radii(virtual_lights.size(), std::numeric_limits<float>::infinity());
+    for (int i{ point_lights_count }; i < static_cast<int>(virtual_lights.size()); i++)
+    {
+        influence_radii[i] = VPLInfluenceRadius(virtual_lights[i], shading.attenuation_epsilon, weight);
+    }
+
+    struct QuadLight
+    {
+        Vector3 corners[4];
+        Vector3 radiance;
+    };
+    std::vector<QuadLight> quad_lights(emitters.quads.size());
+    for (std::size_t k{}; k < quad_lights.size(); k++)
+    {
+        QuadCorners(*emitters.quads[k], quad_lights[k].corners);
+        quad_lights[k].radiance = emitters.quads[k]->emissive_color * emitters.quads[k]->emissive_intensity;
+    }
+
+    auto shade_light{ [&](int i, Vector3 position, Vector3 normal, Vector3 albedo)
+    {
+        const VirtualLight& light{ virtual_lights[i] };
+        if (i < point_lights_count)
+        {
+            return ShadeShadowed(position, normal, albedo, light, m_cube_shadow_maps[i], shadow) * weight;
+        }
+
+        if (shading.vpl_visibility == VPL_VISIBILITY_ISM)
+        {
+            Vector3 v{ position - light.position };
+            if (v.Length() * (1.0f - ISM_DEPTH_BIAS) > imperfect_shadow_maps.Sample(i, v)) return Vector3{};
+        }
+
+        Vector3 color{ ShadeDiffuse(position, normal, albedo, light, vpl_type) * weight };
+        if (shading.attenuation_epsilon > 0.0f)
+        {
+            color *= BoundedAttenuation((light.position - position).Length(), influence_radii[i]);
+        }
+        return color;
+    } };
+
+    auto shade_quad_light{ [&](const QuadLight& quad_light, Vector3 position, Vector3 normal, Vector3 albedo)
+    {
+        return albedo / std::numbers::pi_v<float> * quad_light.radiance * QuadProjectedSolidAngle(quad_light.corners, position, normal) * weight;
+    } };
+
+    float aspect{ static_cast<float>(m_rasterizer.Width()) / static_cast<float>(m_rasterizer.Height()) };
+    m_rasterizer.Clear(FRAME_CLEAR_COLOR, 1.0f);
+    m_rasterizer.SetGeometry(objects, CameraViewProjection(camera, aspect), true);
+
+    RasterState first_pass_state{ RasterDepthTest::Less, true, false, false, {}, 0.0f };
+    RasterState sum_state{ RasterDepthTest::Equal, true, true, false, {}, 0.0f };
+
+    if (shading.deferred)
+    {
+        if (virtual_lights.empty()) return stats; // as the passes, which only draw over the first one
+
+        const int width{ m_rasterizer.Width() };
+        const int height{ m_rasterizer.Height() };
+
+        std::vector<GBufferTexel> gbuffer(m_rasterizer.Color().size());
+        m_rasterizer.Draw(first_pass_state, [&](const RasterFragment& fragment)
+        {
+            Vector3 N{ fragment.world_normal };
+            N.Normalize();
+            gbuffer[static_cast<std::size_t>(fragment.y) * width + fragment.x] = {
+                fragment.world_position, N, fragment.object->albedo, (fragment.world_position - camera.eye).Length()
+            };
+            return Vector3{};
+        });
+
+        bool tiled{ shading.light_culling == LIGHT_CULLING_TILED };
+        bool clustered{ shading.light_culling == LIGHT_CULLING_CLUSTERED };
+        std::vector<std::vector<int>> tile_lights{};
+        LightClusters clusters{};
+        if (tiled)
+        {
+            BuildTileLightLists(tile_lights, gbuffer, width, height, camera, virtual_lights, influence_radii, point_lights_count, vpl_type);
+
+            std::size_t lights_sum{};
+            int covered_tiles{};
+            for (const std::vector<int>& lights : tile_lights)
+            {
+                if (lights.empty()) continue;
+                lights_sum += lights.size();
+                covered_tiles++;
+            }
+            stats.average_list_lights = covered_tiles > 0 ? static_cast<float>(lights_sum) / static_cast<float>(covered_tiles) : 0.0f;
+        }
+        else if (clustered)
+        {
+            BuildLightClusters(clusters, gbuffer, width, height, camera, virtual_lights, influence_radii, point_lights_count, vpl_type);
+
+            std::vector<std::uint8_t> covered(clusters.offsets.size() - 1);
+            for (int cluster : clusters.pixel_clusters)
+            {
+                if (cluster >= 0) covered[cluster] = 1;
+            }
+            std::size_t lights_sum{};
+            int covered_clusters{};
+            for (std::size_t cluster{}; cluster < covered.size(); cluster++)
+            {
+                if (!covered[cluster]) continue;
+                lights_sum += point_lights_count + clusters.offsets[cluster + 1] - clusters.offsets[cluster];
+                covered_clusters++;
+            }
+            stats.average_list_lights = covered_clusters > 0 ? static_cast<float>(lights_sum) / static_cast<float>(covered_clusters) : 0.0f;
+        }
+
+        // VPL light interpolated from the irradiance cache (a record per pixel at worst)
+        const bool cached_vpls{ shading.irradiance_accuracy > 0.0f };
+        std::vector<Vector3> irradiance(cached_vpls ? gbuffer.size() : 0);
+        if (cached_vpls)
+        {
+            Timer timer{};
+            timer.Start();
+
+            std::size_t lighting_hash{};
+            for (int j{ point_lights_count }; j < static_cast<int>(virtual_lights.size()); j++)
+            {
+                HashCombine(lighting_hash, virtual_lights[j].position);
+                HashCombine(lighting_hash, virtual_lights[j].normal);
+                HashCombine(lighting_hash, virtual_lights[j].color);
+                HashCombine(lighting_hash, virtual_lights[j].intensity);
+            }
+            for (const Object& obj : objects)
+            {
+                HashCombine(lighting_hash, obj.position);
+                HashCombine(lighting_hash, obj.rotation);
+                HashCombine(lighting_hash, obj.scaling);
+            }
+            HashCombine(lighting_hash, particles_count);
+            HashCombine(lighting_hash, vpl_type);
+            HashCombine(lighting_hash, shading.attenuation_epsilon);
+            HashCombine(lighting_hash, shading.vpl_visibility);
+            HashCombine(lighting_hash, shading.irradiance_accuracy);
+            if (lighting_hash != m_irradiance_cache.LightingHash() || m_irradiance_cache.RecordsCount() == 0)
+            {
+                Vector3 bounds_min{}, bounds_max{};
+                ComputeSceneBounds(objects, bounds_min, bounds_max);
+                m_irradiance_cache.Reset(bounds_min, bounds_max, shading.irradiance_accuracy, lighting_hash);
+            }
+
+            const int vpls_count{ static_cast<int>(virtual_lights.size()) - point_lights_count };
+            std::vector<Vector3> vpl_positions(vpls_count);
+            for (int j{}; j < vpls_count; j++)
+            {
+                vpl_positions[j] = virtual_lights[point_lights_count + j].position;
+            }
+
+            auto vpl_irradiance{ [&](Vector3 position, Vector3 normal, const std::uint8_t* occluded)
+            {
+                // occluded: a flag per VPL with ray visibility, nullptr otherwise
+                Vector3 color{};
+                for (int j{}; j < vpls_count; j++)
+                {
+                    if (occluded && occluded[j]) continue;
+                    color = color + shade_light(point_lights_count + j, position, normal, Vector3{ 1.0f });
+                }
+                return color;
+            } };
+
+            const float pixel_angle{ 2.0f * std::tan(0.5f * DirectX::XMConvertToRadians(camera.fov_deg)) / static_cast<float>(height) };
+            auto create_record{ [&](const GBufferTexel& texel, std::uint32_t rng, std::size_t& rays)
+            {
+                IrradianceCache::Record record{};
+                record.position = texel.position;
+                record.normal = texel.normal;
+                BuildOrthonormalBasis(texel.normal, record.tangent, record.bitangent);
+
+                // split sphere: harmonic mean distance of the surfaces seen over the hemisphere (stratified)
+                float inverse_distance_sum{};
+                for (int sy{}; sy < IRRADIANCE_CACHE_HEMISPHERE_STRATA; sy++)
+                {
+                    for (int sx{}; sx < IRRADIANCE_CACHE_HEMISPHERE_STRATA; sx++)
+                    {
+                        float u0{ (static_cast<float>(sx) + RandomFloat(rng)) / static_cast<float>(IRRADIANCE_CACHE_HEMISPHERE_STRATA) };
+                        float u1{ (static_cast<float>(sy) + RandomFloat(rng)) / static_cast<float>(IRRADIANCE_CACHE_HEMISPHERE_STRATA) };
+                        Ray ray{ texel.position + texel.normal * SHADOW_RAY_OFFSET, SampleCosineHemisphere(texel.normal, u0, u1) };
+                        RayHit hit{ IntersectScene(objects, ray, nullptr) };
+                        if (hit.valid)
+                        {
+                            inverse_distance_sum += 1.0f / std::max((hit.position - ray.origin).Length(), SHADOW_RAY_OFFSET);
+                        }
+                    }
+                }
+                constexpr float hemisphere_rays{ static_cast<float>(IRRADIANCE_CACHE_HEMISPHERE_STRATA * IRRADIANCE_CACHE_HEMISPHERE_STRATA) };
+                float harmonic_mean{ inverse_distance_sum > 0.0f ? hemisphere_rays / inverse_distance_sum : std::numeric_limits<float>::infinity() };
+
+                // the radius of validity (accuracy times radius) is bounded in pixels, not to create too many or too few records
+                float pixel_size{ texel.depth * pixel_angle };
+                record.radius = std::clamp(
+                    harmonic_mean, IRRADIANCE_CACHE_MIN_PIXELS * pixel_size / shading.irradiance_accuracy,
+                    IRRADIANCE_CACHE_MAX_PIXELS * pixel_size / shading.irradiance_accuracy
+                );
+
+                // gradients by central differences, the translated positions need their own VPL visibility
+                const float step{ IRRADIANCE_CACHE_GRADIENT_STEP * shading.irradiance_accuracy * record.radius };
+                const Vector3 positions[5]{
+                    texel.position, texel.position + record.tangent * step, texel.position - record.tangent * step,
+                    texel.position + record.bitangent * step, texel.position - record.bitangent * step
+                };
+                std::vector<std::uint8_t> occluded(ray_visibility ? std::size(positions) * vpls_count : 0);
+                if (ray_visibility)
+                {
+                    for (std::size_t k{}; k < std::size(positions); k++)
+                    {
+                        bvh.OccludedBatch(positions[k] + texel.normal * SHADOW_RAY_OFFSET, vpl_positions.data(), vpls_count, occluded.data() + k * vpls_count);
+                    }
+                    rays += occluded.size();
+                }
+                auto visibility{ [&](std::size_t k) { return ray_visibility ? occluded.data() + k * vpls_count : nullptr; } };
+
+                record.irradiance = vpl_irradiance(texel.position, texel.normal, visibility(0));
+                const float tilt_cos{ std::cos(IRRADIANCE_CACHE_GRADIENT_TILT) };
+                const float tilt_sin{ std::sin(IRRADIANCE_CACHE_GRADIENT_TILT) };
+                for (int axis{}; axis < 2; axis++)
+                {
+                    Vector3 direction{ axis == 0 ? record.tangent : record.bitangent };
+                    Vector3 forward{ vpl_irradiance(positions[1 + 2 * axis], texel.normal, visibility(1 + 2 * axis)) };
+                    Vector3 backward{ vpl_irradiance(positions[2 + 2 * axis], texel.normal, visibility(2 + 2 * axis)) };
+                    record.translation_gradient[axis] = (forward - backward) / (2.0f * step);
+
+                    Vector3 tilted_forward{ vpl_irradiance(texel.position, texel.normal * tilt_cos + direction * tilt_sin, visibility(0)) };
+                    Vector3 tilted_backward{ vpl_irradiance(texel.position, texel.normal * tilt_cos - direction * tilt_sin, visibility(0)) };
+                    record.rotation_gradient[axis] = (tilted_forward - tilted_backward) / (2.0f * tilt_sin);
+                }
+                return record;
+            } };
+
+            std::vector<std::vector<std::size_t>> row_candidates{};
+            std::vector<std::size_t> candidates{};
+            std::vector<IrradianceCache::Record> records{};
+            std::vector<std::size_t> record_rays{};
+            for (int stride{ IRRADIANCE_CACHE_FIRST_STRIDE }; stride >= 1; stride /= 2)
+            {
+                // candidates: the pixels of the stride no record is valid for yet
+                const int rows{ (height + stride - 1) / stride };
+                row_candidates.assign(rows, {});
+                ParallelFor(rows, [&](int row)
+                {
+                    for (int x{}; x < width; x += stride)
+                    {
+                        std::size_t i{ static_cast<std::size_t>(row * stride) * width + x };
+                        Vector3 unused{};
+                        if (gbuffer[i].depth > 0.0f && !m_irradiance_cache.Interpolate(gbuffer[i].position, gbuffer[i].normal, unused))
+                        {
+                            row_candidates[row].push_back(i);
+                        }
+                    }
+                });
+                candidates.clear();
+                for (const std::vector<std::size_t>& row : row_candidates)
+                {
+                    candidates.insert(candidates.end(), row.begin(), row.end());
+                }
+
+                records.resize(candidates.size());
+                record_rays.assign(candidates.size(), 0);
+                ParallelFor(static_cast<int>(candidates.size()), [&](int k)
+                {
+                    records[k] = create_record(gbuffer[candidates[k]], PCGHash(static_cast<std::uint32_t>(candidates[k])), record_rays[k]);
+                });
+                stats.shadow_rays += std::accumulate(record_rays.begin(), record_rays.end(), std::size_t{});
+
+                // the records of close candidates overlap, the later ones are dropped (deterministic, whatever the threads)
+                for (std::size_t k{}; k < candidates.size(); k++)
+                {
+                    const GBufferTexel& texel{ gbuffer[candidates[k]] };
+                    Vector3 unused{};
+                    if (m_irradiance_cache.Interpolate(texel.position, texel.normal, unused)) continue;
+                    m_irradiance_cache.Insert(records[k]);
+                    stats.irradiance_records_created++;
+                }
+            }
+
+            // every pixel is covered once the last stride is done
+            ParallelFor(height, [&](int y)
+            {
+                for (int x{}; x < width; x++)
+                {
+                    std::size_t i{ static_cast<std::size_t>(y) * width + x };
+                    if (gbuffer[i].depth <= 0.0f) continue;
+                    m_irradiance_cache.Interpolate(gbuffer[i].position, gbuffer[i].normal, irradiance[i]);
+                }
+            });
+
+            timer.End();
+            stats.irradiance_cache_sec = timer.DeltaSec();
+            stats.irradiance_records = m_irradiance_cache.RecordsCount();
+        }
+
+        const int tiles_x{ (width + LIGHT_CULLING_TILE_SIZE - 1) / LIGHT_CULLING_TILE_SIZE };
+        const int tiles_y{ (height + LIGHT_CULLING_TILE_SIZE - 1) / LIGHT_CULLING_TILE_SIZE };
+        std::vector<std::size_t> tile_pixels(static_cast<std::size_t>(tiles_x) * tiles_y); // covered pixels
+        std::vector<std::size_t> tile_pixel_lights(tile_pixels.size()); // lights shaded by them
+        std::vector<std::size_t> tile_shadow_rays(tile_pixels.size());
+        std::vector<std::size_t> tile_cache_lookups(tile_pixels.size());
+        std::vector<std::size_t> tile_cache_hits(tile_pixels.size());
+        std::vector<Vector3>& image{ m_rasterizer.Color() };
+        // reduced resolution VPL light, the sample of a block is its covered pixel closest to the center (gbuffer.size() for none)
+        const bool reduced_vpls{ !cached_vpls && shading.indirect_scale > 1 };
+        const int scale{ shading.indirect_scale };
+        const int reduced_w{ (width + scale - 1) / scale };
+        const int reduced_h{ (height + scale - 1) / scale };
+        std::vector<std::size_t> reduced_pixels(reduced_vpls ? static_cast<std::size_t>(reduced_w) * reduced_h : 0, gbuffer.size());
+        std::vector<Vector3> reduced_indirect(reduced_pixels.size());
+        if (reduced_vpls)
+        {
+            ParallelFor(reduced_h, [&](int ry)
+            {
+                for (int rx{}; rx < reduced_w; rx++)
+                {
+                    float center_x{ static_cast<float>(rx * scale) + 0.5f * static_cast<float>(scale - 1) };
+                    float center_y{ static_cast<float>(ry * scale) + 0.5f * static_cast<float>(scale - 1) };
+                    float closest{ std::numeric_limits<float>::max() };
+                    for (int y{ ry * scale }; y < std::min((ry + 1) * scale, height); y++)
+                    {
+                        for (int x{ rx * scale }; x < std::min((rx + 1) * scale, width); x++)
+                        {
+                            std::size_t i{ static_cast<std::size_t>(y) * width + x };
+                            if (gbuffer[i].depth <= 0.0f) continue;
+
+                            float distance{ (static_cast<float>(x) - center_x) * (static_cast<float>(x) - center_x) + (static_cast<float>(y) - center_y) * (static_cast<float>(y) - center_y) };
+                            if (distance < closest)
+                            {
+                                closest = distance;
+                                reduced_pixels[static_cast<std::size_t>(ry) * reduced_w + rx] = i;
+                            }
+                        }
+                    }
+                }
+            });
+        }
+
+        // with temporal reuse, VPL i is shaded by the frames where (i - point_lights_count) % subsets is the frame % subsets
+        const bool temporal_vpls{ !cached_vpls && shading.temporal_subsets > 0 };
+        const int temporal_subsets{ temporal_vpls ? shading.temporal_subsets : 1 };
+        const int temporal_subset{ temporal_vpls ? m_temporal_history.frame % temporal_subsets : 0 };
+
+        const int subsets_count{ cached_vpls || reduced_vpls || temporal_vpls ? 1 : shading.interleave * shading.interleave };
+        std::vector<Vector3> indirect(subsets_count > 1 ? image.size() : 0); // VPL light of the subset of each pixel
+
+        // the VPL light to reuse or denoise is kept apart, and added last
+        const bool denoised_vpls{ shading.denoise_iterations > 0 };
+        const bool separate_vpls{ denoised_vpls || temporal_vpls };
+        std::vector<Vector3> vpl_light(separate_vpls ? image.size() : 0);
+        auto add_vpl_light{ [&](std::size_t i, Vector3 color)
+        {
+            if (separate_vpls)
+            {
+                vpl_light[i] = vpl_light[i] + color;
+            }
+            else
+            {
+                image[i] = image[i] + color;
+            }
+        } };
+
+        // specialized kernels, picked once for the frame, the span of a VPL skips the visibility and the attenuation of shade_light
+        const PointLightSpanKernel shade_point_light_span{ SelectPointLightSpanKernel(shadow.pcf_samples) };
+        const VPLSpanKernel shade_vpl_span{ SelectVPLSpanKernel(vpl_type) };
+        const bool span_vpls{ shading.vpl_visibility == VPL_VISIBILITY_NONE && shading.attenuation_epsilon <= 0.0f };
+        const bool lanes_vpls{ span_vpls && shading.simd_lanes > 1 }; // the VPLs of a group are gathered, then shaded a pixel at a time
+        const VPLLanesKernel shade_vpl_lanes{ SelectVPLLanesKernel(vpl_type, shading.simd_lanes) };
+
+        // the shadow rays are cached across frames, by each chunk of tiles (shaded by a single thread), until the VPLs or the geometry move
+        const int tile_chunks_count{ ParallelChunkCount(tiles_x * tiles_y) };
+        if (ray_visibility)
+        {
+            std::size_t scene_hash{};
+            HashCombine(scene_hash, point_lights_count); // the VPL indices are in the keys
+            for (int j{ point_lights_count }; j < static_cast<int>(virtual_lights.size()); j++)
+            {
+                HashCombine(scene_hash, virtual_lights[j].position);
+            }
+            for (const Object& obj : objects)
+            {
+                HashCombine(scene_hash, obj.position);
+                HashCombine(scene_hash, obj.rotation);
+                HashCombine(scene_hash, obj.scaling);
+            }
+            while (static_cast<int>(m_visibility_caches.size()) < tile_chunks_count)
+            {
+                m_visibility_caches.emplace_back(VISIBILITY_CACHE_SIZE);
+            }
+            for (VisibilityCache& cache : m_visibility_caches)
+            {
+                if (cache.SceneHash() != scene_hash || cache.Cell() != VISIBILITY_CACHE_CELL)
+                {
+                    cache.Reset(VISIBILITY_CACHE_CELL, scene_hash);
+                }
+            }
+        }
+        auto shade_tile{ [&](int tile, VisibilityCache* visibility_cache)
+        {
+            const int min_x{ (tile % tiles_x) * LIGHT_CULLING_TILE_SIZE };
+            const int min_y{ (tile / tiles_x) * LIGHT_CULLING_TILE_SIZE };
+            const int max_x{ std::min(min_x + LIGHT_CULLING_TILE_SIZE, width) };
+            const int max_y{ std::min(min_y + LIGHT_CULLING_TILE_SIZE, height) };
+
+            /*
+                The covered pixels are grouped by the lights they shade (cluster, interleaving subset or none of the VPLs at reduced
+                resolution), and each group is shaded
+                a light at a time, so that the shadow rays of a VPL can be traced as a batch sharing its origin. Each pixel still
+                sums its lights in the same order as the passes.
+            */
+            struct TilePixel
+            {
+                std::size_t index;
+                int group;
+                int subset;
+            };
+            std::vector<TilePixel> pixels{};
+            for (int y{ min_y }; y < max_y; y++)
+            {
+                for (int x{ min_x }; x < max_x; x++)
+                {
+                    std::size_t i{ static_cast<std::size_t>(y) * width + x };
+                    if (gbuffer[i].depth <= 0.0f) continue; // background
+
+                    int subset{ cached_vpls ? 0 : (y % shading.interleave) * shading.interleave + x % shading.interleave };
+                    if (reduced_vpls)
+                    {
+                        subset = reduced_pixels[static_cast<std::size_t>(y / scale) * reduced_w + x / scale] == i ? 0 : -1; // -1 for no VPLs
+                    }
+                    const int cluster{ clustered ? clusters.pixel_clusters[i] : 0 };
+                    pixels.push_back({ i, subset < 0 ? -1 - cluster : cluster * subsets_count + subset, subset });
+                }
+            }
+            std::stable_sort(pixels.begin(), pixels.end(), [](const TilePixel& a, const TilePixel& b) { return a.group < b.group; });
+            std::vector<GBufferTexel> texels(pixels.size()); // contiguous for the span kernels
+            for (std::size_t k{}; k < pixels.size(); k++)
+            {
+                texels[k] = gbuffer[pixels[k].index];
+            }
+
+            // without interleaving, reduced resolution, temporal reuse nor denoising everything is summed into colors
+            std::vector<Vector3> colors(pixels.size());
+            std::vector<Vector3> subset_colors(pixels.size());
+            std::size_t pixel_lights{};
+
+            std::vector<std::size_t> batch_pixels{};
+            std::vector<Vector3> batch_colors{};
+            std::vector<Vector3> batch_targets{};
+            std::vector<std::uint8_t> batch_occluded{};
+            std::vector<int> group_vpls{};
+            std::vector<Vector3>* group_vpls_target{};
+            VPLLanes group_lanes{};
+
+            for (std::size_t begin{}; begin < pixels.size();)
+            {
+                std::size_t end{ begin + 1 };
+                while (end < pixels.size() && pixels[end].group == pixels[begin].group) end++;
+                const int subset{ pixels[begin].subset };
+                group_vpls.clear();
+
+                auto add_light{ [&](int j)
+                {
+                    if (j >= point_lights_count && (cached_vpls || subset < 0)) return;
+                    if (j >= point_lights_count && (j - point_lights_count) % temporal_subsets != temporal_subset) return;
+                    bool summed{ j < point_lights_count || (subsets_count == 1 && !reduced_vpls && !separate_vpls) };
+                    if (!summed && (j - point_lights_count) % subsets_count != subset) return;
+                    std::vector<Vector3>& target{ summed ? colors : subset_colors };
+                    pixel_lights += end - begin;
+
+                    if (j < point_lights_count)
+                    {
+                        shade_point_light_span(virtual_lights[j], m_cube_shadow_maps[j], shadow, texels.data() + begin, end - begin, weight, target.data() + begin);
+                        return;
+                    }
+                    if (lanes_vpls)
+                    {
+                        group_vpls.push_back(j);
+                        group_vpls_target = &target;
+                        return;
+                    }
+                    if (span_vpls)
+                    {
+                        shade_vpl_span(virtual_lights[j], texels.data() + begin, end - begin, weight, target.data() + begin);
+                        return;
+                    }
+                    if (!ray_visibility)
+                    {
+                        for (std::size_t k{ begin }; k < end; k++)
+                        {
+                            target[k] = target[k] + shade_light(j, texels[k].position, texels[k].normal, texels[k].albedo);
+                        }
+                        return;
+                    }
+
+                    // the pixels missing the cache get a batch of shadow rays from the VPL
+                    batch_pixels.clear();
+                    batch_colors.clear();
+                    batch_targets.clear();
+                    for (std::size_t k{ begin }; k < end; k++)
+                    {
+                        const GBufferTexel& texel{ texels[k] };
+                        Vector3 color{ shade_light(j, texel.position, texel.normal, texel.albedo) };
+                        if (Luminance(color) <= 0.0f) continue;
+
+                        Vector3 ray_target{ texel.position + texel.normal * SHADOW_RAY_OFFSET };
+                        int visible{ visibility_cache->Find(ray_target, j) };
+                        tile_cache_lookups[tile]++;
+                        if (visible >= 0)
+                        {
+                            tile_cache_hits[tile]++;
+                            if (visible) target[k] = target[k] + color;
+                            continue;
+                        }
+                        batch_pixels.push_back(k);
+                        batch_colors.push_back(color);
+                        batch_targets.push_back(ray_target);
+                    }
+                    if (batch_pixels.empty()) return;
+
+                    batch_occluded.resize(batch_pixels.size());
+                    bvh.OccludedBatch(virtual_lights[j].position, batch_targets.data(), static_cast<int>(batch_targets.size()), batch_occluded.data());
+                    tile_shadow_rays[tile] += batch_pixels.size();
+                    for (std::size_t r{}; r < batch_pixels.size(); r++)
+                    {
+                        visibility_cache->Insert(batch_targets[r], j, !batch_occluded[r]);
+                        if (!batch_occluded[r]) target[batch_pixels[r]] = target[batch_pixels[r]] + batch_colors[r];
+                    }
+                } };
+
+                if (tiled)
+                {
+                    for (int j : tile_lights[tile])
+                    {
+                        add_light(j);
+                    }
+                }
+                else if (clustered)
+                {
+                    for (int j{}; j < point_lights_count; j++)
+                    {
+                        add_light(j);
+                    }
+                    const int cluster{ clusters.pixel_clusters[pixels[begin].index] };
+                    for (int k{ clusters.offsets[cluster] }; k < clusters.offsets[cluster + 1]; k++)
+                    {
+                        add_light(clusters.lights[k]);
+                    }
+                }
+                else
+                {
+                    // the subset is strided, no need to test the other VPLs
+                    const int first_vpl{ point_lights_count + (subsets_count == 1 ? temporal_subset : subset) };
+                    for (int j{}; j < point_lights_count; j++)
+                    {
+                        add_light(j);
+                    }
+                    for (int j{ first_vpl }; j < static_cast<int>(virtual_lights.size()); j += subsets_count * temporal_subsets)
+                    {
+                        add_light(j);
+                    }
+                }
+
+                if (!group_vpls.empty())
+                {
+                    PackVPLLanes(virtual_lights, group_vpls, weight, group_lanes);
+                    std::vector<Vector3>& target{ *group_vpls_target };
+                    for (std::size_t k{ begin }; k < end; k++)
+                    {
+                        target[k] = target[k] + shade_vpl_lanes(group_lanes, texels[k].position, texels[k].normal, texels[k].albedo);
+                    }
+                }
+                begin = end;
+            }
+
+            for (std::size_t k{}; k < pixels.size(); k++)
+            {
+                std::size_t i{ pixels[k].index };
+                const GBufferTexel& texel{ gbuffer[i] };
+                Vector3 color{ colors[k] };
+                if (cached_vpls && !separate_vpls)
+                {
+                    color = color + texel.albedo * irradiance[i];
+                }
+                for (const QuadLight& quad_light : quad_lights)
+                {
+                    color = color + shade_quad_light(quad_light, texel.position, texel.normal, texel.albedo);
+                }
+                image[i] = color;
+                if (cached_vpls && separate_vpls)
+                {
+                    vpl_light[i] = texel.albedo * irradiance[i];
+                }
+                else if (separate_vpls && subsets_count == 1 && !reduced_vpls)
+                {
+                    vpl_light[i] = subset_colors[k];
+                }
+                if (subsets_count > 1)
+                {
+                    indirect[i] = subset_colors[k] * static_cast<float>(subsets_count);
+                }
+                if (reduced_vpls && pixels[k].subset == 0)
+                {
+                    int x{ static_cast<int>(i % width) };
+                    int y{ static_cast<int>(i / width) };
+                    reduced_indirect[static_cast<std::size_t>(y / scale) * reduced_w + x / scale] = subset_colors[k];
+                }
+            }
+            tile_pixels[tile] = pixels.size();
+            tile_pixel_lights[tile] = pixel_lights;
+        } };
+        ParallelForChunks(tiles_x * tiles_y, [&](int chunk, int begin, int end)
+        {
+            VisibilityCache* visibility_cache{ ray_visibility ? &m_visibility_caches[chunk] : nullptr };
+            for (int tile{ begin }; tile < end; tile++)
+            {
+                shade_tile(tile, visibility_cache);
+            }
+        });
+
+        if (subsets_count > 1)
+        {
+            // discontinuity buffer, the window holds one pixel of each subset
+            const int window_min{ -(shading.interleave / 2) };
+            const int window_max{ window_min + shading.interleave }; // exclusive
+            ParallelFor(height, [&](int y)
+            {
+                for (int x{}; x < width; x++)
+                {
+                    std::size_t i{ static_cast<std::size_t>(y) * width + x };
+                    const GBufferTexel& texel{ gbuffer[i] };
+                    if (texel.depth <= 0.0f) continue;
+
+                    Vector3 sum{};
+                    int count{};
+                    for (int dy{ window_min }; dy < window_max; dy++)
+                    {
+                        int py{ y + dy };
+                        if (py < 0 || py >= height) continue;
+                        for (int dx{ window_min }; dx < window_max; dx++)
+                        {
+                            int px{ x + dx };
+                            if (px < 0 || px >= width) continue;
+                            std::size_t j{ static_cast<std::size_t>(py) * width + px };
+                            if (!SimilarTexels(texel, gbuffer[j])) continue;
+                            sum = sum + indirect[j];
+                            count++;
+                        }
+                    }
+                    add_vpl_light(i, sum / static_cast<float>(count)); // the pixel itself always counts
+                }
+            });
+        }
+
+        if (reduced_vpls)
+        {
+            // joint bilateral upsampling (Kopf et al.): bilinear weights of the 4 closest samples, times the similarity of their surface
+            ParallelFor(height, [&](int y)
+            {
+                for (int x{}; x < width; x++)
+                {
+                    std::size_t i{ static_cast<std::size_t>(y) * width + x };
+                    const GBufferTexel& texel{ gbuffer[i] };
+                    if (texel.depth <= 0.0f) continue;
+
+                    float fx{ (static_cast<float>(x) + 0.5f) / static_cast<float>(scale) - 0.5f };
+                    float fy{ (static_cast<float>(y) + 0.5f) / static_cast<float>(scale) - 0.5f };
+                    int x0{ static_cast<int>(std::floor(fx)) };
+                    int y0{ static_cast<int>(std::floor(fy)) };
+                    float tx{ fx - static_cast<float>(x0) };
+                    float ty{ fy - static_cast<float>(y0) };
+
+                    Vector3 sum{};
+                    float weight_sum{};
+                    Vector3 most_similar{};
+                    float max_similarity{};
+                    for (int dy{}; dy < 2; dy++)
+                    {
+                        int ry{ y0 + dy };
+                        if (ry < 0 || ry >= reduced_h) continue;
+                        for (int dx{}; dx < 2; dx++)
+                        {
+                            int rx{ x0 + dx };
+                            if (rx < 0 || rx >= reduced_w) continue;
+                            std::size_t r{ static_cast<std::size_t>(ry) * reduced_w + rx };
+                            if (reduced_pixels[r] == gbuffer.size()) continue;
+
+                            float similarity{ JointBilateralWeight(texel, gbuffer[reduced_pixels[r]]) };
+                            float weight{ (dx ? tx : 1.0f - tx) * (dy ? ty : 1.0f - ty) * similarity };
+                            sum = sum + reduced_indirect[r] * weight;
+                            weight_sum += weight;
+                            if (similarity > max_similarity)
+                            {
+                                max_similarity = similarity;
+                                most_similar = reduced_indirect[r];
+                            }
+                        }
+                    }
+                    add_vpl_light(i, weight_sum > UPSAMPLE_MIN_WEIGHT ? sum / weight_sum : most_similar);
+                }
+            });
+        }
+
+        std::size_t reprojected_pixels{};
+        if (temporal_vpls)
+        {
+            /*
+                Each pixel is reprojected into the previous frame with its view projection, and the history of the 4 closest pixels
+                seeing the same surface (SimilarTexels) is interpolated with their bilinear weights. The VPL light of the frame, scaled
+                by the subsets, is then blended into it by an exponential moving average of weight 1 / length, the length of the history
+                growing by a frame up to TEMPORAL_MAX_HISTORY times the subsets, so that a pixel without history (disoccluded, or off
+                screen in the previous frame) takes the light of the frame, and others average over (more than) all the subsets.
+                The light is demodulated by the albedo, as for denoising.
+            */
+            Timer timer{};
+            timer.Start();
+
+            const bool history_valid{ m_temporal_history.width == width && m_temporal_history.height == height };
+            const float max_history{ TEMPORAL_MAX_HISTORY * static_cast<float>(temporal_subsets) };
+            std::vector<Vector3> accumulated(gbuffer.size());
+            std::vector<float> lengths(gbuffer.size());
+            std::vector<std::size_t> row_reprojected(height);
+            ParallelFor(height, [&](int y)
+            {
+                for (int x{}; x < width; x++)
+                {
+                    std::size_t i{ static_cast<std::size_t>(y) * width + x };
+                    const GBufferTexel& texel{ gbuffer[i] };
+                    if (texel.depth <= 0.0f) continue;
+
+                    Vector3 current{ vpl_light[i] * static_cast<float>(temporal_subsets) };
+                    current.x = texel.albedo.x > 0.0f ? current.x / texel.albedo.x : 0.0f;
+                    current.y = texel.albedo.y > 0.0f ? current.y / texel.albedo.y : 0.0f;
+                    current.z = texel.albedo.z > 0.0f ? current.z / texel.albedo.z : 0.0f;
+
+                    Vector3 history{};
+                    float history_length{};
+                    Vector4 clip{ Vector4::Transform(texel.position, m_temporal_history.view_projection) };
+                    if (history_valid && clip.w > 0.0f)
+                    {
+                        float fx{ (0.5f + 0.5f * clip.x / clip.w) * static_cast<float>(width) - 0.5f };
+                        float fy{ (0.5f - 0.5f * clip.y / clip.w) * static_cast<float>(height) - 0.5f };
+                        int x0{ static_cast<int>(std::floor(fx)) };
+                        int y0{ static_cast<int>(std::floor(fy)) };
+                        float tx{ fx - static_cast<float>(x0) };
+                        float ty{ fy - static_cast<float>(y0) };
+
+                        Vector3 sum{};
+                        float length_sum{};
+                        float weight_sum{};
+                        for (int dy{}; dy < 2; dy++)
+                        {
+                            int py{ y0 + dy };
+                            if (py < 0 || py >= height) continue;
+                            for (int dx{}; dx < 2; dx++)
+                            {
+                                int px{ x0 + dx };
+                                if (px < 0 || px >= width) continue;
+                                std::size_t j{ static_cast<std::size_t>(py) * width + px };
+                                if (m_temporal_history.length[j] <= 0.0f || !SimilarTexels(texel, m_temporal_history.gbuffer[j])) continue;
+
+                                float weight{ (dx ? tx : 1.0f - tx) * (dy ? ty : 1.0f - ty) };
+                                sum = sum + m_temporal_history.irradiance[j] * weight;
+                                length_sum += m_temporal_history.length[j] * weight;
+                                weight_sum += weight;
+                            }
+                        }
+                        if (weight_sum > TEMPORAL_MIN_HISTORY_WEIGHT)
+                        {
+                            history = sum / weight_sum;
+                            history_length = length_sum / weight_sum;
+                            row_reprojected[y]++;
+                        }
+                    }
+
+                    lengths[i] = std::min(history_length + 1.0f, max_history);
+                    accumulated[i] = Vector3::Lerp(history, current, 1.0f / lengths[i]);
+                    vpl_light[i] = accumulated[i] * texel.albedo;
+                }
+            });
+            reprojected_pixels = std::accumulate(row_reprojected.begin(), row_reprojected.end(), std::size_t{});
+
+            m_temporal_history.width = width;
+            m_temporal_history.height = height;
+            m_temporal_history.frame++;
+            m_temporal_history.view_projection = CameraViewProjection(camera, aspect);
+            m_temporal_history.gbuffer = gbuffer;
+            m_temporal_history.irradiance = std::move(accumulated);
+            m_temporal_history.length = std::move(lengths);
+
+            timer.End();
+            stats.temporal_sec = timer.DeltaSec();
+        }
+
+        if (denoised_vpls)
+        {
+            Timer timer{};
+            timer.Start();
+            m_denoiser.Denoise(vpl_light, gbuffer, width, height, shading.denoise_iterations);
+            timer.End();
+            stats.denoise_sec = timer.DeltaSec();
+        }
+
+        if (separate_vpls)
+        {
+            ParallelFor(height, [&](int y)
+            {
+                for (int x{}; x < width; x++)
+                {
+                    std::size_t i{ static_cast<std::size_t>(y) * width + x };
+                    image[i] = image[i] + vpl_light[i];
+                }
+            });
+        }
+
+        std::size_t pixels{ std::accumulate(tile_pixels.begin(), tile_pixels.end(), std::size_t{}) };
+        std::size_t pixel_lights{ std::accumulate(tile_pixel_lights.begin(), tile_pixel_lights.end(), std::size_t{}) };
+        stats.average_pixel_lights = pixels > 0 ? static_cast<float>(pixel_lights) / static_cast<float>(pixels) : 0.0f;
+        stats.reprojected_ratio = pixels > 0 ? static_cast<float>(reprojected_pixels) / static_cast<float>(pixels) : 0.0f;
+        stats.shadow_rays += std::accumulate(tile_shadow_rays.begin(), tile_shadow_rays.end(), std::size_t{});
+        stats.visibility_cache_lookups = std::accumulate(tile_cache_lookups.begin(), tile_cache_lookups.end(), std::size_t{});
+        stats.visibility_cache_hits = std::accumulate(tile_cache_hits.begin(), tile_cache_hits.end(), std::size_t{});
+        return stats;
+    }
+
+    for (int i{}; i < static_cast<int>(virtual_lights.size()); i++)
+    {
+        m_rasterizer.Draw(i == 0 ? first_pass_state : sum_state, [&](const RasterFragment& fragment)
+        {
+            Vector3 N{ fragment.world_normal };
+            N.Normalize();
+            return shade_light(i, fragment.world_position, N, fragment.object->albedo);
+        });
+    }
+
+    for (const QuadLight& quad_light : quad_lights)
+    {
+        m_rasterizer.Draw(sum_state, [&](const RasterFragment& fragment)
+        {
+            Vector3 N{ fragment.world_normal };
+            N.Normalize();
+            return shade_quad_light(quad_light, fragment.world_position, N, fragment.object->albedo);
+        });
+    }
+
+    return stats;
+}
+
+struct BenchmarkFrame
+{
+    float sec;
+    SoftwareFrameStats stats;
+    float rmse; // against the baseline frame, 0 without one
+};
+
+static void SimulateVirtualLights(
+    std::vector<VirtualLight>& virtual_lights, const std::vector<Object>& objects, const std::vector<PointLight>& point_lights,
+    const Emitters& emitters, int particles_count, float mean_reflectivity, int seed
+)
+{
+    // particle simulation of a frame with Keller's light paths and no VPL budget
+    std::vector<std::vector<LightPathNode>> light_paths{};
+    ShootLightPaths(light_paths, point_lights, emitters, particles_count, seed);
+    TraceLightPaths(light_paths, objects, particles_count, mean_reflectivity);
+    SpawnVirtualLights(virtual_lights, light_paths, point_lights, emitters, particles_count, mean_reflectivity, {});
+}
+
+static BenchmarkFrame TimeSoftwareFrame(
+    SoftwareRenderer& renderer, const Camera& camera, const SoftwareScene& scene, const SoftwareLights& lights, const SoftwareShading& shading,
+    const std::vector<Vector3>& baseline // empty for no RMSE
+)
+{
+    Timer timer{};
+    timer.Start();
+    SoftwareFrameStats stats{ renderer.Render(camera, scene, lights, shading) };
+    timer.End();
+    return { timer.DeltaSec(), stats, baseline.empty() ? 0.0f : RootMeanSquaredError(renderer.Color(), baseline) };
+}
+
+static void RunLightCullingBenchmark(
+    const Camera& camera, const std::vector<Object>& objects, const std::vector<PointLight>& point_lights, const ShadowConstants& shadow,
+    int width, int height, float mean_reflectivity, int vpl_type, float attenuation_epsilon, int seed
+)
+{
+    /*
+        Deferred frames with the all lights loop, tiled and clustered light culling, with the same bounded attenuation, for
+        particles counts doubling from LIGHT_CULLING_BENCHMARK_PARTICLES_MIN to LIGHT_CULLING_BENCHMARK_PARTICLES_MAX.
+        Frame times include the cube shadow maps and the G-buffer, which don't depend on the culling. Lights are the average
+        length of the light lists of the tiles or clusters covering some geometry, pixel the average number of lights shaded per
+        covered pixel. Deep scenes (the doorway) are where clusters should beat tiles.
+    */
+    int point_lights_count{ static_cast<int>(point_lights.size()) };
+    Emitters emitters{};
+    BuildEmitters(emitters, point_lights, objects);
+
+    SoftwareShading all_lights_shading{ .attenuation_epsilon = attenuation_epsilon };
+    SoftwareShading tiled_shading{ .light_culling = LIGHT_CULLING_TILED, .attenuation_epsilon = attenuation_epsilon };
+    SoftwareShading clustered_shading{ .light_culling = LIGHT_CULLING_CLUSTERED, .attenuation_epsilon = attenuation_epsilon };
+
+    std::vector<VirtualLight> virtual_lights{};
+    SoftwareScene scene{ objects, emitters, shadow };
+    SoftwareRenderer all_lights_renderer{ width, height };
+    SoftwareRenderer culled_renderer{ width, height };
+
+    auto max_difference{ [&]()
+    {
+        float difference{};
+        for (std::size_t i{}; i < culled_renderer.Color().size(); i++)
+        {
+            Vector3 d{ culled_renderer.Color()[i] - all_lights_renderer.Color()[i] };
+            difference = std::max({ difference, std::abs(d.x), std::abs(d.y), std::abs(d.z) });
+        }
+        return difference;
+    } };
+
+    std::println(
+        "light culling benchmark ({}x{}, {}x{} tiles, {}x{}x{} clusters, attenuation epsilon {})", width, height,
+        LIGHT_CULLING_TILE_SIZE, LIGHT_CULLING_TILE_SIZE, CLUSTER_TILE_SIZE, CLUSTER_TILE_SIZE, CLUSTER_DEPTH_SLICES, attenuation_epsilon
+    );
+    std::println(
+        "{:>10} {:>10} {:>10} {:>11} {:>10} {:>10} {:>10} {:>11} {:>10} {:>10} {:>10} {:>10}",
+        "particles", "VPLs", "all msec", "tile lights", "tile pixel", "tile msec", "tile x", "clus lights", "clus pixel", "clus msec", "clus x",
+        "max diff"
+    );
+    for (int particles_count{ LIGHT_CULLING_BENCHMARK_PARTICLES_MIN }; particles_count <= LIGHT_CULLING_BENCHMARK_PARTICLES_MAX; particles_count *= 2)
+    {
+        SimulateVirtualLights(virtual_lights, objects, point_lights, emitters, particles_count, mean_reflectivity, seed);
+        SoftwareLights lights{ virtual_lights, point_lights_count, particles_count, vpl_type };
+
+        BenchmarkFrame all_lights{ TimeSoftwareFrame(all_lights_renderer, camera, scene, lights, all_lights_shading, {}) };
+        BenchmarkFrame tiled{ TimeSoftwareFrame(culled_renderer, camera, scene, lights, tiled_shading, {}) };
+        float tiled_difference{ max_difference() };
+        BenchmarkFrame clustered{ TimeSoftwareFrame(culled_renderer, camera, scene, lights, clustered_shading, {}) };
+        float clustered_difference{ max_difference() };
+
+        std::println(
+            "{:>10} {:>10} {:>10.2f} {:>11.1f} {:>10.1f} {:>10.2f} {:>9.2f}x {:>11.1f} {:>10.1f} {:>10.2f} {:>9.2f}x {:>10.3g}",
+            particles_count, virtual_lights.size() - point_lights_count, all_lights.sec * 1000.0f,
+            tiled.stats.average_list_lights, tiled.stats.average_pixel_lights, tiled.sec * 1000.0f, all_lights.sec / tiled.sec,
+            clustered.stats.average_list_lights, clustered.stats.average_pixel_lights, clustered.sec * 1000.0f, all_lights.sec / clustered.sec,
+            std::max(tiled_difference, clustered_difference)
+        );
+    }
+}
+
+static void RunInterleaveBenchmark(
+    const Camera& camera, const std::vector<Object>& objects, const std::vector<PointLight>& point_lights, const ShadowConstants& shadow,
+    const SoftwareShading& shading, int width, int height, float mean_reflectivity, int vpl_type, int seed
+)
+{
+    /*
+        Deferred frames shading all the VPLs per pixel, then interleaving them over blocks doubling from 2x2 to INTERLEAVE_MAX x
+        INTERLEAVE_MAX (same light culling and attenuation), for particles counts doubling from INTERLEAVE_BENCHMARK_PARTICLES_MIN to
+        INTERLEAVE_BENCHMARK_PARTICLES_MAX. Lights are the average number shaded per pixel, the RMSE is against the frame shading all
+        the VPLs. Frame times include the cube shadow maps and the G-buffer, which don't depend on the interleaving.
+    */
+    int point_lights_count{ static_cast<int>(point_lights.size()) };
+    Emitters emitters{};
+    BuildEmitters(emitters, point_lights, objects);
+
+    SoftwareShading full_shading{ shading };
+    full_shading.deferred = true;
+    full_shading.interleave = 1;
+
+    std::vector<VirtualLight> virtual_lights{};
+    SoftwareScene scene{ objects, emitters, shadow };
+    SoftwareRenderer full_renderer{ width, height };
+    SoftwareRenderer interleaved_renderer{ width, height };
+
+    std::println("interleaved sampling benchmark ({}x{})", width, height);
+    std::println("{:>10} {:>10} {:>10} {:>10} {:>10} {:>10} {:>12}", "particles", "VPLs", "block", "lights", "msec", "speedup", "RMSE");
+    for (int particles_count{ INTERLEAVE_BENCHMARK_PARTICLES_MIN }; particles_count <= INTERLEAVE_BENCHMARK_PARTICLES_MAX; particles_count *= 2)
+    {
+        SimulateVirtualLights(virtual_lights, objects, point_lights, emitters, particles_count, mean_reflectivity, seed);
+        SoftwareLights lights{ virtual_lights, point_lights_count, particles_count, vpl_type };
+        std::size_t vpls_count{ virtual_lights.size() - point_lights_count };
+
+        BenchmarkFrame full{ TimeSoftwareFrame(full_renderer, camera, scene, lights, full_shading, {}) };
+        std::println("{:>10} {:>10} {:>10} {:>10.1f} {:>10.2f} {:>9.2f}x {:>12.6f}", particles_count, vpls_count, "1x1", full.stats.average_pixel_lights, full.sec * 1000.0f, 1.0f, 0.0f);
+
+        for (int interleave{ 2 }; interleave <= INTERLEAVE_MAX; interleave *= 2)
+        {
+            SoftwareShading interleaved_shading{ full_shading };
+            interleaved_shading.interleave = interleave;
+            BenchmarkFrame interleaved{ TimeSoftwareFrame(interleaved_renderer, camera, scene, lights, interleaved_shading, full_renderer.Color()) };
+
+            std::println(
+                "{:>10} {:>10} {:>10} {:>10.1f} {:>10.2f} {:>9.2f}x {:>12.6f}",
+                particles_count, vpls_count, std::format("{}x{}", interleave, interleave), interleaved.stats.average_pixel_lights,
+                interleaved.sec * 1000.0f, full.sec / interleaved.sec, interleaved.rmse
+            );
+        }
+    }
+}
+
+static void RunVisibilityBenchmark(
+    const Camera& camera, const std::vector<Object>& objects, const std::vector<PointLight>& point_lights, const ShadowConstants& shadow,
+    const SoftwareShading& shading, int width, int height, float mean_reflectivity, int vpl_type, int seed
+)
+{
+    /*
+        Deferred frames with unshadowed VPLs, imperfect shadow maps and shadow rays (same light culling, attenuation and
+        interleaving), for each count of VISIBILITY_BENCHMARK_VPLS (the VPLs of as many particles, cut to the count).
+        The ray throughput only counts the time the frame spends on top of the unshadowed one, the cache hit rate is over the
+        lookups of the pixels the VPL reaches, and the RMSE is the one of the imperfect shadow maps against the rays. The warm
+        frame renders the same VPLs again, with the visibility cached by the first one.
+    */
+    int point_lights_count{ static_cast<int>(point_lights.size()) };
+    Emitters emitters{};
+    BuildEmitters(emitters, point_lights, objects);
+
+    SoftwareShading unshadowed_shading{ shading };
+    unshadowed_shading.deferred = true;
+    unshadowed_shading.vpl_visibility = VPL_VISIBILITY_NONE;
+    SoftwareShading ism_shading{ unshadowed_shading };
+    ism_shading.vpl_visibility = VPL_VISIBILITY_ISM;
+    SoftwareShading rays_shading{ unshadowed_shading };
+    rays_shading.vpl_visibility = VPL_VISIBILITY_RAYS;
+
+    std::vector<VirtualLight> virtual_lights{};
+    SoftwareScene scene{ objects, emitters, shadow };
+    SoftwareRenderer renderer{ width, height };
+    SoftwareRenderer rays_renderer{ width, height };
+
+    std::println("VPL visibility benchmark ({}x{}, {}x{} ISMs, visibility cache cells of {})", width, height, ISM_SIZE, ISM_SIZE, VISIBILITY_CACHE_CELL);
+    std::println(
+        "{:>8} {:>10} {:>10} {:>10} {:>10} {:>12} {:>12} {:>10} {:>10} {:>10} {:>10}",
+        "VPLs", "none msec", "ISM msec", "ISM RMSE", "rays msec", "rays", "Mrays/sec", "cache hit", "rays x", "warm msec", "warm hit"
+    );
+    for (int vpls_count : VISIBILITY_BENCHMARK_VPLS)
+    {
+        int particles_count{ vpls_count };
+        SimulateVirtualLights(virtual_lights, objects, point_lights, emitters, particles_count, mean_reflectivity, seed);
+        virtual_lights.resize(std::min(virtual_lights.size(), static_cast<std::size_t>(point_lights_count + vpls_count)));
+        SoftwareLights lights{ virtual_lights, point_lights_count, particles_count, vpl_type };
+
+        BenchmarkFrame unshadowed{ TimeSoftwareFrame(renderer, camera, scene, lights, unshadowed_shading, {}) };
+        BenchmarkFrame rays{ TimeSoftwareFrame(rays_renderer, camera, scene, lights, rays_shading, {}) };
+        BenchmarkFrame warm_rays{ TimeSoftwareFrame(rays_renderer, camera, scene, lights, rays_shading, {}) };
+        BenchmarkFrame ism{ TimeSoftwareFrame(renderer, camera, scene, lights, ism_shading, rays_renderer.Color()) };
+
+        float visibility_sec{ std::max(rays.sec - unshadowed.sec, std::numeric_limits<float>::min()) };
+        auto hit_rate{ [](const SoftwareFrameStats& stats)
+        {
+            return stats.visibility_cache_lookups > 0 ? static_cast<float>(stats.visibility_cache_hits) / static_cast<float>(stats.visibility_cache_lookups) : 0.0f;
+        } };
+        std::println(
+            "{:>8} {:>10.2f} {:>10.2f} {:>10.6f} {:>10.2f} {:>12} {:>12.2f} {:>9.1f}% {:>9.2f}x {:>10.2f} {:>9.1f}%",
+            virtual_lights.size() - point_lights_count, unshadowed.sec * 1000.0f, ism.sec * 1000.0f, ism.rmse, rays.sec * 1000.0f,
+            rays.stats.shadow_rays, static_cast<float>(rays.stats.shadow_rays) / visibility_sec * 1e-6f, hit_rate(rays.stats) * 100.0f,
+            rays.sec / unshadowed.sec, warm_rays.sec * 1000.0f, hit_rate(warm_rays.stats) * 100.0f
+        );
+    }
+}
+
+static void RunIrradianceCacheBenchmark(
+    const Camera& camera, const std::vector<Object>& objects, const std::vector<PointLight>& point_lights, const ShadowConstants& shadow,
+    const SoftwareShading& shading, int width, int height, float mean_reflectivity, int vpl_type, int seed
+)
+{
+    /*
+        Deferred frames shading every pixel against the VPLs of IRRADIANCE_CACHE_BENCHMARK_PARTICLES particles, then interpolating
+        them from an irradiance cache for each of IRRADIANCE_CACHE_BENCHMARK_ACCURACIES (same light culling, attenuation and VPL
+        visibility). Each cache renders three frames: the first one creates the records, the second one reuses all of them, the
+        third one moves the camera sideways by IRRADIANCE_CACHE_BENCHMARK_CAMERA_STEP and only adds records where they are
+        missing. The RMSE is the one of the first frame against the frame shading every pixel.
+    */
+    int point_lights_count{ static_cast<int>(point_lights.size()) };
+    Emitters emitters{};
+    BuildEmitters(emitters, point_lights, objects);
+
+    SoftwareShading full_shading{ shading };
+    full_shading.deferred = true;
+    full_shading.irradiance_accuracy = 0.0f;
+
+    int particles_count{ IRRADIANCE_CACHE_BENCHMARK_PARTICLES };
+    std::vector<VirtualLight> virtual_lights{};
+    SimulateVirtualLights(virtual_lights, objects, point_lights, emitters, particles_count, mean_reflectivity, seed);
+
+    Camera moved_camera{ camera };
+    {
+        Vector3 right{ (camera.target - camera.eye).Cross({ 0.0f, 1.0f, 0.0f }) };
+        right.Normalize();
+        moved_camera.eye += right * IRRADIANCE_CACHE_BENCHMARK_CAMERA_STEP;
+        moved_camera.target += right * IRRADIANCE_CACHE_BENCHMARK_CAMERA_STEP;
+    }
+
+    SoftwareScene scene{ objects, emitters, shadow };
+    SoftwareLights lights{ virtual_lights, point_lights_count, particles_count, vpl_type };
+    SoftwareRenderer full_renderer{ width, height };
+    BenchmarkFrame full{ TimeSoftwareFrame(full_renderer, camera, scene, lights, full_shading, {}) };
+
+    std::println("irradiance cache benchmark ({}x{}, {} VPLs, shading every pixel {:.2f} msec)", width, height, virtual_lights.size() - point_lights_count, full.sec * 1000.0f);
+    std::println(
+        "{:>8} {:>10} {:>10} {:>10} {:>12} {:>10} {:>10} {:>10} {:>10}",
+        "accuracy", "records", "msec", "speedup", "RMSE", "reuse msec", "speedup", "move msec", "new"
+    );
+    for (float accuracy : IRRADIANCE_CACHE_BENCHMARK_ACCURACIES)
+    {
+        SoftwareShading cached_shading{ full_shading };
+        cached_shading.irradiance_accuracy = accuracy;
+        SoftwareRenderer cached_renderer{ width, height }; // starts without records
+
+        BenchmarkFrame cached{ TimeSoftwareFrame(cached_renderer, camera, scene, lights, cached_shading, full_renderer.Color()) };
+        BenchmarkFrame reused{ TimeSoftwareFrame(cached_renderer, camera, scene, lights, cached_shading, {}) };
+        BenchmarkFrame moved{ TimeSoftwareFrame(cached_renderer, moved_camera, scene, lights, cached_shading, {}) };
+
+        std::println(
+            "{:>8} {:>10} {:>10.2f} {:>9.2f}x {:>12.6f} {:>10.2f} {:>9.2f}x {:>10.2f} {:>10}",
+            accuracy, cached.stats.irradiance_records, cached.sec * 1000.0f, full.sec / cached.sec, cached.rmse, reused.sec * 1000.0f,
+            full.sec / reused.sec, moved.sec * 1000.0f, moved.stats.irradiance_records_created
+        );
+    }
+}
+
+static void RunUpsampleBenchmark(
+    const Camera& camera, const std::vector<Object>& objects, const std::vector<PointLight>& point_lights, const ShadowConstants& shadow,
+    const SoftwareShading& shading, int width, int height, float mean_reflectivity, int vpl_type, int seed
+)
+{
+    /*
+        Deferred frames shading the VPLs at every pixel, then at 1/2 and 1/4 of the resolution with joint bilateral upsampling
+        (same light culling, attenuation and VPL visibility), for each particles count of UPSAMPLE_BENCHMARK_PARTICLES. Lights are
+        the average number shaded per pixel, the RMSE is against the full resolution frame. Frame times include the cube shadow
+        maps, the G-buffer and the point lights, which don't depend on the resolution of the VPL light.
+    */
+    int point_lights_count{ static_cast<int>(point_lights.size()) };
+    Emitters emitters{};
+    BuildEmitters(emitters, point_lights, objects);
+
+    SoftwareShading full_shading{ shading };
+    full_shading.deferred = true;
+    full_shading.interleave = 1;
+    full_shading.irradiance_accuracy = 0.0f;
+    full_shading.indirect_scale = 1;
+
+    std::vector<VirtualLight> virtual_lights{};
+    SoftwareScene scene{ objects, emitters, shadow };
+    SoftwareRenderer full_renderer{ width, height };
+    SoftwareRenderer reduced_renderer{ width, height };
+
+    std::println("reduced resolution VPL light benchmark ({}x{})", width, height);
+    std::println("{:>10} {:>10} {:>10} {:>10} {:>10} {:>10} {:>12}", "particles", "VPLs", "scale", "lights", "msec", "speedup", "RMSE");
+    for (int particles_count : UPSAMPLE_BENCHMARK_PARTICLES)
+    {
+        SimulateVirtualLights(virtual_lights, objects, point_lights, emitters, particles_count, mean_reflectivity, seed);
+        SoftwareLights lights{ virtual_lights, point_lights_count, particles_count, vpl_type };
+        std::size_t vpls_count{ virtual_lights.size() - point_lights_count };
+
+        BenchmarkFrame full{ TimeSoftwareFrame(full_renderer, camera, scene, lights, full_shading, {}) };
+        std::println("{:>10} {:>10} {:>10} {:>10.1f} {:>10.2f} {:>9.2f}x {:>12.6f}", particles_count, vpls_count, "1/1", full.stats.average_pixel_lights, full.sec * 1000.0f, 1.0f, 0.0f);
+
+        for (int scale{ 2 }; scale <= INDIRECT_SCALE_MAX; scale *= 2)
+        {
+            SoftwareShading reduced_shading{ full_shading };
+            reduced_shading.indirect_scale = scale;
+            BenchmarkFrame reduced{ TimeSoftwareFrame(reduced_renderer, camera, scene, lights, reduced_shading, full_renderer.Color()) };
+
+            std::println(
+                "{:>10} {:>10} {:>10} {:>10.1f} {:>10.2f} {:>9.2f}x {:>12.6f}",
+                particles_count, vpls_count, std::format("1/{}", scale), reduced.stats.average_pixel_lights, reduced.sec * 1000.0f,
+                full.sec / reduced.sec, reduced.rmse
+            );
+        }
+    }
+}
+
+static void RunDenoiseBenchmark(
+    const Camera& camera, const std::vector<Object>& objects, const std::vector<PointLight>& point_lights, const ShadowConstants& shadow,
+    const SoftwareShading& shading, int width, int height, float mean_reflectivity, int vpl_type, int seed
+)
+{
+    /*
+        Deferred frames of each particles count of DENOISE_BENCHMARK_PARTICLES, without and with denoising (same light culling,
+        attenuation, VPL visibility and iterations, DENOISE_ITERATIONS_MAX when none are given), against a frame without denoising of
+        DENOISE_BENCHMARK_REFERENCE_PARTICLES particles. Denoising pays off when the denoised RMSE of a count is below the noisy RMSE
+        of a larger one.
+    */
+    int point_lights_count{ static_cast<int>(point_lights.size()) };
+    Emitters emitters{};
+    BuildEmitters(emitters, point_lights, objects);
+
+    SoftwareShading noisy_shading{ shading };
+    noisy_shading.deferred = true;
+    noisy_shading.denoise_iterations = 0;
+    SoftwareShading denoised_shading{ noisy_shading };
+    denoised_shading.denoise_iterations = shading.denoise_iterations > 0 ? shading.denoise_iterations : DENOISE_ITERATIONS_MAX;
+
+    std::vector<VirtualLight> virtual_lights{};
+    SoftwareScene scene{ objects, emitters, shadow };
+    SoftwareRenderer reference_renderer{ width, height };
+    SoftwareRenderer renderer{ width, height };
+
+    SimulateVirtualLights(virtual_lights, objects, point_lights, emitters, DENOISE_BENCHMARK_REFERENCE_PARTICLES, mean_reflectivity, seed);
+    reference_renderer.Render(camera, scene, { virtual_lights, point_lights_count, DENOISE_BENCHMARK_REFERENCE_PARTICLES, vpl_type }, noisy_shading);
+
+    std::println(
+        "denoising benchmark ({}x{}, {} iterations, reference of {} particles)", width, height, denoised_shading.denoise_iterations,
+        DENOISE_BENCHMARK_REFERENCE_PARTICLES
+    );
+    std::println("{:>10} {:>10} {:>10} {:>12} {:>10} {:>12} {:>12}", "particles", "VPLs", "msec", "RMSE", "msec", "denoise msec", "RMSE");
+    for (int particles_count : DENOISE_BENCHMARK_PARTICLES)
+    {
+        SimulateVirtualLights(virtual_lights, objects, point_lights, emitters, particles_count, mean_reflectivity, seed);
+        SoftwareLights lights{ virtual_lights, point_lights_count, particles_count, vpl_type };
+
+        BenchmarkFrame noisy{ TimeSoftwareFrame(renderer, camera, scene, lights, noisy_shading, reference_renderer.Color()) };
+        BenchmarkFrame denoised{ TimeSoftwareFrame(renderer, camera, scene, lights, denoised_shading, reference_renderer.Color()) };
+
+        std::println(
+            "{:>10} {:>10} {:>10.2f} {:>12.6f} {:>10.2f} {:>12.2f} {:>12.6f}",
+            particles_count, virtual_lights.size() - point_lights_count, noisy.sec * 1000.0f, noisy.rmse, denoised.sec * 1000.0f,
+            denoised.stats.denoise_sec * 1000.0f, denoised.rmse
+        );
+    }
+}
+
+static void RunTemporalBenchmark(
+    const Camera& camera, const std::vector<Object>& objects, const std::vector<PointLight>& point_lights, const ShadowConstants& shadow,
+    const SoftwareShading& shading, int width, int height, float mean_reflectivity, int vpl_type, int seed
+)
+{
+    /*
+        TEMPORAL_BENCHMARK_FRAMES deferred frames of a camera strafing right, then back left, at CAMERA_MOVE_SPEED (a frame every
+        TEMPORAL_BENCHMARK_FRAME_SEC), shading all the VPLs, and with temporal reuse over each subsets count of TEMPORAL_BENCHMARK_SUBSETS
+        (same light culling, attenuation and VPL visibility, no interleaving, reduced resolution, irradiance cache nor denoising).
+        Against the frames shading all the VPLs, the RMSE of the first frame is the one of a subset without history, and the one of
+        the next frames, averaged, is the ghosting and the blur the history brings along.
+    */
+    int point_lights_count{ static_cast<int>(point_lights.size()) };
+    Emitters emitters{};
+    BuildEmitters(emitters, point_lights, objects);
+
+    SoftwareShading full_shading{ shading };
+    full_shading.deferred = true;
+    full_shading.interleave = 1;
+    full_shading.irradiance_accuracy = 0.0f;
+    full_shading.indirect_scale = 1;
+    full_shading.denoise_iterations = 0;
+    full_shading.temporal_subsets = 0;
+
+    int particles_count{ TEMPORAL_BENCHMARK_PARTICLES };
+    std::vector<VirtualLight> virtual_lights{};
+    SimulateVirtualLights(virtual_lights, objects, point_lights, emitters, particles_count, mean_reflectivity, seed);
+
+    constexpr int configs_count{ static_cast<int>(std::size(TEMPORAL_BENCHMARK_SUBSETS)) };
+    SoftwareScene scene{ objects, emitters, shadow };
+    SoftwareLights lights{ virtual_lights, point_lights_count, particles_count, vpl_type };
+    SoftwareRenderer full_renderer{ width, height };
+    std::vector<SoftwareRenderer> temporal_renderers{}; // a history per config
+    temporal_renderers.reserve(configs_count);
+    for (int c{}; c < configs_count; c++)
+    {
+        temporal_renderers.emplace_back(width, height);
+    }
+    float full_sec{};
+    std::vector<float> temporal_sec(configs_count);
+    std::vector<float> reprojected(configs_count);
+    std::vector<float> first_error(configs_count);
+    std::vector<float> ghosting_error(configs_count);
+
+    Vector3 right{ (camera.target - camera.eye).Cross({ 0.0f, 1.0f, 0.0f }) };
+    right.Normalize();
+    const float step{ CAMERA_MOVE_SPEED * TEMPORAL_BENCHMARK_FRAME_SEC };
+    Camera moving_camera{ camera };
+    for (int frame{}; frame < TEMPORAL_BENCHMARK_FRAMES; frame++)
+    {
+        full_sec += TimeSoftwareFrame(full_renderer, moving_camera, scene, lights, full_shading, {}).sec;
+
+        for (int c{}; c < configs_count; c++)
+        {
+            SoftwareShading temporal_shading{ full_shading };
+            temporal_shading.temporal_subsets = TEMPORAL_BENCHMARK_SUBSETS[c];
+
+            BenchmarkFrame temporal{ TimeSoftwareFrame(temporal_renderers[c], moving_camera, scene, lights, temporal_shading, full_renderer.Color()) };
+            temporal_sec[c] += temporal.sec;
+            reprojected[c] += temporal.stats.reprojected_ratio;
+            if (frame == 0)
+            {
+                first_error[c] = temporal.rmse;
+            }
+            else
+            {
+                ghosting_error[c] += temporal.rmse;
+            }
+        }
+
+        Vector3 move{ right * (frame < TEMPORAL_BENCHMARK_FRAMES / 2 ? step : -step) };
+        moving_camera.eye += move;
+        moving_camera.target += move;
+    }
+
+    const float frames{ static_cast<float>(TEMPORAL_BENCHMARK_FRAMES) };
+    std::println(
+        "temporal reuse benchmark ({}x{}, {} VPLs, {} frames, camera moving {:.3f} per frame): all the VPLs {:.2f} msec",
+        width, height, virtual_lights.size() - point_lights_count, TEMPORAL_BENCHMARK_FRAMES, step, full_sec / frames * 1000.0f
+    );
+    std::println("{:>10} {:>10} {:>10} {:>12} {:>12} {:>14}", "subsets", "msec", "saved", "reprojected", "first RMSE", "ghosting RMSE");
+    for (int c{}; c < configs_count; c++)
+    {
+        std::println(
+            "{:>10} {:>10.2f} {:>9.1f}% {:>11.1f}% {:>12.6f} {:>14.6f}",
+            TEMPORAL_BENCHMARK_SUBSETS[c], temporal_sec[c] / frames * 1000.0f, (1.0f - temporal_sec[c] / full_sec) * 100.0f,
+            reprojected[c] / (frames - 1.0f) * 100.0f, first_error[c], ghosting_error[c] / (frames - 1.0f)
+        );
+    }
+}
+
+static void RunKernelBenchmark(
+    const Camera& camera, const std::vector<Object>& objects, const std::vector<PointLight>& point_lights, const ShadowConstants& shadow,
+    int width, int height, float mean_reflectivity, int seed
+)
+{
+    /*
+        Shades the camera samples of a KERNEL_BENCHMARK_SAMPLES_W x KERNEL_BENCHMARK_SAMPLES_H grid a light at a time, on a single
+        thread: against the VPLs as each light type, then against the point lights (KERNEL_BENCHMARK_POINT_LIGHT_RUNS times) with each
+        PCF samples count. The generic kernels are called per pixel, as shade_light does, the span kernels are picked once per pass
+        from the dispatch tables. Both have to produce the same colors. Each is timed as the fastest of KERNEL_BENCHMARK_TRIALS trials.
+        Then shades the same samples against all the VPLs at once with the multi-light kernels supported by the CPU, which have to
+        match the scalar reference within SIMD_TOLERANCE.
+    */
+    int point_lights_count{ static_cast<int>(point_lights.size()) };
+    Emitters emitters{};
+    BuildEmitters(emitters, point_lights, objects);
+
+    std::vector<CameraSample> samples{};
+    BuildCameraSamples(samples, camera, static_cast<float>(width) / static_cast<float>(height), objects, KERNEL_BENCHMARK_SAMPLES_W, KERNEL_BENCHMARK_SAMPLES_H);
+    std::vector<GBufferTexel> texels(samples.size());
+    for (std::size_t k{}; k < samples.size(); k++)
+    {
+        texels[k] = { samples[k].position, samples[k].normal, samples[k].albedo, (samples[k].position - camera.eye).Length() };
+    }
+
+    int particles_count{ KERNEL_BENCHMARK_PARTICLES };
+    std::vector<VirtualLight> virtual_lights{};
+    SimulateVirtualLights(virtual_lights, objects, point_lights, emitters, particles_count, mean_reflectivity, seed);
+    const float weight{ 1.0f / static_cast<float>(particles_count) };
+
+    std::vector<SoftwareCubeShadowMap> cube_shadow_maps(point_lights_count);
+    for (int i{}; i < point_lights_count; i++)
+    {
+        cube_shadow_maps[i].Render(objects, virtual_lights[i].position, CubeShadowMapSize(point_lights_count));
+    }
+
+    std::vector<Vector3> generic_colors(texels.size());
+    std::vector<Vector3> span_colors(texels.size());
+    Timer timer{};
+    auto fastest{ [&](std::vector<Vector3>& colors, const auto& shade)
+    {
+        float fastest_sec{ std::numeric_limits<float>::max() };
+        for (int trial{}; trial < KERNEL_BENCHMARK_TRIALS; trial++)
+        {
+            std::fill(colors.begin(), colors.end(), Vector3{});
+            timer.Start();
+            shade();
+            timer.End();
+            fastest_sec = std::min(fastest_sec, timer.DeltaSec());
+        }
+        return fastest_sec;
+    } };
+
+    auto print_row{ [&](std::string_view kernel, double pairs, float generic_sec, float span_sec)
+    {
+        float max_difference{};
+        for (std::size_t k{}; k < texels.size(); k++)
+        {
+            Vector3 d{ generic_colors[k] - span_colors[k] };
+            max_difference = std::max({ max_difference, std::abs(d.x), std::abs(d.y), std::abs(d.z) });
+        }
+        std::println(
+            "{:>12} {:>16.1f} {:>16.1f} {:>10.2f} {:>16}", kernel, pairs / generic_sec / 1e6, pairs / span_sec / 1e6,
+            generic_sec / span_sec, max_difference
+        );
+    } };
+
+    const int vpls_count{ static_cast<int>(virtual_lights.size()) - point_lights_count };
+    std::println(
+        "shading kernels benchmark ({} camera samples, {} VPLs, {} point lights, single thread)", texels.size(), vpls_count, point_lights_count
+    );
+    std::println("{:>12} {:>16} {:>16} {:>10} {:>16}", "kernel", "generic Mpairs/s", "span Mpairs/s", "speedup", "max difference");
+
+    constexpr std::pair<int, std::string_view> light_types[]{
+        { LIGHT_TYPE_POINT, "point" }, { LIGHT_TYPE_SIGN_COS_WEIGHTED, "sign-cos" }, { LIGHT_TYPE_COS_WEIGHTED, "cos" }
+    };
+    for (const auto& [light_type, name] : light_types)
+    {
+        float generic_sec{ fastest(generic_colors, [&]()
+        {
+            for (int j{ point_lights_count }; j < static_cast<int>(virtual_lights.size()); j++)
+            {
+                for (std::size_t k{}; k < texels.size(); k++)
+                {
+                    generic_colors[k] = generic_colors[k] + ShadeDiffuse(texels[k].position, texels[k].normal, texels[k].albedo, virtual_lights[j], light_type) * weight;
+                }
+            }
+        }) };
+        float span_sec{ fastest(span_colors, [&]()
+        {
+            VPLSpanKernel kernel{ SelectVPLSpanKernel(light_type) };
+            for (int j{ point_lights_count }; j < static_cast<int>(virtual_lights.size()); j++)
+            {
+                kernel(virtual_lights[j], texels.data(), texels.size(), weight, span_colors.data());
+            }
+        }) };
+
+        print_row(std::format("{} VPLs", name), static_cast<double>(vpls_count) * static_cast<double>(texels.size()), generic_sec, span_sec);
+    }
+
+    for (int pcf_samples{ CUBE_SHADOW_MAP_PCF_SAMPLES_MIN }; pcf_samples <= CUBE_SHADOW_MAP_PCF_SAMPLES_MAX && point_lights_count > 0; pcf_samples++)
+    {
+        ShadowConstants pcf_shadow{ shadow };
+        pcf_shadow.pcf_samples = pcf_samples;
+
+        float generic_sec{ fastest(generic_colors, [&]()
+        {
+            for (int run{}; run < KERNEL_BENCHMARK_POINT_LIGHT_RUNS; run++)
+            {
+                for (int i{}; i < point_lights_count; i++)
+                {
+                    for (std::size_t k{}; k < texels.size(); k++)
+                    {
+                        generic_colors[k] = generic_colors[k] + ShadeShadowed(texels[k].position, texels[k].normal, texels[k].albedo, virtual_lights[i], cube_shadow_maps[i], pcf_shadow) * weight;
+                    }
+                }
+            }
+        }) };
+        float span_sec{ fastest(span_colors, [&]()
+        {
+            PointLightSpanKernel kernel{ SelectPointLightSpanKernel(pcf_samples) };
+            for (int run{}; run < KERNEL_BENCHMARK_POINT_LIGHT_RUNS; run++)
+            {
+                for (int i{}; i < point_lights_count; i++)
+                {
+                    kernel(virtual_lights[i], cube_shadow_maps[i], pcf_shadow, texels.data(), texels.size(), weight, span_colors.data());
+                }
+            }
+        }) };
+
+        double pairs{ static_cast<double>(KERNEL_BENCHMARK_POINT_LIGHT_RUNS) * point_lights_count * static_cast<double>(texels.size()) };
+        print_row(std::format("PCF {}", pcf_samples), pairs, generic_sec, span_sec);
+    }
+
+    // the multi-light kernels against the scalar reference, a shading point at a time (simd-check compares their colors)
+    std::vector<int> vpl_indices(vpls_count);
+    std::iota(vpl_indices.begin(), vpl_indices.end(), point_lights_count);
+    VPLLanes lanes{};
+    PackVPLLanes(virtual_lights, vpl_indices, weight, lanes);
+    const int supported_lanes{ SupportedSIMDLanes() };
+
+    std::println("multi-light kernels ({} VPLs padded to {}, {} lanes supported)", vpls_count, lanes.count, supported_lanes);
+    std::println("{:>12} {:>8} {:>16} {:>10}", "kernel", "lanes", "Mpairs/s", "speedup");
+
+    std::vector<Vector3> reference_colors(texels.size());
+    std::vector<Vector3> lanes_colors(texels.size());
+    const double pairs{ static_cast<double>(vpls_count) * static_cast<double>(texels.size()) };
+    for (const auto& [light_type, name] : light_types)
+    {
+        auto shade{ [&](std::vector<Vector3>& colors, VPLLanesKernel kernel)
+        {
+            for (std::size_t k{}; k < texels.size(); k++)
+            {
+                colors[k] = kernel(lanes, texels[k].position, texels[k].normal, texels[k].albedo);
+            }
+        } };
+
+        float reference_sec{ fastest(reference_colors, [&]() { shade(reference_colors, SelectVPLLanesKernel(light_type, 1)); }) };
+        for (int simd_lanes : { 1, 8, SIMD_MAX_LANES })
+        {
+            std::string kernel{ std::format("{} VPLs", name) };
+            if (simd_lanes > supported_lanes)
+            {
+                std::println("{:>12} {:>8} {:>16}", kernel, simd_lanes, "unsupported");
+                continue;
+            }
+
+            float sec{ reference_sec };
+            if (simd_lanes > 1)
+            {
+                sec = fastest(lanes_colors, [&]() { shade(lanes_colors, SelectVPLLanesKernel(light_type, simd_lanes)); });
+            }
+            std::println("{:>12} {:>8} {:>16.1f} {:>10.2f}", kernel, simd_lanes, pairs / sec / 1e6, reference_sec / sec);
+        }
+    }
+}
+
+static void RunSIMDCheck(
+    const Camera& camera, const std::vector<Object>& objects, const std::vector<PointLight>& point_lights,
+    int width, int height, float mean_reflectivity, int seed
+)
+{
+    /*
+        Shades the camera samples of a SIMD_CHECK_SAMPLES_W x SIMD_CHECK_SAMPLES_H grid against the first SIMD_CHECK_VPL_COUNTS
+        VPLs (padded differently) and against all of them, with the scalar reference and the multi-light kernels of every lane width
+        the CPU supports, as each light type. Crashes, after the report, when a kernel differs from the reference by more than
+        SIMD_TOLERANCE of the brightest sample.
+    */
+    int point_lights_count{ static_cast<int>(point_lights.size()) };
+    Emitters emitters{};
+    BuildEmitters(emitters, point_lights, objects);
+
+    std::vector<CameraSample> samples{};
+    BuildCameraSamples(samples, camera, static_cast<float>(width) / static_cast<float>(height), objects, SIMD_CHECK_SAMPLES_W, SIMD_CHECK_SAMPLES_H);
+
+    int particles_count{ SIMD_CHECK_PARTICLES };
+    std::vector<VirtualLight> virtual_lights{};
+    SimulateVirtualLights(virtual_lights, objects, point_lights, emitters, particles_count, mean_reflectivity, seed);
+    const float weight{ 1.0f / static_cast<float>(particles_count) };
+    const int vpls_count{ static_cast<int>(virtual_lights.size()) - point_lights_count };
+
+    std::vector<int> counts{};
+    for (int count : SIMD_CHECK_VPL_COUNTS)
+    {
+        if (count < vpls_count) counts.push_back(count);
+    }
+    counts.push_back(vpls_count);
+
+    const int supported_lanes{ SupportedSIMDLanes() };
+    std::println("multi-light kernels check ({} camera samples, {} VPLs, {} lanes supported)", samples.size(), vpls_count, supported_lanes);
+    std::println("{:>12} {:>8} {:>24} {:>8}", "kernel", "lanes", "max relative difference", "result");
+
+    constexpr std::pair<int, std::string_view> light_types[]{
+        { LIGHT_TYPE_POINT, "point" }, { LIGHT_TYPE_SIGN_COS_WEIGHTED, "sign-cos" }, { LIGHT_TYPE_COS_WEIGHTED, "cos" }
+    };
+    std::vector<Vector3> reference_colors(samples.size());
+    VPLLanes lanes{};
+    int failures{};
+    for (const auto& [light_type, name] : light_types)
+    {
+        for (int simd_lanes : { 8, SIMD_MAX_LANES })
+        {
+            std::string kernel{ std::format("{} VPLs", name) };
+            if (simd_lanes > supported_lanes)
+            {
+                std::println("{:>12} {:>8} {:>24} {:>8}", kernel, simd_lanes, "", "skipped");
+                continue;
+            }
+
+            // worst difference over the VPL counts, each relative to its brightest sample
+            float max_difference{};
+            for (int count : counts)
+            {
+                std::vector<int> vpl_indices(count);
+                std::iota(vpl_indices.begin(), vpl_indices.end(), point_lights_count);
+                PackVPLLanes(virtual_lights, vpl_indices, weight, lanes);
+
+                const VPLLanesKernel reference{ SelectVPLLanesKernel(light_type, 1) };
+                const VPLLanesKernel tested{ SelectVPLLanesKernel(light_type, simd_lanes) };
+                float max_reference{};
+                for (std::size_t k{}; k < samples.size(); k++)
+                {
+                    reference_colors[k] = reference(lanes, samples[k].position, samples[k].normal, samples[k].albedo);
+                    max_reference = std::max({ max_reference, reference_colors[k].x, reference_colors[k].y, reference_colors[k].z });
+                }
+
+                float difference{};
+                for (std::size_t k{}; k < samples.size(); k++)
+                {
+                    Vector3 d{ tested(lanes, samples[k].position, samples[k].normal, samples[k].albedo) - reference_colors[k] };
+                    difference = std::max({ difference, std::abs(d.x), std::abs(d.y), std::abs(d.z) });
+                }
+                max_difference = std::max(max_difference, difference / std::max(max_reference, std::numeric_limits<float>::min()));
+            }
+
+            bool passed{ max_difference <= SIMD_TOLERANCE };
+            failures += passed ? 0 : 1;
+            std::println("{:>12} {:>8} {:>24} {:>8}", kernel, simd_lanes, max_difference, passed ? "ok" : "FAILED");
+        }
+    }
+
+    if (failures > 0)
+    {
+        Crash(std::format("{} multi-light kernels differ from the scalar reference by more than {}", failures, SIMD_TOLERANCE));
+    }
+}
+
+static void RunResampleCheck(const std::vector<Object>& objects, const std::vector<PointLight>& point_lights, float mean_reflectivity, int seed)
+{
+    /*
+        Resamples the VPLs of RESAMPLE_CHECK_PARTICLES particles followed by each count of RESAMPLE_CHECK_BLACK_VPLS black ones, to
+        each of RESAMPLE_CHECK_BUDGETS, with RESAMPLE_CHECK_SEEDS seeds and the extreme offsets of the strata (0 and the largest
+        double below 1, whose last pick can round past the total power). Every kept VPL must have a finite and positive power, and
+        their total power the one of the spawned VPLs within RESAMPLE_TOLERANCE. Crashes, after the report, when a case fails.
+    */
+    int point_lights_count{ static_cast<int>(point_lights.size()) };
+    Emitters emitters{};
+    BuildEmitters(emitters, point_lights, objects);
+
+    int particles_count{ RESAMPLE_CHECK_PARTICLES };
+    std::vector<VirtualLight> spawned{};
+    SimulateVirtualLights(spawned, objects, point_lights, emitters, particles_count, mean_reflectivity, seed);
+    const int vpls_count{ static_cast<int>(spawned.size()) - point_lights_count };
+
+    auto power{ [](const VirtualLight& vpl) { return static_cast<double>(vpl.intensity * Luminance(vpl.color)); } };
+    double spawned_power{};
+    for (int j{ point_lights_count }; j < static_cast<int>(spawned.size()); j++)
+    {
+        spawned_power += power(spawned[j]);
+    }
+
+    std::println("VPL budget resampling check ({} spawned VPLs, {} seeds)", vpls_count, RESAMPLE_CHECK_SEEDS);
+    std::println("{:>12} {:>8} {:>16} {:>24} {:>8}", "black VPLs", "budget", "zero power VPLs", "max relative difference", "result");
+
+    std::vector<VirtualLight> virtual_lights{};
+    int failures{};
+    for (int black_count : RESAMPLE_CHECK_BLACK_VPLS)
+    {
+        for (int budget : RESAMPLE_CHECK_BUDGETS)
+        {
+            if (budget >= vpls_count) continue;
+
+            int invalid{};
+            double max_difference{};
+            for (int s{ -2 }; s < RESAMPLE_CHECK_SEEDS; s++)
+            {
+                virtual_lights = spawned;
+                VirtualLight black{ spawned.back() };
+                black.color = Vector3{};
+                virtual_lights.insert(virtual_lights.end(), black_count, black);
+                if (s < 0)
+                {
+                    ResampleVPLs(virtual_lights, point_lights_count, budget, s == -2 ? 0.0 : std::nextafter(1.0, 0.0));
+                }
+                else
+                {
+                    ResampleVPLs(virtual_lights, point_lights_count, budget, seed + s);
+                }
+
+                double kept_power{};
+                for (int j{ point_lights_count }; j < static_cast<int>(virtual_lights.size()); j++)
+                {
+                    double p{ power(virtual_lights[j]) };
+                    if (!std::isfinite(p) || p <= 0.0) invalid++;
+                    else kept_power += p;
+                }
+                max_difference = std::max(max_difference, std::abs(kept_power - spawned_power) / spawned_power);
+            }
+
+            bool passed{ invalid == 0 && max_difference <= RESAMPLE_TOLERANCE };
+            failures += passed ? 0 : 1;
+            std::println("{:>12} {:>8} {:>16} {:>24.2e} {:>8}", black_count, budget, invalid, max_difference, passed ? "ok" : "FAILED");
+        }
+    }
+
+    if (failures > 0)
+    {
+        Crash(std::format("{} VPL budget resamplings kept black VPLs or changed the total power by more than {}", failures, RESAMPLE_TOLERANCE));
+    }
+}
+
+static void RunBakeCheck(const std::vector<Object>& objects, const std::vector<PointLight>& point_lights, float mean_reflectivity, int seed)
+{
+    /*
+        Bakes the VPLs of the first point light over a BAKE_CHECK_LATTICE_SIZE^3 lattice into a memory mapped file and loads it back.
+        The nearest lookup at each lattice point must return the VPLs the particle simulation spawns with the point light there (up to
+        the octahedral encoding of the normals). The blended lookups at BAKE_CHECK_LOOKUPS random positions must return at most the
+        VPLs of the largest lattice point set and of each of BAKE_CHECK_BUDGETS, all with a finite and non negative power (the bake
+        keeps the black VPLs the simulation spawns). Crashes, after the report, when a case fails.
+    */
+    Check(!point_lights.empty());
+    const std::string path{ (std::filesystem::temp_directory_path() / BAKE_CHECK_FILE_NAME).string() };
+    const int lattice_size{ BAKE_CHECK_LATTICE_SIZE };
+    const int particles_count{ BAKE_CHECK_PARTICLES };
+    BakeVPLs(path, point_lights, 0, objects, lattice_size, particles_count, mean_reflectivity, seed);
+
+    VPLBake bake{};
+    if (!bake.Load(path)) Crash(std::format("can't load the VPL bake '{}'", path));
+    std::println("VPL bake check ({}^3 lattice, {} baked VPLs, {})", lattice_size, bake.VPLCount(), GetBytesStr(std::filesystem::file_size(path)));
+
+    auto power{ [](const VirtualLight& vpl) { return static_cast<double>(vpl.intensity * Luminance(vpl.color)); } };
+    int failures{};
+
+    // nearest lookups against the simulation
+    int mismatches{};
+    int largest_set{};
+    std::vector<VirtualLight> simulated{};
+    std::vector<VirtualLight> looked_up{};
+    for (int i{}; i < lattice_size * lattice_size * lattice_size; i++)
+    {
+        std::vector<PointLight> lattice_point_lights{ point_lights };
+        lattice_point_lights[0].position = VPLBakeLatticePosition(bake.Header(), i % lattice_size, (i / lattice_size) % lattice_size, i / (lattice_size * lattice_size));
+        Emitters emitters{};
+        BuildEmitters(emitters, lattice_point_lights, objects);
+        SimulateVirtualLights(simulated, objects, lattice_point_lights, emitters, particles_count, mean_reflectivity, seed);
+        simulated.erase(simulated.begin(), simulated.begin() + static_cast<std::ptrdiff_t>(point_lights.size()));
+
+        looked_up.clear();
+        bake.Lookup(looked_up, lattice_point_lights[0].position, VPL_BAKE_LOOKUP_NEAREST, VPL_BUDGET_MAX, VPL_BUDGET_SAMPLING_POWER, seed);
+        largest_set = std::max(largest_set, static_cast<int>(looked_up.size()));
+
+        bool match{ looked_up.size() == simulated.size() };
+        for (std::size_t j{}; match && j < simulated.size(); j++)
+        {
+            match =
+                looked_up[j].position == simulated[j].position && looked_up[j].normal.Dot(simulated[j].normal) > 1.0f - BAKE_TOLERANCE &&
+                std::abs(power(looked_up[j]) - power(simulated[j])) <= BAKE_TOLERANCE * power(simulated[j]) &&
+                looked_up[j].bounce == simulated[j].bounce && looked_up[j].emitter == simulated[j].emitter;
+        }
+        mismatches += match ? 0 : 1;
+    }
+    failures += mismatches > 0 ? 1 : 0;
+    std::println("nearest lookups: {} lattice points, {} differ from the simulation, largest set of {} VPLs", lattice_size * lattice_size * lattice_size, mismatches, largest_set);
+
+    // blended lookups
+    Vector3 bounds_min{ bake.Header().bounds_min[0], bake.Header().bounds_min[1], bake.Header().bounds_min[2] };
+    Vector3 bounds_max{ bake.Header().bounds_max[0], bake.Header().bounds_max[1], bake.Header().bounds_max[2] };
+    std::println("{:>8} {:>10} {:>10} {:>16} {:>8}", "budget", "sampling", "max VPLs", "invalid VPLs", "result");
+    constexpr std::pair<int, std::string_view> samplings[]{ { VPL_BUDGET_SAMPLING_UNIFORM_STRIDE, "stride" }, { VPL_BUDGET_SAMPLING_POWER, "power" } };
+    for (int budget : BAKE_CHECK_BUDGETS)
+    {
+        for (const auto& [sampling, name] : samplings)
+        {
+            int max_count{};
+            int invalid{};
+            std::uint32_t rng{ PCGHash(static_cast<std::uint32_t>(seed)) };
+            for (int k{}; k < BAKE_CHECK_LOOKUPS; k++)
+            {
+                Vector3 t{ RandomFloat(rng), RandomFloat(rng), RandomFloat(rng) };
+                looked_up.clear();
+                bake.Lookup(looked_up, bounds_min + (bounds_max - bounds_min) * t, VPL_BAKE_LOOKUP_TRILINEAR, budget, sampling, seed + k);
+                max_count = std::max(max_count, static_cast<int>(looked_up.size()));
+                for (const VirtualLight& vpl : looked_up)
+                {
+                    double p{ power(vpl) };
+                    if (!std::isfinite(p) || p < 0.0) invalid++;
+                }
+            }
+
+            bool passed{ max_count <= std::min(budget, largest_set) && invalid == 0 };
+            failures += passed ? 0 : 1;
+            std::println("{:>8} {:>10} {:>10} {:>16} {:>8}", budget, name, max_count, invalid, passed ? "ok" : "FAILED");
+        }
+    }
+
+    bake.Unload();
+    std::filesystem::remove(path);
+
+    if (failures > 0)
+    {
+        Crash(std::format("{} VPL bake cases failed", failures));
+    }
+}
+
+static void RunProgressiveCheck(
+    const Camera& camera, const std::vector<Object>& objects, const std::vector<PointLight>& point_lights, const ShadowConstants& shadow,
+    const SoftwareShading& shading, int width, int height, float mean_reflectivity, int vpl_type, int seed
+)
+{
+    /*
+        Renders PROGRESSIVE_CHECK_REFERENCE_FRAMES frames of PROGRESSIVE_CHECK_PARTICLES particles, each with its own seed, as the
+        interactive mode accumulates a static view (in float), and averages them by disjoint blocks of each of
+        PROGRESSIVE_CHECK_FRAME_COUNTS frames. The standard error of each block average is estimated from the average of its odd
+        frames (ProgressiveRelativeError), and its actual error is the difference with the average of all the frames, which
+        includes the block (hence the 1 - n / reference frames variance). A single block is too noisy to compare with (a few
+        VPLs make most of a frame), so the RMS over the blocks are compared. Crashes, after the report, when the estimates are
+        off by more than a factor PROGRESSIVE_TOLERANCE.
+    */
+    int point_lights_count{ static_cast<int>(point_lights.size()) };
+    Emitters emitters{};
+    BuildEmitters(emitters, point_lights, objects);
+
+    SoftwareShading frame_shading{ shading };
+    frame_shading.temporal_subsets = 0; // the frames must be independent
+
+    int particles_count{ PROGRESSIVE_CHECK_PARTICLES };
+    std::vector<VirtualLight> virtual_lights{};
+    SoftwareScene scene{ objects, emitters, shadow };
+    SoftwareRenderer renderer{ width, height };
+
+    struct BlockAverages
+    {
+        int frames;
+        std::vector<Vector3> average; // of the block being accumulated
+        std::vector<Vector3> odd_average;
+        std::vector<std::vector<Vector3>> averages; // of the blocks
+        double estimates2; // sum over the blocks of the squared estimated relative errors
+    };
+    const std::size_t pixels{ static_cast<std::size_t>(width) * height };
+    std::vector<BlockAverages> blocks{};
+    for (int frames : PROGRESSIVE_CHECK_FRAME_COUNTS)
+    {
+        blocks.push_back({ frames, std::vector<Vector3>(pixels), std::vector<Vector3>(pixels), {}, 0.0 });
+    }
+    std::vector<Vector3> reference(pixels);
+    for (int n{}; n < PROGRESSIVE_CHECK_REFERENCE_FRAMES; n++)
+    {
+        SimulateVirtualLights(virtual_lights, objects, point_lights, emitters, particles_count, mean_reflectivity, seed + n);
+        SoftwareLights lights{ virtual_lights, point_lights_count, particles_count, vpl_type };
+        renderer.Render(camera, scene, lights, frame_shading);
+
+        // average += (frame - average) / (n + 1)
+        const std::vector<Vector3>& frame{ renderer.Color() };
+        float weight{ 1.0f / static_cast<float>(n + 1) };
+        for (std::size_t i{}; i < pixels; i++)
+        {
+            reference[i] += (frame[i] - reference[i]) * weight;
+        }
+        for (BlockAverages& block : blocks)
+        {
+            int k{ n % block.frames };
+            float block_weight{ 1.0f / static_cast<float>(k + 1) };
+            float odd_weight{ 1.0f / static_cast<float>(k / 2 + 1) };
+            for (std::size_t i{}; i < pixels; i++)
+            {
+                block.average[i] += (frame[i] - block.average[i]) * block_weight;
+                if (k % 2 == 1) block.odd_average[i] += (frame[i] - block.odd_average[i]) * odd_weight;
+            }
+            if (k == block.frames - 1)
+            {
+                float estimate{ ProgressiveRelativeError(block.average, block.odd_average) };
+                block.estimates2 += static_cast<double>(estimate) * estimate;
+                block.averages.push_back(block.average);
+            }
+        }
+    }
+
+    std::println(
+        "progressive convergence check ({}x{}, {} particles, {} frames)", width, height, particles_count, PROGRESSIVE_CHECK_REFERENCE_FRAMES
+    );
+    std::println("{:>8} {:>8} {:>12} {:>12} {:>8}", "frames", "blocks", "estimated", "actual", "result");
+
+    double reference2{};
+    for (std::size_t i{}; i < pixels; i++)
+    {
+        reference2 += static_cast<double>(reference[i].LengthSquared());
+    }
+
+    int failures{};
+    for (const BlockAverages& block : blocks)
+    {
+        double errors2{};
+        for (const std::vector<Vector3>& average : block.averages)
+        {
+            double error2{};
+            for (std::size_t i{}; i < pixels; i++)
+            {
+                error2 += static_cast<double>((average[i] - reference[i]).LengthSquared());
+            }
+            errors2 += error2 / std::max(reference2, std::numeric_limits<double>::min());
+        }
+        double count{ static_cast<double>(block.averages.size()) };
+        double nested{ 1.0 - static_cast<double>(block.frames) / static_cast<double>(PROGRESSIVE_CHECK_REFERENCE_FRAMES) };
+        float estimated{ static_cast<float>(std::sqrt(block.estimates2 / count)) };
+        float actual{ static_cast<float>(std::sqrt(errors2 / count / nested)) };
+
+        float ratio{ estimated / std::max(actual, std::numeric_limits<float>::min()) };
+        bool passed{ ratio <= PROGRESSIVE_TOLERANCE && ratio >= 1.0f / PROGRESSIVE_TOLERANCE };
+        failures += passed ? 0 : 1;
+        std::println("{:>8} {:>8} {:>12.6f} {:>12.6f} {:>8}", block.frames, block.averages.size(), estimated, actual, passed ? "ok" : "FAILED");
+    }
+
+    if (failures > 0)
+    {
+        Crash(std::format("{} standard error estimates of the average of frames are off by more than a factor {}", failures, PROGRESSIVE_TOLERANCE));
+    }
+}
+
+static void WritePFM(const std::string& path, int width, int height, const std::vector<Vector3>& pixels)
+{
+    // portable float map: text header, then little endian (negative scale) RGB rows from the bottom one up
+    std::string header{ std::format("PF\n{} {}\n-1.0\n", width, height) };
+    std::vector<float> row(static_cast<std::size_t>(width) * 3);
+
+    std::ofstream file{ path, std::ios::binary | std::ios::trunc };
+    Check(file.is_open());
+    file.write(header.data(), static_cast<std::streamsize>(header.size()));
+    for (int y{ height - 1 }; y >= 0; y--)
+    {
+        for (int x{}; x < width; x++)
+        {
+            const Vector3& pixel{ pixels[static_cast<std::size_t>(y) * width + x] };
+            row[static_cast<std::size_t>(x) * 3 + 0] = pixel.x;
+            row[static_cast<std::size_t>(x) * 3 + 1] = pixel.y;
+            row[static_cast<std::size_t>(x) * 3 + 2] = pixel.z;
+        }
+        file.write(reinterpret_cast<const char*>(row.data()), static_cast<std::streamsize>(row.size() * sizeof(float)));
+    }
+    Check(file.good());
+}
+
+// ----------------------------------------------------------------------------
+// Path Tracer
+// ----------------------------------------------------------------------------
+
+/*
+    Multithreaded progressive path tracer, rendering the references the VPL renderers are compared against.
+    It converges to the image the final render converges to with infinitely many particles, with exact visibility instead:
+    shadow rays replace the cube shadow maps, and shadow the VPLs and the emissive quads too (the final render doesn't).
+    - camera rays go through the pixel centers, as the rasterizers sample them, and pixels they miss keep the clear color
+    - point lights are shaded as PSShadowed.hlsl, emissive quads by sampling a point on their surface
+    - indirect light follows the light path code (emission, albedo / PI attenuation and mirror bounces), which can't be sampled
+      starting from the camera: each sample traces one light path bouncing with probability mean_reflectivity (russian roulette,
+      as Metropolis instant radiosity) and connects each of its vertices to the camera hit, as a VPL of the selected type
+    The final render weights the direct light by 1 / particles_count too (the point lights are shaded once, not once per particle),
+    so direct and indirect light are accumulated apart and Resolve weights them as the final render does.
+*/
+
+static Vector3 TraceDirectLight(
+    const CameraSample& sample, const std::vector<Object>& objects, const std::vector<PointLight>& point_lights, const Emitters& emitters,
+    std::uint32_t& rng
+)
+{
+    Vector3 color{};
+
+    for (const PointLight& point_light : point_lights)
+    {
+        VirtualLight light{};
+        light.position = point_light.position;
+        light.color = point_light.color;
+        light.intensity = point_light.intenisty;
+        light.bounce = PRIMARY_LIGHT_BOUNCE;
+        color += ShadeCameraSample(sample, light, LIGHT_TYPE_POINT, objects);
+    }
+
+    for (const Object* quad : emitters.quads)
+    {
+        // uniform point on the quad surface (pdf 1 / area), emitting radiance L on the side of its normal
+        Vector3 local_position{ RandomFloat(rng) - 0.5f, RandomFloat(rng) - 0.5f, 0.0f };
+        Vector3 quad_position{ Vector3::Transform(local_position, quad->model) };
+        Vector3 quad_normal{ Vector3::TransformNormal({ 0.0f, 0.0f, 1.0f }, quad->normal) };
+        quad_normal.Normalize();
+
+        Vector3 to_quad{ quad_position - sample.position };
+        float distance_squared{ to_quad.LengthSquared() };
+        if (distance_squared <= 4.0f * SHADOW_RAY_OFFSET * SHADOW_RAY_OFFSET) continue;
+
+        Vector3 L{ to_quad / std::sqrt(distance_squared) };
+        float n_dot_l{ std::max(sample.normal.Dot(L), 0.0f) };
+        float quad_cos{ std::max(quad_normal.Dot(-L), 0.0f) };
+        if (n_dot_l * quad_cos <= 0.0f) continue;
+        if (!Visible(objects, sample.position, sample.normal, quad_position)) continue;
+
+        Vector3 radiance{ quad->emissive_color * quad->emissive_intensity };
+        color += sample.albedo / std::numbers::pi_v<float> * radiance * (n_dot_l * quad_cos * QuadArea(*quad) / distance_squared);
+    }
+
+    return color;
+}
+
+static Vector3 TraceIndirectLight(
+    const CameraSample& sample, const std::vector<Object>& objects, const std::vector<PointLight>& point_lights, const Emitters& emitters,
+    float mean_reflectivity, int vpl_type, std::vector<LightPathNode>& light_path, PathSample& light_sample, std::uint32_t& rng
+)
+{
+    // one light path, each of its vertices connected to the camera hit
+    for (float& u : light_sample)
+    {
+        u = RandomFloat(rng);
+    }
+    TraceMetropolisLightPath(light_path, light_sample, point_lights, emitters, objects, mean_reflectivity);
+
+    Vector3 color{};
+    for (int j{}; j < static_cast<int>(light_path.size()); j++)
+    {
+        const LightPathNode& node{ light_path[j] };
+        if (!node.hit.valid) continue;
+
+        color += ShadeCameraSample(sample, LightPathVPL(node, j, emitters, mean_reflectivity), vpl_type, objects);
+    }
+
+    return color;
+}
+
+class PathTracer
+{
+public:
+    PathTracer(int width, int height);
+    ~PathTracer() = default;
+    PathTracer(const PathTracer&) = delete;
+    PathTracer(PathTracer&&) noexcept = default;
+    PathTracer& operator=(const PathTracer&) = delete;
+    PathTracer& operator=(PathTracer&&) noexcept = default;
+public:
+    void Reset(); // forgets the accumulated samples
+    void AddSample( // accumulates one more sample per pixel
+        const Camera& camera, const std::vector<Object>& objects, const std::vector<PointLight>& point_lights, const Emitters& emitters,
+        float mean_reflectivity, int vpl_type, std::uint32_t seed
+    );
+    void Resolve(std::vector<Vector3>& image, int particles_count) const; // mean of the samples, weighted as the final render
+    int Width() const noexcept { return m_width; }
+    int Height() const noexcept { return m_height; }
+    int Samples() const noexcept { return m_samples; }
+private:
+    int m_width;
+    int m_height;
+    int m_samples;
+    std::vector<Vector3> m_direct; // per pixel sums of the samples
+    std::vector<Vector3> m_indirect;
+    std::vector<std::uint8_t> m_covered; // the camera ray through the pixel center hits something
+};
+
+PathTracer::PathTracer(int width, int height)
+    : m_width{ width }
+    , m_height{ height }
+    , m_samples{}
+    , m_direct{}
+    , m_indirect{}
+    , m_covered{}
+{
+    Check(width > 0 && height > 0);
+
+    std::size_t pixel_count{ static_cast<std::size_t>(width) * static_cast<std::size_t>(height) };
+    m_direct.resize(pixel_count);
+    m_indirect.resize(pixel_count);
+    m_covered.resize(pixel_count);
+}
+
+void PathTracer::Reset()
+{
+    m_samples = 0;
+    std::fill(m_direct.begin(), m_direct.end(), Vector3{});
+    std::fill(m_indirect.begin(), m_indirect.end(), Vector3{});
+    std::fill(m_covered.begin(), m_covered.end(), std::uint8_t{});
+}
+
+void PathTracer::AddSample(
+    const Camera& camera, const std::vector<Object>& objects, const std::vector<PointLight>& point_lights, const Emitters& emitters,
+    float mean_reflectivity, int vpl_type, std::uint32_t seed
+)
+{
+    float aspect{ static_cast<float>(m_width) / static_cast<float>(m_height) };
+    Matrix inverse_view_projection{ CameraViewProjection(camera, aspect).Invert() };
+
+    // decorrelated random numbers for each pixel, sample and seed
+    std::uint32_t sample_seed{ PCGHash(static_cast<std::uint32_t>(m_samples) + PCGHash(seed)) };
+
+    ParallelFor(m_height, [&](int y)
+    {
+        std::vector<LightPathNode> light_path{};
+        PathSample light_sample{};
+
+        for (int x{}; x < m_width; x++)
+        {
+            std::size_t pixel{ static_cast<std::size_t>(y) * static_cast<std::size_t>(m_width) + static_cast<std::size_t>(x) };
+
+            float ndc_x{ 2.0f * (static_cast<float>(x) + 0.5f) / static_cast<float>(m_width) - 1.0f };
+            float ndc_y{ 1.0f - 2.0f * (static_cast<float>(y) + 0.5f) / static_cast<float>(m_height) };
+
+            const Object* hit_obj{};
+            RayHit hit{ IntersectScene(objects, CameraRay(inverse_view_projection, camera.eye, ndc_x, ndc_y), &hit_obj) };
+            m_covered[pixel] = hit.valid;
+            if (!hit.valid) continue;
+
+            CameraSample sample{ hit.position, hit.normal, hit_obj->albedo };
+            std::uint32_t rng{ PCGHash(static_cast<std::uint32_t>(pixel) + sample_seed) };
+
+            m_direct[pixel] += TraceDirectLight(sample, objects, point_lights, emitters, rng);
+            m_indirect[pixel] += TraceIndirectLight(sample, objects, point_lights, emitters, mean_reflectivity, vpl_type, light_path, light_sample, rng);
+        }
+    });
+
+    m_samples++;
+}
+
+void PathTracer::Resolve(std::vector<Vector3>& image, int particles_count) const
+{
+    image.assign(m_direct.size(), FRAME_CLEAR_COLOR);
+    if (m_samples == 0) return;
+
+    float direct_weight{ 1.0f / static_cast<float>(particles_count) }; // abiding by Keller, as the final render
+    float inverse_samples{ 1.0f / static_cast<float>(m_samples) };
+    for (std::size_t i{}; i < image.size(); i++)
+    {
+        if (!m_covered[i]) continue;
+        image[i] = (m_direct[i] * direct_weight + m_indirect[i]) * inverse_samples;
+    }
+}
+
+static void RunEqualTimeBenchmark(
+    const Camera& camera, const std::vector<Object>& objects, const std::vector<PointLight>& point_lights, const ShadowConstants& shadow,
+    const SoftwareShading& shading, int width, int height, float mean_reflectivity, int vpl_type, int reference_samples, int seed
+)
+{
+    /*
+        Equal time comparison between the VPL renderer (on the software rasterizer) and the path tracer, against a path traced
+        reference with reference_samples samples per pixel.
+        For each particles count (doubling from PATH_TRACER_BENCHMARK_PARTICLES_MIN to PATH_TRACER_BENCHMARK_PARTICLES_MAX), the VPL
+        frame is timed (particle simulation included), then a path tracer independent of the reference accumulates samples for the
+        same time. Both errors are RMSEs against the reference weighted with the same particles count, so the rows trace the equal
+        time RMSE curves of both renderers. The VPL error levels off at its bias (shadow maps, unshadowed VPLs and area lights).
+    */
+    int point_lights_count{ static_cast<int>(point_lights.size()) };
+    Emitters emitters{};
+    BuildEmitters(emitters, point_lights, objects);
+
+    Timer timer{};
+    timer.Start();
+    PathTracer reference_tracer{ width, height };
+    for (int i{}; i < reference_samples; i++)
+    {
+        reference_tracer.AddSample(camera, objects, point_lights, emitters, mean_reflectivity, vpl_type, static_cast<std::uint32_t>(seed));
+    }
+    timer.End();
+
+    std::println("equal time benchmark ({}x{}, reference with {} samples per pixel in {:.2f} sec)", width, height, reference_samples, timer.DeltaSec());
+
+    std::vector<VirtualLight> virtual_lights{};
+    SoftwareScene scene{ objects, emitters, shadow };
+    SoftwareRenderer renderer{ width, height };
+    PathTracer path_tracer{ width, height };
+    std::vector<Vector3> reference{};
+    std::vector<Vector3> image{};
+
+    std::println("{:>10} {:>10} {:>12} {:>12} {:>12} {:>12}", "particles", "VPLs", "msec", "VPL RMSE", "PT samples", "PT RMSE");
+    for (int particles_count{ PATH_TRACER_BENCHMARK_PARTICLES_MIN }; particles_count <= PATH_TRACER_BENCHMARK_PARTICLES_MAX; particles_count *= 2)
+    {
+        reference_tracer.Resolve(reference, particles_count);
+
+        timer.Start();
+        SimulateVirtualLights(virtual_lights, objects, point_lights, emitters, particles_count, mean_reflectivity, seed);
+        renderer.Render(camera, scene, { virtual_lights, point_lights_count, particles_count, vpl_type }, shading);
+        timer.End();
+        float vpl_sec{ timer.DeltaSec() };
+        float vpl_error{ RootMeanSquaredError(renderer.Color(), reference) };
+
+        // at least one sample, even when the VPL frame is faster than a path tracer pass
+        path_tracer.Reset();
+        timer.Start();
+        do
+        {
+            path_tracer.AddSample(camera, objects, point_lights, emitters, mean_reflectivity, vpl_type, static_cast<std::uint32_t>(seed) + 1u);
+            timer.End();
+        } while (timer.DeltaSec() < vpl_sec);
+        path_tracer.Resolve(image, particles_count);
+        float path_tracer_error{ RootMeanSquaredError(image, reference) };
+
+        std::println(
+            "{:>10} {:>10} {:>12.2f} {:>12.6f} {:>12} {:>12.6f}",
+            particles_count, virtual_lights.size() - point_lights_count, vpl_sec * 1000.0f, vpl_error, path_tracer.Samples(), path_tracer_error
+        );
+    }
+}
+
+// ----------------------------------------------------------------------------
+// Headless Entry Point
+// ----------------------------------------------------------------------------
+
+static int ParseIntArgument(std::string_view name, std::string_view value, int min, int max)
+{
+    int result{};
+    auto [end, error]{ std::from_chars(value.data(), value.data() + value.size(), result) };
+    if (error != std::errc{} || end != value.data() + value.size() || result < min || result > max)
+    {
+        Crash(std::format("invalid value '{}' for {} (expected an integer in [{};{}])", value, name, min, max));
+    }
+    return result;
+}
+
+static float ParseFloatArgument(std::string_view name, std::string_view value, float min, float max)
+{
+    float result{};
+    auto [end, error]{ std::from_chars(value.data(), value.data() + value.size(), result) };
+    if (error != std::errc{} || end != value.data() + value.size() || result < min || result > max)
+    {
+        Crash(std::format("invalid value '{}' for {} (expected a number in [{};{}])", value, name, min, max));
+    }
+    return result;
+}
+
+void HeadlessEntry(const std::vector<std::string_view>& args)
+{
+    /*
+        Renders the final frame with the software rasterizer and writes it to a PFM file, without creating a window or a D3D11
+        device. The configuration is the one the interactive mode starts with, except for the options:
+        --scene cornell|doorway, --width <pixels>, --height <pixels>, --particles <count>, --reflectivity <mean>,
+        --vpl-type point|sign-cos|cos, --seed <seed>, --output <path>
+        --mode <mode>, the benchmarks and checks write nothing:
+            frame                       renders the final frame (default)
+            reference                   path traces a reference with --samples <per pixel>, written to the output instead
+            equal-time                  compares the VPL frame and the path tracer at equal time against such a reference
+            shading-check               renders the final frame and checks that the other shading path produces the same image
+            culling-benchmark           light culling
+            interleave-benchmark        interleaved sampling
+            visibility-benchmark        VPL visibility
+            irradiance-cache-benchmark  irradiance cache
+            upsample-benchmark          reduced resolution VPL light
+            denoise-benchmark           denoising
+            temporal-benchmark          temporal reuse
+            kernel-benchmark            throughput of the shading kernels
+            simd-check                  checks the multi-light kernels against the scalar reference, a failed check exits with 1
+            resample-check              checks the VPL budget resampling of VPLs followed by black ones, a failed check exits with 1
+            progressive-check           checks the convergence estimate of the accumulated static views, a failed check exits with 1
+            bake-check                  checks the memory mapped VPL bake and its blended lookups, a failed check exits with 1
+        --shading deferred|multipass shades the final frame from a G-buffer in a single pass, or with a pass per light as the GPU
+        --culling none|tiled|clustered, --attenuation-epsilon <contribution> (0 for no attenuation), --interleave <block size> (1 for
+        no interleaving) for the deferred shading of the VPLs
+        --vpl-visibility none|ism|rays leaves the VPLs unshadowed as the GPU, or shadows them with imperfect shadow maps or (deferred
+        only) with shadow rays
+        --irradiance-cache <accuracy> interpolates the VPL light from an irradiance cache (deferred only, 0 to shade every pixel)
+        --indirect-scale 1|2|4 shades the VPL light at full, half or quarter resolution (deferred only)
+        --denoise <iterations> filters the VPL light with as many a-trous passes (deferred only, 0 for no denoising)
+        --temporal <subsets> shades a subset of the VPLs per frame and reuses the VPL light of the previous frames (deferred only, 0 for
+        no temporal reuse), a single frame has no history
+        --simd 1|8|16 shades the VPLs without visibility nor attenuation with the exact span kernels, or the AVX2 or AVX-512 multi-light
+        kernels (deferred only, 1 by default, the multi-light kernels only match the span kernels within SIMD_TOLERANCE)
+        --vpl-budget <count> renders at most as many of the spawned VPLs, drawn with --budget-sampling power|uniform in proportion to
+        their power or with a uniform stride (frame and shading check only)
+    */
+    int width{ WINDOW_START_W };
+    int height{ WINDOW_START_H };
+    int scene{ SCENE_CORNELL_BOX };
+    int particles_count{ PARTICLES_COUNT_START };
+    float mean_reflectivity{ MEAN_REFLECTIVITY_START };
+    int vpl_type{ LIGHT_TYPE_POINT };
+    int seed{};
+    std::string output_path{ HEADLESS_OUTPUT_PATH_START };
+    int mode{ HEADLESS_MODE_FRAME };
+    int reference_samples{ PATH_TRACER_REFERENCE_SAMPLES_START };
+    int vpl_budget{ VPL_BUDGET_START };
+    int vpl_budget_sampling{ VPL_BUDGET_SAMPLING_POWER };
+    SoftwareShading shading{};
+
+    for (std::size_t i{}; i < args.size(); i += 2)
+    {
+        std::string_view name{ args[i] };
+        if (i + 1 >= args.size())
+        {
+            Crash(std::format("missing value for {}", name));
+        }
+        std::string_view value{ args[i + 1] };
+
+        if (name == "--scene")
+        {
+            if (value == "cornell") scene = SCENE_CORNELL_BOX;
+            else if (value == "doorway") scene = SCENE_DOORWAY;
+            else Crash(std::format("unknown scene '{}' (expected cornell or doorway)", value));
+        }
+        else if (name == "--width") width = ParseIntArgument(name, value, WINDOW_MIN_W, std::numeric_limits<int>::max());
+        else if (name == "--height") height = ParseIntArgument(name, value, WINDOW_MIN_H, std::numeric_limits<int>::max());
+        else if (name == "--particles") particles_count = ParseIntArgument(name, value, PARTICLES_COUNT_MIN, LIGHT_TREE_PARTICLES_COUNT_MAX);
+        else if (name == "--reflectivity") mean_reflectivity = ParseFloatArgument(name, value, MEAN_REFLECTIVITY_MIN, MEAN_REFLECTIVITY_MAX);
+        else if (name == "--vpl-type")
+        {
+            if (value == "point") vpl_type = LIGHT_TYPE_POINT;
+            else if (value == "sign-cos") vpl_type = LIGHT_TYPE_SIGN_COS_WEIGHTED;
+            else if (value == "cos") vpl_type = LIGHT_TYPE_COS_WEIGHTED;
+            else Crash(std::format("unknown VPL type '{}' (expected point, sign-cos or cos)", value));
+        }
+        else if (name == "--seed") seed = ParseIntArgument(name, value, std::numeric_limits<int>::min(), std::numeric_limits<int>::max());
+        else if (name == "--output") output_path = value;
+        else if (name == "--mode")
+        {
+            if (value == "frame") mode = HEADLESS_MODE_FRAME;
+            else if (value == "reference") mode = HEADLESS_MODE_REFERENCE;
+            else if (value == "equal-time") mode = HEADLESS_MODE_EQUAL_TIME;
+            else if (value == "shading-check") mode = HEADLESS_MODE_SHADING_CHECK;
+            else if (value == "culling-benchmark") mode = HEADLESS_MODE_CULLING_BENCHMARK;
+            else if (value == "interleave-benchmark") mode = HEADLESS_MODE_INTERLEAVE_BENCHMARK;
+            else if (value == "visibility-benchmark") mode = HEADLESS_MODE_VISIBILITY_BENCHMARK;
+            else if (value == "irradiance-cache-benchmark") mode = HEADLESS_MODE_IRRADIANCE_CACHE_BENCHMARK;
+            else if (value == "upsample-benchmark") mode = HEADLESS_MODE_UPSAMPLE_BENCHMARK;
+            else if (value == "denoise-benchmark") mode = HEADLESS_MODE_DENOISE_BENCHMARK;
+            else if (value == "temporal-benchmark") mode = HEADLESS_MODE_TEMPORAL_BENCHMARK;
+            else if (value == "kernel-benchmark") mode = HEADLESS_MODE_KERNEL_BENCHMARK;
+            else if (value == "simd-check") mode = HEADLESS_MODE_SIMD_CHECK;
+            else if (value == "resample-check") mode = HEADLESS_MODE_RESAMPLE_CHECK;
+            else if (value == "progressive-check") mode = HEADLESS_MODE_PROGRESSIVE_CHECK;
+            else if (value == "bake-check") mode = HEADLESS_MODE_BAKE_CHECK;
+            else Crash(std::format(
+                "unknown mode '{}' (expected frame, reference, equal-time, shading-check, culling-benchmark, interleave-benchmark, "
+                "visibility-benchmark, irradiance-cache-benchmark, upsample-benchmark, denoise-benchmark, temporal-benchmark or "
+                "kernel-benchmark, simd-check, resample-check, progressive-check or bake-check)", value
+            ));
+        }
+        else if (name == "--shading")
+        {
+            if (value == "deferred") shading.deferred = true;
+            else if (value == "multipass") shading.deferred = false;
+            else Crash(std::format("unknown shading '{}' (expected deferred or multipass)", value));
+        }
+        else if (name == "--culling")
+        {
+            if (value == "none") shading.light_culling = LIGHT_CULLING_NONE;
+            else if (value == "tiled") shading.light_culling = LIGHT_CULLING_TILED;
+            else if (value == "clustered") shading.light_culling = LIGHT_CULLING_CLUSTERED;
+            else Crash(std::format("unknown culling '{}' (expected none, tiled or clustered)", value));
+        }
+        else if (name == "--attenuation-epsilon") shading.attenuation_epsilon = ParseFloatArgument(name, value, 0.0f, std::numeric_limits<float>::max());
+        else if (name == "--interleave") shading.interleave = ParseIntArgument(name, value, INTERLEAVE_MIN, INTERLEAVE_MAX);
+        else if (name == "--vpl-visibility")
+        {
+            if (value == "none") shading.vpl_visibility = VPL_VISIBILITY_NONE;
+            else if (value == "ism") shading.vpl_visibility = VPL_VISIBILITY_ISM;
+            else if (value == "rays") shading.vpl_visibility = VPL_VISIBILITY_RAYS;
+            else Crash(std::format("unknown VPL visibility '{}' (expected none, ism or rays)", value));
+        }
+        else if (name == "--irradiance-cache") shading.irradiance_accuracy = ParseFloatArgument(name, value, 0.0f, IRRADIANCE_CACHE_ACCURACY_MAX);
+        else if (name == "--indirect-scale")
+        {
+            shading.indirect_scale = ParseIntArgument(name, value, INDIRECT_SCALE_START, INDIRECT_SCALE_MAX);
+            if (!std::has_single_bit(static_cast<unsigned>(shading.indirect_scale)))
+            {
+                Crash(std::format("invalid value '{}' for {} (expected 1, 2 or 4)", value, name));
+            }
+        }
+        else if (name == "--denoise") shading.denoise_iterations = ParseIntArgument(name, value, DENOISE_ITERATIONS_START, DENOISE_ITERATIONS_MAX);
+        else if (name == "--temporal") shading.temporal_subsets = ParseIntArgument(name, value, TEMPORAL_SUBSETS_START, TEMPORAL_SUBSETS_MAX);
+        else if (name == "--simd")
+        {
+            shading.simd_lanes = ParseIntArgument(name, value, 1, SIMD_MAX_LANES);
+            if (shading.simd_lanes != 1 && shading.simd_lanes != 8 && shading.simd_lanes != SIMD_MAX_LANES)
+            {
+                Crash(std::format("invalid value '{}' for {} (expected 1, 8 or 16)", value, name));
+            }
+            if (shading.simd_lanes > SupportedSIMDLanes())
+            {
+                Crash(std::format("{} lanes are not supported by the CPU (at most {})", shading.simd_lanes, SupportedSIMDLanes()));
+            }
+        }
+        else if (name == "--vpl-budget") vpl_budget = ParseIntArgument(name, value, VPL_BUDGET_MIN, VPL_BUDGET_MAX);
+        else if (name == "--budget-sampling")
+        {
+            if (value == "power") vpl_budget_sampling = VPL_BUDGET_SAMPLING_POWER;
+            else if (value == "uniform") vpl_budget_sampling = VPL_BUDGET_SAMPLING_UNIFORM_STRIDE;
+            else Crash(std::format("unknown budget sampling '{}' (expected power or uniform)", value));
+        }
+        else if (name == "--samples") reference_samples = ParseIntArgument(name, value, PATH_TRACER_REFERENCE_SAMPLES_MIN, PATH_TRACER_REFERENCE_SAMPLES_MAX);
+        else Crash(std::format("unknown option '{}'", name));
+    }
+
+    // scene (meshes without a device only have their CPU copy)
+    Mesh quad_mesh{ Mesh::Quad() };
+    Mesh cube_mesh{ Mesh::Cube() };
+
+    Camera camera{};
+    camera.fov_deg = CAMERA_FOV_DEG;
+    camera.near_plane = CAMERA_NEAR_PLANE;
+    camera.far_plane = CAMERA_FAR_PLANE;
+
+    std::vector<PointLight> point_lights{};
+    std::vector<Object> objects{};
+    if (scene == SCENE_DOORWAY)
+    {
+        BuildDoorwayScene(objects, point_lights, camera, &quad_mesh, &cube_mesh);
+    }
+    else
+    {
+        BuildCornellBoxScene(objects, point_lights, camera, &quad_mesh, &cube_mesh);
+    }
+    ValidateSceneObjects(objects);
+    for (Object& obj : objects)
+    {
+        UpdateObjectMatrices(obj);
+    }
+
+    ShadowConstants shadow{};
+    shadow.far_plane = CUBE_SHADOW_MAP_FAR;
+    shadow.static_bias = CUBE_SHADOW_MAP_STATIC_BIAS_START;
+    shadow.max_dynamic_bias = CUBE_SHADOW_MAP_MAX_DYNAMIC_BIAS_START;
+    shadow.pcf_samples = CUBE_SHADOW_MAP_PCF_SAMPLES_START;
+    shadow.offset_scale = CUBE_SHADOW_MAP_PCF_OFFSET_SCALE_START;
+
+    if (mode == HEADLESS_MODE_EQUAL_TIME)
+    {
+        RunEqualTimeBenchmark(camera, objects, point_lights, shadow, shading, width, height, mean_reflectivity, vpl_type, reference_samples, seed);
+        return;
+    }
+
+    if (mode == HEADLESS_MODE_CULLING_BENCHMARK)
+    {
+        float attenuation_epsilon{ shading.attenuation_epsilon > 0.0f ? shading.attenuation_epsilon : VPL_ATTENUATION_EPSILON_BENCHMARK };
+        RunLightCullingBenchmark(camera, objects, point_lights, shadow, width, height, mean_reflectivity, vpl_type, attenuation_epsilon, seed);
+        return;
+    }
+
+    if (mode == HEADLESS_MODE_INTERLEAVE_BENCHMARK)
+    {
+        RunInterleaveBenchmark(camera, objects, point_lights, shadow, shading, width, height, mean_reflectivity, vpl_type, seed);
+        return;
+    }
+
+    if (mode == HEADLESS_MODE_VISIBILITY_BENCHMARK)
+    {
+        RunVisibilityBenchmark(camera, objects, point_lights, shadow, shading, width, height, mean_reflectivity, vpl_type, seed);
+        return;
+    }
+
+    if (mode == HEADLESS_MODE_IRRADIANCE_CACHE_BENCHMARK)
+    {
+        RunIrradianceCacheBenchmark(camera, objects, point_lights, shadow, shading, width, height, mean_reflectivity, vpl_type, seed);
+        return;
+    }
+
+    if (mode == HEADLESS_MODE_UPSAMPLE_BENCHMARK)
+    {
+        RunUpsampleBenchmark(camera, objects, point_lights, shadow, shading, width, height, mean_reflectivity, vpl_type, seed);
+        return;
+    }
+
+    if (mode == HEADLESS_MODE_DENOISE_BENCHMARK)
+    {
+        RunDenoiseBenchmark(camera, objects, point_lights, shadow, shading, width, height, mean_reflectivity, vpl_type, seed);
+        return;
+    }
+
+    if (mode == HEADLESS_MODE_TEMPORAL_BENCHMARK)
+    {
+        RunTemporalBenchmark(camera, objects, point_lights, shadow, shading, width, height, mean_reflectivity, vpl_type, seed);
+        return;
+    }
+
+    if (mode == HEADLESS_MODE_KERNEL_BENCHMARK)
+    {
+        RunKernelBenchmark(camera, objects, point_lights, shadow, width, height, mean_reflectivity, seed);
+        return;
+    }
+
+    if (mode == HEADLESS_MODE_SIMD_CHECK)
+    {
+        RunSIMDCheck(camera, objects, point_lights, width, height, mean_reflectivity, seed);
+        return;
+    }
+
+    if (mode == HEADLESS_MODE_RESAMPLE_CHECK)
+    {
+        RunResampleCheck(objects, point_lights, mean_reflectivity, seed);
+        return;
+    }
+
+    if (mode == HEADLESS_MODE_BAKE_CHECK)
+    {
+        RunBakeCheck(objects, point_lights, mean_reflectivity, seed);
+        return;
+    }
+
+    if (mode == HEADLESS_MODE_PROGRESSIVE_CHECK)
+    {
+        RunProgressiveCheck(camera, objects, point_lights, shadow, shading, width, height, mean_reflectivity, vpl_type, seed);
+        return;
+    }
+
+    if (mode == HEADLESS_MODE_REFERENCE)
+    {
+        Emitters emitters{};
+        BuildEmitters(emitters, point_lights, objects);
+
+        Timer path_tracing_timer{};
+        path_tracing_timer.Start();
+
+        PathTracer path_tracer{ width, height };
+        for (int i{}; i < reference_samples; i++)
+        {
+            path_tracer.AddSample(camera, objects, point_lights, emitters, mean_reflectivity, vpl_type, static_cast<std::uint32_t>(seed));
+        }
+
+        path_tracing_timer.End();
+
+        std::vector<Vector3> image{};
+        path_tracer.Resolve(image, particles_count);
+        WritePFM(output_path, width, height, image);
+
+        std::println(
+            "{}x{}, {} samples per pixel: path tracing {:.2f} sec, written to {}",
+            width, height, reference_samples, path_tracing_timer.DeltaSec(), output_path
+        );
+        return;
+    }
+
+    // particle simulation
+    Timer particle_sim_timer{};
+    particle_sim_timer.Start();
+
+    Emitters emitters{};
+    BuildEmitters(emitters, point_lights, objects);
+
+    std::vector<std::vector<LightPathNode>> light_paths{};
+    ShootLightPaths(light_paths, point_lights, emitters, particles_count, seed);
+    TraceLightPaths(light_paths, objects, particles_count, mean_reflectivity);
+
+    std::vector<VirtualLight> virtual_lights{};
+    SpawnVirtualLights(virtual_lights, light_paths, point_lights, emitters, particles_count, mean_reflectivity, {});
+    int point_lights_count{ static_cast<int>(point_lights.size()) };
+    int spawned_vpls_count{ static_cast<int>(virtual_lights.size()) - point_lights_count };
+
+    // don't render more VPLs than the budget allows
+    if (vpl_budget_sampling == VPL_BUDGET_SAMPLING_POWER)
+    {
+        ResampleVPLs(virtual_lights, point_lights_count, vpl_budget, seed);
+    }
+    else
+    {
+        ApplyVPLBudget(virtual_lights, point_lights_count, vpl_budget);
+    }
+
+    particle_sim_timer.End();
+
+    // rendering
+    Timer rendering_timer{};
+    rendering_timer.Start();
+
+    SoftwareScene software_scene{ objects, emitters, shadow };
+    SoftwareRenderer renderer{ width, height };
+    SoftwareFrameStats stats{ renderer.Render(camera, software_scene, { virtual_lights, point_lights_count, particles_count, vpl_type }, shading) };
+
+    rendering_timer.End();
+
+    WritePFM(output_path, width, height, renderer.Color());
+
+    std::println(
+        "{}x{}, {} virtual lights: particle simulation {:.2f} msec, {} rendering {:.2f} msec, written to {}",
+        width, height, virtual_lights.size(), particle_sim_timer.DeltaSec() * 1000.0f, shading.deferred ? "deferred" : "multipass",
+        rendering_timer.DeltaSec() * 1000.0f, output_path
+    );
+    if (spawned_vpls_count > vpl_budget)
+    {
+        std::println(
+            "{} of {} spawned VPLs rendered ({})", static_cast<int>(virtual_lights.size()) - point_lights_count, spawned_vpls_count,
+            vpl_budget_sampling == VPL_BUDGET_SAMPLING_POWER ? "power proportional" : "uniform stride"
+        );
+    }
+    if (shading.deferred)
+    {
+        std::println("{:.1f} lights per pixel, {:.1f} per tile or cluster on average", stats.average_pixel_lights, stats.average_list_lights);
+    }
+    if (shading.vpl_visibility == VPL_VISIBILITY_ISM)
+    {
+        std::println("imperfect shadow maps {:.2f} msec", stats.vpl_visibility_sec * 1000.0f);
+    }
+    else if (shading.vpl_visibility == VPL_VISIBILITY_RAYS && shading.deferred)
+    {
+        std::println(
+            "BVH {:.2f} msec, {} shadow rays, {} of {} visibility cache lookups hit", stats.vpl_visibility_sec * 1000.0f,
+            stats.shadow_rays, stats.visibility_cache_hits, stats.visibility_cache_lookups
+        );
+    }
+    if (shading.irradiance_accuracy > 0.0f && shading.deferred)
+    {
+        std::println("irradiance cache {:.2f} msec, {} records", stats.irradiance_cache_sec * 1000.0f, stats.irradiance_records);
+    }
+    if (shading.denoise_iterations > 0 && shading.deferred)
+    {
+        std::println("denoising {:.2f} msec", stats.denoise_sec * 1000.0f);
+    }
+    if (shading.temporal_subsets > 0 && shading.deferred)
+    {
+        std::println("temporal reuse {:.2f} msec, {:.1f}% of the pixels reprojected", stats.temporal_sec * 1000.0f, stats.reprojected_ratio * 100.0f);
+    }
+
+    if (mode == HEADLESS_MODE_SHADING_CHECK)
+    {
+        Timer check_timer{};
+        check_timer.Start();
+
+        SoftwareShading check_shading{ shading };
+        check_shading.deferred = !shading.deferred;
+
+        SoftwareRenderer check_renderer{ width, height };
+        check_renderer.Render(camera, software_scene, { virtual_lights, point_lights_count, particles_count, vpl_type }, check_shading);
+
+        check_timer.End();
+
+        int mismatches{};
+        float max_difference{};
+        for (std::size_t i{}; i < renderer.Color().size(); i++)
+        {
+            Vector3 d{ renderer.Color()[i] - check_renderer.Color()[i] };
+            float difference{ std::max({ std::abs(d.x), std::abs(d.y), std::abs(d.z) }) };
+            if (difference > 0.0f) mismatches++;
+            max_difference = std::max(max_difference, difference);
+        }
+
+        std::println(
+            "{} rendering {:.2f} msec, {} of {} pixels differ (max difference {})",
+            check_shading.deferred ? "deferred" : "multipass", check_timer.DeltaSec() * 1000.0f, mismatches, renderer.Color().size(), max_difference
+        );
+    }
+}
+
+// ----------------------------------------------------------------------------
+// Main
+// ----------------------------------------------------------------------------
+
+#if !defined(_WIN32)
+int main(int argc, char* argv[])
+{
+    // without Windows the headless entry point is the only one, HEADLESS_FLAG is accepted for the same command lines
+    try
+    {
+        std::vector<std::string_view> args(argv + 1, argv + argc);
+        if (!args.empty() && args.front() == HEADLESS_FLAG)
+        {
+            args.erase(args.begin());
+        }
+        HeadlessEntry(args);
+    }
+    catch (const Error& e)
+    {
+        std::println("{}", e.what());
+        return 1;
+    }
+
+    return 0;
+}
+#endif
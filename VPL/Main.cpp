@@ -5,29 +5,11 @@
 // Precompiled header
 #include "PCH.h"
 
-// Windows
-#define WIN32_LEAN_AND_MEAN
-#define NOMINMAX
-#include <Windows.h>
-#include <Windowsx.h>
-#include <wrl/client.h> // for ComPtr
-namespace wrl = Microsoft::WRL;
+// Windows, D3D11, math library, constant buffers, scene and VPLs shared with the headless entry point
+#include "Common.h"
 
-// D3D11
-#include <d3d11.h>
-#include <d3dcompiler.h>
-#include <dxgi1_3.h>
-#if defined(_DEBUG)
-#include <dxgidebug.h>
-#endif
-
-// Math Library
-#include "SimpleMath.h"
-using Matrix = DirectX::SimpleMath::Matrix;
-using Vector2 = DirectX::SimpleMath::Vector2;
-using Vector3 = DirectX::SimpleMath::Vector3;
-using Vector4 = DirectX::SimpleMath::Vector4;
-using Quaternion = DirectX::SimpleMath::Quaternion;
+// the window, the D3D11 device and ImGui only exist on Windows, Headless.cpp builds everywhere
+#if defined(_WIN32)
 
 // ImGui Library
 #include "imgui.h"
@@ -42,19 +24,10 @@ using Quaternion = DirectX::SimpleMath::Quaternion;
 #include "PSPointLight.h"
 #include "PSCubeShadowMap.h"
 #include "PSSkybox.h"
-
-// Constant buffers
-#define float2 Vector2
-#define float3 Vector3
-#define float4 Vector4
-#define matrix Matrix
-#define int int32_t
-#include "ConstantBuffers.hlsli"
-#undef float2
-#undef float3
-#undef float4
-#undef matrix
-#undef int
+#include "PSLightTree.h"
+#include "VSFullscreen.h"
+#include "PSAccumulation.h"
+#include "PSAreaLight.h"
 
 // ----------------------------------------------------------------------------
 // Libraries
@@ -73,78 +46,17 @@ constexpr const char* WINDOW_CLASS_NAME{ "vpl_window_class" };
 constexpr const char* WINDOW_TITLE{ "VPL" };
 constexpr DWORD WINDOW_STYLE{ WS_OVERLAPPEDWINDOW };
 constexpr DWORD WINDOW_STYLE_EX{ WS_EX_OVERLAPPEDWINDOW };
-constexpr int WINDOW_START_W{ 1280 };
-constexpr int WINDOW_START_H{ 720 };
-constexpr int WINDOW_MIN_W{ 8 };
-constexpr int WINDOW_MIN_H{ 8 };
 constexpr DXGI_FORMAT DEPTH_BUFFER_FORMAT{ DXGI_FORMAT_D32_FLOAT };
-constexpr float CAMERA_START_YAW_DEG{ -90.0f };
-constexpr float CAMERA_START_PITCH_DEG{ 0.0f };
-constexpr float CAMERA_MIN_PITCH_DEG{ -89.0f };
-constexpr float CAMERA_MAX_PITCH_DEG{ +89.0f };
-constexpr float CAMERA_FOV_DEG{ 45.0f };
-constexpr float CAMERA_NEAR_PLANE{ 0.01f };
-constexpr float CAMERA_FAR_PLANE{ 100.0f };
-constexpr float CAMERA_MOVE_SPEED{ 10.0f };
-constexpr float CAMERA_MOVE_SPEED_MULTIPLIER{ 2.0f };
-constexpr float MOUSE_SENSITIVITY{ 5.0f };
-constexpr float POINT_LIGHT_RADIUS{ 0.25f };
-constexpr float POINT_LIGHT_MIN_INTENSITY{ 1.0f };
-constexpr float POINT_LIGHT_MAX_INTENSITY{ 100.0f };
-constexpr float POINT_LIGHT_START_INTENSITY{ 5.0f };
 constexpr UINT LINE_VERTEX_COUNT{ 2 };
-constexpr Vector3 LINE_OK_COLOR{ 0.0f, 1.0f, 0.0f };
-constexpr Vector3 LINE_ERROR_COLOR{ 1.0f, 0.0f, 0.0f };
-constexpr Vector3 LINE_NORMAL_COLOR{ 1.0f, 0.0f, 1.0f };
-constexpr float LINE_NORMAL_T{ 0.5f };
-constexpr float LINE_ERROR_T{ 10.0f };
-constexpr int PARTICLES_COUNT_START{ 10 };
-constexpr int PARTICLES_COUNT_MIN{ 1 };
-constexpr int PARTICLES_COUNT_MAX{ 1000 };
-constexpr float MEAN_REFLECTIVITY_START{ 0.5f };
-constexpr float MEAN_REFLECTIVITY_MIN{ 0.1f };
-constexpr float MEAN_REFLECTIVITY_MAX{ 0.9f };
-constexpr int MIN_SELECTED_LIGHT_PATH_INDEX{ -1 };
-constexpr int MIN_SELECTED_LIGHT_INDEX{ -1 };
-constexpr int POINT_LIGHT_INDEX{};
-constexpr int CUBE_MAP_FACES{ 6 };
-constexpr int CUBE_SHADOW_MAP_SIZE{ 1024 };
-constexpr float CUBE_SHADOW_MAP_NEAR{ 0.1f };
-constexpr float CUBE_SHADOW_MAP_FAR{ 10.0f };
-constexpr float CUBE_SHADOW_MAP_STATIC_BIAS_START{ 0.01f };
-constexpr float CUBE_SHADOW_MAP_MAX_DYNAMIC_BIAS_START{ 0.1f };
-constexpr float CUBE_SHADOW_MAP_BIAS_MIN{ 0.0f };
-constexpr float CUBE_SHADOW_MAP_BIAS_MAX{ 1.0f };
-constexpr int CUBE_SHADOW_MAP_PCF_SAMPLES_START{ 4 };
-constexpr int CUBE_SHADOW_MAP_PCF_SAMPLES_MIN{ 1 };
-constexpr int CUBE_SHADOW_MAP_PCF_SAMPLES_MAX{ PCF_MAX_SAMPLES };
-constexpr float CUBE_SHADOW_MAP_PCF_OFFSET_SCALE_START{ 0.005f };
-constexpr float CUBE_SHADOW_MAP_PCF_OFFSET_SCALE_MIN{ 0.0f };
-constexpr float CUBE_SHADOW_MAP_PCF_OFFSET_SCALE_MAX{ 1.0f };
+constexpr DXGI_FORMAT ACCUMULATION_BUFFER_FORMAT{ DXGI_FORMAT_R32G32B32A32_FLOAT };
+constexpr DXGI_FORMAT RESTIR_IMAGE_FORMAT{ DXGI_FORMAT_R32G32B32A32_FLOAT };
 
 // ----------------------------------------------------------------------------
 // Custom Assertions
 // ----------------------------------------------------------------------------
 
-class Error : public std::runtime_error
-{
-public:
-    Error(const char* file, int line, const std::string& msg)
-        : std::runtime_error{ std::format("{}({}): {}\n{}", file, line, msg, std::stacktrace::current(1)) }
-    {}
-};
-
-#if defined(_DEBUG)
-#define Crash(msg) __debugbreak()
-#else
-#define Crash(msg) throw Error(__FILE__, __LINE__, msg)
-#endif
-
-#define Check(p) do { if (!(p)) Crash("check failed: " #p); } while (false)
 #define CheckHR(hr) Check(SUCCEEDED(hr))
 
-#define Unreachable() Crash("unreachable code path")
-
 // ----------------------------------------------------------------------------
 // Miscellaneous Utilities
 // ----------------------------------------------------------------------------
@@ -181,24 +93,6 @@ static std::wstring WStrFromStr(const std::string& wstr)
     }
 }
 
-static std::string GetBytesStr(size_t bytes)
-{
-    const char* suffixes[]{ "B", "KB", "MB", "GB", "TB", "PB" };
-
-    size_t i{};
-    double val{ static_cast<double>(bytes) };
-    while (val >= 1024.0 && i < std::size(suffixes) - 1)
-    {
-        val /= 1024.0;
-        i++;
-    }
-
-    std::ostringstream out{};
-    out << std::fixed << std::setprecision(2) << val << " " << suffixes[i];
-
-    return out.str();
-}
-
 // ----------------------------------------------------------------------------
 // Window Procedure
 // ----------------------------------------------------------------------------
@@ -350,53 +244,6 @@ float GetElapsedSec(LARGE_INTEGER t0, LARGE_INTEGER t1, LARGE_INTEGER frequency)
     return elapsed_sec;
 }
 
-// ----------------------------------------------------------------------------
-// Timer
-// ----------------------------------------------------------------------------
-
-class Timer
-{
-public:
-    Timer();
-public:
-    void Start();
-    void End();
-    float DeltaSec();
-private:
-    LARGE_INTEGER m_freq;
-    LARGE_INTEGER m_t0;
-    LARGE_INTEGER m_t1;
-};
-
-Timer::Timer()
-    : m_freq{ GetWin32PerformanceFrequency() }
-    , m_t0{}
-    , m_t1{}
-{
-}
-void Timer::Start()
-{
-    m_t0 = GetWin32PerformanceCounter();
-}
-void Timer::End()
-{
-    m_t1 = GetWin32PerformanceCounter();
-}
-float Timer::DeltaSec()
-{
-    return GetElapsedSec(m_t0, m_t1, m_freq);
-}
-
-// ----------------------------------------------------------------------------
-// Vertex Definition
-// ----------------------------------------------------------------------------
-
-struct Vertex
-{
-    Vector3 position;
-    Vector3 normal;
-};
-
 // ----------------------------------------------------------------------------
 // D3D11 (and DXGI) API Helpers
 // ----------------------------------------------------------------------------
@@ -412,6 +259,7 @@ public:
     FrameBuffer& operator=(const FrameBuffer&) = delete;
     FrameBuffer& operator=(FrameBuffer&&) noexcept = default;
 public:
+    ID3D11Texture2D* BackBuffer() const noexcept { return m_back_buffer.Get(); }
     ID3D11RenderTargetView* BackBufferRTV() const noexcept { return m_back_buffer_rtv.Get(); }
     ID3D11DepthStencilView* DepthBufferDSV() const noexcept { return m_depth_buffer_dsv.Get(); }
 private:
@@ -455,29 +303,32 @@ FrameBuffer::FrameBuffer()
 class CubeShadowMap
 {
 public:
-    CubeShadowMap(ID3D11Device* d3d_dev);
+    CubeShadowMap(ID3D11Device* d3d_dev, int size);
     ~CubeShadowMap() = default;
     CubeShadowMap(const CubeShadowMap&) = delete;
-    CubeShadowMap(CubeShadowMap&&) noexcept = delete;
+    CubeShadowMap(CubeShadowMap&&) noexcept = default;
     CubeShadowMap& operator=(const CubeShadowMap&) = delete;
-    CubeShadowMap& operator=(CubeShadowMap&&) noexcept = delete;
+    CubeShadowMap& operator=(CubeShadowMap&&) noexcept = default;
 public:
+    int Size() const noexcept { return m_size; }
     ID3D11DepthStencilView* DSVs(int face_idx) const noexcept { return m_dsvs[face_idx].Get(); }
     ID3D11ShaderResourceView* SRV() const noexcept { return m_srv.Get(); }
 private:
+    int m_size;
     wrl::ComPtr<ID3D11Texture2D> m_cube_map;
     wrl::ComPtr<ID3D11DepthStencilView> m_dsvs[CUBE_MAP_FACES];
     wrl::ComPtr<ID3D11ShaderResourceView> m_srv;
 };
 
-CubeShadowMap::CubeShadowMap(ID3D11Device* d3d_dev)
-    : m_cube_map{}
+CubeShadowMap::CubeShadowMap(ID3D11Device* d3d_dev, int size)
+    : m_size{ size }
+    , m_cube_map{}
 {
     // create cube map texture
     {
         D3D11_TEXTURE2D_DESC desc{};
-        desc.Width = static_cast<UINT>(CUBE_SHADOW_MAP_SIZE);
-        desc.Height = static_cast<UINT>(CUBE_SHADOW_MAP_SIZE);
+        desc.Width = static_cast<UINT>(size);
+        desc.Height = static_cast<UINT>(size);
         desc.MipLevels = 1;
         desc.ArraySize = static_cast<UINT>(CUBE_MAP_FACES);
         desc.Format = DXGI_FORMAT_R32_TYPELESS;
@@ -511,174 +362,71 @@ CubeShadowMap::CubeShadowMap(ID3D11Device* d3d_dev)
     }
 }
 
-class Mesh
+class RenderTarget
 {
 public:
-    static Mesh Quad(ID3D11Device* d3d_dev);
-    static Mesh Cube(ID3D11Device* d3d_dev);
+    RenderTarget(ID3D11Device* d3d_dev, int width, int height, DXGI_FORMAT format);
+    RenderTarget();
+    ~RenderTarget() = default;
+    RenderTarget(const RenderTarget&) = delete;
+    RenderTarget(RenderTarget&&) noexcept = default;
+    RenderTarget& operator=(const RenderTarget&) = delete;
+    RenderTarget& operator=(RenderTarget&&) noexcept = default;
 public:
-    Mesh(ID3D11Device* d3d_dev, UINT vertex_count, UINT vertex_size, const void* vertices, UINT index_count, UINT index_size, const void* indices);
-    ~Mesh() = default;
-    Mesh(const Mesh&) = delete;
-    Mesh(Mesh&&) noexcept = default;
-    Mesh& operator=(const Mesh&) = delete;
-    Mesh& operator=(Mesh&&) noexcept = default;
-public:
-    ID3D11Buffer* const* Vertices() const noexcept { return m_vertices.GetAddressOf(); }
-    ID3D11Buffer* Indices() const noexcept { return m_indices.Get(); }
-    UINT VertexCount() const noexcept { return m_vertex_count; }
-    UINT IndexCount() const noexcept { return m_index_count; }
-    const UINT* Stride() const noexcept { return &m_stride; }
-    DXGI_FORMAT IndexFormat() const noexcept { return m_index_format; }
-    const UINT* Offset() const noexcept { return &m_offset; }
+    ID3D11Texture2D* Texture() const noexcept { return m_texture.Get(); }
+    ID3D11RenderTargetView* RTV() const noexcept { return m_rtv.Get(); }
+    ID3D11ShaderResourceView* SRV() const noexcept { return m_srv.Get(); }
 private:
-    wrl::ComPtr<ID3D11Buffer> m_vertices;
-    wrl::ComPtr<ID3D11Buffer> m_indices;
-    UINT m_vertex_count;
-    UINT m_index_count;
-    UINT m_stride;
-    DXGI_FORMAT m_index_format;
-    UINT m_offset;
+    wrl::ComPtr<ID3D11Texture2D> m_texture;
+    wrl::ComPtr<ID3D11RenderTargetView> m_rtv;
+    wrl::ComPtr<ID3D11ShaderResourceView> m_srv;
 };
 
-Mesh Mesh::Quad(ID3D11Device* d3d_dev)
+RenderTarget::RenderTarget(ID3D11Device* d3d_dev, int width, int height, DXGI_FORMAT format)
+    : m_texture{}
+    , m_rtv{}
+    , m_srv{}
 {
-    /*
-        Local space quad vertex positions (we are on z = 0)
-        We suppose the quad's normal is (0, 0, 1)
-
-        (-0.5, +0.5)            (+0.5, +0.5)
-                    +----------+
-                    |          |
-                    |          |
-                    |          |
-                    |          |
-                    +----------+
-        (-0.5, -0.5)            (+0.5, -0.5)
-
-    */
-
-    Vertex vertices[]
-    {
-        { { +0.5f, +0.5f, 0.0f }, { 0.0f, 0.0f, 1.0f } },
-        { { -0.5f, +0.5f, 0.0f }, { 0.0f, 0.0f, 1.0f } },
-        { { -0.5f, -0.5f, 0.0f }, { 0.0f, 0.0f, 1.0f } },
-        { { +0.5f, -0.5f, 0.0f }, { 0.0f, 0.0f, 1.0f } },
-    };
-
-    UINT indices[]
+    // create texture
     {
-        0, 1, 2,
-        2, 3, 0,
-    };
+        D3D11_TEXTURE2D_DESC desc{};
+        desc.Width = static_cast<UINT>(width);
+        desc.Height = static_cast<UINT>(height);
+        desc.MipLevels = 1;
+        desc.ArraySize = 1;
+        desc.Format = format;
+        desc.SampleDesc = { .Count = 1, .Quality = 0 };
+        desc.Usage = D3D11_USAGE_DEFAULT;
+        desc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+        desc.MiscFlags = 0;
+        CheckHR(d3d_dev->CreateTexture2D(&desc, nullptr, m_texture.ReleaseAndGetAddressOf()));
+    }
 
-    return { d3d_dev, _countof(vertices), sizeof(*vertices), vertices, _countof(indices), sizeof(*indices), indices };
+    // create views
+    CheckHR(d3d_dev->CreateRenderTargetView(m_texture.Get(), nullptr, m_rtv.ReleaseAndGetAddressOf()));
+    CheckHR(d3d_dev->CreateShaderResourceView(m_texture.Get(), nullptr, m_srv.ReleaseAndGetAddressOf()));
 }
 
-Mesh Mesh::Cube(ID3D11Device* d3d_dev)
+RenderTarget::RenderTarget()
+    : m_texture{}
+    , m_rtv{}
+    , m_srv{}
 {
-    Vertex vertices[]
-    {
-        // front face (Z+)
-        { { -0.5f, -0.5f, +0.5f }, { 0.0f, 0.0f, 1.0f } },
-        { { +0.5f, -0.5f, +0.5f }, { 0.0f, 0.0f, 1.0f } },
-        { { +0.5f, +0.5f, +0.5f }, { 0.0f, 0.0f, 1.0f } },
-        { { -0.5f, +0.5f, +0.5f }, { 0.0f, 0.0f, 1.0f } },
-
-        // back face (Z-)
-        { { +0.5f, -0.5f, -0.5f }, { 0.0f, 0.0f, -1.0f } },
-        { { -0.5f, -0.5f, -0.5f }, { 0.0f, 0.0f, -1.0f } },
-        { { -0.5f, +0.5f, -0.5f }, { 0.0f, 0.0f, -1.0f } },
-        { { +0.5f, +0.5f, -0.5f }, { 0.0f, 0.0f, -1.0f } },
-
-        // left face (X-)
-        { { -0.5f, -0.5f, -0.5f }, { -1.0f, 0.0f, 0.0f } },
-        { { -0.5f, -0.5f, +0.5f }, { -1.0f, 0.0f, 0.0f } },
-        { { -0.5f, +0.5f, +0.5f }, { -1.0f, 0.0f, 0.0f } },
-        { { -0.5f, +0.5f, -0.5f }, { -1.0f, 0.0f, 0.0f } },
-
-        // right face (X+)
-        { { +0.5f, -0.5f, +0.5f }, { +1.0f, 0.0f, 0.0f } },
-        { { +0.5f, -0.5f, -0.5f }, { +1.0f, 0.0f, 0.0f } },
-        { { +0.5f, +0.5f, -0.5f }, { +1.0f, 0.0f, 0.0f } },
-        { { +0.5f, +0.5f, +0.5f }, { +1.0f, 0.0f, 0.0f } },
-
-        // top face (Y+)
-        { { -0.5f, +0.5f, +0.5f }, { 0.0f, +1.0f, 0.0f } },
-        { { +0.5f, +0.5f, +0.5f }, { 0.0f, +1.0f, 0.0f } },
-        { { +0.5f, +0.5f, -0.5f }, { 0.0f, +1.0f, 0.0f } },
-        { { -0.5f, +0.5f, -0.5f }, { 0.0f, +1.0f, 0.0f } },
-
-        // bottom face (Y-)
-        { { -0.5f, -0.5f, -0.5f }, { 0.0f, -1.0f, 0.0f } },
-        { { +0.5f, -0.5f, -0.5f }, { 0.0f, -1.0f, 0.0f } },
-        { { +0.5f, -0.5f, +0.5f }, { 0.0f, -1.0f, 0.0f } },
-        { { -0.5f, -0.5f, +0.5f }, { 0.0f, -1.0f, 0.0f } },
-    };
-
-    UINT indices[]
-    {
-        // front
-        0, 1, 2,
-        0, 2, 3,
-
-        // back
-        4, 5, 6,
-        4, 6, 7,
-
-        // left
-        8, 9,10,
-        8,10,11,
-
-        // right
-        12,13,14,
-        12,14,15,
-
-        // top 
-        16,17,18,
-        16,18,19,
-
-        // bottom
-        20,21,22,
-        20,22,23
-    };
-
-    return { d3d_dev, _countof(vertices), sizeof(*vertices), vertices, _countof(indices), sizeof(*indices), indices };
 }
 
-Mesh::Mesh(ID3D11Device* d3d_dev, UINT vertex_count, UINT vertex_size, const void* vertices, UINT index_count, UINT index_size, const void* indices)
-    : m_vertices{}
-    , m_indices{}
-    , m_vertex_count{ vertex_count }
-    , m_index_count{ index_count }
-    , m_stride{ vertex_size }
-    , m_index_format{}
-    , m_offset{}
-{
-    Check(vertex_count > 0);
-    Check(index_count > 0);
-    Check(vertex_size > 0);
-    Check(index_size > 0 && (index_size == 2 || index_size == 4));
-
-    // set index format based on index stride
-    switch (index_size)
-    {
-    case 2: { m_index_format = DXGI_FORMAT_R16_UINT; } break;
-    case 4: { m_index_format = DXGI_FORMAT_R32_UINT; } break;
-    default: { Unreachable(); } break;
-    }
-
+void Mesh::Upload(ID3D11Device* d3d_dev)
+{
     // upload vertices to the GPU
     {
         D3D11_BUFFER_DESC desc{};
-        desc.ByteWidth = m_vertex_count * vertex_size;
+        desc.ByteWidth = VertexCount() * m_stride;
         desc.Usage = D3D11_USAGE_IMMUTABLE;
         desc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
         desc.CPUAccessFlags = 0;
         desc.MiscFlags = 0;
         desc.StructureByteStride = 0;
         D3D11_SUBRESOURCE_DATA data{};
-        data.pSysMem = vertices;
+        data.pSysMem = m_cpu_vertices.data();
         data.SysMemPitch = 0;
         data.SysMemSlicePitch = 0;
         CheckHR(d3d_dev->CreateBuffer(&desc, &data, m_vertices.ReleaseAndGetAddressOf()));
@@ -687,14 +435,14 @@ Mesh::Mesh(ID3D11Device* d3d_dev, UINT vertex_count, UINT vertex_size, const voi
     // upload indices to the GPU
     {
         D3D11_BUFFER_DESC desc{};
-        desc.ByteWidth = m_index_count * index_size;
+        desc.ByteWidth = IndexCount() * sizeof(std::uint32_t);
         desc.Usage = D3D11_USAGE_IMMUTABLE;
         desc.BindFlags = D3D11_BIND_INDEX_BUFFER;
         desc.CPUAccessFlags = 0;
         desc.MiscFlags = 0;
         desc.StructureByteStride = 0;
         D3D11_SUBRESOURCE_DATA data{};
-        data.pSysMem = indices;
+        data.pSysMem = m_cpu_indices.data();
         data.SysMemPitch = 0;
         data.SysMemSlicePitch = 0;
         CheckHR(d3d_dev->CreateBuffer(&desc, &data, m_indices.ReleaseAndGetAddressOf()));
@@ -712,6 +460,7 @@ public:
     SubresourceMap& operator=(SubresourceMap&&) noexcept = delete;
 public:
     void* Data() { return m_mapped_subres.pData; }
+    UINT RowPitch() const noexcept { return m_mapped_subres.RowPitch; }
 private:
     ID3D11DeviceContext* m_d3d_ctx;
     ID3D11Resource* m_res;
@@ -733,6 +482,351 @@ SubresourceMap::~SubresourceMap()
     m_d3d_ctx->Unmap(m_res, m_subres_idx);
 }
 
+class DynamicTexture
+{
+public:
+    DynamicTexture(ID3D11Device* d3d_dev, int width, int height, DXGI_FORMAT format);
+    DynamicTexture();
+    ~DynamicTexture() = default;
+    DynamicTexture(const DynamicTexture&) = delete;
+    DynamicTexture(DynamicTexture&&) noexcept = default;
+    DynamicTexture& operator=(const DynamicTexture&) = delete;
+    DynamicTexture& operator=(DynamicTexture&&) noexcept = default;
+public:
+    void Upload(ID3D11DeviceContext* d3d_ctx, const void* data, UINT row_size); // data rows are tightly packed, row_size bytes each
+    ID3D11ShaderResourceView* SRV() const noexcept { return m_srv.Get(); }
+    int Width() const noexcept { return m_width; }
+    int Height() const noexcept { return m_height; }
+private:
+    wrl::ComPtr<ID3D11Texture2D> m_texture;
+    wrl::ComPtr<ID3D11ShaderResourceView> m_srv;
+    int m_width;
+    int m_height;
+};
+
+DynamicTexture::DynamicTexture(ID3D11Device* d3d_dev, int width, int height, DXGI_FORMAT format)
+    : m_texture{}
+    , m_srv{}
+    , m_width{ width }
+    , m_height{ height }
+{
+    // create texture
+    {
+        D3D11_TEXTURE2D_DESC desc{};
+        desc.Width = static_cast<UINT>(width);
+        desc.Height = static_cast<UINT>(height);
+        desc.MipLevels = 1;
+        desc.ArraySize = 1;
+        desc.Format = format;
+        desc.SampleDesc = { .Count = 1, .Quality = 0 };
+        desc.Usage = D3D11_USAGE_DYNAMIC;
+        desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+        desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+        desc.MiscFlags = 0;
+        CheckHR(d3d_dev->CreateTexture2D(&desc, nullptr, m_texture.ReleaseAndGetAddressOf()));
+    }
+
+    // create view
+    CheckHR(d3d_dev->CreateShaderResourceView(m_texture.Get(), nullptr, m_srv.ReleaseAndGetAddressOf()));
+}
+
+DynamicTexture::DynamicTexture()
+    : m_texture{}
+    , m_srv{}
+    , m_width{}
+    , m_height{}
+{
+}
+
+void DynamicTexture::Upload(ID3D11DeviceContext* d3d_ctx, const void* data, UINT row_size)
+{
+    // the rows of the mapped texture may be padded, so they are copied one by one
+    SubresourceMap map{ d3d_ctx, m_texture.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0 };
+    auto dst{ static_cast<std::byte*>(map.Data()) };
+    auto src{ static_cast<const std::byte*>(data) };
+    for (int y{}; y < m_height; y++)
+    {
+        std::memcpy(dst + static_cast<std::size_t>(y) * map.RowPitch(), src + static_cast<std::size_t>(y) * row_size, row_size);
+    }
+}
+
+class ReadbackTexture
+{
+public:
+    ReadbackTexture(ID3D11Device* d3d_dev, int width, int height, DXGI_FORMAT format);
+    ReadbackTexture();
+    ~ReadbackTexture() = default;
+    ReadbackTexture(const ReadbackTexture&) = delete;
+    ReadbackTexture(ReadbackTexture&&) noexcept = default;
+    ReadbackTexture& operator=(const ReadbackTexture&) = delete;
+    ReadbackTexture& operator=(ReadbackTexture&&) noexcept = default;
+public:
+    void Read(ID3D11DeviceContext* d3d_ctx, ID3D11Texture2D* texture, void* data, UINT row_size); // same size and format, blocks until the GPU is done
+    int Width() const noexcept { return m_width; }
+    int Height() const noexcept { return m_height; }
+private:
+    wrl::ComPtr<ID3D11Texture2D> m_texture;
+    int m_width;
+    int m_height;
+};
+
+ReadbackTexture::ReadbackTexture(ID3D11Device* d3d_dev, int width, int height, DXGI_FORMAT format)
+    : m_texture{}
+    , m_width{ width }
+    , m_height{ height }
+{
+    D3D11_TEXTURE2D_DESC desc{};
+    desc.Width = static_cast<UINT>(width);
+    desc.Height = static_cast<UINT>(height);
+    desc.MipLevels = 1;
+    desc.ArraySize = 1;
+    desc.Format = format;
+    desc.SampleDesc = { .Count = 1, .Quality = 0 };
+    desc.Usage = D3D11_USAGE_STAGING;
+    desc.BindFlags = 0;
+    desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+    desc.MiscFlags = 0;
+    CheckHR(d3d_dev->CreateTexture2D(&desc, nullptr, m_texture.ReleaseAndGetAddressOf()));
+}
+
+ReadbackTexture::ReadbackTexture()
+    : m_texture{}
+    , m_width{}
+    , m_height{}
+{
+}
+
+void ReadbackTexture::Read(ID3D11DeviceContext* d3d_ctx, ID3D11Texture2D* texture, void* data, UINT row_size)
+{
+    // the rows of the mapped texture may be padded, so they are copied one by one
+    d3d_ctx->CopyResource(m_texture.Get(), texture);
+    SubresourceMap map{ d3d_ctx, m_texture.Get(), 0, D3D11_MAP_READ, 0 };
+    auto src{ static_cast<const std::byte*>(map.Data()) };
+    auto dst{ static_cast<std::byte*>(data) };
+    for (int y{}; y < m_height; y++)
+    {
+        std::memcpy(dst + static_cast<std::size_t>(y) * row_size, src + static_cast<std::size_t>(y) * map.RowPitch(), row_size);
+    }
+}
+
+class StructuredBuffer
+{
+public:
+    StructuredBuffer(UINT element_size);
+    ~StructuredBuffer() = default;
+    StructuredBuffer(const StructuredBuffer&) = delete;
+    StructuredBuffer(StructuredBuffer&&) noexcept = default;
+    StructuredBuffer& operator=(const StructuredBuffer&) = delete;
+    StructuredBuffer& operator=(StructuredBuffer&&) noexcept = default;
+public:
+    void Upload(ID3D11Device* d3d_dev, ID3D11DeviceContext* d3d_ctx, UINT element_count, const void* elements);
+    ID3D11ShaderResourceView* SRV() const noexcept { return m_srv.Get(); }
+private:
+    wrl::ComPtr<ID3D11Buffer> m_buffer;
+    wrl::ComPtr<ID3D11ShaderResourceView> m_srv;
+    UINT m_element_size;
+    UINT m_capacity;
+};
+
+StructuredBuffer::StructuredBuffer(UINT element_size)
+    : m_buffer{}
+    , m_srv{}
+    , m_element_size{ element_size }
+    , m_capacity{}
+{
+    Check(element_size > 0);
+}
+
+void StructuredBuffer::Upload(ID3D11Device* d3d_dev, ID3D11DeviceContext* d3d_ctx, UINT element_count, const void* elements)
+{
+    // nothing to upload, keep whatever the buffer holds
+    if (element_count == 0) return;
+
+    // grow the buffer (at least doubling its capacity, to avoid re-creating it every frame)
+    if (element_count > m_capacity)
+    {
+        m_capacity = std::max(element_count, m_capacity * 2);
+
+        {
+            D3D11_BUFFER_DESC desc{};
+            desc.ByteWidth = m_capacity * m_element_size;
+            desc.Usage = D3D11_USAGE_DYNAMIC;
+            desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+            desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+            desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+            desc.StructureByteStride = m_element_size;
+            CheckHR(d3d_dev->CreateBuffer(&desc, nullptr, m_buffer.ReleaseAndGetAddressOf()));
+        }
+
+        {
+            D3D11_SHADER_RESOURCE_VIEW_DESC desc{};
+            desc.Format = DXGI_FORMAT_UNKNOWN;
+            desc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+            desc.Buffer.FirstElement = 0;
+            desc.Buffer.NumElements = m_capacity;
+            CheckHR(d3d_dev->CreateShaderResourceView(m_buffer.Get(), &desc, m_srv.ReleaseAndGetAddressOf()));
+        }
+    }
+
+    // upload elements
+    {
+        SubresourceMap map{ d3d_ctx, m_buffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0 };
+        std::memcpy(map.Data(), elements, static_cast<std::size_t>(element_count) * m_element_size);
+    }
+}
+
+class GPUTimer
+{
+public:
+    GPUTimer(ID3D11Device* d3d_dev);
+    ~GPUTimer() = default;
+    GPUTimer(const GPUTimer&) = delete;
+    GPUTimer(GPUTimer&&) noexcept = delete;
+    GPUTimer& operator=(const GPUTimer&) = delete;
+    GPUTimer& operator=(GPUTimer&&) noexcept = delete;
+public:
+    void Start(ID3D11DeviceContext* d3d_ctx);
+    void End(ID3D11DeviceContext* d3d_ctx);
+    float DeltaSec(ID3D11DeviceContext* d3d_ctx); // stalls until the GPU has executed the timed commands
+private:
+    wrl::ComPtr<ID3D11Query> m_disjoint;
+    wrl::ComPtr<ID3D11Query> m_t0;
+    wrl::ComPtr<ID3D11Query> m_t1;
+};
+
+GPUTimer::GPUTimer(ID3D11Device* d3d_dev)
+    : m_disjoint{}
+    , m_t0{}
+    , m_t1{}
+{
+    D3D11_QUERY_DESC desc{};
+    desc.Query = D3D11_QUERY_TIMESTAMP_DISJOINT;
+    CheckHR(d3d_dev->CreateQuery(&desc, m_disjoint.ReleaseAndGetAddressOf()));
+    desc.Query = D3D11_QUERY_TIMESTAMP;
+    CheckHR(d3d_dev->CreateQuery(&desc, m_t0.ReleaseAndGetAddressOf()));
+    CheckHR(d3d_dev->CreateQuery(&desc, m_t1.ReleaseAndGetAddressOf()));
+}
+
+void GPUTimer::Start(ID3D11DeviceContext* d3d_ctx)
+{
+    d3d_ctx->Begin(m_disjoint.Get());
+    d3d_ctx->End(m_t0.Get());
+}
+
+void GPUTimer::End(ID3D11DeviceContext* d3d_ctx)
+{
+    d3d_ctx->End(m_t1.Get());
+    d3d_ctx->End(m_disjoint.Get());
+}
+
+float GPUTimer::DeltaSec(ID3D11DeviceContext* d3d_ctx)
+{
+    D3D11_QUERY_DATA_TIMESTAMP_DISJOINT disjoint{};
+    while (d3d_ctx->GetData(m_disjoint.Get(), &disjoint, sizeof(disjoint), 0) == S_FALSE) {} // busy wait
+
+    UINT64 t0{}, t1{};
+    CheckHR(d3d_ctx->GetData(m_t0.Get(), &t0, sizeof(t0), 0));
+    CheckHR(d3d_ctx->GetData(m_t1.Get(), &t1, sizeof(t1), 0));
+
+    // timestamps are unreliable, if the GPU clock frequency changed while timing
+    if (disjoint.Disjoint) return 0.0f;
+
+    return static_cast<float>(static_cast<double>(t1 - t0) / static_cast<double>(disjoint.Frequency));
+}
+
+class GPUFrameTimer
+{
+public:
+    GPUFrameTimer(ID3D11Device* d3d_dev);
+    ~GPUFrameTimer() = default;
+    GPUFrameTimer(const GPUFrameTimer&) = delete;
+    GPUFrameTimer(GPUFrameTimer&&) noexcept = delete;
+    GPUFrameTimer& operator=(const GPUFrameTimer&) = delete;
+    GPUFrameTimer& operator=(GPUFrameTimer&&) noexcept = delete;
+public:
+    void Start(ID3D11DeviceContext* d3d_ctx);
+    void End(ID3D11DeviceContext* d3d_ctx); // then reads back the frames the GPU has executed, without stalling
+    float DeltaSec() const noexcept { return m_delta_sec; } // of the last frame read back, 0 until the first one
+private:
+    struct Frame
+    {
+        wrl::ComPtr<ID3D11Query> disjoint;
+        wrl::ComPtr<ID3D11Query> t0;
+        wrl::ComPtr<ID3D11Query> t1;
+    };
+private:
+    bool ReadBack(ID3D11DeviceContext* d3d_ctx, Frame& frame, UINT flags); // false while the GPU hasn't executed the frame
+private:
+    std::array<Frame, FRAME_BUDGET_GPU_TIMER_FRAMES> m_frames; // a ring, as GPUTimer each
+    int m_oldest; // first frame not read back yet
+    int m_pending;
+    float m_delta_sec;
+};
+
+GPUFrameTimer::GPUFrameTimer(ID3D11Device* d3d_dev)
+    : m_frames{}
+    , m_oldest{}
+    , m_pending{}
+    , m_delta_sec{}
+{
+    for (Frame& frame : m_frames)
+    {
+        D3D11_QUERY_DESC desc{};
+        desc.Query = D3D11_QUERY_TIMESTAMP_DISJOINT;
+        CheckHR(d3d_dev->CreateQuery(&desc, frame.disjoint.ReleaseAndGetAddressOf()));
+        desc.Query = D3D11_QUERY_TIMESTAMP;
+        CheckHR(d3d_dev->CreateQuery(&desc, frame.t0.ReleaseAndGetAddressOf()));
+        CheckHR(d3d_dev->CreateQuery(&desc, frame.t1.ReleaseAndGetAddressOf()));
+    }
+}
+
+void GPUFrameTimer::Start(ID3D11DeviceContext* d3d_ctx)
+{
+    // the GPU is a whole ring behind: wait for its oldest frame rather than overwrite its queries
+    if (m_pending == FRAME_BUDGET_GPU_TIMER_FRAMES)
+    {
+        while (!ReadBack(d3d_ctx, m_frames[m_oldest], 0)) {} // busy wait
+        m_oldest = (m_oldest + 1) % FRAME_BUDGET_GPU_TIMER_FRAMES;
+        m_pending--;
+    }
+
+    Frame& frame{ m_frames[(m_oldest + m_pending) % FRAME_BUDGET_GPU_TIMER_FRAMES] };
+    d3d_ctx->Begin(frame.disjoint.Get());
+    d3d_ctx->End(frame.t0.Get());
+}
+
+void GPUFrameTimer::End(ID3D11DeviceContext* d3d_ctx)
+{
+    Frame& frame{ m_frames[(m_oldest + m_pending) % FRAME_BUDGET_GPU_TIMER_FRAMES] };
+    d3d_ctx->End(frame.t1.Get());
+    d3d_ctx->End(frame.disjoint.Get());
+    m_pending++;
+
+    // the frames complete in order
+    while (m_pending > 0 && ReadBack(d3d_ctx, m_frames[m_oldest], D3D11_ASYNC_GETDATA_DONOTFLUSH))
+    {
+        m_oldest = (m_oldest + 1) % FRAME_BUDGET_GPU_TIMER_FRAMES;
+        m_pending--;
+    }
+}
+
+bool GPUFrameTimer::ReadBack(ID3D11DeviceContext* d3d_ctx, Frame& frame, UINT flags)
+{
+    D3D11_QUERY_DATA_TIMESTAMP_DISJOINT disjoint{};
+    if (d3d_ctx->GetData(frame.disjoint.Get(), &disjoint, sizeof(disjoint), flags) == S_FALSE) return false;
+
+    UINT64 t0{}, t1{};
+    CheckHR(d3d_ctx->GetData(frame.t0.Get(), &t0, sizeof(t0), 0));
+    CheckHR(d3d_ctx->GetData(frame.t1.Get(), &t1, sizeof(t1), 0));
+
+    // timestamps are unreliable, if the GPU clock frequency changed while timing: keep the previous frame time
+    if (!disjoint.Disjoint)
+    {
+        m_delta_sec = static_cast<float>(static_cast<double>(t1 - t0) / static_cast<double>(disjoint.Frequency));
+    }
+    return true;
+}
+
 static void SetupDXGIInforQueue()
 {
     #if defined(_DEBUG)
@@ -871,300 +965,412 @@ static void RenderImGuiFrame(ID3D11DeviceContext* d3d_ctx, ID3D11RenderTargetVie
 }
 
 // ----------------------------------------------------------------------------
-// Geometry
+// Morton Order
 // ----------------------------------------------------------------------------
 
-struct Ray
+static std::uint32_t ExpandMortonBits(std::uint32_t v)
 {
-    Vector3 origin;
-    Vector3 direction;
-};
+    // insert two zero bits after each of the 10 lowest bits of v
+    v = (v * 0x00010001u) & 0xFF0000FFu;
+    v = (v * 0x00000101u) & 0x0F00F00Fu;
+    v = (v * 0x00000011u) & 0xC30C30C3u;
+    v = (v * 0x00000005u) & 0x49249249u;
+    return v;
+}
 
-struct RayHit
+static std::uint32_t MortonCode(Vector3 position, Vector3 aabb_min, Vector3 aabb_max)
 {
-    bool valid;
-    Vector3 position;
-    Vector3 normal;
-};
+    // 30 bit Morton code of position, quantized on a 1024^3 grid spanning the given aabb
+    auto quantize = [](float v, float min, float max) -> std::uint32_t
+    {
+        float extent{ max - min };
+        float t{ extent > 0.0f ? (v - min) / extent : 0.0f };
+        return static_cast<std::uint32_t>(std::clamp(t * 1024.0f, 0.0f, 1023.0f));
+    };
 
-using RayIntersectFn = RayHit(Ray ray, const Matrix& model, const Matrix& normal);
+    std::uint32_t x{ ExpandMortonBits(quantize(position.x, aabb_min.x, aabb_max.x)) };
+    std::uint32_t y{ ExpandMortonBits(quantize(position.y, aabb_min.y, aabb_max.y)) };
+    std::uint32_t z{ ExpandMortonBits(quantize(position.z, aabb_min.z, aabb_max.z)) };
+    return (x << 2) | (y << 1) | z;
+}
 
-static RayHit RayQuadIntersect(Ray ray, const Matrix& model, const Matrix& normal)
+static void ComputeVPLMortonKeys(std::vector<std::uint64_t>& keys, const std::vector<VirtualLight>& virtual_lights, int point_lights_count)
 {
-    /*
-        ray/quad intersection test in local space
-
-        ray: p(t) = o + td
-        plane p.n + s = 0
-
-        quad in local space lies on z=0 (we know it because we know how the quad mesh has been defined)
-        n: (0,0,1)
-        s: 0
-        plane: p.(0,0,1) = 0
-
-        we plug the ray equation into the plane equation
-
-        (o + td).(0,0,1) = 0
-        o.(0,0,1) + td.(0,0,1) = 0
-        o_z + t * d_z = 0
-        t * d_z = - o_z
-        t = - o_z / d_z
+    // one key per VPL, packing its Morton code (over the VPLs aabb) in the high bits and its index in virtual_lights in the low bits
+    const int first_vpl_idx{ point_lights_count };
+    const int vpl_count{ static_cast<int>(virtual_lights.size()) - first_vpl_idx };
+    keys.resize(std::max(vpl_count, 0));
+    if (vpl_count <= 0) return;
+
+    // VPLs aabb (used for quantizing positions)
+    Vector3 aabb_min{ virtual_lights[first_vpl_idx].position };
+    Vector3 aabb_max{ virtual_lights[first_vpl_idx].position };
+    for (int i{ first_vpl_idx }; i < static_cast<int>(virtual_lights.size()); i++)
+    {
+        aabb_min = Vector3::Min(aabb_min, virtual_lights[i].position);
+        aabb_max = Vector3::Max(aabb_max, virtual_lights[i].position);
+    }
 
-        if d_z != 0 then t exists
-        since we have a ray t must also be >= 0
+    ParallelFor(vpl_count, [&](int i)
+    {
+        int vpl_idx{ first_vpl_idx + i };
+        std::uint64_t code{ MortonCode(virtual_lights[vpl_idx].position, aabb_min, aabb_max) };
+        keys[i] = (code << 32) | static_cast<std::uint32_t>(vpl_idx);
+    });
+}
 
-        if both conditions are met, there is an intersection at point p(t)
+static void RadixSortMortonKeys(std::vector<std::uint64_t>& keys)
+{
+    /*
+        Parallel LSD radix sort of the keys by their Morton code (bits [32;32+MORTON_CODE_BITS)), MORTON_RADIX_BITS per pass.
+        Each pass: every chunk of keys counts its digits, an exclusive scan over (digit, chunk) gives each chunk the output
+        offset of each digit, then each chunk scatters its keys in order.
+        Scattering in order keeps the sort stable, so keys with the same Morton code stay sorted by index.
     */
+    const int count{ static_cast<int>(keys.size()) };
+    if (count <= 1) return;
 
-    RayHit hit{};
+    const int chunk_count{ ParallelChunkCount(count) };
+    auto chunk_begin = [&](int chunk) { return static_cast<int>(static_cast<long long>(count) * chunk / chunk_count); };
 
-    // inverse transform: world -> model
-    Matrix inverse_model{ model.Invert() };
+    std::vector<std::uint64_t> sorted(count);
+    std::vector<int> offsets(static_cast<std::size_t>(chunk_count) * MORTON_RADIX_BUCKETS); // per chunk digit counts, then output offsets
 
-    // transform world space ray into model space ray
+    for (int shift{ 32 }; shift < 32 + MORTON_CODE_BITS; shift += MORTON_RADIX_BITS)
     {
-        Vector4 origin{ ray.origin.x, ray.origin.y, ray.origin.z, 1.0f }; // influenced by translations
-        Vector4 direction{ ray.direction.x, ray.direction.y, ray.direction.z, 0.0f }; // NOT influenced by translations
+        auto digit = [&](std::uint64_t key) { return static_cast<int>((key >> shift) & (MORTON_RADIX_BUCKETS - 1)); };
 
-        origin = Vector4::Transform(origin, inverse_model); // local space ray origin
-        direction = Vector4::Transform(direction, inverse_model); // local space ray direction
-
-        ray.origin = { origin.x, origin.y, origin.z };
-        ray.direction = { direction.x, direction.y, direction.z };
-    }
-
-    // ray/plane intersection in local space
-    if (ray.direction.z != 0)
-    {
-        float t{ -(ray.origin.z) / (ray.direction.z) };
-        if (t > 0) // we ignore hits at the ray's origin
+        // per chunk digit histograms
+        ParallelFor(chunk_count, [&](int chunk)
         {
-            // find hit local space position 
-            Vector3 local_hit{ ray.origin + t * ray.direction };
-
-            // check whether local_hit is within the quad's bounds or not
-            if ((-0.5f <= local_hit.x && local_hit.x <= +0.5f) && (-0.5f <= local_hit.y && local_hit.y <= +0.5f))
+            int* histogram{ &offsets[static_cast<std::size_t>(chunk) * MORTON_RADIX_BUCKETS] };
+            std::fill(histogram, histogram + MORTON_RADIX_BUCKETS, 0);
+            for (int i{ chunk_begin(chunk) }; i < chunk_begin(chunk + 1); i++)
             {
-                hit.valid = true;
-
-                // compute world hit
-                Vector4 world_hit{ Vector4::Transform({local_hit.x, local_hit.y, local_hit.z, 1.0f}, model) };
-                hit.position = { world_hit.x, world_hit.y, world_hit.z };
+                histogram[digit(keys[i])]++;
+            }
+        });
 
-                // compute normal at hit point
-                Vector4 local_normal{ 0.0f, 0.0f, 1.0f, 0.0f }; // NOT influenced by translations
-                Vector4 world_normal{ Vector4::Transform(local_normal, normal) };
-                world_normal.Normalize();
-                hit.normal = { world_normal.x, world_normal.y, world_normal.z };
+        // exclusive scan: keys with a smaller digit go first, then keys with the same digit from the previous chunks
+        int sum{};
+        for (int d{}; d < MORTON_RADIX_BUCKETS; d++)
+        {
+            for (int chunk{}; chunk < chunk_count; chunk++)
+            {
+                int& offset{ offsets[static_cast<std::size_t>(chunk) * MORTON_RADIX_BUCKETS + d] };
+                int digit_count{ offset };
+                offset = sum;
+                sum += digit_count;
             }
         }
-    }
 
-    return hit;
+        // stable scatter
+        ParallelFor(chunk_count, [&](int chunk)
+        {
+            int* offset{ &offsets[static_cast<std::size_t>(chunk) * MORTON_RADIX_BUCKETS] };
+            for (int i{ chunk_begin(chunk) }; i < chunk_begin(chunk + 1); i++)
+            {
+                sorted[offset[digit(keys[i])]++] = keys[i];
+            }
+        });
+
+        keys.swap(sorted);
+    }
 }
 
-static RayHit RayBoxIntersect(Ray ray, const Matrix& model, const Matrix& normal)
+static void SortVPLsByMortonCode(std::vector<VirtualLight>& virtual_lights, int point_lights_count, std::vector<int>& original_indices)
 {
     /*
-        ray/box intersection test in local space
+        Reorder the VPLs along a Morton curve, so that VPLs close in space are also close in memory
+        (per tile and clustered consumers then access them coherently). The point lights keep their indices.
+        original_indices[i] is the index virtual_lights[i] had before sorting, i.e. in light path order.
+    */
+    std::vector<std::uint64_t> keys{};
+    ComputeVPLMortonKeys(keys, virtual_lights, point_lights_count);
+    RadixSortMortonKeys(keys);
 
-        ray: p(t) = o + td
+    original_indices.resize(virtual_lights.size());
+    std::iota(original_indices.begin(), original_indices.begin() + point_lights_count, 0);
 
-        in local space, the box is an AABB from (-0.5, -0.5, -0.5) to (+0.5, +0.5, +0.5)
-        we can consider the box as being made up of three slabs
-        - one slab with normal (0, 0, 1) and shifts -0.5, +0.5
-        - one slab with normal (0, 1, 0) and shifts -0.5, +0.5
-        - one slab with normal (1, 0, 0) and shifts -0.5, +0.5
+    std::vector<VirtualLight> sorted(virtual_lights.size());
+    std::copy(virtual_lights.begin(), virtual_lights.begin() + point_lights_count, sorted.begin());
+    ParallelFor(static_cast<int>(keys.size()), [&](int i)
+    {
+        int vpl_idx{ static_cast<int>(keys[i] & 0xFFFFFFFFu) };
+        sorted[point_lights_count + i] = virtual_lights[vpl_idx];
+        original_indices[point_lights_count + i] = vpl_idx;
+    });
 
-        we use the slab method for finding the ray/box intersection
-        - we intersect the ray with the first slab, finding an interval for t
-        - we intersect the ray with the second slab, finding an interval for t
-        - we intersect the ray with the third slab, finding an interval for t
+    virtual_lights = std::move(sorted);
+}
 
-        if the intersection of the found intervals is not empty, we have an intersection
-    */
+// ----------------------------------------------------------------------------
+// Light Tree
+// ----------------------------------------------------------------------------
+
+/*
+    Binary tree over the VPLs, used for stochastic lightcuts (Yuksel, "Stochastic Lightcuts", 2019).
+    Each shading point walks down the tree and, at each internal node, picks one of the two children with probability
+    proportional to an upper bound of their contribution (power and orientation bounds with the same unattenuated
+    shading as PSLit.hlsl, see PSLightTree.hlsl).
+    The reached leaf is shaded and divided by the product of the picked probabilities, making the estimate unbiased.
+    Point lights are not part of the tree (they are rendered with shadows by their own passes).
+*/
+struct LightTree
+{
+    std::vector<LightTreeNode> nodes;
+    int root{ LIGHT_TREE_NULL_INDEX };
+};
 
-    RayHit hit{};
+static void MergeNormalCones(Vector3 axis_a, float cos_a, Vector3 axis_b, float cos_b, Vector3& axis, float& cos)
+{
+    // smallest cone bounding both cones (Conty Estevez and Kulla, "Importance Sampling of Many Lights with Adaptive Tree Splitting", 2018)
+    constexpr float PI{ std::numbers::pi_v<float> };
 
-    // inverse transform: world -> model
-    Matrix inverse_model{ model.Invert() };
+    float theta_a{ std::acos(std::clamp(cos_a, -1.0f, 1.0f)) };
+    float theta_b{ std::acos(std::clamp(cos_b, -1.0f, 1.0f)) };
+    float theta_d{ std::acos(std::clamp(axis_a.Dot(axis_b), -1.0f, 1.0f)) }; // angle between the axes
 
-    // transform world space ray into model space ray
+    // one cone already contains the other
+    if (std::min(theta_d + theta_b, PI) <= theta_a)
     {
-        Vector4 origin{ ray.origin.x, ray.origin.y, ray.origin.z, 1.0f }; // influenced by translations
-        Vector4 direction{ ray.direction.x, ray.direction.y, ray.direction.z, 0.0f }; // NOT influenced by translations
-
-        origin = Vector4::Transform(origin, inverse_model); // local space ray origin
-        direction = Vector4::Transform(direction, inverse_model); // local space ray direction
+        axis = axis_a;
+        cos = cos_a;
+        return;
+    }
+    if (std::min(theta_d + theta_a, PI) <= theta_b)
+    {
+        axis = axis_b;
+        cos = cos_b;
+        return;
+    }
 
-        ray.origin = { origin.x, origin.y, origin.z };
-        ray.direction = { direction.x, direction.y, direction.z };
+    // the bounding cone covers the whole sphere
+    float theta_o{ 0.5f * (theta_a + theta_d + theta_b) };
+    Vector3 ortho{ axis_b - axis_a * axis_a.Dot(axis_b) }; // direction in which axis_a has to rotate to reach axis_b
+    if (theta_o >= PI || ortho.LengthSquared() <= 0.0f)
+    {
+        axis = axis_a;
+        cos = -1.0f;
+        return;
     }
 
-    /*
-        ray/slab intersection (slab 1)
+    // rotate axis_a towards axis_b, so that the new cone touches the far sides of both cones
+    float theta_r{ theta_o - theta_a };
+    ortho.Normalize();
+    axis = axis_a * std::cos(theta_r) + ortho * std::sin(theta_r);
+    axis.Normalize();
+    cos = std::cos(theta_o);
+}
 
-        slab:
-        p.(0,0,1) - 0.5 = 0
-        p.(0,0,1) + 0.5 = 0
+static LightTreeNode MergeLightTreeNodes(const LightTreeNode& a, const LightTreeNode& b)
+{
+    LightTreeNode node{};
+    node.aabb_min = Vector3::Min(a.aabb_min, b.aabb_min);
+    node.aabb_max = Vector3::Max(a.aabb_max, b.aabb_max);
+    node.power = a.power + b.power;
+    node.light_index = LIGHT_TREE_NULL_INDEX;
+    MergeNormalCones(a.cone_axis, a.cone_cos, b.cone_axis, b.cone_cos, node.cone_axis, node.cone_cos);
+    node.left = LIGHT_TREE_NULL_INDEX;
+    node.right = LIGHT_TREE_NULL_INDEX;
+    return node;
+}
 
-        we plug the ray equation
-
-        (o + t_a * d).(0, 0, 1) - 0.5 = 0
-        o.(0,0,1) + (t_a * d).(0,0,1) - 0.5 = 0
-        o_z + t_a * d_z - 0.5 = 0
-        t_a * d_z = 0.5 - o_z
-        t_a = (0.5 - o_z) / d_z
+static void BuildLightTree(LightTree& tree, const std::vector<VirtualLight>& virtual_lights, int point_lights_count)
+{
+    /*
+        Parallel bottom-up construction.
+        The VPLs are sorted along a Morton curve, so that lights that are close in space are also close in the leaves array.
+        Then, each level of the tree is built merging adjacent pairs of nodes of the level below (in parallel).
+        When a level has an odd number of nodes, the last one is carried up as it is.
+        Leaves store the index of their VPL in virtual_lights.
+    */
 
-        analogously
+    tree.nodes.clear();
+    tree.root = LIGHT_TREE_NULL_INDEX;
 
-        t_b = (-0.5 - o_z) / d_z
+    const int vpl_count{ static_cast<int>(virtual_lights.size()) - point_lights_count };
+    if (vpl_count <= 0) return;
 
-        it is easy to derive the formulas for the other slabs
-    */
+    // sort VPLs by Morton code (each key packs the code in its high bits and the VPL index in its low bits)
+    std::vector<std::uint64_t> keys{};
+    ComputeVPLMortonKeys(keys, virtual_lights, point_lights_count);
+    RadixSortMortonKeys(keys);
 
-    float t_min{ 0.0f }; // intervals intersection lower bound
-    float t_max{ std::numeric_limits<float>::infinity() }; // intervals intersection upper bound
+    // leaves
+    tree.nodes.resize(vpl_count);
+    ParallelFor(vpl_count, [&](int i)
+    {
+        int vpl_idx{ static_cast<int>(keys[i] & 0xFFFFFFFFu) };
+        const VirtualLight& vpl{ virtual_lights[vpl_idx] };
+
+        LightTreeNode& leaf{ tree.nodes[i] };
+        leaf.aabb_min = vpl.position;
+        leaf.aabb_max = vpl.position;
+        leaf.power = vpl.intensity * Luminance(vpl.color);
+        leaf.light_index = vpl_idx;
+        leaf.cone_axis = vpl.normal;
+        leaf.cone_cos = 1.0f;
+        leaf.left = LIGHT_TREE_NULL_INDEX;
+        leaf.right = LIGHT_TREE_NULL_INDEX;
+    });
+
+    // internal nodes, one level at a time
+    int level_begin{};
+    int level_size{ vpl_count };
+    while (level_size > 1)
     {
-        float ray_origin[3]{ ray.origin.x, ray.origin.y, ray.origin.z };
-        float ray_direction[3]{ ray.direction.x, ray.direction.y, ray.direction.z };
+        int pair_count{ level_size / 2 };
+        int next_level_begin{ static_cast<int>(tree.nodes.size()) };
+        int next_level_size{ pair_count + level_size % 2 };
+        tree.nodes.resize(tree.nodes.size() + next_level_size);
 
-        for (int i{}; i < 3; i++) // the hardcoded 3 stands for the three slabs
+        ParallelFor(pair_count, [&](int i)
         {
-            if (ray_direction[i] != 0) // there is an intersection
-            {
-                // find interval
-                float t_a{ (+0.5f - ray_origin[i]) / ray_direction[i] };
-                float t_b{ (-0.5f - ray_origin[i]) / ray_direction[i] };
-
-                // intersect found interval
-                t_min = std::max(t_min, std::min(t_a, t_b));
-                t_max = std::min(t_max, std::max(t_a, t_b));
-            }
-            else // there is no intersection
-            {
-                t_max = t_min; // collapse the intervals intersection into a single value
-            }
-        }
-    }
-
-    if (t_min < t_max) // the ray intersects the box (we ignore single value intervals)
-    {
-        if (t_min > 0) // we ignore hits at the ray's origin
+            int left{ level_begin + 2 * i };
+            int right{ left + 1 };
+            LightTreeNode node{ MergeLightTreeNodes(tree.nodes[left], tree.nodes[right]) };
+            node.left = left;
+            node.right = right;
+            tree.nodes[next_level_begin + i] = node;
+        });
+
+        // carry the odd node up
+        if (level_size % 2 != 0)
         {
-            hit.valid = true;
-
-            // find hit local space position 
-            Vector3 local_hit{ ray.origin + t_min * ray.direction };
-
-            // compute world hit
-            Vector4 world_hit{ Vector4::Transform({local_hit.x, local_hit.y, local_hit.z, 1.0f}, model) };
-            hit.position = { world_hit.x, world_hit.y, world_hit.z };
-
-            // find hit normal
-            {
-                float local_normal[3]{};
-                float hit_position[3]{ local_hit.x, local_hit.y, local_hit.z };
-
-                constexpr float EPSILON{ 0.0001 }; // TODO: hardcoded epsilon
-                for (int i{}; i < 3; i++)
-                {
-                    if (std::abs(std::abs(hit_position[i]) - 0.5f) < EPSILON)
-                    {
-                        local_normal[i] = hit_position[i] > 0.0f ? +1.0f : -1.0f;
-                        break;
-                    }
-                }
-
-                Vector4 world_normal{ Vector4::Transform({local_normal[0], local_normal[1], local_normal[2], 0.0f}, normal) };
-                world_normal.Normalize();
-                hit.normal = { world_normal.x, world_normal.y, world_normal.z };
-            }
+            tree.nodes[next_level_begin + pair_count] = tree.nodes[level_begin + level_size - 1];
         }
+
+        level_begin = next_level_begin;
+        level_size = next_level_size;
     }
 
-    return hit;
+    tree.root = level_begin;
+}
+
+static void BuildLightTreeLights(std::vector<LightConstants>& lights, const std::vector<VirtualLight>& virtual_lights, int point_lights_count, int vpl_type)
+{
+    // GPU side copy of the virtual lights (light tree leaves index this array)
+    lights.resize(virtual_lights.size());
+    ParallelFor(static_cast<int>(virtual_lights.size()), [&](int i)
+    {
+        const VirtualLight& light{ virtual_lights[i] };
+        lights[i] = {};
+        lights[i].world_position = light.position;
+        lights[i].color = light.color;
+        lights[i].intensity = light.intensity;
+        lights[i].normal = light.normal;
+        lights[i].type = (i < point_lights_count) ? LIGHT_TYPE_POINT : vpl_type;
+    });
 }
 
 // ----------------------------------------------------------------------------
-// Scene
+// Frame Budget Controller
 // ----------------------------------------------------------------------------
 
-struct Camera
+/*
+    Picks particles count and VPL budget so that particle simulation plus rendering fit in a target frame time.
+    Each frame it is fed the measured stage times (the CPU time of the particle simulation, the GPU time of the rendering, from
+    timestamp queries read back 1-2 frames late); they are smoothed with an exponential moving average and turned
+    into a per particle and a per VPL cost estimate. From those, the controller derives the particles count that
+    would exactly fill the stage budget and moves a fraction of the way towards it (bounded growth and shrink).
+    The output is held while the stage time is inside a dead band just below the budget, so that measurement noise
+    doesn't make the particles count (and the image) flicker.
+*/
+class FrameBudgetController
 {
-    Vector3 eye;
-    float yaw_deg;
-    float pitch_deg;
-    float fov_deg;
-    float near_plane;
-    float far_plane;
-    Vector3 target;
-};
-
-struct Object
-{
-    std::string name{ "unknown" };
-    Vector3 position{};
-    Vector3 rotation{};
-    Vector3 scaling{ 1.0f, 1.0f, 1.0f };
-    Mesh* mesh{};
-    Vector3 albedo{ 1.0f, 1.0f, 1.0f };
-    RayIntersectFn* ray_intersect_fn{};
-    Matrix model{ Matrix::Identity };
-    Matrix normal{ Matrix::Identity };
+public:
+    FrameBudgetController();
+public:
+    void Reset(int particles_count, int vpl_budget);
+    bool Update(float target_msec, float sim_msec, float rendering_msec, int particles_count, int spawned_vpls, int rendered_vpls);
+    int ParticlesCount() const noexcept { return static_cast<int>(m_particles_count); }
+    int VPLBudget() const noexcept { return static_cast<int>(m_vpl_budget); }
+    float StageMsec() const noexcept { return m_sim_msec + m_rendering_msec; }
+    float StageBudgetMsec() const noexcept { return m_stage_budget_msec; }
+private:
+    bool m_primed;
+    float m_sim_msec;
+    float m_rendering_msec;
+    float m_particle_cost_msec;
+    float m_vpl_cost_msec;
+    float m_vpls_per_particle;
+    float m_stage_budget_msec;
+    float m_particles_count;
+    float m_vpl_budget;
 };
 
-struct PointLight
+FrameBudgetController::FrameBudgetController()
+    : m_primed{}
+    , m_sim_msec{}
+    , m_rendering_msec{}
+    , m_particle_cost_msec{}
+    , m_vpl_cost_msec{}
+    , m_vpls_per_particle{}
+    , m_stage_budget_msec{}
+    , m_particles_count{ static_cast<float>(PARTICLES_COUNT_START) }
+    , m_vpl_budget{ static_cast<float>(VPL_BUDGET_START) }
 {
-    Vector3 position;
-    Vector3 color;
-    float intenisty;
-};
-
-// ----------------------------------------------------------------------------
-// VPL
-// ----------------------------------------------------------------------------
+}
 
-struct LightPathNode
+void FrameBudgetController::Reset(int particles_count, int vpl_budget)
 {
-    Ray ray;
-    RayHit hit;
-    Vector3 ray_color;
-    Vector3 hit_color;
-};
+    m_primed = false;
+    m_particles_count = static_cast<float>(particles_count);
+    m_vpl_budget = static_cast<float>(vpl_budget);
+}
 
-/*
-    Either a point light or a VPL
-*/
-struct VirtualLight
+bool FrameBudgetController::Update(float target_msec, float sim_msec, float rendering_msec, int particles_count, int spawned_vpls, int rendered_vpls)
 {
-    Vector3 position;
-    Vector3 normal;
-    Vector3 color;
-    int bounce;
-};
+    // no measurements yet (e.g. first frame)
+    if (sim_msec <= 0.0f || rendering_msec <= 0.0f || particles_count <= 0) return false;
 
-static Vector3 CompensateVPLColor(int particles_count, float mean_reflectivity, int bounce, Vector3 color)
-{
-    /*
-        Keller corrects each VPL color multiplying it by N / floor(w), where
-        - N is the number of particles/rays we shot from the light source
-        - w = mean_reflectivity^bounce * N
-        here bounce is the number of bounces the ray had to do before hitting the point in which the VPL was spawned
-        Keller spaws N VPLs on the surface of the light source and considers them to be at bounce 0.
-        Then, mean_reflectivity * N rays are cast.
-        Their hit points are at bounce 1, and so on ...
-        In our implementation, we did not spawn N VPLs on the light source.
-        Instead, we simply shot N rays from it.
-        These N rays will hit something.
-        These hits are considered to be at bounce zero.
-    */
-    float num{ static_cast<float>(particles_count) };
-    float den{ static_cast<float>(std::floor(std::pow(mean_reflectivity, bounce) * particles_count)) };
-    Check(den != 0.0f);
-    float compensation{ num / den };
-    Vector3 compensated_color = compensation * color;
-    return compensated_color;
+    int old_particles_count{ ParticlesCount() };
+    int old_vpl_budget{ VPLBudget() };
+
+    // smooth stage times and per unit costs
+    {
+        float particle_cost_msec{ sim_msec / static_cast<float>(particles_count) };
+        float vpl_cost_msec{ rendering_msec / static_cast<float>(std::max(rendered_vpls, 1)) };
+        float vpls_per_particle{ static_cast<float>(spawned_vpls) / static_cast<float>(particles_count) };
+
+        float a{ m_primed ? FRAME_BUDGET_SMOOTHING : 1.0f }; // the first measurement initializes the averages
+        m_sim_msec += a * (sim_msec - m_sim_msec);
+        m_rendering_msec += a * (rendering_msec - m_rendering_msec);
+        m_particle_cost_msec += a * (particle_cost_msec - m_particle_cost_msec);
+        m_vpl_cost_msec += a * (vpl_cost_msec - m_vpl_cost_msec);
+        m_vpls_per_particle += a * (vpls_per_particle - m_vpls_per_particle);
+        m_primed = true;
+    }
+
+    m_stage_budget_msec = target_msec * (1.0f - FRAME_BUDGET_HEADROOM);
+
+    // hold the current output while the stage time is inside the dead band
+    float stage_msec{ StageMsec() };
+    bool over_budget{ stage_msec > m_stage_budget_msec };
+    bool under_budget{ stage_msec < m_stage_budget_msec * (1.0f - FRAME_BUDGET_HYSTERESIS) };
+    if (!over_budget && !under_budget) return false;
+
+    // each particle costs its simulation plus the rendering of the VPLs it spawns
+    float cost_per_particle_msec{ m_particle_cost_msec + m_vpls_per_particle * m_vpl_cost_msec };
+    if (cost_per_particle_msec <= 0.0f) return false;
+    float desired_particles_count{ m_stage_budget_msec / cost_per_particle_msec };
+
+    // move towards the desired particles count, without overshooting in a single frame
+    {
+        float next{ m_particles_count + FRAME_BUDGET_GAIN * (desired_particles_count - m_particles_count) };
+        next = std::clamp(next, m_particles_count * FRAME_BUDGET_MAX_SHRINK, m_particles_count * FRAME_BUDGET_MAX_GROWTH);
+        m_particles_count = std::clamp(next, static_cast<float>(PARTICLES_COUNT_MIN), static_cast<float>(PARTICLES_COUNT_MAX));
+    }
+
+    // the VPL budget leaves room for the VPLs the chosen particles are expected to spawn (plus the dead band)
+    // it only bites when the scene suddenly starts spawning more VPLs per particle
+    {
+        float expected_vpls{ m_particles_count * m_vpls_per_particle * (1.0f + FRAME_BUDGET_HYSTERESIS) };
+        m_vpl_budget = std::clamp(std::ceil(expected_vpls), static_cast<float>(VPL_BUDGET_MIN), static_cast<float>(VPL_BUDGET_MAX));
+    }
+
+    return ParticlesCount() != old_particles_count || VPLBudget() != old_vpl_budget;
 }
 
 // ----------------------------------------------------------------------------
@@ -1189,8 +1395,8 @@ static void Entry()
     // frame buffer
     FrameBuffer frame_buffer{ d3d_dev.Get(), swap_chain.Get() };
 
-    // cube shadow map
-    CubeShadowMap cube_shadow_map{ d3d_dev.Get() };
+    // cube shadow maps (one for each point light, created on first use)
+    std::vector<CubeShadowMap> cube_shadow_maps{};
 
     // viewprot
     D3D11_VIEWPORT viewport{};
@@ -1214,6 +1420,14 @@ static void Entry()
     CheckHR(d3d_dev->CreatePixelShader(PSCubeShadowMap_bytes, sizeof(PSCubeShadowMap_bytes), nullptr, ps_cube_shadow_map.ReleaseAndGetAddressOf()));
     wrl::ComPtr<ID3D11PixelShader> ps_skybox{};
     CheckHR(d3d_dev->CreatePixelShader(PSSkybox_bytes, sizeof(PSSkybox_bytes), nullptr, ps_skybox.ReleaseAndGetAddressOf()));
+    wrl::ComPtr<ID3D11PixelShader> ps_light_tree{};
+    CheckHR(d3d_dev->CreatePixelShader(PSLightTree_bytes, sizeof(PSLightTree_bytes), nullptr, ps_light_tree.ReleaseAndGetAddressOf()));
+    wrl::ComPtr<ID3D11VertexShader> vs_fullscreen{};
+    CheckHR(d3d_dev->CreateVertexShader(VSFullscreen_bytes, sizeof(VSFullscreen_bytes), nullptr, vs_fullscreen.ReleaseAndGetAddressOf()));
+    wrl::ComPtr<ID3D11PixelShader> ps_accumulation{};
+    CheckHR(d3d_dev->CreatePixelShader(PSAccumulation_bytes, sizeof(PSAccumulation_bytes), nullptr, ps_accumulation.ReleaseAndGetAddressOf()));
+    wrl::ComPtr<ID3D11PixelShader> ps_area_light{};
+    CheckHR(d3d_dev->CreatePixelShader(PSAreaLight_bytes, sizeof(PSAreaLight_bytes), nullptr, ps_area_light.ReleaseAndGetAddressOf()));
 
     // input layout
     wrl::ComPtr<ID3D11InputLayout> input_layout{};
@@ -1323,6 +1537,23 @@ static void Entry()
         CheckHR(d3d_dev->CreateBlendState(&desc, bs_sum.ReleaseAndGetAddressOf()));
     }
 
+    // blend state for running averages (the destination is weighted by the blend factor)
+    wrl::ComPtr<ID3D11BlendState> bs_average{};
+    {
+        D3D11_BLEND_DESC desc{};
+        desc.AlphaToCoverageEnable = false;
+        desc.IndependentBlendEnable = false;
+        desc.RenderTarget[0].BlendEnable = true;
+        desc.RenderTarget[0].SrcBlend = D3D11_BLEND_ONE;
+        desc.RenderTarget[0].DestBlend = D3D11_BLEND_BLEND_FACTOR;
+        desc.RenderTarget[0].BlendOp = D3D11_BLEND_OP_ADD;
+        desc.RenderTarget[0].SrcBlendAlpha = D3D11_BLEND_ONE;
+        desc.RenderTarget[0].DestBlendAlpha = D3D11_BLEND_ZERO;
+        desc.RenderTarget[0].BlendOpAlpha = D3D11_BLEND_OP_ADD;
+        desc.RenderTarget[0].RenderTargetWriteMask = D3D11_COLOR_WRITE_ENABLE_ALL;
+        CheckHR(d3d_dev->CreateBlendState(&desc, bs_average.ReleaseAndGetAddressOf()));
+    }
+
     // depth stencil state for depth testing pass only with equal depth
     wrl::ComPtr<ID3D11DepthStencilState> ds_equal{};
     {
@@ -1399,6 +1630,49 @@ static void Entry()
         CheckHR(d3d_dev->CreateBuffer(&desc, nullptr, cb_shadow.ReleaseAndGetAddressOf()));
     }
 
+    // light tree constant buffer
+    wrl::ComPtr<ID3D11Buffer> cb_light_tree{};
+    {
+        D3D11_BUFFER_DESC desc{};
+        desc.ByteWidth = sizeof(LightTreeConstants);
+        desc.Usage = D3D11_USAGE_DYNAMIC;
+        desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+        desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+        desc.MiscFlags = 0;
+        desc.StructureByteStride = 0;
+        CheckHR(d3d_dev->CreateBuffer(&desc, nullptr, cb_light_tree.ReleaseAndGetAddressOf()));
+    }
+
+    // accumulation constant buffer
+    wrl::ComPtr<ID3D11Buffer> cb_accumulation{};
+    {
+        D3D11_BUFFER_DESC desc{};
+        desc.ByteWidth = sizeof(AccumulationConstants);
+        desc.Usage = D3D11_USAGE_DYNAMIC;
+        desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+        desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+        desc.MiscFlags = 0;
+        desc.StructureByteStride = 0;
+        CheckHR(d3d_dev->CreateBuffer(&desc, nullptr, cb_accumulation.ReleaseAndGetAddressOf()));
+    }
+
+    // area light constant buffer
+    wrl::ComPtr<ID3D11Buffer> cb_area_light{};
+    {
+        D3D11_BUFFER_DESC desc{};
+        desc.ByteWidth = sizeof(AreaLightConstants);
+        desc.Usage = D3D11_USAGE_DYNAMIC;
+        desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+        desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+        desc.MiscFlags = 0;
+        desc.StructureByteStride = 0;
+        CheckHR(d3d_dev->CreateBuffer(&desc, nullptr, cb_area_light.ReleaseAndGetAddressOf()));
+    }
+
+    // light tree nodes and lights buffers
+    StructuredBuffer light_tree_node_buffer{ sizeof(LightTreeNode) };
+    StructuredBuffer light_tree_light_buffer{ sizeof(LightConstants) };
+
     // line vertex buffer
     wrl::ComPtr<ID3D11Buffer> vb_line{};
     {
@@ -1413,8 +1687,10 @@ static void Entry()
     }
 
     // meshes
-    Mesh quad_mesh{ Mesh::Quad(d3d_dev.Get()) };
-    Mesh cube_mesh{ Mesh::Cube(d3d_dev.Get()) };
+    Mesh quad_mesh{ Mesh::Quad() };
+    Mesh cube_mesh{ Mesh::Cube() };
+    quad_mesh.Upload(d3d_dev.Get());
+    cube_mesh.Upload(d3d_dev.Get());
 
     // ImGui handle
     ImGuiHandle imgui_handle{ window, d3d_dev.Get(), d3d_ctx.Get() };
@@ -1434,152 +1710,201 @@ static void Entry()
     float cube_shadow_map_max_dynamic_bias{ CUBE_SHADOW_MAP_MAX_DYNAMIC_BIAS_START };
     int pcf_samples{ CUBE_SHADOW_MAP_PCF_SAMPLES_START };
     float pcf_offset_scale{ CUBE_SHADOW_MAP_PCF_OFFSET_SCALE_START };
+    int vpl_budget{ VPL_BUDGET_START };
+    int vpl_budget_sampling{ VPL_BUDGET_SAMPLING_POWER };
+    bool frame_budget_enabled{};
+    float frame_budget_target_msec{ FRAME_BUDGET_TARGET_MSEC_START };
+    bool light_tree_enabled{};
+    int light_tree_samples{ LIGHT_TREE_SAMPLES_START };
+    bool run_light_tree_benchmark{};
+    bool vpl_rotation_enabled{};
+    int vpl_rotation_subsets{ VPL_ROTATION_SUBSETS_START };
+    bool metropolis_enabled{};
+    bool morton_order_enabled{ true };
+    bool vpl_bake_enabled{};
+    int vpl_bake_lookup{ VPL_BAKE_LOOKUP_TRILINEAR };
+    int vpl_bake_lattice_size{ VPL_BAKE_LATTICE_SIZE_START };
+    bool run_vpl_bake{};
+    bool run_metropolis_benchmark{};
+    bool restir_enabled{};
+    int restir_candidates{ RESTIR_CANDIDATES_START };
+    int restir_spatial_neighbours{ RESTIR_SPATIAL_NEIGHBOURS_START };
+    float restir_spatial_radius{ RESTIR_SPATIAL_RADIUS_START };
+    bool restir_temporal_reuse{ true };
+    bool progressive_enabled{};
+    float progressive_threshold{ PROGRESSIVE_THRESHOLD_START };
 
     // controls configuration variables
     bool invert_camera_mouse_x{};
     bool invert_camera_mouse_y{};
 
-    // uniform distribution between [0, 1)
-    std::uniform_real_distribution<float> dis{ 0.0f, 1.0f };
-
     // scene camera
     Camera camera{};
-    camera.eye = { 0.0f, 2.0f, 10.0f };
-    camera.yaw_deg = CAMERA_START_YAW_DEG;
-    camera.pitch_deg = CAMERA_START_PITCH_DEG;
     camera.fov_deg = CAMERA_FOV_DEG;
     camera.near_plane = CAMERA_NEAR_PLANE;
     camera.far_plane = CAMERA_FAR_PLANE;
-    camera.target = {};
-
-    // scene point light
-    PointLight point_light{};
-    point_light.position = { 0.0f, 3.25f, 1.0f };
-    point_light.color = { 1.0f, 1.0f, 1.0f };
-    point_light.intenisty = POINT_LIGHT_START_INTENSITY;
 
-    // scene objects
+    // scene point lights and objects
+    std::vector<PointLight> point_lights{};
+    int selected_point_light{};
     std::vector<Object> objects{};
-    {
-        Object& obj{ objects.emplace_back() };
-        obj.name = "Left Cube";
-        obj.position = { -0.40f, 1.35f, -0.75f };
-        obj.rotation = { 0.0f, 20.0f, 0.0f };
-        obj.scaling = { 1.5f, 2.75f, 1.0f };
-        obj.mesh = &cube_mesh;
-        obj.albedo = { 1.0f, 1.0f, 1.0f };
-        obj.ray_intersect_fn = RayBoxIntersect;
-    }
-    {
-        Object& obj{ objects.emplace_back() };
-        obj.name = "Right Cube";
-        obj.position = { 1.0f, 0.61f, 1.15f };
-        obj.rotation = { 0.0f, -15.0f, 0.0f };
-        obj.scaling = { 1.25f, 1.25f, 1.25f };
-        obj.mesh = &cube_mesh;
-        obj.albedo = { 1.0f, 1.0f, 1.0f };
-        obj.ray_intersect_fn = RayBoxIntersect;
-    }
-    {
-        Object& obj{ objects.emplace_back() };
-        obj.name = "Floor";
-        obj.position = {};
-        obj.rotation = { 270.0f, 0.0f, 0.0f };
-        obj.scaling = { 4.0f, 4.0f, 1.0f };
-        obj.mesh = &quad_mesh;
-        obj.albedo = { 1.0f, 1.0f, 1.0f };
-        obj.ray_intersect_fn = RayQuadIntersect;
-    }
-    {
-        Object& obj{ objects.emplace_back() };
-        obj.name = "Cieling";
-        obj.position = { 0.0f, 4.0f, 0.0f };
-        obj.rotation = { 90.0f, 0.0f, 0.0f };
-        obj.scaling = { 4.0f, 4.0f, 1.0f };
-        obj.mesh = &quad_mesh;
-        obj.albedo = { 1.0f, 1.0f, 1.0f };
-        obj.ray_intersect_fn = RayQuadIntersect;
-    }
-    {
-        Object& obj{ objects.emplace_back() };
-        obj.name = "Left Wall";
-        obj.position = { -2.0f, 2.0f, 0.0f };
-        obj.rotation = { 0.0f, 90.0f, 0.0f };
-        obj.scaling = { 4.0f, 4.0f, 1.0f };
-        obj.mesh = &quad_mesh;
-        obj.albedo = { 1.0f, 0.0f, 0.0f };
-        obj.ray_intersect_fn = RayQuadIntersect;
-    }
-    {
-        Object& obj{ objects.emplace_back() };
-        obj.name = "Right Wall";
-        obj.position = { 2.0f, 2.0f, 0.0f };
-        obj.rotation = { 0.0f, 270.0f, 0.0f };
-        obj.scaling = { 4.0f, 4.0f, 1.0f };
-        obj.mesh = &quad_mesh;
-        obj.albedo = { 0.0f, 1.0f, 0.0f };
-        obj.ray_intersect_fn = RayQuadIntersect;
-    }
-    {
-        Object& obj{ objects.emplace_back() };
-        obj.name = "Back Wall";
-        obj.position = { 0.0f, 2.0f, -2.0f };
-        obj.rotation = { 0.0f, 0.0f, 0.0f };
-        obj.scaling = { 4.0f, 4.0f, 1.0f };
-        obj.mesh = &quad_mesh;
-        obj.albedo = { 1.0f, 1.0f, 1.0f };
-        obj.ray_intersect_fn = RayQuadIntersect;
-    }
-    {
-        Object& obj{ objects.emplace_back() };
-        obj.name = "Front Wall";
-        obj.position = { 0.0f, 2.0f, 2.0f };
-        obj.rotation = { 0.0f, 180.0f, 0.0f };
-        obj.scaling = { 4.0f, 4.0f, 1.0f };
-        obj.mesh = &quad_mesh;
-        obj.albedo = { 1.0f, 1.0f, 1.0f };
-        obj.ray_intersect_fn = RayQuadIntersect;
-    }
+    int selected_scene{ SCENE_CORNELL_BOX };
+    BuildCornellBoxScene(objects, point_lights, camera, &quad_mesh, &cube_mesh);
+    ValidateSceneObjects(objects);
 
     // light paths
     std::vector<std::vector<LightPathNode>> light_paths{};
+    std::vector<float> light_path_weights{}; // Metropolis light paths only
 
-    // virtual lights (main point light + VPLs)
+    // particles sources (point lights + emissive quads)
+    Emitters emitters{};
+
+    // virtual lights (point lights + VPLs)
     std::vector<VirtualLight> virtual_lights{};
+    int point_lights_count{}; // number of point lights at the start of virtual_lights
+    int spawned_vpls_count{}; // number of VPLs spawned by the particle simulation (before applying the VPL budget)
+    std::vector<int> vpl_original_indices{}; // index of each virtual light in light path order (before sorting them in Morton order)
 
-    // validate scene objects: no two objects can have the same name
+    // time data
+    const LARGE_INTEGER performance_counter_frequency{ GetWin32PerformanceFrequency() };
+    LARGE_INTEGER frame_timestamp{ GetWin32PerformanceCounter() };
+    float frame_t_sec{};
+    float frame_dt_sec{};
+
+    Timer particle_sim_timer{};
+    Timer rendering_timer{};
+    GPUFrameTimer rendering_gpu_timer{ d3d_dev.Get() }; // the frame budget controller is fed the GPU time of the rendering
+
+    // adaptive particles count and VPL budget
+    FrameBudgetController frame_budget_controller{};
+
+    // light tree over the VPLs (stochastic lightcuts)
+    LightTree light_tree{};
+    std::vector<LightConstants> light_tree_lights{};
+    Timer light_tree_timer{};
+
+    // VPL sets baked over a lattice of point light positions (loaded from the previous run, when there is one)
+    VPLBake vpl_bake{};
+    vpl_bake.Load(VPL_BAKE_FILE_PATH);
+    bool vpl_bake_valid{}; // the bake matches the current scene and configuration
+
+    // Metropolis instant radiosity
+    std::vector<CameraSample> camera_samples{};
+    MetropolisStats metropolis_stats{};
+
+    // VPL subsets accumulated across frames
+    RenderTarget accumulation_buffer{}; // created on first use, destroyed on resize
+    std::size_t accumulation_state_hash{};
+    int accumulated_vpl_subsets{};
+
+    // progressive accumulation of static views, each frame with its own seed
+    RenderTarget progressive_buffer{}; // running average of the frames, created on first use, destroyed on resize
+    RenderTarget progressive_odd_buffer{}; // running average of the odd frames (second, fourth...), its difference estimates the error
+    RenderTarget progressive_frame{}; // the scene passes render here instead of the back buffer, which would clamp and quantize the frame
+    ReadbackTexture progressive_readback{};
+    std::vector<Vector4> progressive_average{}; // read back at the last convergence check
+    std::vector<Vector4> progressive_odd_average{};
+    std::size_t progressive_state_hash{};
+    int progressive_frames{};
+    float progressive_error{}; // relative RMS standard error of the average at the last convergence check
+    bool progressive_converged{}; // no more simulation and rendering, the average is re-presented
+    int frame_seed{}; // seed of the current frame
+
+    // render target of the scene passes (the back buffer, or progressive_frame while static views are averaged)
+    ID3D11RenderTargetView* scene_rtv{};
+
+    // VPLs shaded on the CPU by per pixel reservoir resampling
+    ReSTIRRenderer restir_renderer{};
+    DynamicTexture restir_image{}; // created on first use, destroyed on resize
+    std::size_t restir_vpls_hash{};
+    std::uint32_t restir_frame{};
+    Timer restir_timer{};
+
+    // blend a window sized texture (times scale) into a render target (expects the final render pipeline state to be set, and restores it)
+    auto render_fullscreen = [&](ID3D11ShaderResourceView* srv, float scale, ID3D11RenderTargetView* rtv, ID3D11BlendState* blend_state, const float* blend_factor)
     {
-        std::unordered_set<std::string> object_names{};
-        for (const Object& obj : objects)
+        // upload accumulation constants
         {
-            if (object_names.contains(obj.name))
-            {
-                Crash(std::format("two or more scene objects have the same name '{}'", obj.name));
-            }
-            else
-            {
-                object_names.emplace(obj.name);
-            }
+            SubresourceMap map{ d3d_ctx.Get(), cb_accumulation.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0 };
+            auto constants{ static_cast<AccumulationConstants*>(map.Data()) };
+            constants->scale = scale;
+        }
+
+        // set pipeline state
+        {
+            ID3D11ShaderResourceView* srvs[]{ srv };
+            d3d_ctx->IASetInputLayout(nullptr);
+            d3d_ctx->VSSetShader(vs_fullscreen.Get(), nullptr, 0);
+            d3d_ctx->PSSetShader(ps_accumulation.Get(), nullptr, 0);
+            d3d_ctx->OMSetBlendState(blend_state, blend_factor, 0XFFFFFFFF);
+            d3d_ctx->OMSetRenderTargets(1, &rtv, nullptr); // no depth test, the fullscreen triangle covers every pixel
+            d3d_ctx->PSSetShaderResources(3, std::size(srvs), srvs); // after the render target, as the texture may still be bound as the previous one
         }
-    }
 
-    // validate scene objects: all objects must be able to intersect with a ray
-    for (const Object& obj : objects)
+        // draw
+        d3d_ctx->Draw(3, 0);
+
+        // restore final render pipeline state
+        {
+            ID3D11ShaderResourceView* srvs[]{ nullptr }; // the texture may be bound as render target again (accumulation buffer, progressive frame)
+            d3d_ctx->PSSetShaderResources(3, std::size(srvs), srvs);
+            d3d_ctx->IASetInputLayout(input_layout.Get());
+            d3d_ctx->VSSetShader(vs.Get(), nullptr, 0);
+            d3d_ctx->OMSetRenderTargets(1, &scene_rtv, frame_buffer.DepthBufferDSV());
+        }
+    };
+
+    // add a window sized texture (times scale) to the scene render target (expects the final render pipeline state to be set, and restores it)
+    auto render_fullscreen_sum = [&](ID3D11ShaderResourceView* srv, float scale)
     {
-        if (!obj.ray_intersect_fn)
+        render_fullscreen(srv, scale, scene_rtv, bs_sum.Get(), nullptr);
+    };
+
+    // render the contribution of all the VPLs of a light tree in a single pass (expects the final render pipeline state to be set)
+    auto render_light_tree = [&](const LightTree& tree, const std::vector<LightConstants>& lights)
+    {
+        // upload light tree
         {
-            Crash(std::format("object '{}' doesn't support ray intersection", obj.name));
+            light_tree_node_buffer.Upload(d3d_dev.Get(), d3d_ctx.Get(), static_cast<UINT>(tree.nodes.size()), tree.nodes.data());
+            light_tree_light_buffer.Upload(d3d_dev.Get(), d3d_ctx.Get(), static_cast<UINT>(lights.size()), lights.data());
+
+            SubresourceMap map{ d3d_ctx.Get(), cb_light_tree.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0 };
+            auto constants{ static_cast<LightTreeConstants*>(map.Data()) };
+            constants->root = tree.root;
+            constants->samples = light_tree_samples;
+            constants->seed = frame_seed;
+            constants->vpl_type = selected_vpl_type;
         }
-    }
 
-    // time data
-    const LARGE_INTEGER performance_counter_frequency{ GetWin32PerformanceFrequency() };
-    LARGE_INTEGER frame_timestamp{ GetWin32PerformanceCounter() };
-    float frame_t_sec{};
-    float frame_dt_sec{};
+        // set pipeline state
+        {
+            ID3D11ShaderResourceView* srvs[]{ light_tree_node_buffer.SRV(), light_tree_light_buffer.SRV() };
+            d3d_ctx->PSSetShaderResources(1, std::size(srvs), srvs);
+            d3d_ctx->PSSetShader(ps_light_tree.Get(), nullptr, 0);
+            d3d_ctx->OMSetBlendState(bs_sum.Get(), nullptr, 0XFFFFFFFF);
+            d3d_ctx->OMSetDepthStencilState(ds_equal.Get(), 0);
+        }
 
-    Timer particle_sim_timer{};
-    Timer rendering_timer{};
+        // render each object
+        for (const Object& obj : objects)
+        {
+            // upload object constants
+            {
+                SubresourceMap map{ d3d_ctx.Get(), cb_object.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0 };
+                auto constants{ static_cast<ObjectConstants*>(map.Data()) };
+                constants->model = obj.model;
+                constants->normal = obj.normal;
+                constants->albedo = obj.albedo;
+            }
+
+            // set pipeline state
+            d3d_ctx->IASetIndexBuffer(obj.mesh->Indices(), obj.mesh->IndexFormat(), 0);
+            d3d_ctx->IASetVertexBuffers(0, 1, obj.mesh->Vertices(), obj.mesh->Stride(), obj.mesh->Offset());
+
+            // draw
+            d3d_ctx->DrawIndexed(obj.mesh->IndexCount(), 0, 0);
+        }
+    };
 
     // main loop
     {
@@ -1622,6 +1947,14 @@ static void Entry()
                     // destroy frame buffer
                     frame_buffer = {};
 
+                    // destroy accumulation buffers and ReSTIR image (they will be re-created with the new size)
+                    accumulation_buffer = {};
+                    progressive_buffer = {};
+                    progressive_odd_buffer = {};
+                    progressive_frame = {};
+                    progressive_readback = {};
+                    restir_image = {};
+
                     // resize swap chain
                     CheckHR(swap_chain->ResizeBuffers(0, window_w, window_h, DXGI_FORMAT_UNKNOWN, 0));
 
@@ -1645,15 +1978,7 @@ static void Entry()
                         }
 
                         // compute camera forward from yaw and pitch
-                        Vector3 camera_forward{};
-                        {
-                            const float yaw_rad{ DirectX::XMConvertToRadians(camera.yaw_deg) };
-                            const float pitch_rad{ DirectX::XMConvertToRadians(camera.pitch_deg) };
-                            camera_forward.x = std::cos(yaw_rad) * std::cos(pitch_rad);
-                            camera_forward.y = std::sin(pitch_rad);
-                            camera_forward.z = std::sin(yaw_rad) * std::cos(pitch_rad);
-                            camera_forward.Normalize();
-                        }
+                        Vector3 camera_forward{ CameraForward(camera.yaw_deg, camera.pitch_deg) };
 
                         Vector3 camera_right{ camera_forward.Cross({0.0f, 1.0f, 0.0f}) };
                         camera_right.Normalize();
@@ -1688,26 +2013,32 @@ static void Entry()
                     // update object model and normal matrices (any change to the object's transform MUST happen BEFORE this)
                     for (Object& obj : objects)
                     {
-                        Vector3 rotation_rad{};
-                        rotation_rad.x = DirectX::XMConvertToRadians(obj.rotation.x);
-                        rotation_rad.y = DirectX::XMConvertToRadians(obj.rotation.y);
-                        rotation_rad.z = DirectX::XMConvertToRadians(obj.rotation.z);
-
-                        Matrix translate{ Matrix::CreateTranslation(obj.position) };
-                        Matrix rotate{ Matrix::CreateFromYawPitchRoll(rotation_rad) };
-                        Matrix scale{ Matrix::CreateScale(obj.scaling) };
-                        Matrix model{ scale * rotate * translate };
-                        Matrix normal{ scale * rotate };
-                        normal.Invert();
-                        normal.Transpose();
-
-                        obj.model = model;
-                        obj.normal = normal;
+                        UpdateObjectMatrices(obj);
+                    }
+
+                    // let the frame budget controller pick particles count and VPL budget (based on the stage times of the previous
+                    // frame, and the GPU rendering time of the last frame the GPU has executed, 1-2 frames earlier)
+                    // (not while a static view is accumulated, changing the particles count would start it over)
+                    if (frame_budget_enabled && progressive_frames == 0)
+                    {
+                        float sim_msec{ particle_sim_timer.DeltaSec() * 1000.0f };
+                        float rendering_msec{ rendering_gpu_timer.DeltaSec() * 1000.0f };
+                        int rendered_vpls_count{ static_cast<int>(virtual_lights.size()) - point_lights_count };
+                        if (frame_budget_controller.Update(frame_budget_target_msec, sim_msec, rendering_msec, particles_count, spawned_vpls_count, rendered_vpls_count))
+                        {
+                            std::println(
+                                "frame budget: {:.2f}/{:.2f} msec -> particles: {}, VPL budget: {}",
+                                frame_budget_controller.StageMsec(), frame_budget_controller.StageBudgetMsec(),
+                                frame_budget_controller.ParticlesCount(), frame_budget_controller.VPLBudget()
+                            );
+                        }
+                        particles_count = frame_budget_controller.ParticlesCount();
+                        vpl_budget = frame_budget_controller.VPLBudget();
                     }
 
                     // validate configuration variables
                     {
-                        particles_count = std::clamp(particles_count, PARTICLES_COUNT_MIN, PARTICLES_COUNT_MAX);
+                        particles_count = std::clamp(particles_count, PARTICLES_COUNT_MIN, light_tree_enabled ? LIGHT_TREE_PARTICLES_COUNT_MAX : PARTICLES_COUNT_MAX);
                         mean_reflectivity = std::clamp(mean_reflectivity, MEAN_REFLECTIVITY_MIN, MEAN_REFLECTIVITY_MAX);
                         selected_light_path_index = std::clamp(selected_light_path_index, MIN_SELECTED_LIGHT_PATH_INDEX, static_cast<int>(light_paths.size()) - 1);
                         selected_light_index = std::clamp(selected_light_index, MIN_SELECTED_LIGHT_INDEX, static_cast<int>(virtual_lights.size()) - 1);
@@ -1715,167 +2046,188 @@ static void Entry()
                         cube_shadow_map_max_dynamic_bias = std::clamp(cube_shadow_map_max_dynamic_bias, CUBE_SHADOW_MAP_BIAS_MIN, CUBE_SHADOW_MAP_BIAS_MAX);
                         pcf_samples = std::clamp(pcf_samples, CUBE_SHADOW_MAP_PCF_SAMPLES_MIN, CUBE_SHADOW_MAP_PCF_SAMPLES_MAX);
                         pcf_offset_scale = std::clamp(pcf_offset_scale, CUBE_SHADOW_MAP_PCF_OFFSET_SCALE_MIN, CUBE_SHADOW_MAP_PCF_OFFSET_SCALE_MAX);
+                        vpl_budget = std::clamp(vpl_budget, VPL_BUDGET_MIN, VPL_BUDGET_MAX);
+                        restir_candidates = std::clamp(restir_candidates, RESTIR_CANDIDATES_MIN, RESTIR_CANDIDATES_MAX);
+                        restir_spatial_neighbours = std::clamp(restir_spatial_neighbours, RESTIR_SPATIAL_NEIGHBOURS_MIN, RESTIR_SPATIAL_NEIGHBOURS_MAX);
+                        restir_spatial_radius = std::clamp(restir_spatial_radius, RESTIR_SPATIAL_RADIUS_MIN, RESTIR_SPATIAL_RADIUS_MAX);
+                        frame_budget_target_msec = std::clamp(frame_budget_target_msec, FRAME_BUDGET_TARGET_MSEC_MIN, FRAME_BUDGET_TARGET_MSEC_MAX);
+                        light_tree_samples = std::clamp(light_tree_samples, LIGHT_TREE_SAMPLES_MIN, LIGHT_TREE_SAMPLES_MAX);
+                        vpl_rotation_subsets = std::clamp(vpl_rotation_subsets, VPL_ROTATION_SUBSETS_MIN, VPL_ROTATION_SUBSETS_MAX);
+                        vpl_bake_lattice_size = std::clamp(vpl_bake_lattice_size, VPL_BAKE_LATTICE_SIZE_MIN, VPL_BAKE_LATTICE_SIZE_MAX);
+                        selected_point_light = std::clamp(selected_point_light, 0, static_cast<int>(point_lights.size()) - 1);
+                        progressive_threshold = std::clamp(progressive_threshold, PROGRESSIVE_THRESHOLD_MIN, PROGRESSIVE_THRESHOLD_MAX);
                     }
 
-                    particle_sim_timer.Start();
-
-                    // start new light paths by shooting random rays from the point light
+                    // progressive accumulation starts over when anything affecting the frame changed
+                    if (progressive_enabled)
                     {
-                        light_paths.clear(); // forget the previous frame's light paths
-
-                        // generate random ray direction from random positions on a unit sphere
+                        std::size_t state_hash{ HashScene(camera, point_lights, objects) };
+                        HashCombine(state_hash, window_w);
+                        HashCombine(state_hash, window_h);
+                        HashCombine(state_hash, seed);
+                        HashCombine(state_hash, particles_count);
+                        HashCombine(state_hash, mean_reflectivity);
+                        HashCombine(state_hash, selected_light_index);
+                        HashCombine(state_hash, selected_vpl_type);
+                        HashCombine(state_hash, cube_shadow_map_static_bias);
+                        HashCombine(state_hash, cube_shadow_map_max_dynamic_bias);
+                        HashCombine(state_hash, pcf_samples);
+                        HashCombine(state_hash, pcf_offset_scale);
+                        HashCombine(state_hash, vpl_budget);
+                        HashCombine(state_hash, vpl_budget_sampling);
+                        HashCombine(state_hash, light_tree_enabled);
+                        HashCombine(state_hash, light_tree_samples);
+                        HashCombine(state_hash, metropolis_enabled);
+                        HashCombine(state_hash, vpl_bake_enabled);
+                        HashCombine(state_hash, vpl_bake_lookup);
+                        HashCombine(state_hash, restir_enabled);
+                        HashCombine(state_hash, restir_candidates);
+                        HashCombine(state_hash, restir_spatial_neighbours);
+                        HashCombine(state_hash, restir_spatial_radius);
+                        HashCombine(state_hash, restir_temporal_reuse);
+
+                        if (state_hash != progressive_state_hash)
                         {
-                            std::mt19937 generator{ static_cast<unsigned>(seed) };
-
-                            for (int i{}; i < particles_count; i++)
-                            {
-                                float theta{ 2.0f * static_cast<float>(std::numbers::pi) * dis(generator) }; // azimuthal angle (0 to 2π)
-                                float z{ 2.0f * dis(generator) - 1.0f }; // z-coordinate (-1 to 1)
-                                float r{ sqrt(1.0f - z * z) }; // radius at that z
-
-                                float x{ r * cos(theta) };
-                                float y{ r * sin(theta) };
-
-                                Ray ray{};
-                                ray.origin = point_light.position;
-                                ray.direction = { x, y, z };
-
-                                // generate new light path with randomly generated starting ray
-                                std::vector<LightPathNode>& light_path{ light_paths.emplace_back() };
-                                LightPathNode start{};
-                                start.ray = ray;
-                                start.ray_color = point_light.color;
-                                light_path.emplace_back(start);
-                            }
+                            progressive_state_hash = state_hash;
+                            progressive_frames = 0;
+                            progressive_error = 0.0f;
+                            progressive_converged = false;
                         }
                     }
-
-                    // build light paths by intersecting rays with the scene geometry and eventually making them bounce
+                    else
                     {
-                        for (int i{}; i < static_cast<int>(light_paths.size()); i++)
-                        {
-                            std::vector<LightPathNode>& light_path{ light_paths[i] }; // light path we are building
-
-                            int bounce{}; // counter for the number of ray bounces
-                            bool last_ray_hit_something{ true };
-
-                            /*
-                                This while loop deals with ray bounce logic.
-                                Keller tells us that:
-                                - the first mean_reflectivity^1 * N rays bounce at least once.
-                                - the first mean_reflectivity^2 * N rays bounce at least twice.
-                                - the first mean_reflectivity^3 * N rays bounce at least trice.
-                                - ...
-                                - the first mean_reflectivity^j * N rays bounce at least j times.
-                                - and so on ...
-                            */
-                            while (i < static_cast<int>(std::pow(mean_reflectivity, bounce) * particles_count) && last_ray_hit_something)
-                            {
-                                Ray ray{ light_path.back().ray }; // starting ray
-                                RayHit closest{}; // closest ray hit
-                                const Object* closest_obj{}; // closest object hit
+                        progressive_state_hash = {};
+                        progressive_frames = 0;
+                        progressive_converged = false;
+                    }
 
-                                for (const Object& obj : objects) // test each object for ray intersection
-                                {
-                                    RayHit hit{ obj.ray_intersect_fn(ray, obj.model, obj.normal) };
-                                    if (hit.valid) // there is an intersection point
-                                    {
-                                        // check if the current hit is closer than the closest hit recorded up until now
-                                        if (!closest.valid) // cloeset hit up until now is not valid
-                                        {
-                                            // current hit is closer
-                                            closest = hit;
-                                            closest_obj = &obj;
-                                        }
-                                        else // cloeset hit up until now is valid
-                                        {
-                                            // we need to compare the distance between both hits and the ray origin
-                                            Vector3 o_closest{ closest.position - ray.origin }; // from ray origin to closest hit position
-                                            Vector3 o_hit{ hit.position - ray.origin }; // from ray origin to current hit position
-                                            float d_o_closest{ o_closest.Dot(o_closest) }; // squared adistance between ray origin and closest hit 
-                                            float d_o_hit{ o_hit.Dot(o_hit) }; // squared adistance between ray origin and current hit 
-                                            if (d_o_hit < d_o_closest)
-                                            {
-                                                // current hit is closer than closest hit
-                                                closest = hit;
-                                                closest_obj = &obj;
-                                            }
-                                        }
-                                    }
-                                }
+                    // a static view is averaged over frames with different seeds (the UI seed is the one of the first frame)
+                    frame_seed = seed + progressive_frames;
 
-                                if (closest.valid) // the ray hit something
-                                {
-                                    // compute ray reflection
-                                    Vector3 reflection{ Vector3::Reflect(ray.direction, closest.normal) };
-                                    Ray reflected_ray{ closest.position, reflection };
+                    particle_sim_timer.Start();
 
-                                    // compute hit albedo attenuating the ray's color by the object's albedo divided by PI
-                                    Vector3 hit_color{ light_path.back().ray_color * (closest_obj->albedo / std::numbers::pi_v<float>) };
+                    // start new light paths by shooting random rays from the point lights and the emissive quads
+                    point_lights_count = static_cast<int>(point_lights.size());
+                    BuildEmitters(emitters, point_lights, objects);
 
-                                    // record current ray hit into the light path
-                                    light_path.back().hit = closest;
-                                    light_path.back().hit_color = hit_color;
+                    // bake the VPLs of the selected point light over a lattice of positions (blocking)
+                    if (run_vpl_bake)
+                    {
+                        run_vpl_bake = false;
+                        vpl_bake.Unload(); // release the file before overwriting it
+                        BakeVPLs(VPL_BAKE_FILE_PATH, point_lights, selected_point_light, objects, vpl_bake_lattice_size, particles_count, mean_reflectivity, seed);
+                        vpl_bake.Load(VPL_BAKE_FILE_PATH);
+                    }
 
-                                    // append the next light path node given by the reflected direction vector
-                                    {
-                                        LightPathNode next{};
-                                        next.ray = reflected_ray;
-                                        next.ray_color = hit_color;
-                                        light_path.emplace_back(next);
-                                    }
-                                }
+                    vpl_bake_valid =
+                        vpl_bake.IsLoaded() && vpl_bake.Header().point_light < point_lights_count &&
+                        vpl_bake.Header().inputs_hash == HashVPLInputs(point_lights, vpl_bake.Header().point_light, objects, particles_count, mean_reflectivity, seed);
+                    bool use_vpl_bake{ vpl_bake_enabled && vpl_bake_valid };
 
-                                last_ray_hit_something = closest.valid;
+                    if (progressive_converged)
+                    {
+                        // no simulation at all, the converged average is re-presented
+                    }
+                    else if (use_vpl_bake)
+                    {
+                        // no simulation at all, the VPLs come from the bake
+                        light_paths.clear();
+                        light_path_weights.clear();
+                    }
+                    else if (metropolis_enabled)
+                    {
+                        // mutate light paths towards the ones lighting what the camera sees
+                        float aspect{ static_cast<float>(window_w) / static_cast<float>(window_h) };
+                        BuildCameraSamples(camera_samples, camera, aspect, objects, MIR_CAMERA_SAMPLES_W, MIR_CAMERA_SAMPLES_H);
+                        metropolis_stats = MetropolisLightPaths(
+                            light_paths, light_path_weights, point_lights, emitters, objects, camera_samples, particles_count, mean_reflectivity, selected_vpl_type, frame_seed
+                        );
+                    }
+                    else
+                    {
+                        ShootLightPaths(light_paths, point_lights, emitters, particles_count, frame_seed);
 
-                                bounce++; // go to the next bounce
-                            }
-                        }
+                        // build light paths by intersecting rays with the scene geometry and eventually making them bounce
+                        TraceLightPaths(light_paths, objects, particles_count, mean_reflectivity);
+                        light_path_weights.clear();
                     }
 
-                    // spawn VPLs
+                    // spawn VPLs (the ones of the last frame are kept once the view converged)
+                    if (!progressive_converged)
                     {
-                        virtual_lights.clear(); // forget about previous frame virtual lights
-
-                        // the main point light is treated as a virtual light (and must have index POINT_LIGHT_INDEX)
+                        SpawnVirtualLights(virtual_lights, light_paths, point_lights, emitters, particles_count, mean_reflectivity, light_path_weights);
+                        if (use_vpl_bake)
                         {
-                            VirtualLight light{};
-                            light.position = point_light.position;
-                            light.color = point_light.color;
-                            virtual_lights.emplace_back(light);
+                            vpl_bake.Lookup(
+                                virtual_lights, point_lights[vpl_bake.Header().point_light].position, vpl_bake_lookup, vpl_budget, vpl_budget_sampling, frame_seed
+                            );
                         }
+                        spawned_vpls_count = static_cast<int>(virtual_lights.size()) - point_lights_count;
 
-                        // spawn VPLs at light paths hits
-                        for (const std::vector<LightPathNode>& light_path : light_paths)
+                        // don't render more VPLs than the budget allows
+                        if (vpl_budget_sampling == VPL_BUDGET_SAMPLING_POWER)
                         {
-                            for (int j{}; j < static_cast<int>(light_path.size()); j++)
-                            {
-                                const LightPathNode& node{ light_path[j] };
+                            ResampleVPLs(virtual_lights, point_lights_count, vpl_budget, frame_seed);
+                        }
+                        else
+                        {
+                            ApplyVPLBudget(virtual_lights, point_lights_count, vpl_budget);
+                        }
 
-                                // if we hit something, we spawn a VPL
-                                if (node.hit.valid)
-                                {
-                                    VirtualLight vpl{};
-                                    vpl.position = node.hit.position;
-                                    vpl.normal = node.hit.normal;
-                                    vpl.color = CompensateVPLColor(particles_count, mean_reflectivity, j, node.hit_color);
-                                    vpl.bounce = j;
-                                    virtual_lights.emplace_back(vpl);
-                                }
-                            }
+                        // store spatially adjacent VPLs next to each other
+                        if (morton_order_enabled)
+                        {
+                            SortVPLsByMortonCode(virtual_lights, point_lights_count, vpl_original_indices);
+                        }
+                        else
+                        {
+                            vpl_original_indices.resize(virtual_lights.size());
+                            std::iota(vpl_original_indices.begin(), vpl_original_indices.end(), 0);
                         }
                     }
                 }
 
                 particle_sim_timer.End();
 
+                // the Light Index inspector selects virtual lights in light path order, find where the selected one is stored
+                int selected_light_slot{ selected_light_index };
+                if (selected_light_index > MIN_SELECTED_LIGHT_INDEX)
+                {
+                    auto found{ std::find(vpl_original_indices.begin(), vpl_original_indices.end(), selected_light_index) };
+                    if (found != vpl_original_indices.end())
+                    {
+                        selected_light_slot = static_cast<int>(found - vpl_original_indices.begin());
+                    }
+                }
+
+                // build the light tree over the rendered VPLs
+                if (light_tree_enabled && !progressive_converged)
+                {
+                    light_tree_timer.Start();
+                    BuildLightTree(light_tree, virtual_lights, point_lights_count);
+                    BuildLightTreeLights(light_tree_lights, virtual_lights, point_lights_count, selected_vpl_type);
+                    light_tree_timer.End();
+                }
+
                 rendering_timer.Start();
+                rendering_gpu_timer.Start(d3d_ctx.Get());
+
+                // (re-)create the cube shadow maps when the number of point lights changed
+                if (static_cast<int>(cube_shadow_maps.size()) != point_lights_count)
+                {
+                    int size{ CubeShadowMapSize(point_lights_count) };
+                    cube_shadow_maps.clear();
+                    for (int i{}; i < point_lights_count; i++)
+                    {
+                        cube_shadow_maps.emplace_back(d3d_dev.Get(), size);
+                    }
+                }
 
                 // prepare cube shaodw map render
                 {
-                    // set viewport dimension
-                    viewport.Width = static_cast<float>(CUBE_SHADOW_MAP_SIZE);
-                    viewport.Height = static_cast<float>(CUBE_SHADOW_MAP_SIZE);
+                    // set viewport dimension (all cube shadow maps have the same size)
+                    viewport.Width = static_cast<float>(cube_shadow_maps.front().Size());
+                    viewport.Height = static_cast<float>(cube_shadow_maps.front().Size());
 
                     // prepare pipeline for drawing
                     {
@@ -1913,87 +2265,70 @@ static void Entry()
                 #endif
 
                 // render cube shadow map
+                if (!progressive_converged)
                 {
-                    // directions to use for computing the view matrix of each side of the shadow cube map
-                    Vector3 view_directions[6]
+                    // for each point light
+                    for (int light_idx{}; light_idx < point_lights_count; light_idx++)
                     {
-                        { +1.0f, +0.0f, +0.0f }, // +X
-                        { -1.0f, +0.0f, +0.0f }, // -X
-                        { +0.0f, +1.0f, +0.0f }, // +Y
-                        { +0.0f, -1.0f, +0.0f }, // -Y
-                        { +0.0f, +0.0f, +1.0f }, // +Z
-                        { +0.0f, +0.0f, -1.0f }, // -Z
-                    };
+                        const PointLight& point_light{ point_lights[light_idx] };
+                        const CubeShadowMap& cube_shadow_map{ cube_shadow_maps[light_idx] };
 
-                    // up vectors to use for computing the view matrix of each side of the shadow cube map
-                    Vector3 view_ups[6]
-                    {
-                        { +0.0f, +1.0f, +0.0f }, // +X
-                        { +0.0f, +1.0f, +0.0f }, // -X
-                        { +0.0f, +0.0f, -1.0f }, // +Y
-                        { +0.0f, +0.0f, +1.0f }, // -Y
-                        { +0.0f, +1.0f, +0.0f }, // +Z
-                        { +0.0f, +1.0f, +0.0f }, // -Z
-                    };
-
-                    // upload light constants
-                    {
-                        SubresourceMap map{ d3d_ctx.Get(), cb_light.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0 };
-                        auto constants{ static_cast<LightConstants*>(map.Data()) };
-                        constants->world_position = point_light.position;
-                    }
-
-                    // for each side of the cube
-                    for (int face_idx{}; face_idx < CUBE_MAP_FACES; face_idx++)
-                    {
-                        // render the scene
+                        // upload light constants
                         {
-                            // clear depth buffer
-                            d3d_ctx->ClearDepthStencilView(cube_shadow_map.DSVs(face_idx), D3D11_CLEAR_DEPTH, 1.0f, 0);
-
-                            // set cube shadow map side as depth buffer
-                            d3d_ctx->OMSetRenderTargets(0, nullptr, cube_shadow_map.DSVs(face_idx));
+                            SubresourceMap map{ d3d_ctx.Get(), cb_light.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0 };
+                            auto constants{ static_cast<LightConstants*>(map.Data()) };
+                            constants->world_position = point_light.position;
+                        }
 
-                            // upload scene constants
+                        // for each side of the cube
+                        for (int face_idx{}; face_idx < CUBE_MAP_FACES; face_idx++)
+                        {
+                            // render the scene
                             {
-                                float fov_rad{ static_cast<float>(std::numbers::pi) / 2.0f };
-                                float aspect{ 1.0f };
+                                // clear depth buffer
+                                d3d_ctx->ClearDepthStencilView(cube_shadow_map.DSVs(face_idx), D3D11_CLEAR_DEPTH, 1.0f, 0);
 
-                                SubresourceMap map{ d3d_ctx.Get(), cb_scene.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0 };
-                                auto constants{ static_cast<SceneConstants*>(map.Data()) };
-                                constants->view = DirectX::XMMatrixLookAtLH(point_light.position, point_light.position + view_directions[face_idx], view_ups[face_idx]);
-                                constants->projection = DirectX::XMMatrixPerspectiveFovLH(fov_rad, aspect, CUBE_SHADOW_MAP_NEAR, CUBE_SHADOW_MAP_FAR);
-                            }
+                                // set cube shadow map side as depth buffer
+                                d3d_ctx->OMSetRenderTargets(0, nullptr, cube_shadow_map.DSVs(face_idx));
 
-                            // upload shadow constants
-                            {
-                                SubresourceMap map{ d3d_ctx.Get(), cb_shadow.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0 };
-                                auto constants{ static_cast<ShadowConstants*>(map.Data()) };
-                                constants->far_plane = CUBE_SHADOW_MAP_FAR;
-                                constants->static_bias = cube_shadow_map_static_bias;
-                                constants->max_dynamic_bias = cube_shadow_map_max_dynamic_bias;
-                                constants->pcf_samples = pcf_samples;
-                                constants->offset_scale = pcf_offset_scale;
-                            }
+                                // upload scene constants
+                                {
+                                    SubresourceMap map{ d3d_ctx.Get(), cb_scene.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0 };
+                                    auto constants{ static_cast<SceneConstants*>(map.Data()) };
+                                    constants->view = CubeShadowMapView(point_light.position, face_idx);
+                                    constants->projection = CubeShadowMapProjection();
+                                }
 
-                            // render each object
-                            for (const Object& obj : objects)
-                            {
-                                // upload object constants
+                                // upload shadow constants
                                 {
-                                    SubresourceMap map{ d3d_ctx.Get(), cb_object.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0 };
-                                    auto constants{ static_cast<ObjectConstants*>(map.Data()) };
-                                    constants->model = obj.model;
-                                    constants->normal = obj.normal;
-                                    constants->albedo = obj.albedo;
+                                    SubresourceMap map{ d3d_ctx.Get(), cb_shadow.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0 };
+                                    auto constants{ static_cast<ShadowConstants*>(map.Data()) };
+                                    constants->far_plane = CUBE_SHADOW_MAP_FAR;
+                                    constants->static_bias = cube_shadow_map_static_bias;
+                                    constants->max_dynamic_bias = cube_shadow_map_max_dynamic_bias;
+                                    constants->pcf_samples = pcf_samples;
+                                    constants->offset_scale = pcf_offset_scale;
                                 }
 
-                                // set pipeline state
-                                d3d_ctx->IASetIndexBuffer(obj.mesh->Indices(), obj.mesh->IndexFormat(), 0);
-                                d3d_ctx->IASetVertexBuffers(0, 1, obj.mesh->Vertices(), obj.mesh->Stride(), obj.mesh->Offset());
+                                // render each object
+                                for (const Object& obj : objects)
+                                {
+                                    // upload object constants
+                                    {
+                                        SubresourceMap map{ d3d_ctx.Get(), cb_object.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0 };
+                                        auto constants{ static_cast<ObjectConstants*>(map.Data()) };
+                                        constants->model = obj.model;
+                                        constants->normal = obj.normal;
+                                        constants->albedo = obj.albedo;
+                                    }
 
-                                // draw
-                                d3d_ctx->DrawIndexed(obj.mesh->IndexCount(), 0, 0);
+                                    // set pipeline state
+                                    d3d_ctx->IASetIndexBuffer(obj.mesh->Indices(), obj.mesh->IndexFormat(), 0);
+                                    d3d_ctx->IASetVertexBuffers(0, 1, obj.mesh->Vertices(), obj.mesh->Stride(), obj.mesh->Offset());
+
+                                    // draw
+                                    d3d_ctx->DrawIndexed(obj.mesh->IndexCount(), 0, 0);
+                                }
                             }
                         }
                     }
@@ -2010,11 +2345,26 @@ static void Entry()
 
                 // prepare final render
                 {
+                    // static views are rendered in float, so that the average of the frames isn't made of clamped 8 bit frames
+                    if (progressive_enabled && !progressive_buffer.RTV())
+                    {
+                        progressive_buffer = { d3d_dev.Get(), window_w, window_h, ACCUMULATION_BUFFER_FORMAT };
+                        progressive_odd_buffer = { d3d_dev.Get(), window_w, window_h, ACCUMULATION_BUFFER_FORMAT };
+                        progressive_frame = { d3d_dev.Get(), window_w, window_h, ACCUMULATION_BUFFER_FORMAT };
+                        progressive_readback = { d3d_dev.Get(), window_w, window_h, ACCUMULATION_BUFFER_FORMAT };
+                        progressive_frames = 0;
+                        progressive_converged = false;
+                    }
+                    scene_rtv = progressive_enabled ? progressive_frame.RTV() : frame_buffer.BackBufferRTV();
+
                     // clear color buffer and depth buffer
                     {
-                        float clear_color[4]{ 0.2f, 0.3f, 0.3f, 1.0f };
-                        d3d_ctx->ClearRenderTargetView(frame_buffer.BackBufferRTV(), clear_color);
-                        d3d_ctx->ClearDepthStencilView(frame_buffer.DepthBufferDSV(), D3D11_CLEAR_DEPTH, 1.0f, 0);
+                        float clear_color[4]{ FRAME_CLEAR_COLOR.x, FRAME_CLEAR_COLOR.y, FRAME_CLEAR_COLOR.z, 1.0f };
+                        d3d_ctx->ClearRenderTargetView(scene_rtv, clear_color);
+                        if (!progressive_converged) // the visualizations are depth tested against the last rendered frame
+                        {
+                            d3d_ctx->ClearDepthStencilView(frame_buffer.DepthBufferDSV(), D3D11_CLEAR_DEPTH, 1.0f, 0);
+                        }
                     }
 
                     // set viewport dimension
@@ -2023,9 +2373,8 @@ static void Entry()
 
                     // prepare pipeline for drawing
                     {
-                        ID3D11RenderTargetView* rtv{ frame_buffer.BackBufferRTV() };
-                        ID3D11Buffer* cbufs[]{ cb_scene.Get(), cb_object.Get(), cb_light.Get(), cb_shadow.Get() };
-                        ID3D11ShaderResourceView* srvs[]{ cube_shadow_map.SRV() };
+                        ID3D11Buffer* cbufs[]{ cb_scene.Get(), cb_object.Get(), cb_light.Get(), cb_shadow.Get(), cb_light_tree.Get(), cb_accumulation.Get(), cb_area_light.Get() };
+                        ID3D11ShaderResourceView* srvs[]{ cube_shadow_maps.front().SRV() };
                         ID3D11SamplerState* sss[]{ ss_cube_shadow_map.Get(), ss_skybox.Get() };
 
                         d3d_ctx->ClearState();
@@ -2038,7 +2387,7 @@ static void Entry()
                         d3d_ctx->PSSetSamplers(0, std::size(sss), sss);
                         d3d_ctx->RSSetState(rs_default.Get());
                         d3d_ctx->RSSetViewports(1, &viewport);
-                        d3d_ctx->OMSetRenderTargets(1, &rtv, frame_buffer.DepthBufferDSV());
+                        d3d_ctx->OMSetRenderTargets(1, &scene_rtv, frame_buffer.DepthBufferDSV());
                     }
 
                     // upload scene constants
@@ -2056,15 +2405,59 @@ static void Entry()
                 }
 
                 // render the scene for each virtual light, accumulating the result
+                if (!progressive_converged)
                 {
                     /*
                         A non negative selected light index means that the user wants to see the contribution of a single light source
                         A negative selected light index means that the user wants to see the final frame
                     */
+                    bool use_light_tree{ light_tree_enabled && selected_light_index == MIN_SELECTED_LIGHT_INDEX };
+                    bool use_restir{ restir_enabled && !use_light_tree && selected_light_index == MIN_SELECTED_LIGHT_INDEX };
+                    bool use_vpl_rotation{ vpl_rotation_enabled && !progressive_enabled && !use_light_tree && !use_restir && selected_light_index == MIN_SELECTED_LIGHT_INDEX };
+
+                    // discard the accumulated VPL subsets when anything affecting the frame changed
+                    if (use_vpl_rotation)
+                    {
+                        std::size_t state_hash{ HashScene(camera, point_lights, objects) };
+                        HashCombine(state_hash, seed);
+                        HashCombine(state_hash, particles_count);
+                        HashCombine(state_hash, mean_reflectivity);
+                        HashCombine(state_hash, selected_vpl_type);
+                        HashCombine(state_hash, vpl_budget);
+                        HashCombine(state_hash, vpl_budget_sampling);
+                        HashCombine(state_hash, metropolis_enabled);
+                        HashCombine(state_hash, vpl_rotation_subsets);
+                        HashCombine(state_hash, virtual_lights.size());
+
+                        if (!accumulation_buffer.RTV() || state_hash != accumulation_state_hash)
+                        {
+                            if (!accumulation_buffer.RTV())
+                            {
+                                accumulation_buffer = { d3d_dev.Get(), window_w, window_h, ACCUMULATION_BUFFER_FORMAT };
+                            }
+
+                            float clear_color[4]{ 0.0f, 0.0f, 0.0f, 0.0f };
+                            d3d_ctx->ClearRenderTargetView(accumulation_buffer.RTV(), clear_color);
+
+                            accumulation_state_hash = state_hash;
+                            accumulated_vpl_subsets = 0;
+                        }
+                    }
+
                     for (int i{}; i < static_cast<int>(virtual_lights.size()); i++)
                     {
                         // skip non selected light (when one is actually selected)
-                        if (selected_light_index > MIN_SELECTED_LIGHT_INDEX && i != selected_light_index) continue;
+                        if (selected_light_index > MIN_SELECTED_LIGHT_INDEX && i != selected_light_slot) continue;
+
+                        // VPLs are rendered all together, by sampling the light tree (or on the CPU, by reservoir resampling)
+                        if ((use_light_tree || use_restir) && i >= point_lights_count) break;
+
+                        // VPLs are rendered one subset per frame (each subset takes every k-th VPL, so it is stratified over the light paths)
+                        if (use_vpl_rotation && i >= point_lights_count)
+                        {
+                            if (accumulated_vpl_subsets >= vpl_rotation_subsets) break; // every subset has been accumulated already
+                            if ((i - point_lights_count) % vpl_rotation_subsets != accumulated_vpl_subsets) continue;
+                        }
 
                         const VirtualLight& light{ virtual_lights[i] };
 
@@ -2075,8 +2468,15 @@ static void Entry()
                             constants->world_position = light.position;
                             constants->color = light.color;
                             constants->normal = light.normal;
-                            constants->intensity = point_light.intenisty;
-                            constants->type = (i == POINT_LIGHT_INDEX) ? LIGHT_TYPE_POINT : selected_vpl_type;
+                            constants->intensity = light.intensity;
+                            constants->type = (i < point_lights_count) ? LIGHT_TYPE_POINT : selected_vpl_type;
+                        }
+
+                        // each point light is shadowed using its own cube shadow map
+                        if (i < point_lights_count)
+                        {
+                            ID3D11ShaderResourceView* srvs[]{ cube_shadow_maps[i].SRV() };
+                            d3d_ctx->PSSetShaderResources(0, std::size(srvs), srvs);
                         }
 
                         // it is the first frame we render, or we only want to render the contribution of a single virtual light
@@ -2093,6 +2493,13 @@ static void Entry()
                             d3d_ctx->OMSetDepthStencilState(ds_equal.Get(), 0);
                         }
 
+                        // VPL subsets are accumulated across frames in the accumulation buffer, instead of the back buffer
+                        if (use_vpl_rotation && i >= point_lights_count)
+                        {
+                            ID3D11RenderTargetView* rtv{ accumulation_buffer.RTV() };
+                            d3d_ctx->OMSetRenderTargets(1, &rtv, frame_buffer.DepthBufferDSV());
+                        }
+
                         // render each object
                         for (const Object& obj : objects)
                         {
@@ -2111,8 +2518,8 @@ static void Entry()
                                 d3d_ctx->IASetIndexBuffer(obj.mesh->Indices(), obj.mesh->IndexFormat(), 0);
                                 d3d_ctx->IASetVertexBuffers(0, 1, obj.mesh->Vertices(), obj.mesh->Stride(), obj.mesh->Offset());
 
-                                // if we are lighting the scene using the main point light, then also render shadows
-                                if (i == POINT_LIGHT_INDEX)
+                                // if we are lighting the scene using a point light, then also render shadows
+                                if (i < point_lights_count)
                                 {
                                     d3d_ctx->PSSetShader(ps_shadowed.Get(), nullptr, 0);
                                 }
@@ -2127,15 +2534,120 @@ static void Entry()
                         }
                     }
 
+                    // add the direct contribution of the emissive quads (analytic and unshadowed, instead of a VPL per emitter sample)
+                    if (selected_light_index == MIN_SELECTED_LIGHT_INDEX && !emitters.quads.empty())
+                    {
+                        // VPL subsets may have left the accumulation buffer bound
+                        d3d_ctx->OMSetRenderTargets(1, &scene_rtv, frame_buffer.DepthBufferDSV());
+
+                        for (const Object* quad : emitters.quads)
+                        {
+                            // upload area light constants
+                            {
+                                Vector3 corners[4]{};
+                                QuadCorners(*quad, corners);
+
+                                SubresourceMap map{ d3d_ctx.Get(), cb_area_light.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0 };
+                                auto constants{ static_cast<AreaLightConstants*>(map.Data()) };
+                                for (int c{}; c < 4; c++)
+                                {
+                                    constants->corners[c] = { corners[c].x, corners[c].y, corners[c].z, 1.0f };
+                                }
+                                constants->color = quad->emissive_color;
+                                constants->intensity = quad->emissive_intensity;
+                            }
+
+                            // set pipeline state
+                            d3d_ctx->PSSetShader(ps_area_light.Get(), nullptr, 0);
+                            d3d_ctx->OMSetBlendState(bs_sum.Get(), nullptr, 0XFFFFFFFF);
+                            d3d_ctx->OMSetDepthStencilState(ds_equal.Get(), 0);
+
+                            // render each object
+                            for (const Object& obj : objects)
+                            {
+                                // upload object constants
+                                {
+                                    SubresourceMap map{ d3d_ctx.Get(), cb_object.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0 };
+                                    auto constants{ static_cast<ObjectConstants*>(map.Data()) };
+                                    constants->model = obj.model;
+                                    constants->normal = obj.normal;
+                                    constants->albedo = obj.albedo;
+                                }
+
+                                // set pipeline state
+                                d3d_ctx->IASetIndexBuffer(obj.mesh->Indices(), obj.mesh->IndexFormat(), 0);
+                                d3d_ctx->IASetVertexBuffers(0, 1, obj.mesh->Vertices(), obj.mesh->Stride(), obj.mesh->Offset());
+
+                                // draw
+                                d3d_ctx->DrawIndexed(obj.mesh->IndexCount(), 0, 0);
+                            }
+                        }
+                    }
+
+                    // accumulate the contribution of the VPLs
+                    if (use_light_tree)
+                    {
+                        render_light_tree(light_tree, light_tree_lights);
+                    }
+
+                    // add the accumulated VPL subsets to the frame
+                    if (use_vpl_rotation)
+                    {
+                        // this frame's subset has been accumulated
+                        if (accumulated_vpl_subsets < vpl_rotation_subsets)
+                        {
+                            accumulated_vpl_subsets++;
+                        }
+
+                        render_fullscreen_sum(accumulation_buffer.SRV(), static_cast<float>(vpl_rotation_subsets) / static_cast<float>(accumulated_vpl_subsets)); // each subset holds 1/k of the VPLs
+                    }
+
+                    // shade the VPLs on the CPU and add the result to the frame
+                    if (use_restir)
+                    {
+                        // reservoirs of the previous frame are stale when the VPL set changed
+                        std::size_t vpls_hash{ HashVPLInputs(point_lights, -1, objects, particles_count, mean_reflectivity, seed) };
+                        HashCombine(vpls_hash, selected_vpl_type);
+                        HashCombine(vpls_hash, vpl_budget);
+                        HashCombine(vpls_hash, vpl_budget_sampling);
+                        HashCombine(vpls_hash, metropolis_enabled);
+                        HashCombine(vpls_hash, vpl_bake_enabled);
+                        HashCombine(vpls_hash, virtual_lights.size());
+                        if (vpls_hash != restir_vpls_hash)
+                        {
+                            restir_renderer.ResetHistory();
+                            restir_vpls_hash = vpls_hash;
+                        }
+
+                        restir_timer.Start();
+                        {
+                            ReSTIRSettings settings{ restir_candidates, restir_spatial_neighbours, restir_spatial_radius, restir_temporal_reuse };
+                            restir_renderer.Render(camera, window_w, window_h, objects, virtual_lights, point_lights_count, particles_count, selected_vpl_type, settings, restir_frame++);
+                        }
+                        restir_timer.End();
+
+                        if (restir_image.Width() != window_w || restir_image.Height() != window_h)
+                        {
+                            restir_image = { d3d_dev.Get(), window_w, window_h, RESTIR_IMAGE_FORMAT };
+                        }
+                        restir_image.Upload(d3d_ctx.Get(), restir_renderer.Image().data(), static_cast<UINT>(window_w) * sizeof(Vector4));
+
+                        render_fullscreen_sum(restir_image.SRV(), 1.0f);
+                    }
+
                     // from this point onwards, we use the default blend state and depth stencil state
                     {
                         d3d_ctx->OMSetBlendState(nullptr, nullptr, 0XFFFFFFFF); // default blend state
                         d3d_ctx->OMSetDepthStencilState(nullptr, 0); // default depth stencil state
                     }
 
-                    // render main point light (only if we are rendering the final frame or we have selected the point light)
-                    if (selected_light_index == MIN_SELECTED_LIGHT_INDEX || selected_light_index == POINT_LIGHT_INDEX)
+                    // render point lights (only if we are rendering the final frame or we have selected the point light)
+                    for (int i{}; i < point_lights_count; i++)
                     {
+                        if (selected_light_index != MIN_SELECTED_LIGHT_INDEX && selected_light_index != i) continue;
+
+                        const PointLight& point_light{ point_lights[i] };
+
                         // upload object constants (light impostor cube)
                         {
                             float point_ligt_diameter{ POINT_LIGHT_RADIUS * 2.0f };
@@ -2168,18 +2680,153 @@ static void Entry()
                         // draw
                         d3d_ctx->DrawIndexed(cube_mesh.IndexCount(), 0, 0);
                     }
+
+                    // render emissive quads with their radiance (only if we are rendering the final frame)
+                    if (selected_light_index == MIN_SELECTED_LIGHT_INDEX)
+                    {
+                        // overwrite the lit color of the quads
+                        d3d_ctx->OMSetDepthStencilState(ds_equal.Get(), 0);
+
+                        for (const Object* quad : emitters.quads)
+                        {
+                            // upload object constants
+                            {
+                                SubresourceMap map{ d3d_ctx.Get(), cb_object.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0 };
+                                auto constants{ static_cast<ObjectConstants*>(map.Data()) };
+                                constants->model = quad->model;
+                                constants->normal = quad->normal;
+                                constants->albedo = quad->emissive_intensity * quad->emissive_color;
+                            }
+
+                            // set pipeline state
+                            d3d_ctx->IASetIndexBuffer(quad->mesh->Indices(), quad->mesh->IndexFormat(), 0);
+                            d3d_ctx->IASetVertexBuffers(0, 1, quad->mesh->Vertices(), quad->mesh->Stride(), quad->mesh->Offset());
+                            d3d_ctx->PSSetShader(ps_flat.Get(), nullptr, 0);
+
+                            // draw
+                            d3d_ctx->DrawIndexed(quad->mesh->IndexCount(), 0, 0);
+                        }
+
+                        d3d_ctx->OMSetDepthStencilState(nullptr, 0); // default depth stencil state
+                    }
                 }
 
+                // average the frames of a static view, and present the average instead of the last frame
+                if (progressive_enabled)
+                {
+                    if (!progressive_converged)
+                    {
+                        // average += (frame - average) / (n + 1), the first frame overwrites whatever the buffer holds
+                        auto accumulate{ [&](const RenderTarget& buffer, int frames)
+                        {
+                            float weight{ 1.0f / static_cast<float>(frames + 1) };
+                            float blend_factor[4]{ 1.0f - weight, 1.0f - weight, 1.0f - weight, 1.0f - weight };
+                            if (frames == 0)
+                            {
+                                float clear_color[4]{ 0.0f, 0.0f, 0.0f, 0.0f };
+                                d3d_ctx->ClearRenderTargetView(buffer.RTV(), clear_color);
+                            }
+                            render_fullscreen(progressive_frame.SRV(), weight, buffer.RTV(), bs_average.Get(), blend_factor);
+                        } };
+                        accumulate(progressive_buffer, progressive_frames);
+                        if (progressive_frames % 2 == 1)
+                        {
+                            accumulate(progressive_odd_buffer, progressive_frames / 2);
+                        }
+                        progressive_frames++;
+
+                        // convergence: standard error of the average, estimated from the averages of all and of the odd frames
+                        if (progressive_frames % PROGRESSIVE_CHECK_FRAMES == 0)
+                        {
+                            std::size_t pixels{ static_cast<std::size_t>(window_w) * window_h };
+                            progressive_average.resize(pixels);
+                            progressive_odd_average.resize(pixels);
+                            progressive_readback.Read(d3d_ctx.Get(), progressive_buffer.Texture(), progressive_average.data(), static_cast<UINT>(window_w) * sizeof(Vector4));
+                            progressive_readback.Read(d3d_ctx.Get(), progressive_odd_buffer.Texture(), progressive_odd_average.data(), static_cast<UINT>(window_w) * sizeof(Vector4));
+                            progressive_error = ProgressiveRelativeError(progressive_average, progressive_odd_average);
+                            progressive_converged = progressive_error < progressive_threshold;
+                        }
+                    }
+
+                    // resolve to the back buffer (the visualizations below are drawn over it, and not averaged)
+                    scene_rtv = frame_buffer.BackBufferRTV();
+                    render_fullscreen(progressive_buffer.SRV(), 1.0f, scene_rtv, nullptr, nullptr);
+                    d3d_ctx->OMSetBlendState(nullptr, nullptr, 0XFFFFFFFF);
+                }
+
+                rendering_gpu_timer.End(d3d_ctx.Get());
                 rendering_timer.End();
 
+                // light tree benchmark: build time and shading time against the number of VPLs
+                if (run_light_tree_benchmark)
+                {
+                    run_light_tree_benchmark = false;
+
+                    std::println("light tree benchmark ({} samples per pixel, {}x{} pixels, {} repetitions)", light_tree_samples, window_w, window_h, LIGHT_TREE_BENCHMARK_REPETITIONS);
+                    std::println("{:>10} {:>15} {:>15}", "VPLs", "build [msec]", "shading [msec]");
+
+                    std::vector<std::vector<LightPathNode>> bench_light_paths{};
+                    std::vector<VirtualLight> bench_virtual_lights{};
+                    LightTree bench_light_tree{};
+                    std::vector<LightConstants> bench_light_tree_lights{};
+                    Timer build_timer{};
+                    GPUTimer shading_timer{ d3d_dev.Get() };
+
+                    for (int vpl_count : LIGHT_TREE_BENCHMARK_VPL_COUNTS)
+                    {
+                        // every particle spawns at least one VPL in a closed scene: simulate vpl_count particles and keep vpl_count VPLs
+                        ShootLightPaths(bench_light_paths, point_lights, emitters, vpl_count, seed);
+                        TraceLightPaths(bench_light_paths, objects, vpl_count, mean_reflectivity);
+                        SpawnVirtualLights(bench_virtual_lights, bench_light_paths, point_lights, emitters, vpl_count, mean_reflectivity, {});
+                        ApplyVPLBudget(bench_virtual_lights, point_lights_count, vpl_count);
+
+                        float build_msec{};
+                        for (int r{}; r < LIGHT_TREE_BENCHMARK_REPETITIONS; r++)
+                        {
+                            build_timer.Start();
+                            BuildLightTree(bench_light_tree, bench_virtual_lights, point_lights_count);
+                            BuildLightTreeLights(bench_light_tree_lights, bench_virtual_lights, point_lights_count, selected_vpl_type);
+                            build_timer.End();
+                            build_msec += build_timer.DeltaSec() * 1000.0f;
+                        }
+
+                        // the depth buffer still holds the scene depth, so the light tree pass shades the same pixels as in the frame
+                        float shading_msec{};
+                        for (int r{}; r < LIGHT_TREE_BENCHMARK_REPETITIONS; r++)
+                        {
+                            shading_timer.Start(d3d_ctx.Get());
+                            render_light_tree(bench_light_tree, bench_light_tree_lights);
+                            shading_timer.End(d3d_ctx.Get());
+                            shading_msec += shading_timer.DeltaSec(d3d_ctx.Get()) * 1000.0f;
+                        }
+
+                        int bench_vpls_count{ static_cast<int>(bench_virtual_lights.size()) - point_lights_count };
+                        std::println(
+                            "{:>10} {:>15.3f} {:>15.3f}",
+                            bench_vpls_count, build_msec / LIGHT_TREE_BENCHMARK_REPETITIONS, shading_msec / LIGHT_TREE_BENCHMARK_REPETITIONS
+                        );
+                    }
+
+                    // restore the default blend state and depth stencil state
+                    d3d_ctx->OMSetBlendState(nullptr, nullptr, 0XFFFFFFFF);
+                    d3d_ctx->OMSetDepthStencilState(nullptr, 0);
+                }
+
+                // metropolis instant radiosity benchmark: VPLs needed for equal error against uniform emission
+                if (run_metropolis_benchmark)
+                {
+                    run_metropolis_benchmark = false;
+                    RunMetropolisBenchmark(&quad_mesh, &cube_mesh, static_cast<float>(window_w) / static_cast<float>(window_h), mean_reflectivity, selected_vpl_type);
+                }
+
                 // render visualizations
                 {
                     // render VPLs
                     {
-                        for (int i{ POINT_LIGHT_INDEX + 1 }; i < static_cast<int>(virtual_lights.size()) && draw_vpls; i++)
+                        for (int i{ point_lights_count }; i < static_cast<int>(virtual_lights.size()) && draw_vpls; i++)
                         {
                             // skip non selected VPL (when one is actually selected)
-                            if (selected_light_index > MIN_SELECTED_LIGHT_INDEX && i != selected_light_index) continue;
+                            if (selected_light_index > MIN_SELECTED_LIGHT_INDEX && i != selected_light_slot) continue;
 
                             const VirtualLight& vpl{ virtual_lights[i] };
 
@@ -2205,8 +2852,8 @@ static void Entry()
                                 constants->world_position = vpl.position;
                                 constants->radius = radius;
                                 constants->color = vpl.color;
-                                constants->intensity = point_light.intenisty;
-                                constants->type = i == POINT_LIGHT_INDEX ? LIGHT_TYPE_POINT : selected_vpl_type;
+                                constants->intensity = vpl.intensity;
+                                constants->type = selected_vpl_type;
                             }
 
                             // set pipeline state
@@ -2284,10 +2931,10 @@ static void Entry()
                     }
 
                     // render VPLs normals
-                    for (int i{ POINT_LIGHT_INDEX + 1 }; i < static_cast<int>(virtual_lights.size()) && draw_vpls; i++)
+                    for (int i{ point_lights_count }; i < static_cast<int>(virtual_lights.size()) && draw_vpls; i++)
                     {
                         // skip non selected VPL (when one is actually selected)
-                        if (selected_light_index > POINT_LIGHT_INDEX && i != selected_light_index) continue;
+                        if (selected_light_index >= point_lights_count && i != selected_light_slot) continue;
 
                         const VirtualLight& vpl{ virtual_lights[i] };
 
@@ -2329,12 +2976,14 @@ static void Entry()
                     // prepare pipeline for drawing
                     {
                         ID3D11RenderTargetView* rtv{ frame_buffer.BackBufferRTV() };
+                        ID3D11ShaderResourceView* srvs[]{ cube_shadow_maps[selected_point_light].SRV() }; // cube shadow map of the point light selected in the editor
 
                         d3d_ctx->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
                         d3d_ctx->IASetIndexBuffer(cube_mesh.Indices(), cube_mesh.IndexFormat(), 0);
                         d3d_ctx->IASetVertexBuffers(0, 1, cube_mesh.Vertices(), cube_mesh.Stride(), cube_mesh.Offset());
                         d3d_ctx->RSSetState(rs_no_cull.Get());
                         d3d_ctx->PSSetShader(ps_skybox.Get(), nullptr, 0);
+                        d3d_ctx->PSSetShaderResources(0, std::size(srvs), srvs);
                         d3d_ctx->OMSetDepthStencilState(ds_no_depth.Get(), 0);
                         d3d_ctx->OMSetRenderTargets(1, &rtv, nullptr);
                     }
@@ -2373,16 +3022,52 @@ static void Entry()
                             ImGui::Text("Delta Time: %.2f msec", frame_dt_sec * 1000.0f);
                             ImGui::Text("Particle Simulation: %.2f msec", particle_sim_timer.DeltaSec() * 1000.0f);
                             ImGui::Text("Rendering: %.2f msec", rendering_timer.DeltaSec() * 1000.0f);
+                            ImGui::Text("Rendering (GPU): %.2f msec", rendering_gpu_timer.DeltaSec() * 1000.0f);
+                            if (ImGui::Checkbox("Frame Budget", &frame_budget_enabled) && frame_budget_enabled)
+                            {
+                                frame_budget_controller.Reset(particles_count, vpl_budget); // start from the current configuration
+                            }
+                            ImGui::DragFloat("Target Frame Time", &frame_budget_target_msec, 0.1f, FRAME_BUDGET_TARGET_MSEC_MIN, FRAME_BUDGET_TARGET_MSEC_MAX, "%.1f msec");
+                            ImGui::Text("Particles: %d", particles_count);
+                            ImGui::Text("VPLs: %d spawned, %d rendered (budget %d)", spawned_vpls_count, static_cast<int>(virtual_lights.size()) - point_lights_count, vpl_budget);
+                            if (light_tree_enabled)
+                            {
+                                ImGui::Text("Light Tree Build: %.2f msec (%d nodes)", light_tree_timer.DeltaSec() * 1000.0f, static_cast<int>(light_tree.nodes.size()));
+                            }
                         }
                         if (ImGui::CollapsingHeader("Configuration", ImGuiTreeNodeFlags_DefaultOpen))
                         {
+                            // scene editor
+                            {
+                                const char* scene_descs[]{ "Cornell Box", "Doorway" };
+                                if (ImGui::Combo("Scene", &selected_scene, scene_descs, std::size(scene_descs)))
+                                {
+                                    if (selected_scene == SCENE_DOORWAY)
+                                    {
+                                        BuildDoorwayScene(objects, point_lights, camera, &quad_mesh, &cube_mesh);
+                                    }
+                                    else
+                                    {
+                                        BuildCornellBoxScene(objects, point_lights, camera, &quad_mesh, &cube_mesh);
+                                    }
+                                    ValidateSceneObjects(objects);
+                                    selected_point_light = 0;
+                                }
+                            }
                             ImGui::DragInt("Seed", &seed, 1.0f);
-                            ImGui::DragInt("Particles", &particles_count, 1.0f, PARTICLES_COUNT_MIN, PARTICLES_COUNT_MAX);
+                            ImGui::DragInt("Particles", &particles_count, 1.0f, PARTICLES_COUNT_MIN, light_tree_enabled ? LIGHT_TREE_PARTICLES_COUNT_MAX : PARTICLES_COUNT_MAX);
                             ImGui::DragFloat("Mean Reflectivity", &mean_reflectivity, 0.001f, MEAN_REFLECTIVITY_MIN, MEAN_REFLECTIVITY_MAX);
+                            ImGui::DragInt("VPL Budget", &vpl_budget, 1.0f, VPL_BUDGET_MIN, VPL_BUDGET_MAX);
+                            // VPL budget sampling editor
+                            {
+                                const char* vpl_budget_sampling_descs[]{ "Uniform Stride", "Power Proportional" };
+                                ImGui::Combo("VPL Budget Sampling", &vpl_budget_sampling, vpl_budget_sampling_descs, std::size(vpl_budget_sampling_descs));
+                            }
                             ImGui::Checkbox("Draw Light Paths", &draw_light_paths);
                             ImGui::Checkbox("Draw Lost Light Path Rays", &draw_lost_light_path_rays);
                             ImGui::DragInt("Light Path Index", &selected_light_path_index, 0.1f, MIN_SELECTED_LIGHT_PATH_INDEX, static_cast<int>(light_paths.size()) - 1);
                             ImGui::Checkbox("Draw VPLs", &draw_vpls);
+                            ImGui::Checkbox("Morton Order VPLs", &morton_order_enabled);
                             ImGui::DragInt("Light Index", &selected_light_index, 0.1f, MIN_SELECTED_LIGHT_INDEX, static_cast<int>(virtual_lights.size()) - 1);
                             // VPL type editor
                             {
@@ -2390,6 +3075,79 @@ static void Entry()
                                 ImGui::Combo("VPL Type", &selected_vpl_type, vpl_type_descs, std::size(vpl_type_descs));
                             }
                         }
+                        if (ImGui::CollapsingHeader("Light Tree", ImGuiTreeNodeFlags_DefaultOpen))
+                        {
+                            ImGui::Checkbox("Sample Light Tree", &light_tree_enabled);
+                            ImGui::DragInt("Samples Per Pixel", &light_tree_samples, 0.1f, LIGHT_TREE_SAMPLES_MIN, LIGHT_TREE_SAMPLES_MAX);
+                            if (ImGui::Button("Run Benchmark"))
+                            {
+                                run_light_tree_benchmark = true; // runs during the next frame, results are printed to the console
+                            }
+                        }
+                        if (ImGui::CollapsingHeader("Metropolis Instant Radiosity", ImGuiTreeNodeFlags_DefaultOpen))
+                        {
+                            ImGui::Checkbox("Metropolis Light Paths", &metropolis_enabled);
+                            if (metropolis_enabled)
+                            {
+                                ImGui::Text("Acceptance Rate: %.1f%%", metropolis_stats.acceptance_rate * 100.0f);
+                                ImGui::Text("Mean Importance: %g", metropolis_stats.normalization);
+                            }
+                            if (ImGui::Button("Run Doorway Benchmark"))
+                            {
+                                run_metropolis_benchmark = true; // runs during the next frame, results are printed to the console
+                            }
+                        }
+                        if (ImGui::CollapsingHeader("VPL Bake", ImGuiTreeNodeFlags_DefaultOpen))
+                        {
+                            ImGui::Checkbox("Use Baked VPLs", &vpl_bake_enabled);
+                            // lookup editor
+                            {
+                                const char* vpl_bake_lookup_descs[]{ "Nearest", "Trilinear" };
+                                ImGui::Combo("Lookup", &vpl_bake_lookup, vpl_bake_lookup_descs, std::size(vpl_bake_lookup_descs));
+                            }
+                            ImGui::DragInt("Lattice Size", &vpl_bake_lattice_size, 0.1f, VPL_BAKE_LATTICE_SIZE_MIN, VPL_BAKE_LATTICE_SIZE_MAX);
+                            if (ImGui::Button("Bake Selected Point Light"))
+                            {
+                                run_vpl_bake = true; // runs during the next frame
+                            }
+                            if (vpl_bake.IsLoaded())
+                            {
+                                int n{ vpl_bake.Header().lattice_size };
+                                ImGui::Text("Bake: point light %d, %dx%dx%d lattice, %d VPLs", vpl_bake.Header().point_light, n, n, n, vpl_bake.VPLCount());
+                                ImGui::Text("%s", vpl_bake_valid ? "Bake is up to date" : "Bake is stale (scene or configuration changed)");
+                            }
+                            else
+                            {
+                                ImGui::Text("No bake loaded");
+                            }
+                        }
+                        if (ImGui::CollapsingHeader("VPL Rotation", ImGuiTreeNodeFlags_DefaultOpen))
+                        {
+                            ImGui::Checkbox("Rotate VPL Subsets", &vpl_rotation_enabled);
+                            ImGui::DragInt("Subsets", &vpl_rotation_subsets, 0.1f, VPL_ROTATION_SUBSETS_MIN, VPL_ROTATION_SUBSETS_MAX);
+                            ImGui::Text("Accumulated Subsets: %d/%d", accumulated_vpl_subsets, vpl_rotation_subsets);
+                        }
+                        if (ImGui::CollapsingHeader("Progressive", ImGuiTreeNodeFlags_DefaultOpen))
+                        {
+                            ImGui::Checkbox("Accumulate Static Views", &progressive_enabled);
+                            ImGui::DragFloat("Convergence Threshold", &progressive_threshold, 0.0001f, PROGRESSIVE_THRESHOLD_MIN, PROGRESSIVE_THRESHOLD_MAX, "%.4f");
+                            if (progressive_enabled)
+                            {
+                                ImGui::Text("Frames: %d, Error: %.5f%s", progressive_frames, progressive_error, progressive_converged ? " (converged)" : "");
+                            }
+                        }
+                        if (ImGui::CollapsingHeader("ReSTIR", ImGuiTreeNodeFlags_DefaultOpen))
+                        {
+                            ImGui::Checkbox("Resample VPLs On CPU", &restir_enabled);
+                            ImGui::DragInt("Candidates", &restir_candidates, 0.1f, RESTIR_CANDIDATES_MIN, RESTIR_CANDIDATES_MAX);
+                            ImGui::DragInt("Spatial Neighbours", &restir_spatial_neighbours, 0.1f, RESTIR_SPATIAL_NEIGHBOURS_MIN, RESTIR_SPATIAL_NEIGHBOURS_MAX);
+                            ImGui::DragFloat("Spatial Radius", &restir_spatial_radius, 0.1f, RESTIR_SPATIAL_RADIUS_MIN, RESTIR_SPATIAL_RADIUS_MAX, "%.1f px");
+                            ImGui::Checkbox("Temporal Reuse", &restir_temporal_reuse);
+                            if (restir_enabled)
+                            {
+                                ImGui::Text("CPU Shading: %.2f msec", restir_timer.DeltaSec() * 1000.0f);
+                            }
+                        }
                         if (ImGui::CollapsingHeader("Shadows", ImGuiTreeNodeFlags_DefaultOpen))
                         {
                             ImGui::Checkbox("Draw Shadow Map", &draw_cube_shadow_map);
@@ -2403,8 +3161,28 @@ static void Entry()
                             ImGui::Checkbox("Invert Camera Mouse X", &invert_camera_mouse_x);
                             ImGui::Checkbox("Invert Camera Mouse Y", &invert_camera_mouse_y);
                         }
-                        if (ImGui::CollapsingHeader("Point Light", ImGuiTreeNodeFlags_DefaultOpen))
+                        if (ImGui::CollapsingHeader("Point Lights", ImGuiTreeNodeFlags_DefaultOpen))
                         {
+                            // add a copy of the selected point light / remove the selected point light
+                            {
+                                if (ImGui::Button("Add") && static_cast<int>(point_lights.size()) < POINT_LIGHTS_MAX)
+                                {
+                                    PointLight copy{ point_lights[selected_point_light] };
+                                    point_lights.emplace_back(copy);
+                                    selected_point_light = static_cast<int>(point_lights.size()) - 1;
+                                }
+                                ImGui::SameLine();
+                                if (ImGui::Button("Remove") && static_cast<int>(point_lights.size()) > POINT_LIGHTS_MIN)
+                                {
+                                    point_lights.erase(point_lights.begin() + selected_point_light);
+                                    selected_point_light = std::min(selected_point_light, static_cast<int>(point_lights.size()) - 1);
+                                }
+                                ImGui::SameLine();
+                                ImGui::Text("%d/%d", static_cast<int>(point_lights.size()), POINT_LIGHTS_MAX);
+                            }
+                            ImGui::DragInt("Selected", &selected_point_light, 0.1f, 0, static_cast<int>(point_lights.size()) - 1);
+
+                            PointLight& point_light{ point_lights[selected_point_light] };
                             // position editor
                             {
                                 float position[3]{ point_light.position.x, point_light.position.y, point_light.position.z };
@@ -2450,6 +3228,14 @@ static void Entry()
                                         ImGui::ColorEdit3("Albedo", color);
                                         objects[i].albedo = { color[0], color[1], color[2] };
                                     }
+                                    // emission editor (only quads can emit)
+                                    if (objects[i].ray_intersect_fn == RayQuadIntersect)
+                                    {
+                                        float color[3]{ objects[i].emissive_color.x, objects[i].emissive_color.y, objects[i].emissive_color.z };
+                                        ImGui::ColorEdit3("Emissive Color", color);
+                                        objects[i].emissive_color = { color[0], color[1], color[2] };
+                                        ImGui::DragFloat("Emissive Intensity", &objects[i].emissive_intensity, 0.1f, EMISSIVE_INTENSITY_MIN, EMISSIVE_INTENSITY_MAX);
+                                    }
 
                                     ImGui::TreePop();
                                 }
@@ -2481,16 +3267,27 @@ static void Entry()
 // Main
 // ----------------------------------------------------------------------------
 
-int main()
+int main(int argc, char* argv[])
 {
     try
     {
-        Entry();
+        std::vector<std::string_view> args(argv + 1, argv + argc);
+        if (!args.empty() && args.front() == HEADLESS_FLAG)
+        {
+            HeadlessEntry({ args.begin() + 1, args.end() });
+        }
+        else
+        {
+            Entry();
+        }
     }
     catch (const Error& e)
     {
         std::println("{}", e.what());
+        return 1;
     }
 
     return 0;
 }
+
+#endif // _WIN32
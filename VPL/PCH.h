@@ -1,22 +1,41 @@
 #pragma once
 
 #include <algorithm>
+#include <array>
+#include <bit>
+#include <charconv>
+#include <chrono>
 #include <cmath>
 #include <cstddef>
 #include <cstring>
 #include <exception>
+#include <execution>
 #include <filesystem>
 #include <format>
+#include <fstream>
 #include <functional>
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#if defined(__GNUC__) || defined(__clang__)
+#include <cpuid.h> // for __get_cpuid_count
+#else
+#include <intrin.h> // for __cpuidex
+#endif
+#endif
 #include <iomanip>
 #include <iostream>
+#include <limits>
 #include <memory>
 #include <numbers>
+#include <numeric>
 #include <print>
 #include <random>
 #include <sstream>
 #include <stacktrace>
 #include <stdexcept>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
 #include <unordered_set>
 #include <vector>
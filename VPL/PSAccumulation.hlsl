@@ -0,0 +1,7 @@
+#include "Commons.hlsli"
+
+float4 main(float4 clip_position : SV_Position) : SV_TARGET
+{
+    float3 color = accumulation_buffer.Load(int3(clip_position.xy, 0)).rgb;
+    return float4(color * cb_accumulation.scale, 1.0);
+}
@@ -0,0 +1,45 @@
+#include "Commons.hlsli"
+
+// integral of the cosine term over the solid angle subtended by the quad (Lambert's polygon formula)
+float ProjectedSolidAngle(float3 P, float3 N)
+{
+    float3 v[4];
+    for (int i = 0; i < 4; i++)
+    {
+        v[i] = normalize(cb_area_light.corners[i].xyz - P);
+    }
+
+    float sum = 0;
+    for (int j = 0; j < 4; j++)
+    {
+        float3 a = v[j];
+        float3 b = v[(j + 1) % 4];
+        float theta = acos(clamp(dot(a, b), -1, 1)); // angle subtended by the edge
+        float3 edge_normal = cross(b, a);
+        float len = length(edge_normal);
+        if (len > 0)
+        {
+            sum += theta * dot(edge_normal / len, N);
+        }
+    }
+
+    // no horizon clipping: quads crossing the receiver's tangent plane are approximated, while the ones behind it get nothing
+    // points behind the emitting side of the quad see it clockwise, so they get nothing as well
+    return max(0.5 * sum, 0);
+}
+
+float4 main(VSOutput input) : SV_TARGET
+{
+    float3 albedo = cb_object.albedo;
+    float3 diffuse = albedo / PI; // Lambert diffuse BRDF
+
+    float3 N = normalize(input.world_normal);
+
+    float3 radiance = cb_area_light.intensity * cb_area_light.color;
+    float3 irradiance = radiance * ProjectedSolidAngle(input.world_position, N);
+
+    float3 color = diffuse * irradiance; // rendering equation
+    color /= cb_scene.particles_count; // abiding by Keller, each frame is weighted by the number of particles (as for point lights)
+
+    return float4(color, 1.0);
+}
@@ -0,0 +1,132 @@
+#include "Commons.hlsli"
+
+// PCG hash (Jarzynski and Olano, "Hash Functions for GPU Rendering")
+uint PCGHash(uint v)
+{
+    uint state = v * 747796405u + 2891336453u;
+    uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+// uniform random number in [0;1)
+float Random(inout uint state)
+{
+    state = PCGHash(state);
+    return float(state >> 8) / 16777216.0;
+}
+
+// upper bound of the contribution of the lights below a node to a shading point, bounding the
+// same terms as Shade: the VPLs are not attenuated with distance (as in PSLit.hlsl), so the
+// distance to the node only enters through the angles it subtends
+float Importance(LightTreeNode node, float3 P, float3 N)
+{
+    float3 center = 0.5 * (node.aabb_min + node.aabb_max);
+    float radius = 0.5 * length(node.aabb_max - node.aabb_min); // radius of the sphere bounding the node aabb
+    float3 d = center - P;
+    float distance = length(d);
+    float3 L = distance > 0 ? d / distance : N;
+
+    // angle subtended by the node bounding sphere, as seen from the shading point
+    float theta_u = distance > radius ? asin(radius / distance) : PI;
+
+    // the receiver cosine can't be smaller than the one of the direction closest to the normal
+    float theta_n = acos(clamp(dot(N, L), -1, 1));
+    float receiver = cos(min(max(theta_n - theta_u, 0), PI / 2));
+
+    // the emitter weight can't be smaller than the one of the normal closest to -L
+    float emitter = 1;
+    if (cb_light_tree.vpl_type != LIGHT_TYPE_POINT)
+    {
+        float theta_e = acos(clamp(node.cone_cos, -1, 1));
+        float theta = acos(clamp(dot(node.cone_axis, -L), -1, 1));
+        float theta_min = max(theta - theta_e - theta_u, 0);
+        if (theta_min >= PI / 2)
+        {
+            emitter = 0;
+        }
+        else if (cb_light_tree.vpl_type == LIGHT_TYPE_COS_WEIGHTED)
+        {
+            emitter = cos(theta_min);
+        }
+    }
+
+    return node.power * receiver * emitter;
+}
+
+// same shading math as PSLit.hlsl
+float3 Shade(LightConstants light, float3 albedo, float3 P, float3 N)
+{
+    float3 diffuse = albedo / PI; // Lambert diffuse BRDF
+
+    float3 L = normalize(light.world_position - P);
+    float NdotL = max(dot(N, L), 0);
+
+    float3 color = light.intensity * light.color;
+
+    float light_weight = 1;
+    if (light.type == LIGHT_TYPE_COS_WEIGHTED)
+    {
+        light_weight = max(dot(normalize(light.normal), -L), 0);
+    }
+    else if (light.type == LIGHT_TYPE_SIGN_COS_WEIGHTED)
+    {
+        light_weight = sign(max(dot(normalize(light.normal), -L), 0));
+    }
+
+    return diffuse * color * light_weight * NdotL;
+}
+
+float4 main(VSOutput input) : SV_TARGET
+{
+    float3 P = input.world_position;
+    float3 N = normalize(input.world_normal);
+
+    uint rng = PCGHash(uint(input.clip_position.x) + PCGHash(uint(input.clip_position.y) + PCGHash(uint(cb_light_tree.seed))));
+
+    float3 color = 0;
+    if (cb_light_tree.root != LIGHT_TREE_NULL_INDEX)
+    {
+        for (int i = 0; i < cb_light_tree.samples; i++)
+        {
+            // walk down the tree, picking children proportionally to their importance
+            int node_index = cb_light_tree.root;
+            float pdf = 1;
+            LightTreeNode node = light_tree_nodes[node_index];
+            [loop]
+            while (node.light_index == LIGHT_TREE_NULL_INDEX)
+            {
+                float w_left = Importance(light_tree_nodes[node.left], P, N);
+                float w_right = Importance(light_tree_nodes[node.right], P, N);
+                float w_sum = w_left + w_right;
+                if (w_sum <= 0)
+                {
+                    pdf = 0; // none of the lights below this node can reach the shading point
+                    break;
+                }
+
+                float p_left = w_left / w_sum;
+                if (Random(rng) < p_left)
+                {
+                    node_index = node.left;
+                    pdf *= p_left;
+                }
+                else
+                {
+                    node_index = node.right;
+                    pdf *= 1 - p_left;
+                }
+                node = light_tree_nodes[node_index];
+            }
+
+            if (pdf > 0)
+            {
+                color += Shade(light_tree_lights[node.light_index], cb_object.albedo, P, N) / pdf;
+            }
+        }
+        color /= float(cb_light_tree.samples); // average of the unbiased one sample estimates
+    }
+
+    color /= cb_scene.particles_count; // abiding by Keller, each frame is weighted by the number of particles
+
+    return float4(color, 1.0);
+}
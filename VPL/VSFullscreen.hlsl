@@ -0,0 +1,8 @@
+#include "Commons.hlsli"
+
+// fullscreen triangle, generated from the vertex id (no vertex buffer and no input layout needed)
+float4 main(uint vertex_id : SV_VertexID) : SV_Position
+{
+    float2 uv = float2((vertex_id << 1) & 2, vertex_id & 2);
+    return float4(uv * float2(2, -2) + float2(-1, 1), 0, 1);
+}